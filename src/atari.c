@@ -22,7 +22,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
-#define _POSIX_C_SOURCE 199309L /* for nanosleep */
+#define _POSIX_C_SOURCE 200112L /* for nanosleep and snprintf */
 
 #include "afile.h"
 #include "config.h"
@@ -60,10 +60,14 @@
 #include "artifact.h"
 #include "atari.h"
 #include "binload.h"
+#ifdef BATCH_MODE
+#include "batch.h"
+#endif
 #include "cartridge.h"
 #include "cassette.h"
 #include "cfg.h"
 #include "cpu.h"
+#include "crc32.h"
 #include "devices.h"
 #include "emuos.h"
 #include "esc.h"
@@ -118,6 +122,12 @@
 #ifdef PBI_BB
 #include "pbi_bb.h"
 #endif
+#ifdef PBI_MIO
+#include "pbi_mio.h"
+#endif
+#ifdef PBI_XLD
+#include "pbi_xld.h"
+#endif
 #if defined(PBI_XLD) || defined (VOICEBOX)
 #include "votraxsnd.h"
 #endif
@@ -175,6 +185,13 @@ static double benchmark_start_time;
 
 int emuos_mode = 1;	/* 0 = never use EmuOS, 1 = use EmuOS if real OS not available, 2 = always use EmuOS */
 
+char Atari800_boot_cache_dir[FILENAME_MAX] = "";
+int Atari800_boot_capture = FALSE;
+#ifndef BASIC
+/* Path of the boot snapshot for the current configuration. */
+static char boot_snapshot[FILENAME_MAX];
+#endif
+
 #ifdef HAVE_SIGNAL
 volatile sig_atomic_t sigint_flag = FALSE;
 
@@ -239,7 +256,7 @@ void Atari800_Warmstart(void)
 #endif
 }
 
-void Atari800_Coldstart(void)
+static void ColdReset(void)
 {
 	PBI_Reset();
 	PIA_Reset();
@@ -271,6 +288,121 @@ void Atari800_Coldstart(void)
 #endif
 }
 
+#ifndef BASIC
+/* Stores in boot_snapshot the path of the boot snapshot for the current
+   machine configuration and ROMs. Returns FALSE if boot snapshots are not
+   used, or the configuration may change the OS initialisation in a way
+   not covered by the path. */
+static int BootSnapshotPath(void)
+{
+	UBYTE config[21];
+	ULONG crc;
+	char name[64];
+	if (Atari800_boot_cache_dir[0] == '\0'
+	    || Atari800_machine_type == Atari800_MACHINE_5200
+	    || CARTRIDGE_main.type != CARTRIDGE_NONE
+	    || CARTRIDGE_piggyback.type != CARTRIDGE_NONE
+	    || CASSETTE_hold_start)
+		return FALSE;
+#ifdef PBI_MIO
+	if (PBI_MIO_enabled)
+		return FALSE;
+#endif
+#ifdef PBI_BB
+	if (PBI_BB_enabled)
+		return FALSE;
+#endif
+#ifdef PBI_XLD
+	if (PBI_XLD_enabled)
+		return FALSE;
+#endif
+#ifdef AF80
+	if (AF80_enabled)
+		return FALSE;
+#endif
+#ifdef BIT3
+	if (BIT3_enabled)
+		return FALSE;
+#endif
+	config[0] = (UBYTE) Atari800_os_version;
+	config[1] = (UBYTE) Atari800_builtin_basic;
+	config[2] = (UBYTE) Atari800_disable_basic;
+	config[3] = (UBYTE) (BINLOAD_loading_basic != 0);
+	config[4] = (UBYTE) Atari800_builtin_game;
+	config[5] = (UBYTE) Atari800_keyboard_leds;
+	config[6] = (UBYTE) Atari800_f_keys;
+	config[7] = (UBYTE) Atari800_jumper;
+	config[8] = (UBYTE) Atari800_keyboard_detached;
+	config[9] = (UBYTE) ESC_enable_sio_patch;
+	config[10] = (UBYTE) Devices_enable_h_patch;
+	config[11] = (UBYTE) Devices_enable_p_patch;
+	config[12] = (UBYTE) Devices_enable_r_patch;
+	config[13] = (UBYTE) MEMORY_have_basic;
+	config[14] = (UBYTE) (MEMORY_ram_size >> 8);
+	config[15] = (UBYTE) MEMORY_ram_size;
+	config[16] = (UBYTE) (MEMORY_axlon_num_banks >> 8);
+	config[17] = (UBYTE) MEMORY_axlon_num_banks;
+	config[18] = (UBYTE) MEMORY_axlon_0f_mirror;
+	config[19] = (UBYTE) MEMORY_mosaic_num_banks;
+	config[20] = (UBYTE) MEMORY_enable_mapram;
+	crc = CRC32_Update(0xffffffff, MEMORY_os, sizeof(MEMORY_os));
+	crc = CRC32_Update(crc, MEMORY_basic, sizeof(MEMORY_basic));
+	crc = CRC32_Update(crc, config, sizeof(config));
+	snprintf(name, sizeof(name), "boot-%s-%dk-%s-%08lx.a8s",
+	         Atari800_machine_type == Atari800_MACHINE_800 ? "800" : "xlxe",
+	         MEMORY_ram_size, Atari800_tv_mode == Atari800_TV_PAL ? "pal" : "ntsc",
+	         (unsigned long) (crc ^ 0xffffffff));
+	Util_catpath(boot_snapshot, Atari800_boot_cache_dir, name);
+	return TRUE;
+}
+#endif /* BASIC */
+
+void Atari800_SaveBootSnapshot(void)
+{
+#ifndef BASIC
+	char tmp_path[FILENAME_MAX];
+	UWORD pc = CPU_regPC;
+	Atari800_boot_capture = FALSE;
+	/* Called from the SIOV patch - the snapshot restarts at SIOV. */
+	CPU_regPC = 0xe459;
+#ifdef HAVE_UNISTD_H
+	snprintf(tmp_path, sizeof(tmp_path), "%s.%ld", boot_snapshot, (long) getpid());
+#else
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", boot_snapshot);
+#endif
+	if (!StateSav_SaveBootState(tmp_path) || rename(tmp_path, boot_snapshot) != 0) {
+		/* on some systems rename() fails if another instance was first */
+		Util_unlink(tmp_path);
+	}
+	CPU_regPC = pc;
+#endif /* BASIC */
+}
+
+void Atari800_Coldstart(void)
+{
+	ColdReset();
+#ifndef BASIC
+	Atari800_boot_capture = FALSE;
+	if (BootSnapshotPath()) {
+		if (Util_fileexists(boot_snapshot)) {
+			if (StateSav_ReadBootState(boot_snapshot)) {
+				/* The OS has already been initialised, and stopped at
+				   the disk boot. */
+				GTIA_consol_override = 0;
+				ESC_UpdatePatches();
+				return;
+			}
+			Log_print("Removing invalid boot snapshot %s", boot_snapshot);
+			Util_unlink(boot_snapshot);
+			ColdReset();
+		}
+		/* SIO_Handler calls Atari800_SaveBootSnapshot at the disk boot. */
+		Atari800_boot_capture = TRUE;
+		ESC_UpdatePatches();
+	}
+#endif /* BASIC */
+}
+
 int Atari800_LoadImage(const char *filename, UBYTE *buffer, int nbytes)
 {
 	FILE *f;
@@ -577,10 +709,22 @@ int Atari800_Initialise(int *argc, char *argv[])
 		else if (strcmp(argv[i], "-nostereo") == 0) {
 			POKEYSND_stereo_enabled = FALSE;
 		}
+		else if (strcmp(argv[i], "-quad") == 0) {
+			POKEYSND_quad_enabled = TRUE;
+		}
+		else if (strcmp(argv[i], "-noquad") == 0) {
+			POKEYSND_quad_enabled = FALSE;
+		}
 #endif /* STEREO_SOUND */
 		else if (strcmp(argv[i], "-turbo") == 0) {
 			Atari800_turbo = TRUE;
 		}
+		else if (strcmp(argv[i], "-xex-inject") == 0) {
+			BINLOAD_xex_inject = TRUE;
+		}
+		else if (strcmp(argv[i], "-no-xex-inject") == 0) {
+			BINLOAD_xex_inject = FALSE;
+		}
 		else {
 			/* parameters that take additional argument follow here */
 			int i_a = (i + 1 < *argc);		/* is argument available? */
@@ -589,6 +733,11 @@ int Atari800_Initialise(int *argc, char *argv[])
 			if (strcmp(argv[i], "-run") == 0) {
 				if (i_a) run_direct = argv[++i]; else a_m = TRUE;
 			}
+#ifndef BASIC
+			else if (strcmp(argv[i], "-boot-cache") == 0) {
+				if (i_a) Util_strlcpy(Atari800_boot_cache_dir, argv[++i], sizeof(Atari800_boot_cache_dir)); else a_m = TRUE;
+			}
+#endif
 #ifdef R_IO_DEVICE
 			else if (strcmp(argv[i], "-rdevice") == 0) {
 				Devices_enable_r_patch = TRUE;
@@ -627,6 +776,17 @@ int Atari800_Initialise(int *argc, char *argv[])
 				}
 				else a_m = TRUE;
 			}
+#ifdef STEREO_SOUND
+			else if (strcmp(argv[i], "-quad-mix") == 0) {
+				if (i_a) {
+					if (!POKEYSND_SetQuadMix(argv[++i])) {
+						Log_print("Invalid quad POKEY mix - use 4 letters L, R or C");
+						return FALSE;
+					}
+				}
+				else a_m = TRUE;
+			}
+#endif /* STEREO_SOUND */
 			else if (strcmp(argv[i], "-mapram") == 0)
 				MEMORY_enable_mapram = TRUE;
 			else if (strcmp(argv[i], "-no-mapram") == 0)
@@ -680,8 +840,11 @@ int Atari800_Initialise(int *argc, char *argv[])
 					Log_print("\t-pal             Enable PAL TV mode");
 					Log_print("\t-ntsc            Enable NTSC TV mode");
 					Log_print("\t-run <file>      Run Atari program (COM, EXE, XEX, BAS, LST)");
+					Log_print("\t-xex-inject      Store XEX segments directly in memory when booting them");
+					Log_print("\t-no-xex-inject   Boot XEX files through a boot sector and the OS (default)");
 #ifndef BASIC
 					Log_print("\t-state <file>    Load saved-state file");
+					Log_print("\t-boot-cache <dir> Keep snapshots of the booted OS in <dir>");
 					Log_print("\t-refresh <rate>  Specify screen refresh rate");
 #endif
 					Log_print("\t-nopatch         Don't patch SIO routine in OS");
@@ -695,6 +858,11 @@ int Atari800_Initialise(int *argc, char *argv[])
 #ifdef R_IO_DEVICE
 					Log_print("\t-rdevice [<dev>] Enable R: emulation (using serial device <dev>)");
 #endif
+#ifdef STEREO_SOUND
+					Log_print("\t-quad            Emulate four POKEY chips (new POKEY engine only)");
+					Log_print("\t-noquad          Disable the four-POKEY expansion");
+					Log_print("\t-quad-mix <mix>  Place the four chips in the stereo image, eg. LRLR or LRCC");
+#endif /* STEREO_SOUND */
 					Log_print("\t-turbo           Run emulated Atari as fast as possible");
 					Log_print("\t-v               Show version/release number");
 				}
@@ -748,6 +916,9 @@ int Atari800_Initialise(int *argc, char *argv[])
 #ifndef BASIC
 		|| !INPUT_Initialise(argc, argv)
 #endif
+#ifdef BATCH_MODE
+		|| !BATCH_Initialise(argc, argv)
+#endif
 #ifdef XEP80_EMULATION
 		|| !XEP80_Initialise(argc, argv)
 #endif
@@ -764,8 +935,13 @@ int Atari800_Initialise(int *argc, char *argv[])
 		|| !VIDEOMODE_Initialise(argc, argv)
 #endif
 #ifndef DONT_DISPLAY
-		/* Platform Specific Initialisation */
-		|| !PLATFORM_Initialise(argc, argv)
+		/* Platform Specific Initialisation - not in batch mode, which runs
+		   without display, keyboard and sound output */
+		|| (
+#ifdef BATCH_MODE
+		    BATCH_job_file[0] == '\0' &&
+#endif
+		    !PLATFORM_Initialise(argc, argv))
 #endif
 #if !defined(BASIC) && !defined(CURSES_BASIC)
 		|| !Screen_Initialise(argc, argv)
@@ -789,7 +965,11 @@ int Atari800_Initialise(int *argc, char *argv[])
 
 #if SUPPORTS_CHANGE_VIDEOMODE
 #ifndef DONT_DISPLAY
-	if (!VIDEOMODE_InitialiseDisplay()) {
+	if (
+#ifdef BATCH_MODE
+	    BATCH_job_file[0] == '\0' &&
+#endif
+	    !VIDEOMODE_InitialiseDisplay()) {
 		Atari800_ErrExit();
 		return FALSE;
 	}
@@ -894,6 +1074,11 @@ int Atari800_Initialise(int *argc, char *argv[])
 	benchmark_start_time = Util_time();
 #endif
 
+#if defined(SOUND) && defined(BATCH_MODE)
+	if (BATCH_job_file[0] != '\0')
+		/* Sound_Initialise wasn't called, no audio output is opened. */
+		Sound_enabled = FALSE;
+#endif
 #if defined (SOUND) && defined(SOUND_THIN_API)
 	if (Sound_enabled) {
 		/* Up to this point the Sound_enabled flag indicated that we _want_ to
@@ -910,6 +1095,16 @@ int Atari800_Initialise(int *argc, char *argv[])
 	}
 #endif /* defined (SOUND) && defined(SOUND_THIN_API) */
 
+#ifdef BATCH_MODE
+	/* Run the batch jobs headless - the front end was not initialised and
+	   never gets control. */
+	if (BATCH_job_file[0] != '\0') {
+		int status = BATCH_Run();
+		Atari800_Exit(FALSE);
+		exit(status);
+	}
+#endif
+
 	return TRUE;
 }
 
@@ -951,7 +1146,15 @@ int Atari800_Exit(int run_monitor)
 			sums[0], sums[1], sums[2], sums[3], sums[4], sums[5]);
 	}
 #endif /* STAT_UNALIGNED_WORDS */
-	restart = PLATFORM_Exit(run_monitor);
+#ifdef BATCH_MODE
+	if (BATCH_job_file[0] != '\0') {
+		/* The front end wasn't initialised in batch mode. */
+		Log_flushlog();
+		restart = FALSE;
+	}
+	else
+#endif
+		restart = PLATFORM_Exit(run_monitor);
 #ifdef HAVE_SIGNAL
 	/* If a user pressed Ctrl+C in the monitor, avoid immediate return to it. */
 	sigint_flag = FALSE;
@@ -127,6 +127,18 @@ void Atari800_Frame(void);
 /* Reboots the emulated Atari. */
 void Atari800_Coldstart(void);
 
+/* Directory for boot snapshots, empty string if not used. A boot snapshot
+   is the state of the emulated computer when the OS, after its
+   initialisation, starts booting from disk. It is saved for each machine
+   type, RAM size, TV system, OS and BASIC ROM and related settings, and
+   Atari800_Coldstart() restores it instead of running the initialisation
+   again. Not used with cartridges, PBI devices and cassette boot. */
+extern char Atari800_boot_cache_dir[FILENAME_MAX];
+/* Set by Atari800_Coldstart() when there is no boot snapshot yet.
+   SIO_Handler() then calls Atari800_SaveBootSnapshot() at the disk boot. */
+extern int Atari800_boot_capture;
+void Atari800_SaveBootSnapshot(void);
+
 /* Presses the Reset key in the emulated Atari. */
 void Atari800_Warmstart(void);
 
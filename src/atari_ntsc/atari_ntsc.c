@@ -67,6 +67,12 @@ static void correct_errors( atari_ntsc_rgb_t color, atari_ntsc_rgb_t* out )
 }
 
 void atari_ntsc_init( atari_ntsc_t* ntsc, atari_ntsc_setup_t const* setup )
+{
+	atari_ntsc_init_entries( ntsc, setup, 0 );
+}
+
+void atari_ntsc_init_entries( atari_ntsc_t* ntsc, atari_ntsc_setup_t const* setup,
+		unsigned char const* entries )
 {
 	/* Atari change: no alternating burst phases - remove merge_fields variable. */
 	int entry;
@@ -90,6 +96,10 @@ void atari_ntsc_init( atari_ntsc_t* ntsc, atari_ntsc_setup_t const* setup )
 		double i;
 		double q;
 
+		/* Atari change: skip entries that need not be regenerated. */
+		if ( entries && !entries [entry] )
+			continue;
+
 		{
 			double *yiq_ptr = setup->yiq_palette + 3 * entry;
 			y = *yiq_ptr++;
@@ -134,6 +144,22 @@ void atari_ntsc_init( atari_ntsc_t* ntsc, atari_ntsc_setup_t const* setup )
 				gen_kernel( &impl, y, i, q, kernel );
 				/* Atari change: no alternating burst phases - remove code for merge_fields. */
 				correct_errors( rgb, kernel );
+#ifdef ATARI_NTSC_SIMD
+				/* Atari change: copy kernel for the SIMD blitters. */
+				{
+					int k;
+					for ( k = 0; k < atari_ntsc_in_chunk; k++ )
+					{
+						atari_ntsc_simd_rgb_t* row = ntsc->simd_table [entry] [k];
+						int n;
+						for ( n = 0; n < atari_ntsc_simd_row; n++ )
+							row [n] = 0;
+						for ( n = 0; n < atari_ntsc_simd_span; n++ )
+							row [atari_ntsc_simd_pad + n] =
+								(atari_ntsc_simd_rgb_t) kernel [k * atari_ntsc_simd_span + n];
+					}
+				}
+#endif
 			}
 		}
 	}
@@ -165,6 +191,11 @@ void atari_ntsc_blit_rgb16( atari_ntsc_t const* ntsc, ATARI_NTSC_IN_T const* inp
 		int in_width, int in_height, void* rgb_out, long out_pitch )
 {
 	int chunk_count = (in_width - 1) / atari_ntsc_in_chunk;
+#ifdef ATARI_NTSC_SIMD
+	if ( atari_ntsc_simd_blit( ntsc, input, in_row_width, in_width, in_height,
+			rgb_out, out_pitch, ATARI_NTSC_RGB_FORMAT_RGB16 ) )
+		return;
+#endif
 	for ( ; in_height; --in_height )
 	{
 		ATARI_NTSC_IN_T const* line_in = input;
@@ -222,6 +253,11 @@ void atari_ntsc_blit_bgr16( atari_ntsc_t const* ntsc, ATARI_NTSC_IN_T const* inp
 		int in_width, int in_height, void* rgb_out, long out_pitch )
 {
 	int chunk_count = (in_width - 1) / atari_ntsc_in_chunk;
+#ifdef ATARI_NTSC_SIMD
+	if ( atari_ntsc_simd_blit( ntsc, input, in_row_width, in_width, in_height,
+			rgb_out, out_pitch, ATARI_NTSC_RGB_FORMAT_BGR16 ) )
+		return;
+#endif
 	for ( ; in_height; --in_height )
 	{
 		ATARI_NTSC_IN_T const* line_in = input;
@@ -279,6 +315,11 @@ void atari_ntsc_blit_argb32( atari_ntsc_t const* ntsc, ATARI_NTSC_IN_T const* in
 		int in_width, int in_height, void* rgb_out, long out_pitch )
 {
 	int chunk_count = (in_width - 1) / atari_ntsc_in_chunk;
+#ifdef ATARI_NTSC_SIMD
+	if ( atari_ntsc_simd_blit( ntsc, input, in_row_width, in_width, in_height,
+			rgb_out, out_pitch, ATARI_NTSC_RGB_FORMAT_ARGB32 ) )
+		return;
+#endif
 	for ( ; in_height; --in_height )
 	{
 		ATARI_NTSC_IN_T const* line_in = input;
@@ -336,6 +377,11 @@ void atari_ntsc_blit_bgra32( atari_ntsc_t const* ntsc, ATARI_NTSC_IN_T const* in
 		int in_width, int in_height, void* rgb_out, long out_pitch )
 {
 	int chunk_count = (in_width - 1) / atari_ntsc_in_chunk;
+#ifdef ATARI_NTSC_SIMD
+	if ( atari_ntsc_simd_blit( ntsc, input, in_row_width, in_width, in_height,
+			rgb_out, out_pitch, ATARI_NTSC_RGB_FORMAT_BGRA32 ) )
+		return;
+#endif
 	for ( ; in_height; --in_height )
 	{
 		ATARI_NTSC_IN_T const* line_in = input;
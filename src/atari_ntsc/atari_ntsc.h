@@ -58,6 +58,14 @@ atari_ntsc_t object. Can pass NULL for either parameter. */
 typedef struct atari_ntsc_t atari_ntsc_t;
 void atari_ntsc_init( atari_ntsc_t* ntsc, atari_ntsc_setup_t const* setup );
 
+/* Atari change: same as atari_ntsc_init(), but regenerates only palette
+entries for which ENTRIES [n] is non-zero; other entries of NTSC (and of
+setup->palette_out) are left unchanged. Useful when only some colours of
+setup->yiq_palette changed and all other setup fields are the same as when
+NTSC was last initialised. ENTRIES may be NULL to regenerate all entries. */
+void atari_ntsc_init_entries( atari_ntsc_t* ntsc, atari_ntsc_setup_t const* setup,
+		unsigned char const* entries );
+
 /* Filters one or more rows of pixels. Input pixels are 6/9-bit palette indicies.
 In_row_width is the number of pixels to get to the next input row. Out_pitch
 is the number of *bytes* to get to the next output row. Output pixel format
@@ -121,12 +129,53 @@ statement in a block (unless you're using C++). */
 	ATARI_NTSC_RGB_OUT_14_( index, rgb_out, bits, 0 )
 
 
+/* Atari change: SIMD blitters. atari_ntsc_blit_* use the fastest instruction
+set supported by the host CPU, and produce output identical to the portable
+code. */
+enum {
+	ATARI_NTSC_SIMD_NONE,
+	ATARI_NTSC_SIMD_SSE2,
+	ATARI_NTSC_SIMD_AVX2,
+	ATARI_NTSC_SIMD_NEON
+};
+
+/* Returns the fastest instruction set available on the host CPU. */
+int atari_ntsc_simd_detect( void );
+
+/* Selects instruction set used by the blitters; unsupported values fall back
+to the portable code. Returns the instruction set actually selected. */
+int atari_ntsc_simd_select( int simd );
+
+/* Returns name of an instruction set, e.g. "SSE2". */
+char const* atari_ntsc_simd_name( int simd );
+
+
 /* private */
 enum { atari_ntsc_entry_size = 56 };
 typedef unsigned long atari_ntsc_rgb_t;
+
+/* Atari change: kernel copy used by the SIMD blitters. Each input pixel adds
+atari_ntsc_simd_span consecutive kernel values to the output row; for each of
+the 4 input pixels in a chunk these are stored in a 32-bit row padded with
+zeros on both sides, so the contribution to any 8 output pixels of a chunk
+is a single unaligned load. */
+enum { atari_ntsc_simd_span = 14 };
+enum { atari_ntsc_simd_pad = 8 };
+enum { atari_ntsc_simd_row = 32 };
+typedef unsigned int atari_ntsc_simd_rgb_t;
+
 struct atari_ntsc_t {
 	atari_ntsc_rgb_t table [atari_ntsc_palette_size] [atari_ntsc_entry_size];
+#ifdef ATARI_NTSC_SIMD
+	atari_ntsc_simd_rgb_t simd_table [atari_ntsc_palette_size] [atari_ntsc_in_chunk] [atari_ntsc_simd_row];
+#endif
 };
+
+/* Blits using the selected SIMD instruction set. Returns 0 if no SIMD
+blitter is available, and the caller should use the portable code. */
+int atari_ntsc_simd_blit( atari_ntsc_t const* ntsc, ATARI_NTSC_IN_T const* atari_in,
+		long in_row_width, int in_width, int in_height,
+		void* rgb_out, long out_pitch, int format );
 enum { atari_ntsc_burst_size = atari_ntsc_entry_size / atari_ntsc_burst_count };
 
 #define ATARI_NTSC_ENTRY_( ktable, n ) \
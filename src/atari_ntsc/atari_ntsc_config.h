@@ -22,4 +22,12 @@ the pixel index if you use the high bits as flags, etc. */
 /* For each pixel, this is the basic operation:
 output_color = color_palette [ATARI_NTSC_ADJ_IN( ATARI_NTSC_IN_T )] */
 
+/* Atari change: SIMD blitters (SSE2/AVX2 on x86, NEON on ARM) are used
+automatically when the compiler supports them. Define ATARI_NTSC_NO_SIMD
+to use only the portable blitters. */
+#if !defined( ATARI_NTSC_NO_SIMD ) && defined( __GNUC__ ) && \
+	(defined( __SSE2__ ) || defined( __ARM_NEON ) || defined( __ARM_NEON__ ))
+	#define ATARI_NTSC_SIMD 1
+#endif
+
 #endif
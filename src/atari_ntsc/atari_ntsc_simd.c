@@ -0,0 +1,501 @@
+/* SIMD blitters for the Atari NTSC video filter */
+
+#include <string.h>
+
+#include "atari_ntsc.h"
+
+/* Copyright (C) 2016 Atari800 development team. This module is free
+software; you can redistribute it and/or modify it under the terms of the
+GNU Lesser General Public License as published by the Free Software
+Foundation; either version 2.1 of the License, or (at your option) any later
+version. This module is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+for more details. You should have received a copy of the GNU Lesser General
+Public License along with this module; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA */
+
+/* The portable blitters keep 8 kernel pointers and sum 8 kernel values for
+each output pixel. Here the same sum is computed 8 output pixels at a time
+(7 are used): pixel at position k of an input chunk adds 14 consecutive
+kernel values to the output, starting at output pixel 2*k of its chunk. Each
+chunk of 7 output pixels therefore receives values from the input pixels of
+the current chunk and the two preceding ones, and each such contribution is
+one unaligned load from ntsc->simd_table.
+
+Only the low 32 bits of atari_ntsc_rgb_t affect the clamped and converted
+output, so 32-bit lanes give results identical to the portable code. */
+
+#define SIMD_AGE0( k ) (atari_ntsc_simd_pad - 2 * (k))
+#define SIMD_AGE1( k ) (atari_ntsc_simd_pad + atari_ntsc_out_chunk - 2 * (k))
+#define SIMD_AGE2( k ) (atari_ntsc_simd_pad + 2 * atari_ntsc_out_chunk - 2 * (k))
+
+#define SIMD_ROW( ntsc, pixel, k ) ((ntsc)->simd_table [pixel] [k])
+
+static int simd_selected = -1;
+
+#if defined( ATARI_NTSC_SIMD ) && defined( __SSE2__ )
+
+#include <emmintrin.h>
+
+#if defined( __GNUC__ ) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+	#define ATARI_NTSC_AVX2 1
+	#include <immintrin.h>
+#endif
+
+#define SSE2_LOAD( ntsc, pixel, k, offset ) \
+	_mm_loadu_si128( (__m128i const*) (SIMD_ROW( ntsc, pixel, k ) + (offset)) )
+
+static void sse2_format( __m128i* io, int format )
+{
+	__m128i raw = *io;
+	{
+		__m128i const clamp_mask = _mm_set1_epi32( (int) atari_ntsc_clamp_mask );
+		__m128i sub = _mm_and_si128( _mm_srli_epi32( raw, 9 ), clamp_mask );
+		__m128i clamp = _mm_sub_epi32( _mm_set1_epi32( (int) atari_ntsc_clamp_add ), sub );
+		raw = _mm_or_si128( raw, clamp );
+		clamp = _mm_sub_epi32( clamp, sub );
+		raw = _mm_and_si128( raw, clamp );
+	}
+	switch ( format )
+	{
+	case ATARI_NTSC_RGB_FORMAT_RGB16:
+		raw = _mm_or_si128( _mm_or_si128(
+				_mm_and_si128( _mm_srli_epi32( raw, 13 ), _mm_set1_epi32( 0xF800 ) ),
+				_mm_and_si128( _mm_srli_epi32( raw, 8 ), _mm_set1_epi32( 0x07E0 ) ) ),
+				_mm_and_si128( _mm_srli_epi32( raw, 4 ), _mm_set1_epi32( 0x001F ) ) );
+		break;
+	case ATARI_NTSC_RGB_FORMAT_BGR16:
+		raw = _mm_or_si128( _mm_or_si128(
+				_mm_and_si128( _mm_srli_epi32( raw, 24 ), _mm_set1_epi32( 0x001F ) ),
+				_mm_and_si128( _mm_srli_epi32( raw, 8 ), _mm_set1_epi32( 0x07E0 ) ) ),
+				_mm_and_si128( _mm_slli_epi32( raw, 7 ), _mm_set1_epi32( 0xF800 ) ) );
+		break;
+	case ATARI_NTSC_RGB_FORMAT_ARGB32:
+		raw = _mm_or_si128( _mm_or_si128(
+				_mm_and_si128( _mm_srli_epi32( raw, 5 ), _mm_set1_epi32( 0xFF0000 ) ),
+				_mm_and_si128( _mm_srli_epi32( raw, 3 ), _mm_set1_epi32( 0xFF00 ) ) ),
+				_mm_or_si128( _mm_and_si128( _mm_srli_epi32( raw, 1 ), _mm_set1_epi32( 0xFF ) ),
+				_mm_set1_epi32( (int) 0xFF000000 ) ) );
+		break;
+	default: /* ATARI_NTSC_RGB_FORMAT_BGRA32 */
+		raw = _mm_or_si128( _mm_or_si128(
+				_mm_and_si128( _mm_srli_epi32( raw, 13 ), _mm_set1_epi32( 0xFF00 ) ),
+				_mm_and_si128( _mm_slli_epi32( raw, 5 ), _mm_set1_epi32( 0xFF0000 ) ) ),
+				_mm_or_si128( _mm_and_si128( _mm_slli_epi32( raw, 23 ), _mm_set1_epi32( (int) 0xFF000000 ) ),
+				_mm_set1_epi32( 0xFF ) ) );
+		break;
+	}
+	*io = raw;
+}
+
+/* Stores 8 pixels to OUT. */
+static void sse2_store( __m128i lo, __m128i hi, void* out, int format )
+{
+	sse2_format( &lo, format );
+	sse2_format( &hi, format );
+	if ( format == ATARI_NTSC_RGB_FORMAT_RGB16 || format == ATARI_NTSC_RGB_FORMAT_BGR16 )
+	{
+		/* sign-extend so that the saturating pack keeps the low 16 bits */
+		lo = _mm_srai_epi32( _mm_slli_epi32( lo, 16 ), 16 );
+		hi = _mm_srai_epi32( _mm_slli_epi32( hi, 16 ), 16 );
+		_mm_storeu_si128( (__m128i*) out, _mm_packs_epi32( lo, hi ) );
+	}
+	else
+	{
+		_mm_storeu_si128( (__m128i*) out, lo );
+		_mm_storeu_si128( (__m128i*) out + 1, hi );
+	}
+}
+
+/* Sums kernel values for 4 output pixels starting at pixel H of a chunk. */
+#define SSE2_SUM( out, h ) \
+	out = _mm_add_epi32( _mm_add_epi32(\
+		_mm_add_epi32( _mm_add_epi32( SSE2_LOAD( ntsc, p0, 0, SIMD_AGE0( 0 ) + (h) ),\
+		                              SSE2_LOAD( ntsc, p1, 1, SIMD_AGE0( 1 ) + (h) ) ),\
+		               _mm_add_epi32( SSE2_LOAD( ntsc, p2, 2, SIMD_AGE0( 2 ) + (h) ),\
+		                              SSE2_LOAD( ntsc, p3, 3, SIMD_AGE0( 3 ) + (h) ) ) ),\
+		_mm_add_epi32( _mm_add_epi32( SSE2_LOAD( ntsc, q0, 0, SIMD_AGE1( 0 ) + (h) ),\
+		                              SSE2_LOAD( ntsc, q1, 1, SIMD_AGE1( 1 ) + (h) ) ),\
+		               _mm_add_epi32( SSE2_LOAD( ntsc, q2, 2, SIMD_AGE1( 2 ) + (h) ),\
+		                              SSE2_LOAD( ntsc, q3, 3, SIMD_AGE1( 3 ) + (h) ) ) ) ),\
+		_mm_add_epi32( _mm_add_epi32( SSE2_LOAD( ntsc, r1, 1, SIMD_AGE2( 1 ) + (h) ),\
+		                              SSE2_LOAD( ntsc, r2, 2, SIMD_AGE2( 2 ) + (h) ) ),\
+		                              SSE2_LOAD( ntsc, r3, 3, SIMD_AGE2( 3 ) + (h) ) ) )
+
+static void blit_sse2( atari_ntsc_t const* ntsc, ATARI_NTSC_IN_T const* input, long in_row_width,
+		int in_width, int in_height, void* rgb_out, long out_pitch, int format )
+{
+	int chunk_count = (in_width - 1) / atari_ntsc_in_chunk;
+	int out_size = (format == ATARI_NTSC_RGB_FORMAT_ARGB32 || format == ATARI_NTSC_RGB_FORMAT_BGRA32) ? 4 : 2;
+	for ( ; in_height; --in_height )
+	{
+		ATARI_NTSC_IN_T const* line_in = input;
+		char* line_out = (char*) rgb_out;
+		/* current chunk, previous chunk and the one before it */
+		unsigned p0, p1, p2, p3;
+		unsigned q0 = atari_ntsc_black, q1 = atari_ntsc_black, q2 = atari_ntsc_black;
+		unsigned q3 = ATARI_NTSC_ADJ_IN( line_in [0] );
+		unsigned r1 = atari_ntsc_black, r2 = atari_ntsc_black, r3 = atari_ntsc_black;
+		__m128i lo, hi;
+		int n;
+		++line_in;
+
+		for ( n = chunk_count; n; --n )
+		{
+			p0 = ATARI_NTSC_ADJ_IN( line_in [0] );
+			p1 = ATARI_NTSC_ADJ_IN( line_in [1] );
+			p2 = ATARI_NTSC_ADJ_IN( line_in [2] );
+			p3 = ATARI_NTSC_ADJ_IN( line_in [3] );
+			SSE2_SUM( lo, 0 );
+			SSE2_SUM( hi, 4 );
+			/* the 8th pixel is overwritten by the next chunk */
+			sse2_store( lo, hi, line_out, format );
+			r1 = q1; r2 = q2; r3 = q3;
+			q0 = p0; q1 = p1; q2 = p2; q3 = p3;
+			line_in  += atari_ntsc_in_chunk;
+			line_out += atari_ntsc_out_chunk * out_size;
+		}
+
+		/* finish final pixels */
+		{
+			__m128i last [4];
+			p0 = p1 = p2 = p3 = atari_ntsc_black;
+			SSE2_SUM( lo, 0 );
+			SSE2_SUM( hi, 4 );
+			sse2_store( lo, hi, last, format );
+			memcpy( line_out, last, atari_ntsc_out_chunk * out_size );
+		}
+
+		input += in_row_width;
+		rgb_out = (char*) rgb_out + out_pitch;
+	}
+}
+
+#ifdef ATARI_NTSC_AVX2
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+#define AVX2_LOAD( ntsc, pixel, k, offset ) \
+	_mm256_loadu_si256( (__m256i const*) (SIMD_ROW( ntsc, pixel, k ) + (offset)) )
+
+static AVX2_TARGET void avx2_store( __m256i raw, void* out, int format )
+{
+	{
+		__m256i const clamp_mask = _mm256_set1_epi32( (int) atari_ntsc_clamp_mask );
+		__m256i sub = _mm256_and_si256( _mm256_srli_epi32( raw, 9 ), clamp_mask );
+		__m256i clamp = _mm256_sub_epi32( _mm256_set1_epi32( (int) atari_ntsc_clamp_add ), sub );
+		raw = _mm256_or_si256( raw, clamp );
+		clamp = _mm256_sub_epi32( clamp, sub );
+		raw = _mm256_and_si256( raw, clamp );
+	}
+	switch ( format )
+	{
+	case ATARI_NTSC_RGB_FORMAT_RGB16:
+		raw = _mm256_or_si256( _mm256_or_si256(
+				_mm256_and_si256( _mm256_srli_epi32( raw, 13 ), _mm256_set1_epi32( 0xF800 ) ),
+				_mm256_and_si256( _mm256_srli_epi32( raw, 8 ), _mm256_set1_epi32( 0x07E0 ) ) ),
+				_mm256_and_si256( _mm256_srli_epi32( raw, 4 ), _mm256_set1_epi32( 0x001F ) ) );
+		break;
+	case ATARI_NTSC_RGB_FORMAT_BGR16:
+		raw = _mm256_or_si256( _mm256_or_si256(
+				_mm256_and_si256( _mm256_srli_epi32( raw, 24 ), _mm256_set1_epi32( 0x001F ) ),
+				_mm256_and_si256( _mm256_srli_epi32( raw, 8 ), _mm256_set1_epi32( 0x07E0 ) ) ),
+				_mm256_and_si256( _mm256_slli_epi32( raw, 7 ), _mm256_set1_epi32( 0xF800 ) ) );
+		break;
+	case ATARI_NTSC_RGB_FORMAT_ARGB32:
+		raw = _mm256_or_si256( _mm256_or_si256(
+				_mm256_and_si256( _mm256_srli_epi32( raw, 5 ), _mm256_set1_epi32( 0xFF0000 ) ),
+				_mm256_and_si256( _mm256_srli_epi32( raw, 3 ), _mm256_set1_epi32( 0xFF00 ) ) ),
+				_mm256_or_si256( _mm256_and_si256( _mm256_srli_epi32( raw, 1 ), _mm256_set1_epi32( 0xFF ) ),
+				_mm256_set1_epi32( (int) 0xFF000000 ) ) );
+		break;
+	default: /* ATARI_NTSC_RGB_FORMAT_BGRA32 */
+		raw = _mm256_or_si256( _mm256_or_si256(
+				_mm256_and_si256( _mm256_srli_epi32( raw, 13 ), _mm256_set1_epi32( 0xFF00 ) ),
+				_mm256_and_si256( _mm256_slli_epi32( raw, 5 ), _mm256_set1_epi32( 0xFF0000 ) ) ),
+				_mm256_or_si256( _mm256_and_si256( _mm256_slli_epi32( raw, 23 ), _mm256_set1_epi32( (int) 0xFF000000 ) ),
+				_mm256_set1_epi32( 0xFF ) ) );
+		break;
+	}
+	if ( format == ATARI_NTSC_RGB_FORMAT_RGB16 || format == ATARI_NTSC_RGB_FORMAT_BGR16 )
+	{
+		/* sign-extend so that the saturating pack keeps the low 16 bits */
+		raw = _mm256_srai_epi32( _mm256_slli_epi32( raw, 16 ), 16 );
+		_mm_storeu_si128( (__m128i*) out, _mm_packs_epi32(
+				_mm256_castsi256_si128( raw ), _mm256_extracti128_si256( raw, 1 ) ) );
+	}
+	else
+		_mm256_storeu_si256( (__m256i*) out, raw );
+}
+
+/* Sums kernel values for the 8 output pixels of a chunk. */
+#define AVX2_SUM( out ) \
+	out = _mm256_add_epi32( _mm256_add_epi32(\
+		_mm256_add_epi32( _mm256_add_epi32( AVX2_LOAD( ntsc, p0, 0, SIMD_AGE0( 0 ) ),\
+		                                    AVX2_LOAD( ntsc, p1, 1, SIMD_AGE0( 1 ) ) ),\
+		                  _mm256_add_epi32( AVX2_LOAD( ntsc, p2, 2, SIMD_AGE0( 2 ) ),\
+		                                    AVX2_LOAD( ntsc, p3, 3, SIMD_AGE0( 3 ) ) ) ),\
+		_mm256_add_epi32( _mm256_add_epi32( AVX2_LOAD( ntsc, q0, 0, SIMD_AGE1( 0 ) ),\
+		                                    AVX2_LOAD( ntsc, q1, 1, SIMD_AGE1( 1 ) ) ),\
+		                  _mm256_add_epi32( AVX2_LOAD( ntsc, q2, 2, SIMD_AGE1( 2 ) ),\
+		                                    AVX2_LOAD( ntsc, q3, 3, SIMD_AGE1( 3 ) ) ) ) ),\
+		_mm256_add_epi32( _mm256_add_epi32( AVX2_LOAD( ntsc, r1, 1, SIMD_AGE2( 1 ) ),\
+		                                    AVX2_LOAD( ntsc, r2, 2, SIMD_AGE2( 2 ) ) ),\
+		                                    AVX2_LOAD( ntsc, r3, 3, SIMD_AGE2( 3 ) ) ) )
+
+static AVX2_TARGET void blit_avx2( atari_ntsc_t const* ntsc, ATARI_NTSC_IN_T const* input, long in_row_width,
+		int in_width, int in_height, void* rgb_out, long out_pitch, int format )
+{
+	int chunk_count = (in_width - 1) / atari_ntsc_in_chunk;
+	int out_size = (format == ATARI_NTSC_RGB_FORMAT_ARGB32 || format == ATARI_NTSC_RGB_FORMAT_BGRA32) ? 4 : 2;
+	for ( ; in_height; --in_height )
+	{
+		ATARI_NTSC_IN_T const* line_in = input;
+		char* line_out = (char*) rgb_out;
+		/* current chunk, previous chunk and the one before it */
+		unsigned p0, p1, p2, p3;
+		unsigned q0 = atari_ntsc_black, q1 = atari_ntsc_black, q2 = atari_ntsc_black;
+		unsigned q3 = ATARI_NTSC_ADJ_IN( line_in [0] );
+		unsigned r1 = atari_ntsc_black, r2 = atari_ntsc_black, r3 = atari_ntsc_black;
+		__m256i sum;
+		int n;
+		++line_in;
+
+		for ( n = chunk_count; n; --n )
+		{
+			p0 = ATARI_NTSC_ADJ_IN( line_in [0] );
+			p1 = ATARI_NTSC_ADJ_IN( line_in [1] );
+			p2 = ATARI_NTSC_ADJ_IN( line_in [2] );
+			p3 = ATARI_NTSC_ADJ_IN( line_in [3] );
+			AVX2_SUM( sum );
+			/* the 8th pixel is overwritten by the next chunk */
+			avx2_store( sum, line_out, format );
+			r1 = q1; r2 = q2; r3 = q3;
+			q0 = p0; q1 = p1; q2 = p2; q3 = p3;
+			line_in  += atari_ntsc_in_chunk;
+			line_out += atari_ntsc_out_chunk * out_size;
+		}
+
+		/* finish final pixels */
+		{
+			__m256i last [2];
+			p0 = p1 = p2 = p3 = atari_ntsc_black;
+			AVX2_SUM( sum );
+			avx2_store( sum, last, format );
+			memcpy( line_out, last, atari_ntsc_out_chunk * out_size );
+		}
+
+		input += in_row_width;
+		rgb_out = (char*) rgb_out + out_pitch;
+	}
+}
+
+#endif /* ATARI_NTSC_AVX2 */
+
+#endif /* ATARI_NTSC_SIMD && __SSE2__ */
+
+#if defined( ATARI_NTSC_SIMD ) && (defined( __ARM_NEON ) || defined( __ARM_NEON__ ))
+
+#include <arm_neon.h>
+
+#define NEON_LOAD( ntsc, pixel, k, offset ) \
+	vld1q_u32( SIMD_ROW( ntsc, pixel, k ) + (offset) )
+
+static uint32x4_t neon_format( uint32x4_t raw, int format )
+{
+	{
+		uint32x4_t sub = vandq_u32( vshrq_n_u32( raw, 9 ), vdupq_n_u32( atari_ntsc_clamp_mask ) );
+		uint32x4_t clamp = vsubq_u32( vdupq_n_u32( atari_ntsc_clamp_add ), sub );
+		raw = vorrq_u32( raw, clamp );
+		clamp = vsubq_u32( clamp, sub );
+		raw = vandq_u32( raw, clamp );
+	}
+	switch ( format )
+	{
+	case ATARI_NTSC_RGB_FORMAT_RGB16:
+		return vorrq_u32( vorrq_u32(
+				vandq_u32( vshrq_n_u32( raw, 13 ), vdupq_n_u32( 0xF800 ) ),
+				vandq_u32( vshrq_n_u32( raw, 8 ), vdupq_n_u32( 0x07E0 ) ) ),
+				vandq_u32( vshrq_n_u32( raw, 4 ), vdupq_n_u32( 0x001F ) ) );
+	case ATARI_NTSC_RGB_FORMAT_BGR16:
+		return vorrq_u32( vorrq_u32(
+				vandq_u32( vshrq_n_u32( raw, 24 ), vdupq_n_u32( 0x001F ) ),
+				vandq_u32( vshrq_n_u32( raw, 8 ), vdupq_n_u32( 0x07E0 ) ) ),
+				vandq_u32( vshlq_n_u32( raw, 7 ), vdupq_n_u32( 0xF800 ) ) );
+	case ATARI_NTSC_RGB_FORMAT_ARGB32:
+		return vorrq_u32( vorrq_u32(
+				vandq_u32( vshrq_n_u32( raw, 5 ), vdupq_n_u32( 0xFF0000 ) ),
+				vandq_u32( vshrq_n_u32( raw, 3 ), vdupq_n_u32( 0xFF00 ) ) ),
+				vorrq_u32( vandq_u32( vshrq_n_u32( raw, 1 ), vdupq_n_u32( 0xFF ) ),
+				vdupq_n_u32( 0xFF000000 ) ) );
+	default: /* ATARI_NTSC_RGB_FORMAT_BGRA32 */
+		return vorrq_u32( vorrq_u32(
+				vandq_u32( vshrq_n_u32( raw, 13 ), vdupq_n_u32( 0xFF00 ) ),
+				vandq_u32( vshlq_n_u32( raw, 5 ), vdupq_n_u32( 0xFF0000 ) ) ),
+				vorrq_u32( vandq_u32( vshlq_n_u32( raw, 23 ), vdupq_n_u32( 0xFF000000 ) ),
+				vdupq_n_u32( 0xFF ) ) );
+	}
+}
+
+/* Stores 8 pixels to OUT. */
+static void neon_store( uint32x4_t lo, uint32x4_t hi, void* out, int format )
+{
+	lo = neon_format( lo, format );
+	hi = neon_format( hi, format );
+	if ( format == ATARI_NTSC_RGB_FORMAT_RGB16 || format == ATARI_NTSC_RGB_FORMAT_BGR16 )
+		vst1q_u16( (uint16_t*) out, vcombine_u16( vmovn_u32( lo ), vmovn_u32( hi ) ) );
+	else
+	{
+		vst1q_u32( (uint32_t*) out, lo );
+		vst1q_u32( (uint32_t*) out + 4, hi );
+	}
+}
+
+/* Sums kernel values for 4 output pixels starting at pixel H of a chunk. */
+#define NEON_SUM( out, h ) \
+	out = vaddq_u32( vaddq_u32(\
+		vaddq_u32( vaddq_u32( NEON_LOAD( ntsc, p0, 0, SIMD_AGE0( 0 ) + (h) ),\
+		                      NEON_LOAD( ntsc, p1, 1, SIMD_AGE0( 1 ) + (h) ) ),\
+		           vaddq_u32( NEON_LOAD( ntsc, p2, 2, SIMD_AGE0( 2 ) + (h) ),\
+		                      NEON_LOAD( ntsc, p3, 3, SIMD_AGE0( 3 ) + (h) ) ) ),\
+		vaddq_u32( vaddq_u32( NEON_LOAD( ntsc, q0, 0, SIMD_AGE1( 0 ) + (h) ),\
+		                      NEON_LOAD( ntsc, q1, 1, SIMD_AGE1( 1 ) + (h) ) ),\
+		           vaddq_u32( NEON_LOAD( ntsc, q2, 2, SIMD_AGE1( 2 ) + (h) ),\
+		                      NEON_LOAD( ntsc, q3, 3, SIMD_AGE1( 3 ) + (h) ) ) ) ),\
+		vaddq_u32( vaddq_u32( NEON_LOAD( ntsc, r1, 1, SIMD_AGE2( 1 ) + (h) ),\
+		                      NEON_LOAD( ntsc, r2, 2, SIMD_AGE2( 2 ) + (h) ) ),\
+		                      NEON_LOAD( ntsc, r3, 3, SIMD_AGE2( 3 ) + (h) ) ) )
+
+static void blit_neon( atari_ntsc_t const* ntsc, ATARI_NTSC_IN_T const* input, long in_row_width,
+		int in_width, int in_height, void* rgb_out, long out_pitch, int format )
+{
+	int chunk_count = (in_width - 1) / atari_ntsc_in_chunk;
+	int out_size = (format == ATARI_NTSC_RGB_FORMAT_ARGB32 || format == ATARI_NTSC_RGB_FORMAT_BGRA32) ? 4 : 2;
+	for ( ; in_height; --in_height )
+	{
+		ATARI_NTSC_IN_T const* line_in = input;
+		char* line_out = (char*) rgb_out;
+		/* current chunk, previous chunk and the one before it */
+		unsigned p0, p1, p2, p3;
+		unsigned q0 = atari_ntsc_black, q1 = atari_ntsc_black, q2 = atari_ntsc_black;
+		unsigned q3 = ATARI_NTSC_ADJ_IN( line_in [0] );
+		unsigned r1 = atari_ntsc_black, r2 = atari_ntsc_black, r3 = atari_ntsc_black;
+		uint32x4_t lo, hi;
+		int n;
+		++line_in;
+
+		for ( n = chunk_count; n; --n )
+		{
+			p0 = ATARI_NTSC_ADJ_IN( line_in [0] );
+			p1 = ATARI_NTSC_ADJ_IN( line_in [1] );
+			p2 = ATARI_NTSC_ADJ_IN( line_in [2] );
+			p3 = ATARI_NTSC_ADJ_IN( line_in [3] );
+			NEON_SUM( lo, 0 );
+			NEON_SUM( hi, 4 );
+			/* the 8th pixel is overwritten by the next chunk */
+			neon_store( lo, hi, line_out, format );
+			r1 = q1; r2 = q2; r3 = q3;
+			q0 = p0; q1 = p1; q2 = p2; q3 = p3;
+			line_in  += atari_ntsc_in_chunk;
+			line_out += atari_ntsc_out_chunk * out_size;
+		}
+
+		/* finish final pixels */
+		{
+			uint32_t last [8];
+			p0 = p1 = p2 = p3 = atari_ntsc_black;
+			NEON_SUM( lo, 0 );
+			NEON_SUM( hi, 4 );
+			neon_store( lo, hi, last, format );
+			memcpy( line_out, last, atari_ntsc_out_chunk * out_size );
+		}
+
+		input += in_row_width;
+		rgb_out = (char*) rgb_out + out_pitch;
+	}
+}
+
+#endif /* ATARI_NTSC_SIMD && __ARM_NEON */
+
+int atari_ntsc_simd_detect( void )
+{
+#if defined( ATARI_NTSC_SIMD ) && defined( __SSE2__ )
+#ifdef ATARI_NTSC_AVX2
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "avx2" ) )
+		return ATARI_NTSC_SIMD_AVX2;
+#endif
+	return ATARI_NTSC_SIMD_SSE2;
+#elif defined( ATARI_NTSC_SIMD )
+	return ATARI_NTSC_SIMD_NEON;
+#else
+	return ATARI_NTSC_SIMD_NONE;
+#endif
+}
+
+int atari_ntsc_simd_select( int simd )
+{
+	switch ( simd )
+	{
+#if defined( ATARI_NTSC_SIMD ) && defined( __SSE2__ )
+	case ATARI_NTSC_SIMD_SSE2:
+		break;
+#ifdef ATARI_NTSC_AVX2
+	case ATARI_NTSC_SIMD_AVX2:
+		if ( atari_ntsc_simd_detect() != ATARI_NTSC_SIMD_AVX2 )
+			simd = ATARI_NTSC_SIMD_SSE2;
+		break;
+#endif
+#elif defined( ATARI_NTSC_SIMD )
+	case ATARI_NTSC_SIMD_NEON:
+		break;
+#endif
+	default:
+		simd = ATARI_NTSC_SIMD_NONE;
+	}
+	simd_selected = simd;
+	return simd;
+}
+
+char const* atari_ntsc_simd_name( int simd )
+{
+	switch ( simd )
+	{
+	case ATARI_NTSC_SIMD_SSE2:
+		return "SSE2";
+	case ATARI_NTSC_SIMD_AVX2:
+		return "AVX2";
+	case ATARI_NTSC_SIMD_NEON:
+		return "NEON";
+	default:
+		return "none";
+	}
+}
+
+int atari_ntsc_simd_blit( atari_ntsc_t const* ntsc, ATARI_NTSC_IN_T const* atari_in,
+		long in_row_width, int in_width, int in_height,
+		void* rgb_out, long out_pitch, int format )
+{
+	if ( simd_selected < 0 )
+		atari_ntsc_simd_select( atari_ntsc_simd_detect() );
+	switch ( simd_selected )
+	{
+#if defined( ATARI_NTSC_SIMD ) && defined( __SSE2__ )
+	case ATARI_NTSC_SIMD_SSE2:
+		blit_sse2( ntsc, atari_in, in_row_width, in_width, in_height, rgb_out, out_pitch, format );
+		return 1;
+#ifdef ATARI_NTSC_AVX2
+	case ATARI_NTSC_SIMD_AVX2:
+		blit_avx2( ntsc, atari_in, in_row_width, in_width, in_height, rgb_out, out_pitch, format );
+		return 1;
+#endif
+#elif defined( ATARI_NTSC_SIMD )
+	case ATARI_NTSC_SIMD_NEON:
+		blit_neon( ntsc, atari_in, in_row_width, in_width, in_height, rgb_out, out_pitch, format );
+		return 1;
+#endif
+	default:
+		return 0;
+	}
+}
@@ -0,0 +1,379 @@
+/*
+ * batch.c - running variants of a session in forked worker processes
+ *
+ * Copyright (C) 2016 Atari800 development team (see DOC/CREDITS)
+ *
+ * This file is part of the Atari800 emulator project which emulates
+ * the Atari 400, 800, 800XL, 130XE, and 5200 8-bit computers.
+ *
+ * Atari800 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Atari800 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atari800; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#define _POSIX_C_SOURCE 200112L /* for fork and waitpid */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "akey.h"
+#include "atari.h"
+#include "input.h"
+#include "log.h"
+#include "memory.h"
+#include "sio.h"
+#include "statesav.h"
+#include "util.h"
+#ifndef CURSES_BASIC
+#include "screen.h"
+#endif
+#ifdef SOUND
+#include "sound.h"
+#endif
+
+char BATCH_job_file[FILENAME_MAX] = "";
+int BATCH_fork_frame = 0;
+int BATCH_max_workers = 0;
+
+typedef struct {
+	char *script;
+	char *prefix;
+	pid_t pid;
+} Job;
+
+static Job *jobs = NULL;
+static int num_jobs = 0;
+
+int BATCH_Initialise(int *argc, char *argv[])
+{
+	int i;
+	int j;
+	for (i = j = 1; i < *argc; i++) {
+		int i_a = (i + 1 < *argc);		/* is argument available? */
+		int a_m = FALSE;			/* error, argument missing! */
+
+		if (strcmp(argv[i], "-batch") == 0) {
+			if (i_a)
+				Util_strlcpy(BATCH_job_file, argv[++i], sizeof(BATCH_job_file));
+			else a_m = TRUE;
+		}
+		else if (strcmp(argv[i], "-batch-frame") == 0) {
+			if (i_a) {
+				BATCH_fork_frame = Util_sscandec(argv[++i]);
+				if (BATCH_fork_frame < 0) {
+					Log_print("Invalid frame number '%s'", argv[i]);
+					return FALSE;
+				}
+			}
+			else a_m = TRUE;
+		}
+		else if (strcmp(argv[i], "-batch-workers") == 0) {
+			if (i_a) {
+				BATCH_max_workers = Util_sscandec(argv[++i]);
+				if (BATCH_max_workers < 1) {
+					Log_print("Invalid number of workers '%s'", argv[i]);
+					return FALSE;
+				}
+			}
+			else a_m = TRUE;
+		}
+		else {
+			if (strcmp(argv[i], "-help") == 0) {
+				Log_print("\t-batch <file>       Run the jobs listed in <file> in forked workers, headless");
+				Log_print("\t-batch-frame <n>    Fork the workers at frame <n>");
+				Log_print("\t-batch-workers <n>  Run at most <n> workers at the same time");
+			}
+			argv[j++] = argv[i];
+		}
+
+		if (a_m) {
+			Log_print("Missing argument for '%s'", argv[i]);
+			return FALSE;
+		}
+	}
+	*argc = j;
+
+	if (BATCH_max_workers == 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+		BATCH_max_workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		if (BATCH_max_workers < 1)
+			BATCH_max_workers = 1;
+	}
+	return TRUE;
+}
+
+/* Reads the list of jobs from BATCH_job_file. */
+static int ReadJobs(void)
+{
+	FILE *fp;
+	char line[2 * FILENAME_MAX];
+	fp = fopen(BATCH_job_file, "r");
+	if (fp == NULL) {
+		Log_print("Cannot open job file %s", BATCH_job_file);
+		return FALSE;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		char *script = strtok(line, " \t\r\n");
+		char *prefix;
+		if (script == NULL || script[0] == '#')
+			continue;
+		prefix = strtok(NULL, " \t\r\n");
+		jobs = (Job *) Util_realloc(jobs, (num_jobs + 1) * sizeof(Job));
+		jobs[num_jobs].script = Util_strdup(script);
+		jobs[num_jobs].prefix = Util_strdup(prefix != NULL ? prefix : "");
+		jobs[num_jobs].pid = -1;
+		num_jobs++;
+	}
+	fclose(fp);
+	if (num_jobs == 0) {
+		Log_print("No jobs in %s", BATCH_job_file);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* Parses a decimal number or a hexadecimal one with a $ prefix.
+   Returns -1 on error. */
+static int ParseNumber(const char *s)
+{
+	if (s == NULL)
+		return -1;
+	if (s[0] == '$')
+		return Util_sscanhex(s + 1);
+	return Util_sscandec(s);
+}
+
+static void RunFrame(void)
+{
+	Atari800_Frame();
+	/* Special keys (coldstart, warmstart...) act only once. */
+	if (INPUT_key_code < AKEY_NONE)
+		INPUT_key_code = AKEY_NONE;
+}
+
+/* Executes one command of a script. ARGS are the tokens after the command.
+   Returns FALSE on error. *EXIT_STATUS is set to end the script. */
+static int RunCommand(const char *cmd, char *args[], int nargs, const char *prefix, int *exit_status)
+{
+	char path[FILENAME_MAX];
+	int a = nargs > 0 ? ParseNumber(args[0]) : -1;
+	int b = nargs > 1 ? ParseNumber(args[1]) : -1;
+	int code;
+
+	/* Output files are named by the last argument. */
+	if (strcmp(cmd, "dump") == 0 || strcmp(cmd, "screenshot") == 0 || strcmp(cmd, "state") == 0) {
+		if (nargs == 0 || strlen(prefix) + strlen(args[nargs - 1]) >= sizeof(path))
+			return FALSE;
+		strcpy(path, prefix);
+		strcat(path, args[nargs - 1]);
+	}
+
+	if (strcmp(cmd, "key") == 0 && nargs == 1) {
+		if (strcmp(args[0], "none") == 0)
+			INPUT_key_code = AKEY_NONE;
+		else if (args[0][0] == '-' && Util_sscansdec(args[0], &code)
+		         && (code == AKEY_WARMSTART || code == AKEY_COLDSTART || code == AKEY_BREAK))
+			/* Other special keys open the UI or exit the emulator, which
+			   a worker must not do. */
+			INPUT_key_code = code;
+		else if (a >= 0 && a <= 0x1ff)
+			INPUT_key_code = a;
+		else
+			return FALSE;
+	}
+	else if (strcmp(cmd, "shift") == 0 && nargs == 1 && (a == 0 || a == 1))
+		INPUT_key_shift = a;
+	else if (strcmp(cmd, "consol") == 0 && nargs == 1 && a >= 0 && a <= INPUT_CONSOL_NONE)
+		INPUT_key_consol = a;
+	else if (strcmp(cmd, "joy") == 0 && nargs == 2 && a >= 0 && a <= 3 && b >= 0 && b <= 15) {
+		int shift = (a & 1) << 2;
+		INPUT_script_port[a >> 1] = (INPUT_script_port[a >> 1] & ~(0x0f << shift)) | (b << shift);
+	}
+	else if (strcmp(cmd, "trig") == 0 && nargs == 2 && a >= 0 && a <= 3 && (b == 0 || b == 1))
+		INPUT_script_trig[a] = b;
+	else if (strcmp(cmd, "poke") == 0 && nargs == 2 && a >= 0 && a <= 0xffff && b >= 0 && b <= 0xff)
+		MEMORY_dPutByte(a, (UBYTE) b);
+	else if (strcmp(cmd, "dump") == 0 && nargs == 3 && a >= 0 && b >= 0 && a + b <= 0x10000) {
+		FILE *fp = fopen(path, "wb");
+		int i;
+		if (fp == NULL) {
+			Log_print("Cannot create %s", path);
+			return FALSE;
+		}
+		for (i = a; i < a + b; i++)
+			putc(MEMORY_SafeGetByte(i), fp);
+		if (fclose(fp) != 0)
+			return FALSE;
+	}
+#ifndef CURSES_BASIC
+	else if (strcmp(cmd, "screenshot") == 0 && nargs == 1) {
+		if (!Screen_SaveScreenshot(path, FALSE)) {
+			Log_print("Cannot save screenshot %s", path);
+			return FALSE;
+		}
+	}
+#endif
+	else if (strcmp(cmd, "state") == 0 && nargs == 1) {
+		if (!StateSav_SaveAtariState(path, "wb", TRUE)) {
+			Log_print("Cannot save state %s", path);
+			return FALSE;
+		}
+	}
+	else if (strcmp(cmd, "exit") == 0 && nargs <= 1) {
+		if (nargs == 1 && a < 0)
+			return FALSE;
+		*exit_status = nargs == 1 ? a : 0;
+	}
+	else
+		return FALSE;
+	return TRUE;
+}
+
+int BATCH_RunScript(const char *script, const char *prefix)
+{
+	FILE *fp;
+	char line[FILENAME_MAX + 256];
+	int line_no = 0;
+	int frame = 0;
+	int exit_status = -1;
+
+	fp = fopen(script, "r");
+	if (fp == NULL) {
+		Log_print("Cannot open script %s", script);
+		return 1;
+	}
+	while (exit_status < 0 && fgets(line, sizeof(line), fp) != NULL) {
+		char *args[3];
+		int nargs = 0;
+		char *token = strtok(line, " \t\r\n");
+		char *cmd;
+		int cmd_frame;
+		line_no++;
+		if (token == NULL || token[0] == '#')
+			continue;
+		cmd_frame = Util_sscandec(token);
+		cmd = strtok(NULL, " \t\r\n");
+		while (nargs < 3 && (token = strtok(NULL, " \t\r\n")) != NULL)
+			args[nargs++] = token;
+		if (cmd_frame < frame || cmd == NULL || strtok(NULL, " \t\r\n") != NULL) {
+			Log_print("%s:%d: invalid line", script, line_no);
+			exit_status = 1;
+			break;
+		}
+		while (frame < cmd_frame) {
+			RunFrame();
+			frame++;
+		}
+		if (!RunCommand(cmd, args, nargs, prefix, &exit_status)) {
+			Log_print("%s:%d: %s failed", script, line_no, cmd);
+			exit_status = 1;
+		}
+	}
+	fclose(fp);
+	return exit_status < 0 ? 0 : exit_status;
+}
+
+/* Waits for a worker to end. Returns FALSE if it failed. */
+static int WaitForWorker(void)
+{
+	int status;
+	int i;
+	pid_t pid = waitpid(-1, &status, 0);
+	if (pid < 0)
+		return FALSE;
+	for (i = 0; i < num_jobs; i++) {
+		if (jobs[i].pid == pid) {
+			jobs[i].pid = -1;
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+				Log_print("Job %s failed", jobs[i].script);
+				return FALSE;
+			}
+			break;
+		}
+	}
+	return TRUE;
+}
+
+int BATCH_Run(void)
+{
+	int running = 0;
+	int failed = 0;
+	int i;
+
+	if (!ReadJobs())
+		return 1;
+
+	/* Headless and as fast as possible - the display isn't refreshed and
+	   the keyboard isn't read. */
+#ifdef SOUND
+	Sound_Pause();
+#endif
+	Atari800_turbo = TRUE;
+	INPUT_scripted = TRUE;
+	INPUT_key_code = AKEY_NONE;
+	INPUT_key_shift = 0;
+	INPUT_key_consol = INPUT_CONSOL_NONE;
+	while (Atari800_nframes < BATCH_fork_frame)
+		RunFrame();
+
+	/* Only the calling thread exists in the forked process, so no thread
+	   may hold a lock or own unwritten sectors. */
+	SIO_StopFlusher();
+
+	for (i = 0; i < num_jobs; i++) {
+		pid_t pid;
+		if (running == BATCH_max_workers) {
+			if (!WaitForWorker())
+				failed++;
+			running--;
+		}
+		/* Don't let the worker write the parent's buffered output again. */
+		fflush(NULL);
+		pid = fork();
+		if (pid == 0) {
+			int status = BATCH_RunScript(jobs[i].script, jobs[i].prefix);
+			fflush(NULL);
+			/* Don't run the exit handlers of the parent's libraries. */
+			_exit(status);
+		}
+		if (pid < 0) {
+			Log_print("Cannot start job %s", jobs[i].script);
+			failed++;
+			continue;
+		}
+		jobs[i].pid = pid;
+		running++;
+	}
+	while (running > 0) {
+		if (!WaitForWorker())
+			failed++;
+		running--;
+	}
+	Log_print("%d of %d jobs succeeded", num_jobs - failed, num_jobs);
+
+	for (i = 0; i < num_jobs; i++) {
+		free(jobs[i].script);
+		free(jobs[i].prefix);
+	}
+	free(jobs);
+	jobs = NULL;
+	num_jobs = 0;
+	return failed > 0 ? 1 : 0;
+}
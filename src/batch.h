@@ -0,0 +1,54 @@
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <stdio.h> /* FILENAME_MAX */
+
+/* Batch mode runs many variants of one emulated session. The emulator
+   runs headless up to BATCH_fork_frame, then forks a worker process for
+   each job. The workers share the memory of the emulator copy-on-write,
+   so the setup (booting, loading a program) is done only once, and each
+   worker continues with its own input script and writes its own output
+   files.
+
+   A job file lists one job per line: the name of an input script and an
+   optional prefix that is prepended to the names of the job's output
+   files. Each line of an input script is "<frame> <command> [args]",
+   where frame counts from the fork, and the commands are:
+     key <code>|none          press an Atari key (AKEY_* code) or release it;
+                              of the special keys only -2 (warm reset),
+                              -3 (cold reset) and -5 (Break) are allowed,
+                              and they act only once
+     shift 0|1                hold the Shift key (5200: the second button)
+     consol <bits>            Start/Select/Option, 7 means none pressed
+     joy <port> <position>    joystick position (0-15, 15 is centre)
+     trig <port> 0|1          joystick trigger, 0 means pressed
+     poke <addr> <value>      store a byte in memory
+     dump <addr> <len> <file> write a block of memory to a file
+     screenshot <file>        save the screen (not in CURSES_BASIC)
+     state <file>             save the state of the emulator
+     exit [<status>]          end the worker
+   Numbers are decimal or hexadecimal with a $ prefix. The worker ends
+   after the last command. */
+
+/* Name of the job file. Batch mode is enabled when it is not empty. */
+extern char BATCH_job_file[FILENAME_MAX];
+/* Frame (counted from the start of the emulator) at which the workers
+   are forked. */
+extern int BATCH_fork_frame;
+/* Maximum number of workers running at the same time. */
+extern int BATCH_max_workers;
+
+/* Used in Atari800_Initialise during emulator initialisation */
+int BATCH_Initialise(int *argc, char *argv[]);
+
+/* Runs the emulator to BATCH_fork_frame, forks the workers, waits for
+   them and returns the exit status for the emulator: 0 if all jobs
+   succeeded. */
+int BATCH_Run(void);
+
+/* Runs the input script SCRIPT in the current process, writing output
+   files with names prefixed by PREFIX. Returns the exit status of the
+   script (non-zero on errors). */
+int BATCH_RunScript(const char *script, const char *prefix);
+
+#endif /* BATCH_H_ */
@@ -24,6 +24,7 @@
 
 #include "config.h"
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "atari.h"
 #include "binload.h"
@@ -33,10 +34,12 @@
 #include "log.h"
 #include "memory.h"
 #include "sio.h"
+#include "util.h"
 
 int BINLOAD_start_binloading = FALSE;
 int BINLOAD_loading_basic = 0;
 int BINLOAD_slow_xex_loading = FALSE;
+int BINLOAD_xex_inject = FALSE;
 FILE *BINLOAD_bin_file = NULL;
 
 /* These variables are for slow XEX loading only. */
@@ -53,6 +56,83 @@ static int init2e3 = FALSE;
 static int segfinished = TRUE;
 int BINLOAD_pause_loading;
 
+/* These variables are for direct injection only. */
+
+/* A segment of the injected file. */
+typedef struct {
+	UWORD start; /* Load address */
+	ULONG length; /* Number of bytes (up to 0x10000) */
+	ULONG offset; /* Offset of the data in XEX_IMAGE */
+} Segment;
+/* Contents of the injected file, NULL when not injecting. */
+static UBYTE *xex_image = NULL;
+static Segment *segments = NULL;
+static int num_segments = 0;
+/* Index of the segment to be loaded next. */
+static int next_segment = 0;
+
+static void FreeImage(void)
+{
+	if (xex_image != NULL) {
+		free(xex_image);
+		xex_image = NULL;
+	}
+	if (segments != NULL) {
+		free(segments);
+		segments = NULL;
+	}
+	num_segments = 0;
+}
+
+/* Reads the rest of BINLOAD_bin_file, positioned after the first 0xffff,
+   and splits it into segments. The file is closed.
+   Returns FALSE if the file doesn't contain any segment. */
+static int ParseImage(void)
+{
+	int size = Util_flen(BINLOAD_bin_file) - 2;
+	int alloc = 0;
+	int pos = 0;
+	if (size < 0)
+		size = 0;
+	xex_image = (UBYTE *) Util_malloc(size + 1);
+	if (fseek(BINLOAD_bin_file, 2, SEEK_SET) != 0
+	    || (int) fread(xex_image, 1, size, BINLOAD_bin_file) != size)
+		size = 0;
+	fclose(BINLOAD_bin_file);
+	BINLOAD_bin_file = NULL;
+
+	while (pos + 4 <= size) {
+		UWORD start = xex_image[pos] + (xex_image[pos + 1] << 8);
+		UWORD end;
+		Segment *seg;
+		if (start == 0xffff) {
+			/* optional header of the next segment */
+			pos += 2;
+			continue;
+		}
+		end = xex_image[pos + 2] + (xex_image[pos + 3] << 8);
+		pos += 4;
+		if (num_segments >= alloc) {
+			alloc = alloc == 0 ? 16 : alloc * 2;
+			segments = (Segment *) Util_realloc(segments, alloc * sizeof(Segment));
+		}
+		seg = &segments[num_segments++];
+		seg->start = start;
+		seg->length = (ULONG) (UWORD) (end - start) + 1;
+		seg->offset = pos;
+		if (seg->length > (ULONG) (size - pos))
+			/* truncated file - load what is there, like the OS would */
+			seg->length = size - pos;
+		pos += seg->length;
+	}
+	if (num_segments == 0) {
+		FreeImage();
+		return FALSE;
+	}
+	next_segment = 0;
+	return TRUE;
+}
+
 /* Read a word from file */
 static int read_word(void)
 {
@@ -71,6 +151,22 @@ static int read_word(void)
 	return buf[0] + (buf[1] << 8);
 }
 
+/* Calls the INIT routine, which returns to CONT through an ESC code
+   put on the stack. */
+static void call_init(ESC_FunctionType cont)
+{
+	CPU_regS--;
+	ESC_Add((UWORD) (0x100 + CPU_regS), ESC_BINLOADER_CONT, cont);
+	CPU_regS--;
+	MEMORY_dPutByte(0x0100 + CPU_regS--, 0x01);	/* high */
+	MEMORY_dPutByte(0x0100 + CPU_regS, CPU_regS + 1);	/* low */
+	CPU_regS--;
+	CPU_regPC = MEMORY_dGetWordAligned(0x2e2);
+	CPU_SetC;
+
+	MEMORY_dPutByte(0x0300, 0x31);	/* for "Studio Dream" */
+}
+
 /* Start or continue loading */
 static void loader_cont(void)
 {
@@ -143,19 +239,44 @@ static void loader_cont(void)
 		segfinished = TRUE;
 	} while (MEMORY_dGetByte(0x2e3) == 0xd7);
 
-	CPU_regS--;
-	ESC_Add((UWORD) (0x100 + CPU_regS), ESC_BINLOADER_CONT, loader_cont);
-	CPU_regS--;
-	MEMORY_dPutByte(0x0100 + CPU_regS--, 0x01);	/* high */
-	MEMORY_dPutByte(0x0100 + CPU_regS, CPU_regS + 1);	/* low */
-	CPU_regS--;
-	CPU_regPC = MEMORY_dGetWordAligned(0x2e2);
-	CPU_SetC;
-
-	MEMORY_dPutByte(0x0300, 0x31);	/* for "Studio Dream" */
+	call_init(loader_cont);
 	init2e3 = TRUE;
 }
 
+/* Start or continue direct injection of the parsed segments. Whole segments
+   are stored at once, and the CPU runs only the INIT and RUN routines. */
+static void inject_cont(void)
+{
+	if (xex_image == NULL)
+		return;
+	if (BINLOAD_start_binloading) {
+		MEMORY_dPutByte(0x244, 0);
+		MEMORY_dPutByte(0x09, 1);
+		MEMORY_dPutWordAligned(0x2e0, segments[0].start);
+		BINLOAD_start_binloading = FALSE;
+	}
+	else
+		CPU_regS += 2;	/* pop ESC code */
+
+	while (next_segment < num_segments) {
+		Segment const *seg = &segments[next_segment++];
+		UBYTE const *data = xex_image + seg->offset;
+		UWORD addr = seg->start;
+		ULONG i;
+		MEMORY_dPutByte(0x2e3, 0xd7);
+		/* MEMORY_PutByte, because segments may be loaded to hardware
+		   registers or to ROM */
+		for (i = 0; i < seg->length; i++, addr++)
+			MEMORY_PutByte(addr, data[i]);
+		if (MEMORY_dGetByte(0x2e3) != 0xd7) {
+			call_init(inject_cont);
+			return;
+		}
+	}
+	FreeImage();
+	CPU_regPC = MEMORY_dGetWordAligned(0x2e0);
+}
+
 /* Fake boot sector to call loader_cont at boot time */
 int BINLOAD_LoaderStart(UBYTE *buffer)
 {
@@ -167,7 +288,7 @@ int BINLOAD_LoaderStart(UBYTE *buffer)
 	buffer[5] = 0xe4;
 	buffer[6] = 0xf2;	/* ESC */
 	buffer[7] = ESC_BINLOADER_CONT;
-	ESC_Add(0x706, ESC_BINLOADER_CONT, loader_cont);
+	ESC_Add(0x706, ESC_BINLOADER_CONT, xex_image != NULL ? inject_cont : loader_cont);
 	BINLOAD_wait_active = FALSE;
 	init2e3 = TRUE;
 	segfinished = TRUE;
@@ -183,6 +304,7 @@ int BINLOAD_Loader(const char *filename)
 		BINLOAD_bin_file = NULL;
 		BINLOAD_loading_basic = 0;
 	}
+	FreeImage();
 	if (Atari800_machine_type == Atari800_MACHINE_5200) {
 		Log_print("binload: can't run Atari programs directly on the 5200");
 		return FALSE;
@@ -197,6 +319,17 @@ int BINLOAD_Loader(const char *filename)
 		SIO_DisableDrive(1);
 	if (fread(buf, 1, 2, BINLOAD_bin_file) == 2) {
 		if (buf[0] == 0xff && buf[1] == 0xff) {
+			if (BINLOAD_xex_inject && !BINLOAD_slow_xex_loading) {
+				if (!ParseImage()) {
+					Log_print("binload: not valid BIN file");
+					return FALSE;
+				}
+				BINLOAD_start_binloading = TRUE;
+				/* hook SIOV even without the SIO patch, see ESC_PatchOS */
+				ESC_UpdatePatches();
+				Atari800_Coldstart();
+				return TRUE;
+			}
 			BINLOAD_start_binloading = TRUE; /* force SIO to call BINLOAD_LoaderStart at boot */
 			Atari800_Coldstart();             /* reboot */
 			return TRUE;
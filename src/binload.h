@@ -13,6 +13,12 @@ extern int BINLOAD_loading_basic;
 /* Set to TRUE to enable loading of XEX with approximate disk speed */
 extern int BINLOAD_slow_xex_loading;
 
+/* Set to TRUE to store the segments of XEX files directly in memory at boot,
+   running only their INIT and RUN routines, and without a serial transfer
+   of the boot sector when the SIO patch is off. Ignored when
+   BINLOAD_slow_xex_loading is TRUE. */
+extern int BINLOAD_xex_inject;
+
 /* Indicates that a DOS file is being currently slowly loaded. */
 extern int BINLOAD_wait_active;
 
@@ -73,6 +73,9 @@ static int cassette_motor = 0;
 int CASSETTE_hold_start_on_reboot = 0;
 int CASSETTE_hold_start = 0;
 int CASSETTE_press_space = 0;
+int CASSETTE_instant_load = FALSE;
+/* Indicates that Atari800_turbo was switched on by UpdateFlags(). */
+static int turbo_by_tape = FALSE;
 /* Indicates whether the tape has ended. During saving the value is always 0;
    during loading it is equal to (CASSETTE_GetPosition() >= CASSETTE_GetSize()). */
 static int eof_of_tape = 0;
@@ -88,6 +91,18 @@ static void UpdateFlags(void)
 	CASSETTE_writable = cassette_motor &&
 	                    CASSETTE_status == CASSETTE_STATUS_READ_WRITE &&
 	                    !CASSETTE_write_protect;
+	/* With instant loading, run the emulation at full speed for as long as
+	   the tape is being read. */
+	if (CASSETTE_instant_load && CASSETTE_readable && !CASSETTE_record) {
+		if (!Atari800_turbo) {
+			Atari800_turbo = TRUE;
+			turbo_by_tape = TRUE;
+		}
+	}
+	else if (turbo_by_tape) {
+		Atari800_turbo = FALSE;
+		turbo_by_tape = FALSE;
+	}
 }
 
 int CASSETTE_ReadConfig(char *string, char *ptr)
@@ -106,6 +121,12 @@ int CASSETTE_ReadConfig(char *string, char *ptr)
 			return FALSE;
 		CASSETTE_write_protect = value;
 	}
+	else if (strcmp(string, "CASSETTE_INSTANT_LOAD") == 0) {
+		int value = Util_sscanbool(ptr);
+		if (value == -1)
+			return FALSE;
+		CASSETTE_instant_load = value;
+	}
 	else return FALSE;
 	return TRUE;
 }
@@ -115,6 +136,7 @@ void CASSETTE_WriteConfig(FILE *fp)
 	fprintf(fp, "CASSETTE_FILENAME=%s\n", CASSETTE_filename);
 	fprintf(fp, "CASSETTE_LOADED=%d\n", CASSETTE_status != CASSETTE_STATUS_NONE);
 	fprintf(fp, "CASSETTE_WRITE_PROTECT=%d\n", CASSETTE_write_protect);
+	fprintf(fp, "CASSETTE_INSTANT_LOAD=%d\n", CASSETTE_instant_load);
 }
 
 int CASSETTE_Initialise(int *argc, char *argv[])
@@ -148,11 +170,17 @@ int CASSETTE_Initialise(int *argc, char *argv[])
 		}
 		else if (strcmp(argv[i], "-tape-readonly") == 0)
 			protect = TRUE;
+		else if (strcmp(argv[i], "-instant-tape") == 0)
+			CASSETTE_instant_load = TRUE;
+		else if (strcmp(argv[i], "-no-instant-tape") == 0)
+			CASSETTE_instant_load = FALSE;
 		else {
 			if (strcmp(argv[i], "-help") == 0) {
 				Log_print("\t-tape <file>      Insert cassette image");
 				Log_print("\t-boottape <file>  Insert cassette image and boot it");
 				Log_print("\t-tape-readonly    Mark the attached cassette image as read-only");
+				Log_print("\t-instant-tape     Load tapes instantly (when the SIO patch is off)");
+				Log_print("\t-no-instant-tape  Load tapes at the real speed");
 			}
 			argv[j++] = argv[i];
 		}
@@ -461,6 +489,27 @@ int CASSETTE_ReadToMemory(UWORD dest_addr, int length)
 	}
 }
 
+int CASSETTE_CanReadInstantly(void)
+{
+	return CASSETTE_instant_load && !CASSETTE_record && !eof_of_tape
+	       && CASSETTE_status != CASSETTE_STATUS_NONE
+	       && IMG_TAPE_AtDataRecord(cassette_file);
+}
+
+int CASSETTE_ReadInstantly(UWORD dest_addr, int length)
+{
+	int result;
+	/* The record is read as a whole, regardless of the time the OS would
+	   wait for it. */
+	cassette_gapdelay = 0;
+	event_time_left = 0;
+	result = CASSETTE_ReadToMemory(dest_addr, length);
+	/* The tape continues with the IRG of the next record. */
+	pending_serin = FALSE;
+	passing_gap = FALSE;
+	return result;
+}
+
 int CASSETTE_WriteFromMemory(UWORD src_addr, int length)
 {
 	int result;
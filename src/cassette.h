@@ -85,6 +85,20 @@ int CASSETTE_WriteFromMemory(UWORD src_addr, int length);
 void CASSETTE_LeaderLoad(void);
 void CASSETTE_LeaderSave(void);
 
+/* --- Instant loading --- */
+/* If TRUE, records read by the OS SIO routine are taken directly from the
+   tape image even when the SIO patch is off, and the emulator runs at full
+   speed while the tape motor is on. Custom loaders and FSK blocks are still
+   read at the normal baudrate. Call ESC_UpdatePatches() after changing. */
+extern int CASSETTE_instant_load;
+/* Returns TRUE if instant loading is on and the next record on tape can be
+   read by CASSETTE_ReadInstantly(), ie. the tape is not in the middle of
+   a record and the record is not an FSK block. */
+int CASSETTE_CanReadInstantly(void);
+/* Reads the next record like CASSETTE_ReadToMemory(), without waiting for
+   the gap before it. */
+int CASSETTE_ReadInstantly(UWORD dest_addr, int length);
+
 /* Indicates whether the tape can be read from, ie. it's mounted and not on its
    end. */
 extern int CASSETTE_readable;
@@ -35,6 +35,7 @@
 #include "memory.h"
 #include "pbi.h"
 #include "rtime.h"
+#include "sio.h"
 #include "sysrom.h"
 #ifdef XEP80_EMULATION
 #include "xep80.h"
@@ -47,6 +48,7 @@
 #endif
 #include "platform.h"
 #include "pokeysnd.h"
+#include "mzpokeysnd.h"
 #include "ui.h"
 #include "util.h"
 #if !defined(BASIC) && !defined(CURSES_BASIC)
@@ -184,9 +186,25 @@ int CFG_LoadConfig(const char *alternate_config_filename)
 			else if (strcmp(string, "ENABLE_SIO_PATCH") == 0) {
 				ESC_enable_sio_patch = Util_sscanbool(ptr);
 			}
+			else if (strcmp(string, "COMPRESSED_DISKS_WRITABLE") == 0) {
+				SIO_compressed_writable = Util_sscanbool(ptr);
+			}
+			else if (strcmp(string, "DISK_CACHE_DIR") == 0)
+				Util_strlcpy(SIO_disk_cache_dir, ptr, sizeof(SIO_disk_cache_dir));
+			else if (strcmp(string, "BOOT_CACHE_DIR") == 0)
+				Util_strlcpy(Atari800_boot_cache_dir, ptr, sizeof(Atari800_boot_cache_dir));
+			else if (strcmp(string, "TURBO_SIO") == 0)
+				SIO_turbo = Util_sscanbool(ptr);
+			else if (strcmp(string, "DISK_FLUSH_POLICY") == 0) {
+				if (!SIO_SetFlushPolicy(ptr))
+					Log_print("Invalid disk flush policy: %s", ptr);
+			}
 			else if (strcmp(string, "ENABLE_SLOW_XEX_LOADING") == 0) {
 				BINLOAD_slow_xex_loading = Util_sscanbool(ptr);
 			}
+			else if (strcmp(string, "XEX_INJECT") == 0) {
+				BINLOAD_xex_inject = Util_sscanbool(ptr);
+			}
 			else if (strcmp(string, "ENABLE_H_PATCH") == 0) {
 				Devices_enable_h_patch = Util_sscanbool(ptr);
 			}
@@ -200,6 +218,11 @@ int CFG_LoadConfig(const char *alternate_config_filename)
 			else if (strcmp(string, "ENABLE_NEW_POKEY") == 0) {
 #ifdef SOUND
 				POKEYSND_enable_new_pokey = Util_sscanbool(ptr);
+#endif /* SOUND */
+			}
+			else if (strcmp(string, "POKEY_FIXED_POINT") == 0) {
+#ifdef SOUND
+				MZPOKEYSND_fixed_point = Util_sscanbool(ptr);
 #endif /* SOUND */
 			}
 			else if (strcmp(string, "STEREO_POKEY") == 0) {
@@ -208,6 +231,17 @@ int CFG_LoadConfig(const char *alternate_config_filename)
 #ifdef SOUND_THIN_API
 				Sound_desired.channels = POKEYSND_stereo_enabled ? 2 : 1;
 #endif /* SOUND_THIN_API */
+#endif /* STEREO_SOUND */
+			}
+			else if (strcmp(string, "QUAD_POKEY") == 0) {
+#ifdef STEREO_SOUND
+				POKEYSND_quad_enabled = Util_sscanbool(ptr);
+#endif /* STEREO_SOUND */
+			}
+			else if (strcmp(string, "QUAD_POKEY_MIX") == 0) {
+#ifdef STEREO_SOUND
+				if (!POKEYSND_SetQuadMix(ptr))
+					Log_print("Invalid quad POKEY mix: %s", ptr);
 #endif /* STEREO_SOUND */
 			}
 			else if (strcmp(string, "SPEAKER_SOUND") == 0) {
@@ -411,7 +445,13 @@ int CFG_WriteConfig(void)
 
 	fprintf(fp, "DISABLE_BASIC=%d\n", Atari800_disable_basic);
 	fprintf(fp, "ENABLE_SIO_PATCH=%d\n", ESC_enable_sio_patch);
+	fprintf(fp, "COMPRESSED_DISKS_WRITABLE=%d\n", SIO_compressed_writable);
+	fprintf(fp, "DISK_CACHE_DIR=%s\n", SIO_disk_cache_dir);
+	fprintf(fp, "BOOT_CACHE_DIR=%s\n", Atari800_boot_cache_dir);
+	fprintf(fp, "DISK_FLUSH_POLICY=%s\n", SIO_GetFlushPolicy());
+	fprintf(fp, "TURBO_SIO=%d\n", SIO_turbo);
 	fprintf(fp, "ENABLE_SLOW_XEX_LOADING=%d\n", BINLOAD_slow_xex_loading);
+	fprintf(fp, "XEX_INJECT=%d\n", BINLOAD_xex_inject);
 	fprintf(fp, "ENABLE_H_PATCH=%d\n", Devices_enable_h_patch);
 	fprintf(fp, "ENABLE_P_PATCH=%d\n", Devices_enable_p_patch);
 #ifdef R_IO_DEVICE
@@ -420,8 +460,11 @@ int CFG_WriteConfig(void)
 
 #ifdef SOUND
 	fprintf(fp, "ENABLE_NEW_POKEY=%d\n", POKEYSND_enable_new_pokey);
+	fprintf(fp, "POKEY_FIXED_POINT=%d\n", MZPOKEYSND_fixed_point);
 #ifdef STEREO_SOUND
 	fprintf(fp, "STEREO_POKEY=%d\n", POKEYSND_stereo_enabled);
+	fprintf(fp, "QUAD_POKEY=%d\n", POKEYSND_quad_enabled);
+	fprintf(fp, "QUAD_POKEY_MIX=%s\n", POKEYSND_quad_mix);
 #endif
 #ifdef CONSOLE_SOUND
 	fprintf(fp, "SPEAKER_SOUND=%d\n", POKEYSND_console_sound_enabled);
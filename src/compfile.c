@@ -36,11 +36,57 @@
 #include "log.h"
 #include "util.h"
 
+/* Decompressed data goes either to a file or to a memory block
+   that grows as needed. */
+typedef struct {
+	FILE *fp;
+	UBYTE *buf;
+	ULONG pos;
+	ULONG size;
+	ULONG alloc;
+} Output;
+
+static int output_write(Output *out, const void *data, int size)
+{
+	if (out->fp != NULL)
+		return (int) fwrite(data, 1, size, out->fp) == size;
+	if (out->pos + size > out->alloc) {
+		out->alloc = out->alloc == 0 ? 65536 : out->alloc * 2;
+		if (out->alloc < out->pos + size)
+			out->alloc = out->pos + size;
+		out->buf = (UBYTE *) Util_realloc(out->buf, out->alloc);
+	}
+	memcpy(out->buf + out->pos, data, size);
+	out->pos += size;
+	if (out->size < out->pos)
+		out->size = out->pos;
+	return TRUE;
+}
+
+static void output_rewind(Output *out)
+{
+	if (out->fp != NULL)
+		Util_rewind(out->fp);
+	else
+		out->pos = 0;
+}
+
+/* Returns the memory block of OUT in *BUF and *SIZE, or frees it on failure. */
+static int output_finish(Output *out, int success, UBYTE **buf, ULONG *size)
+{
+	if (!success || out->size == 0) {
+		free(out->buf);
+		return FALSE;
+	}
+	*buf = out->buf;
+	*size = out->size;
+	return TRUE;
+}
+
+
 /* GZ decompression ------------------------------------------------------ */
 
-/* Opens a GZIP compressed file and decompresses its contents to outfp.
-   Returns TRUE on success. */
-int CompFile_ExtractGZ(const char *infilename, FILE *outfp)
+static int extract_gz(const char *infilename, Output *out)
 {
 #ifndef HAVE_LIBZ
 	Log_print("This executable cannot decompress ZLIB files");
@@ -59,7 +105,7 @@ int CompFile_ExtractGZ(const char *infilename, FILE *outfp)
 	do {
 		result = gzread(gzf, buf, UNCOMPRESS_BUFFER_SIZE);
 		if (result > 0) {
-			if ((int) fwrite(buf, 1, result, outfp) != result)
+			if (!output_write(out, buf, result))
 				result = -1;
 		}
 	} while (result == UNCOMPRESS_BUFFER_SIZE);
@@ -69,6 +115,39 @@ int CompFile_ExtractGZ(const char *infilename, FILE *outfp)
 #endif	/* HAVE_LIBZ */
 }
 
+/* Opens a GZIP compressed file and decompresses its contents to outfp.
+   Returns TRUE on success. */
+int CompFile_ExtractGZ(const char *infilename, FILE *outfp)
+{
+	Output out;
+	memset(&out, 0, sizeof(out));
+	out.fp = outfp;
+	return extract_gz(infilename, &out);
+}
+
+int CompFile_ExtractGZToMemory(const char *infilename, UBYTE **buf, ULONG *size)
+{
+	Output out;
+	memset(&out, 0, sizeof(out));
+	return output_finish(&out, extract_gz(infilename, &out), buf, size);
+}
+
+#ifdef HAVE_LIBZ
+int CompFile_CompressGZ(const char *outfilename, const UBYTE *buf, ULONG size)
+{
+	gzFile gzf = gzopen(outfilename, "wb");
+	int result;
+	if (gzf == NULL) {
+		Log_print("ZLIB could not create file %s", outfilename);
+		return FALSE;
+	}
+	result = gzwrite(gzf, buf, (unsigned) size) == (int) size;
+	if (gzclose(gzf) != Z_OK)
+		result = FALSE;
+	return result;
+}
+#endif /* HAVE_LIBZ */
+
 
 /* DCM decompression ----------------------------------------------------- */
 
@@ -90,13 +169,8 @@ static int fload(void *buf, int size, FILE *fp)
 	return (int) fread(buf, 1, size, fp) == size;
 }
 
-static int fsave(void *buf, int size, FILE *fp)
-{
-	return (int) fwrite(buf, 1, size, fp) == size;
-}
-
 typedef struct {
-	FILE *fp;
+	Output *out;
 	int sectorcount;
 	int sectorsize;
 	int current_sector;
@@ -122,12 +196,12 @@ static int write_atr_header(const ATR_Info *pai)
 	header.seccounthi = (UBYTE) (paras >> 8);
 	header.hiseccountlo = (UBYTE) (paras >> 16);
 	header.hiseccounthi = (UBYTE) (paras >> 24);
-	return fsave(&header, sizeof(header), pai->fp);
+	return output_write(pai->out, &header, sizeof(header));
 }
 
 static int write_atr_sector(ATR_Info *pai, UBYTE *buf)
 {
-	return fsave(buf, pai->current_sector++ <= 3 ? 128 : pai->sectorsize, pai->fp);
+	return output_write(pai->out, buf, pai->current_sector++ <= 3 ? 128 : pai->sectorsize);
 }
 
 static int pad_till_sector(ATR_Info *pai, int till_sector)
@@ -233,7 +307,7 @@ static int dcm_pass(FILE *infp, ATR_Info *pai)
 	}
 }
 
-int CompFile_DCMtoATR(FILE *infp, FILE *outfp)
+static int dcm_to_atr(FILE *infp, Output *out)
 {
 	int archive_type;
 	int archive_flags;
@@ -252,7 +326,7 @@ int CompFile_DCMtoATR(FILE *infp, FILE *outfp)
 			Log_print("It seems that DCMs of a multi-file archive have been combined in wrong order");
 		return FALSE;
 	}
-	ai.fp = outfp;
+	ai.out = out;
 	ai.current_sector = 1;
 	switch ((archive_flags >> 5) & 3) {
 	case 0:
@@ -306,6 +380,21 @@ int CompFile_DCMtoATR(FILE *infp, FILE *outfp)
 		return pad_till_sector(&ai, ai.sectorcount + 1);
 	/* more sectors written: update ATR header */
 	ai.sectorcount = last_sector;
-	Util_rewind(outfp);
+	output_rewind(out);
 	return write_atr_header(&ai);
 }
+
+int CompFile_DCMtoATR(FILE *infp, FILE *outfp)
+{
+	Output out;
+	memset(&out, 0, sizeof(out));
+	out.fp = outfp;
+	return dcm_to_atr(infp, &out);
+}
+
+int CompFile_DCMtoATRMemory(FILE *infp, UBYTE **buf, ULONG *size)
+{
+	Output out;
+	memset(&out, 0, sizeof(out));
+	return output_finish(&out, dcm_to_atr(infp, &out), buf, size);
+}
@@ -1,9 +1,23 @@
 #ifndef COMPFILE_H_
 #define COMPFILE_H_
 
+#include "config.h"
 #include <stdio.h>  /* FILE */
 
+#include "atari.h"
+
 int CompFile_ExtractGZ(const char *infilename, FILE *outfp);
 int CompFile_DCMtoATR(FILE *infp, FILE *outfp);
 
+/* These decompress to a memory block allocated with Util_malloc(), which
+   the caller must free(). On success they store its address and size
+   in *BUF and *SIZE and return TRUE. */
+int CompFile_ExtractGZToMemory(const char *infilename, UBYTE **buf, ULONG *size);
+int CompFile_DCMtoATRMemory(FILE *infp, UBYTE **buf, ULONG *size);
+
+#ifdef HAVE_LIBZ
+/* Writes SIZE bytes of BUF to a new GZIP compressed file. Returns TRUE on success. */
+int CompFile_CompressGZ(const char *outfilename, const UBYTE *buf, ULONG size);
+#endif
+
 #endif /* COMPFILE_H_ */
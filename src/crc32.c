@@ -77,8 +77,42 @@ static ULONG table[0x100]= {
 	0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94, 0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
 };
 
+/* Tables for processing 8 bytes at a time ("slicing-by-8"):
+   slice[k][i] is the CRC of byte I followed by K zero bytes, so
+   slice[0] equals TABLE. Computed from TABLE on the first call. */
+static ULONG slice[8][0x100];
+static int slice_ready = FALSE;
+
+static void InitSlices(void)
+{
+	int i;
+	for (i = 0; i < 0x100; ++i) {
+		int k;
+		slice[0][i] = table[i];
+		for (k = 1; k < 8; ++k)
+			slice[k][i] = (slice[k - 1][i] >> 8) ^ table[slice[k - 1][i] & 0xff];
+	}
+	slice_ready = TRUE;
+}
+
 ULONG CRC32_Update(ULONG crc, UBYTE const *buf, unsigned int len)
 {
+	if (len >= 16) {
+		if (!slice_ready)
+			InitSlices();
+		/* Bytes are combined explicitly, so the loop works regardless of
+		   the endianness and alignment. */
+		do {
+			ULONG lo = crc ^ (buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((ULONG) buf[3] << 24));
+			ULONG hi = buf[4] | (buf[5] << 8) | (buf[6] << 16) | ((ULONG) buf[7] << 24);
+			crc = slice[7][lo & 0xff] ^ slice[6][(lo >> 8) & 0xff]
+			    ^ slice[5][(lo >> 16) & 0xff] ^ slice[4][lo >> 24]
+			    ^ slice[3][hi & 0xff] ^ slice[2][(hi >> 8) & 0xff]
+			    ^ slice[1][(hi >> 16) & 0xff] ^ slice[0][hi >> 24];
+			buf += 8;
+			len -= 8;
+		} while (len >= 8);
+	}
 	while (len > 0) {
 		crc = (crc >> 8) ^ table[(crc ^ *(buf++)) & 0xff];
 		--len;
@@ -24,6 +24,7 @@
 
 #include "config.h"
 #include "atari.h"
+#include "binload.h"
 #include "cassette.h"
 #include "cpu.h"
 #include "devices.h"
@@ -187,7 +188,17 @@ void ESC_PatchOS(void)
 	else {
 		ESC_Remove(ESC_COPENLOAD);
 		ESC_Remove(ESC_COPENSAVE);
-		ESC_Remove(ESC_SIOV);
+		/* For instant tape loading, XEX injection and boot snapshots, hook
+		   SIOV if it is the usual JMP. */
+		if ((CASSETTE_instant_load || Atari800_boot_capture
+		     || (BINLOAD_start_binloading && BINLOAD_xex_inject && !BINLOAD_slow_xex_loading))
+		    && MEMORY_dGetByte(0xe459) == 0x4c) {
+			SIO_os_routine = MEMORY_dGetWord(0xe45a);
+			ESC_AddEscRts(0xe459, ESC_SIOV, SIO_Handler);
+			patched = TRUE;
+		}
+		else
+			ESC_Remove(ESC_SIOV);
 	};
 	if (patched){
 		UWORD addr;
@@ -21,6 +21,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "filter_ntsc.h"
@@ -50,6 +51,147 @@ static char const * const preset_cfg_strings[FILTER_NTSC_PRESET_SIZE] = {
 
 atari_ntsc_t *FILTER_NTSC_emu = NULL;
 
+char FILTER_NTSC_cache_filename[FILENAME_MAX] = "";
+
+/* Kernels computed by atari_ntsc_init() are kept in a small cache, so that
+   switching between presets, or back to earlier settings, doesn't compute
+   them again. */
+#define CACHE_SIZE 4
+
+/* Everything atari_ntsc_init() depends on. The setup's pointer fields are
+   not included, as FILTER_NTSC_setup leaves them at NULL. */
+#define CACHE_NUM_PARAMS 11
+typedef struct cache_key_t {
+	double params[CACHE_NUM_PARAMS];
+	double yiq_table[768];
+} cache_key_t;
+
+static struct {
+	cache_key_t key;
+	atari_ntsc_t *kernel; /* NULL if the entry is unused */
+	unsigned int last_used;
+} cache[CACHE_SIZE];
+static unsigned int cache_clock = 0;
+
+/* Identifies the cache file format. */
+static char const cache_file_id[8] = "A8NTSC01";
+
+static void MakeKey(cache_key_t *key, double const yiq_table[768])
+{
+	key->params[0] = FILTER_NTSC_setup.hue;
+	key->params[1] = FILTER_NTSC_setup.saturation;
+	key->params[2] = FILTER_NTSC_setup.contrast;
+	key->params[3] = FILTER_NTSC_setup.brightness;
+	key->params[4] = FILTER_NTSC_setup.sharpness;
+	key->params[5] = FILTER_NTSC_setup.gamma;
+	key->params[6] = FILTER_NTSC_setup.resolution;
+	key->params[7] = FILTER_NTSC_setup.artifacts;
+	key->params[8] = FILTER_NTSC_setup.fringing;
+	key->params[9] = FILTER_NTSC_setup.bleed;
+	key->params[10] = FILTER_NTSC_setup.burst_phase;
+	memcpy(key->yiq_table, yiq_table, sizeof(key->yiq_table));
+}
+
+/* Returns index of the cache entry with kernel for KEY, or -1. */
+static int FindKernel(cache_key_t const *key)
+{
+	int i;
+	for (i = 0; i < CACHE_SIZE; i++)
+		if (cache[i].kernel != NULL && memcmp(&cache[i].key, key, sizeof(cache_key_t)) == 0)
+			return i;
+	return -1;
+}
+
+/* Returns index of the most recently used cache entry computed with the same
+   parameters as KEY (but a different colour table), or -1. */
+static int FindSameParams(cache_key_t const *key)
+{
+	int i;
+	int found = -1;
+	for (i = 0; i < CACHE_SIZE; i++)
+		if (cache[i].kernel != NULL
+		    && memcmp(cache[i].key.params, key->params, sizeof(key->params)) == 0
+		    && (found < 0 || cache[i].last_used > cache[found].last_used))
+			found = i;
+	return found;
+}
+
+/* Returns index of an entry to be filled, other than KEEP. */
+static int NewEntry(int keep)
+{
+	int i;
+	int found = -1;
+	for (i = 0; i < CACHE_SIZE; i++) {
+		if (i == keep)
+			continue;
+		if (cache[i].kernel == NULL) {
+			cache[i].kernel = (atari_ntsc_t*) Util_malloc(sizeof(atari_ntsc_t));
+			return i;
+		}
+		if (found < 0 || cache[i].last_used < cache[found].last_used)
+			found = i;
+	}
+	return found;
+}
+
+/* Reads KERNEL from the cache file, if it was saved there for KEY. */
+static int LoadCacheFile(cache_key_t const *key, atari_ntsc_t *kernel)
+{
+	FILE *fp;
+	char id[sizeof(cache_file_id)];
+	unsigned long size;
+	int result = FALSE;
+	cache_key_t *file_key;
+
+	if (FILTER_NTSC_cache_filename[0] == '\0')
+		return FALSE;
+	fp = fopen(FILTER_NTSC_cache_filename, "rb");
+	if (fp == NULL)
+		return FALSE;
+	file_key = (cache_key_t*) Util_malloc(sizeof(cache_key_t));
+	if (fread(id, sizeof(id), 1, fp) == 1 && memcmp(id, cache_file_id, sizeof(id)) == 0
+	    && fread(&size, sizeof(size), 1, fp) == 1 && size == sizeof(atari_ntsc_t)
+	    && fread(file_key, sizeof(cache_key_t), 1, fp) == 1
+	    && memcmp(file_key, key, sizeof(cache_key_t)) == 0
+	    && fread(kernel, sizeof(atari_ntsc_t), 1, fp) == 1)
+		result = TRUE;
+	free(file_key);
+	fclose(fp);
+	return result;
+}
+
+/* Writes the most recently used kernel to the cache file. */
+static void SaveCacheFile(void)
+{
+	FILE *fp;
+	unsigned long size = sizeof(atari_ntsc_t);
+	int i;
+	int last = -1;
+
+	if (FILTER_NTSC_cache_filename[0] == '\0')
+		return;
+	for (i = 0; i < CACHE_SIZE; i++)
+		if (cache[i].kernel != NULL && (last < 0 || cache[i].last_used > cache[last].last_used))
+			last = i;
+	if (last < 0)
+		return;
+	fp = fopen(FILTER_NTSC_cache_filename, "wb");
+	if (fp == NULL) {
+		Log_print("Cannot write NTSC filter cache file %s", FILTER_NTSC_cache_filename);
+		return;
+	}
+	if (fwrite(cache_file_id, sizeof(cache_file_id), 1, fp) != 1
+	    || fwrite(&size, sizeof(size), 1, fp) != 1
+	    || fwrite(&cache[last].key, sizeof(cache_key_t), 1, fp) != 1
+	    || fwrite(cache[last].kernel, sizeof(atari_ntsc_t), 1, fp) != 1) {
+		Log_print("Error writing NTSC filter cache file %s", FILTER_NTSC_cache_filename);
+		fclose(fp);
+		remove(FILTER_NTSC_cache_filename);
+		return;
+	}
+	fclose(fp);
+}
+
 atari_ntsc_t *FILTER_NTSC_New(void)
 {
 	atari_ntsc_t *filter = (atari_ntsc_t*) Util_malloc(sizeof(atari_ntsc_t));
@@ -58,12 +200,20 @@ atari_ntsc_t *FILTER_NTSC_New(void)
 
 void FILTER_NTSC_Delete(atari_ntsc_t *filter)
 {
+	int i;
 	free(filter);
+	SaveCacheFile();
+	for (i = 0; i < CACHE_SIZE; i++) {
+		free(cache[i].kernel);
+		cache[i].kernel = NULL;
+	}
 }
 
 void FILTER_NTSC_Update(atari_ntsc_t *filter)
 {
 	double yiq_table[768];
+	cache_key_t *key;
+	int entry;
 
 	COLOURS_NTSC_GetYIQ(yiq_table, FILTER_NTSC_setup.burst_phase * M_PI);
 	/* The gamma setting is not used in atari_ntsc (palette generation is
@@ -90,7 +240,33 @@ void FILTER_NTSC_Update(atari_ntsc_t *filter)
 	}
 
 	FILTER_NTSC_setup.yiq_palette = yiq_table;
-	atari_ntsc_init(filter, &FILTER_NTSC_setup);
+
+	key = (cache_key_t*) Util_malloc(sizeof(cache_key_t));
+	MakeKey(key, yiq_table);
+	entry = FindKernel(key);
+	if (entry < 0) {
+		int base = FindSameParams(key);
+		entry = NewEntry(base);
+		if (!LoadCacheFile(key, cache[entry].kernel)) {
+			if (base >= 0) {
+				/* Only the colour table changed - recompute just the
+				   changed colours. */
+				unsigned char changed[atari_ntsc_palette_size];
+				int i;
+				for (i = 0; i < atari_ntsc_palette_size; i++)
+					changed[i] = memcmp(key->yiq_table + 3 * i, cache[base].key.yiq_table + 3 * i,
+					                    3 * sizeof(double)) != 0;
+				memcpy(cache[entry].kernel, cache[base].kernel, sizeof(atari_ntsc_t));
+				atari_ntsc_init_entries(cache[entry].kernel, &FILTER_NTSC_setup, changed);
+			}
+			else
+				atari_ntsc_init(cache[entry].kernel, &FILTER_NTSC_setup);
+		}
+		cache[entry].key = *key;
+	}
+	free(key);
+	cache[entry].last_used = ++cache_clock;
+	memcpy(filter, cache[entry].kernel, sizeof(atari_ntsc_t));
 }
 
 void FILTER_NTSC_RestoreDefaults(void)
@@ -164,6 +340,10 @@ int FILTER_NTSC_ReadConfig(char *option, char *ptr)
 		return Util_sscandouble(ptr, &FILTER_NTSC_setup.bleed);
 	else if (strcmp(option, "FILTER_NTSC_BURST_PHASE") == 0)
 		return Util_sscandouble(ptr, &FILTER_NTSC_setup.burst_phase);
+	else if (strcmp(option, "FILTER_NTSC_CACHE_FILE") == 0) {
+		Util_strlcpy(FILTER_NTSC_cache_filename, ptr, sizeof(FILTER_NTSC_cache_filename));
+		return TRUE;
+	}
 	else
 		return FALSE;
 }
@@ -176,6 +356,7 @@ void FILTER_NTSC_WriteConfig(FILE *fp)
 	fprintf(fp, "FILTER_NTSC_FRINGING=%g\n", FILTER_NTSC_setup.fringing);
 	fprintf(fp, "FILTER_NTSC_BLEED=%g\n", FILTER_NTSC_setup.bleed);
 	fprintf(fp, "FILTER_NTSC_BURST_PHASE=%g\n", FILTER_NTSC_setup.burst_phase);
+	fprintf(fp, "FILTER_NTSC_CACHE_FILE=%s\n", FILTER_NTSC_cache_filename);
 }
 
 int FILTER_NTSC_Initialise(int *argc, char *argv[])
@@ -217,6 +398,11 @@ int FILTER_NTSC_Initialise(int *argc, char *argv[])
 				FILTER_NTSC_setup.burst_phase = atof(argv[++i]);
 			else a_m = TRUE;
 		}
+		else if (strcmp(argv[i], "-ntsc-cache-file") == 0) {
+			if (i_a)
+				Util_strlcpy(FILTER_NTSC_cache_filename, argv[++i], sizeof(FILTER_NTSC_cache_filename));
+			else a_m = TRUE;
+		}
 		else if (strcmp(argv[i], "-ntsc-filter-preset") == 0) {
 			if (i_a) {
 				int idx = CFG_MatchTextParameter(argv[++i], preset_cfg_strings, FILTER_NTSC_PRESET_SIZE);
@@ -237,6 +423,8 @@ int FILTER_NTSC_Initialise(int *argc, char *argv[])
 				Log_print("\t-ntsc-burstphase <n>  Set burst phase (artifact colours) for NTSC filter (default %.2g)", FILTER_NTSC_setup.burst_phase);
 				Log_print("\t-ntsc-filter-preset composite|svideo|rgb|monochrome");
 				Log_print("\t                      Use one of predefined NTSC filter adjustments");
+				Log_print("\t-ntsc-cache-file <file>");
+				Log_print("\t                      Keep last computed NTSC filter in <file>");
 			}
 			argv[j++] = argv[i];
 		}
@@ -23,13 +23,19 @@ extern atari_ntsc_setup_t FILTER_NTSC_setup;
 /* Pointer to the NTSC filter structure. Initialise it by setting it to value
    returned by FILTER_NTSC_New(). */
 extern atari_ntsc_t *FILTER_NTSC_emu;
+/* File in which the last computed filter is saved at FILTER_NTSC_Delete(),
+   so that it need not be computed at the next start. Empty string disables
+   saving. */
+extern char FILTER_NTSC_cache_filename[FILENAME_MAX];
 
 /* Allocates memory for a new NTSC filter. */
 atari_ntsc_t *FILTER_NTSC_New(void);
 /* Frees memory used by an NTSC filter, FILTER. */
 void FILTER_NTSC_Delete(atari_ntsc_t *filter);
 /* Reinitialises an NTSC filter, FILTER. Should be called after changing
-   palette setup or loading/unloading an external palette. */
+   palette setup or loading/unloading an external palette. Recently used
+   filters are cached, and when only the palette changed, only the changed
+   colours are recomputed. */
 void FILTER_NTSC_Update(atari_ntsc_t *filter);
 /* Restores default values for NTSC-filter-specific colour controls.
    FILTER_NTSC_Update should be called afterwards to apply changes. */
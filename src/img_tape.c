@@ -33,28 +33,41 @@
 #include "sio.h"
 #include "util.h"
 
-enum { MAX_BLOCKS = 2048 };
-
 /* Standard record length, needed by ReadRecord() when reading raw files */
 enum { DEFAULT_BUFFER_SIZE = 132 };
 
 /* Baudrate for all written blocks and for reading from raw files. */
 enum { DEFAULT_BAUDRATE = 600 };
 
+/* A "data" or "fsk " chunk of a CAS file */
+typedef struct {
+	ULONG offset; /* Offset of the chunk's data in the image */
+	int length; /* Length of the chunk's data */
+	int gap; /* Length of the IRG before the block, in ms */
+	int baudrate; /* Baudrate of the block */
+	int is_fsk; /* FALSE - chunk's type is "data", otherwise "fsk " */
+} Block;
+
 struct IMG_TAPE_t {
 	FILE *file; /* Stream for reading/writing of the tape image */
 	int isCAS; /* Indicates if the file is in CAS format, or a raw binary file */
-	UBYTE *buffer; /* Holds bytes of the last read or currently written data block */
+	UBYTE *image; /* Contents of the whole file, read when opening it and
+	                 extended with each written record */
+	ULONG image_size; /* Length of the file (up to the last valid chunk) */
+	size_t image_alloc; /* Size of the space allocated for IMAGE */
+	Block *blocks; /* Data blocks of a CAS file, parsed when opening it */
+	int blocks_alloc; /* Size of the space allocated for BLOCKS */
+	UBYTE const *record; /* Bytes of the block being read - in IMAGE, or in BUFFER for raw files */
+	int baudrate; /* Baudrate of the block being read */
+	UBYTE *buffer; /* Holds bytes of the last read raw record or currently written data block */
 	size_t buffer_size; /* Size of the space allocated for BUFFER */
 	ULONG savetime; /* Time elapsed since last byte writing, in CPU ticks */
 	ULONG save_gap; /* Length of the IRG before the currently written block */
 	int next_blockbyte; /* Index of the byte in this block that will be read next (counted from 0) */
 	unsigned int current_block; /* Number of the currently-read/written block (counted from 0) */
 	int block_is_fsk; /* FALSE - current chunk's type  is "data", otherwise "fsk " */
-	int block_length; /* Length of the block currently held in BUFFER */
+	int block_length; /* Length of the block being read or held in BUFFER */
 	int num_blocks; /* Number of data blocks in the whole file */
-	ULONG block_offsets[MAX_BLOCKS]; /* File offsets for each data block*/
-	int block_baudrates[MAX_BLOCKS]; /* Baudrates for each data block in the file */
 	char description[CASSETTE_DESCRIPTION_MAX]; /* Tape description, only for CAS files */
 	int was_writing; /* Indicated if the last operation on the file was writing */
 };
@@ -96,20 +109,44 @@ int IMG_TAPE_FileSupported(UBYTE const start_bytes[4])
 	    && start_bytes[2] == 'J' && start_bytes[3] == 'I';
 }
 
+/* Appends SIZE bytes from DATA to the file's image in memory. */
+static void AppendToImage(IMG_TAPE_t *file, void const *data, size_t size)
+{
+	if (file->image_alloc < file->image_size + size) {
+		/* Enlarge the image at least 2 times. */
+		file->image_alloc *= 2;
+		if (file->image_alloc < file->image_size + size)
+			file->image_alloc = file->image_size + size;
+		file->image = (UBYTE *)Util_realloc(file->image, file->image_alloc);
+	}
+	memcpy(file->image + file->image_size, data, size);
+	file->image_size += size;
+}
+
+/* Adds an entry to the file's array of blocks and returns pointer to it. */
+static Block *AddBlock(IMG_TAPE_t *file)
+{
+	if (file->num_blocks >= file->blocks_alloc) {
+		file->blocks_alloc = file->blocks_alloc == 0 ? 64 : file->blocks_alloc * 2;
+		file->blocks = (Block *)Util_realloc(file->blocks, file->blocks_alloc * sizeof(Block));
+	}
+	return &file->blocks[file->num_blocks++];
+}
+
 /* Write contents of the file's block buffer to file, as a separate record;
    then empty the buffer.
    Returns TRUE on success or FALSE on write error. */
 static int WriteRecord(IMG_TAPE_t *file)
 {
 	CAS_Header header;
-	int result;
+	Block *block;
 
 	/* on a raw file, saving is denied because it can hold
 	    only 1 file and could cause confusion */
 	if (!file->isCAS)
 		return FALSE;
 	/* always append */
-	if (fseek(file->file, file->block_offsets[file->num_blocks], SEEK_SET) != 0)
+	if (fseek(file->file, file->image_size, SEEK_SET) != 0)
 		return FALSE;
 	/* write record header */
 	Util_strncpy(header.identifier, "data", 4);
@@ -117,25 +154,31 @@ static int WriteRecord(IMG_TAPE_t *file)
 	header.length_hi = (file->block_length >> 8) & 0xFF;
 	header.aux_lo = file->save_gap & 0xff;
 	header.aux_hi = (file->save_gap >> 8) & 0xff;
-	if (fwrite(&header, 1, 8, file->file) != 8)
+	/* write record */
+	if (fwrite(&header, 1, 8, file->file) != 8
+	    || fwrite(file->buffer, 1, file->block_length, file->file) != file->block_length)
 		return FALSE;
+	/* Keep the image in memory up to date, so the record can be read back. */
+	AppendToImage(file, &header, 8);
+	block = AddBlock(file);
+	block->offset = file->image_size;
+	block->length = file->block_length;
+	block->gap = file->save_gap;
 	/* Saving is supported only with standard baudrate. */
-	file->block_baudrates[file->num_blocks] = DEFAULT_BAUDRATE;
-	file->num_blocks++;
-	file->block_offsets[file->num_blocks] = file->block_offsets[file->num_blocks - 1] + file->block_length + 8;
+	block->baudrate = DEFAULT_BAUDRATE;
+	block->is_fsk = FALSE;
+	AppendToImage(file, file->buffer, file->block_length);
 	file->current_block = file->num_blocks;
-	/* write record */
-	result = fwrite(file->buffer, 1, file->block_length, file->file) == file->block_length;
-	if (result) {
-		file->save_gap = 0;
-		file->block_length = 0;
-	}
-	return result;
+	file->save_gap = 0;
+	file->block_length = 0;
+	return TRUE;
 }
 
 /* Flush any unwritten data to tape. */
 static int CassetteFlush(IMG_TAPE_t *file)
 {
+	/* If the record can't be written, it is what will be read next. */
+	file->record = file->buffer;
 	if (file->block_length > 0)
 		return WriteRecord(file) && fflush(file->file) == 0;
 	return TRUE;
@@ -144,7 +187,7 @@ static int CassetteFlush(IMG_TAPE_t *file)
 IMG_TAPE_t *IMG_TAPE_Open(char const *filename, int *writable, char const **description)
 {
 	IMG_TAPE_t *img;
-	CAS_Header header;
+	int file_length;
 
 	img = (IMG_TAPE_t *)Util_malloc(sizeof(IMG_TAPE_t));
 	/* Check if the file is writable. If not, recording will be disabled. */
@@ -159,74 +202,85 @@ IMG_TAPE_t *IMG_TAPE_Open(char const *filename, int *writable, char const **desc
 	}
 	img->description[0] = '\0';
 
-	if (fread(&header, 1, 6, img->file) == 6
-		&& header.identifier[0] == 'F'
-		&& header.identifier[1] == 'U'
-		&& header.identifier[2] == 'J'
-		&& header.identifier[3] == 'I') {
+	/* Read the whole file at once - reading and seeking the tape are
+	   then done in memory. */
+	file_length = Util_flen(img->file);
+	if (file_length < 0 || fseek(img->file, 0, SEEK_SET) != 0) {
+		fclose(img->file);
+		free(img);
+		return NULL;
+	}
+	img->image_alloc = file_length > 0 ? file_length : DEFAULT_BUFFER_SIZE;
+	img->image = (UBYTE *)Util_malloc(img->image_alloc);
+	if (fread(img->image, 1, file_length, img->file) != (size_t)file_length) {
+		fclose(img->file);
+		free(img->image);
+		free(img);
+		return NULL;
+	}
+	img->image_size = file_length;
+	img->blocks = NULL;
+	img->blocks_alloc = 0;
+	img->num_blocks = 0;
+
+	if (file_length >= 8 && IMG_TAPE_FileSupported(img->image)) {
 		/* CAS file */
-		UWORD length;
-		UWORD skip;
-		int blocks;
+		ULONG pos;
+		int length;
 		int baudrate = DEFAULT_BAUDRATE;
 
 		img->isCAS = TRUE;
-		fseek(img->file, 2L, SEEK_CUR);	/* ignore the aux bytes */
-
-		/* read or skip file description */
-		skip = length = header.length_lo | (header.length_hi << 8);
-		if (length < CASSETTE_DESCRIPTION_MAX)
-			skip = 0;
-		else
-			skip -= CASSETTE_DESCRIPTION_MAX - 1;
-		if (fread(img->description, 1, length - skip, img->file) < (length - skip)) {
+
+		/* read file description */
+		length = img->image[4] | (img->image[5] << 8);
+		if (8 + length > file_length) {
 			fclose(img->file);
+			free(img->image);
 			free(img);
 			return NULL;
 		}
-		img->description[length - skip] = '\0';
-		fseek(img->file, skip, SEEK_CUR);
-
-		/* count number of blocks */
-		blocks = 0;
-		img->block_baudrates[0] = DEFAULT_BAUDRATE;
-		img->block_offsets[0] = ftell(img->file);
-		for (;;) {
+		if (length > CASSETTE_DESCRIPTION_MAX - 1)
+			length = CASSETTE_DESCRIPTION_MAX - 1;
+		memcpy(img->description, img->image + 8, length);
+		img->description[length] = '\0';
+		length = img->image[4] | (img->image[5] << 8);
+
+		/* parse chunk headers and make a list of data blocks */
+		for (pos = 8 + length; pos + 8 <= img->image_size; pos += 8 + length) {
 			/* chunk header is always 8 bytes */
-			if (fread(&header, 1, 8, img->file) != 8)
+			CAS_Header const *header = (CAS_Header const *)(img->image + pos);
+			length = header->length_lo + (header->length_hi << 8);
+			if (pos + 8 + length > img->image_size)
+				/* truncated chunk */
 				break;
-			length = header.length_lo + (header.length_hi << 8);
-			if (header.identifier[0] == 'b' &&
-			    header.identifier[1] == 'a' &&
-			    header.identifier[2] == 'u' &&
-			    header.identifier[3] == 'd') {
-				baudrate=header.aux_lo + (header.aux_hi << 8);
-				img->block_offsets[blocks] += length + 8;
+			if (header->identifier[0] == 'b' &&
+			    header->identifier[1] == 'a' &&
+			    header->identifier[2] == 'u' &&
+			    header->identifier[3] == 'd') {
+				baudrate = header->aux_lo + (header->aux_hi << 8);
 			}
-			else if ((header.identifier[0] == 'd' &&
-			          header.identifier[1] == 'a' &&
-			          header.identifier[2] == 't' &&
-			          header.identifier[3] == 'a') ||
-			         (header.identifier[0] == 'f' &&
-			          header.identifier[1] == 's' &&
-			          header.identifier[2] == 'k' &&
-			          header.identifier[3] == ' ')) {
-				img->block_baudrates[blocks] = baudrate;
-				if (++blocks >= MAX_BLOCKS) {
-					--blocks;
-					break;
-				}
-				img->block_offsets[blocks] = img->block_offsets[blocks - 1] + length + 8;
+			else if ((header->identifier[0] == 'd' &&
+			          header->identifier[1] == 'a' &&
+			          header->identifier[2] == 't' &&
+			          header->identifier[3] == 'a') ||
+			         (header->identifier[0] == 'f' &&
+			          header->identifier[1] == 's' &&
+			          header->identifier[2] == 'k' &&
+			          header->identifier[3] == ' ')) {
+				Block *block = AddBlock(img);
+				block->offset = pos + 8;
+				block->length = length;
+				block->gap = header->aux_lo + (header->aux_hi << 8);
+				block->baudrate = baudrate;
+				block->is_fsk = header->identifier[0] == 'f';
 			}
-			/* skip possibly present data block */
-			fseek(img->file, length, SEEK_CUR);
 		}
-		img->num_blocks = blocks;
+		/* New records are appended after the last valid chunk. */
+		img->image_size = pos;
 		*description = img->description;
 	}
 	else {
 		/* raw file */
-		int file_length = Util_flen(img->file);
 		img->num_blocks = ((file_length + 127) >> 7) + 1;
 		img->isCAS = FALSE;
 		*writable = FALSE; /* Writing raw files is not supported */
@@ -238,7 +292,9 @@ IMG_TAPE_t *IMG_TAPE_Open(char const *filename, int *writable, char const **desc
 	img->next_blockbyte = 0;
 	img->block_length = 0;
 	img->current_block = 0;
+	img->baudrate = DEFAULT_BAUDRATE;
 	img->buffer = (UBYTE *)Util_malloc((img->buffer_size = DEFAULT_BUFFER_SIZE) * sizeof(UBYTE));
+	img->record = img->buffer;
 	img->was_writing = FALSE;
 
 	return img;
@@ -249,6 +305,8 @@ void IMG_TAPE_Close(IMG_TAPE_t *file)
 	if (file->was_writing)
 		CassetteFlush(file);
 	fclose(file->file);
+	free(file->image);
+	free(file->blocks);
 	free(file->buffer);
 	free(file);
 }
@@ -265,33 +323,39 @@ IMG_TAPE_t *IMG_TAPE_Create(char const *filename, char const *description)
 	if (file == NULL)
 		return NULL;
 
-	/* Write the initial FUJI and baud blocks of the CAS file. */
+	img = (IMG_TAPE_t *)Util_malloc(sizeof(IMG_TAPE_t));
+	img->file = file;
+	img->image_size = 0;
+	img->image_alloc = DEFAULT_BUFFER_SIZE;
+	img->image = (UBYTE *)Util_malloc(img->image_alloc);
+	img->blocks = NULL;
+	img->blocks_alloc = 0;
+
+	/* Compose the initial FUJI and baud blocks of the CAS file. */
 	desc_len = strlen(description);
 	memset(&header, 0, sizeof(header));
-	/* write CAS-header */
+	/* CAS-header */
+	memcpy(header.identifier, "FUJI", 4);
 	header.length_lo = (UBYTE) desc_len;
 	header.length_hi = (UBYTE) (desc_len >> 8);
-	if (fwrite("FUJI", 1, 4, file) != 4
-	    || fwrite(&header.length_lo, 1, 4, file) != 4
-	    || fwrite(description, 1, desc_len, file) != desc_len) {
-		fclose(file);
-		return NULL;
-	}
+	AppendToImage(img, &header, 8);
+	AppendToImage(img, description, desc_len);
 
 	memset(&header, 0, sizeof(header));
 	/* All records are written with 600 baud speed. */
+	memcpy(header.identifier, "baud", 4);
 	header.aux_lo = DEFAULT_BAUDRATE & 0xff;
 	header.aux_hi = DEFAULT_BAUDRATE >> 8;
-	if (fwrite("baud", 1, 4, file) != 4
-	    || fwrite(&header.length_lo, 1, 4, file) != 4) {
+	AppendToImage(img, &header, 8);
+
+	if (fwrite(img->image, 1, img->image_size, file) != img->image_size) {
 		fclose(file);
+		free(img->image);
+		free(img);
 		return NULL;
 	}
 
-	img = (IMG_TAPE_t *)Util_malloc(sizeof(IMG_TAPE_t));
-	img->file = file;
-	if (description != NULL)
-		Util_strlcpy(img->description, description, CASSETTE_DESCRIPTION_MAX);
+	Util_strlcpy(img->description, description, CASSETTE_DESCRIPTION_MAX);
 	img->isCAS = TRUE;
 	img->savetime = 0;
 	img->save_gap = 0;
@@ -299,8 +363,9 @@ IMG_TAPE_t *IMG_TAPE_Create(char const *filename, char const *description)
 	img->block_length = 0;
 	img->current_block = 0;
 	img->num_blocks = 0;
-	img->block_offsets[0] = strlen(description) + 16;
+	img->baudrate = DEFAULT_BAUDRATE;
 	img->buffer = (UBYTE *)Util_malloc((img->buffer_size = DEFAULT_BUFFER_SIZE) * sizeof(UBYTE));
+	img->record = img->buffer;
 	img->was_writing = TRUE;
 
 	return img;
@@ -335,24 +400,16 @@ static int ReadNextRecord(IMG_TAPE_t *file, int *gap)
 	}
 
 	if (file->isCAS) {
-		CAS_Header header;
+		Block const *block;
 
-		if (fseek(file->file, file->block_offsets[file->current_block], SEEK_SET) != 0
-		    || fread(&header, 1, 8, file->file) < 8)
-			return FALSE;
-
-		/* Determine chunk type - can be either "fsk " or "data". */
-		file->block_is_fsk = header.identifier[0] == 'f' &&
-		                     header.identifier[1] == 's' &&
-		                     header.identifier[2] == 'k' &&
-		                     header.identifier[3] == ' ';
-
-		length = header.length_lo + (header.length_hi << 8);
-		*gap = header.aux_lo + (header.aux_hi << 8);
-		/* read block into buffer */
-		EnlargeBuffer(file, length);
-		if (fread(file->buffer, 1, length, file->file) < length)
+		if (file->current_block >= file->num_blocks)
 			return FALSE;
+		block = &file->blocks[file->current_block];
+		file->block_is_fsk = block->is_fsk;
+		file->baudrate = block->baudrate;
+		length = block->length;
+		*gap = block->gap;
+		file->record = file->image + block->offset;
 	}
 	else {
 		file->block_is_fsk = FALSE;
@@ -367,10 +424,12 @@ static int ReadNextRecord(IMG_TAPE_t *file, int *gap)
 			memset(file->buffer + 3, 0, 128);
 		}
 		else {
+			ULONG offset = file->current_block * 128;
 			int bytes;
-			if (fseek(file->file, file->current_block * 128, SEEK_SET) != 0
-			    || (bytes = fread(file->buffer + 3, 1, 128, file->file)) == 0)
+			if (offset >= file->image_size)
 				return FALSE;
+			bytes = file->image_size - offset < 128 ? (int) (file->image_size - offset) : 128;
+			memcpy(file->buffer + 3, file->image + offset, bytes);
 			if (bytes < 128) {
 				file->buffer[2] = 0xfa; /* non-full record */
 				memset(file->buffer + 3 + bytes, 0, 127 - bytes);
@@ -380,6 +439,8 @@ static int ReadNextRecord(IMG_TAPE_t *file, int *gap)
 				file->buffer[2] = 0xfc;	/* full record */
 		}
 		file->buffer[0x83] = SIO_ChkSum(file->buffer, 0x83);
+		file->baudrate = DEFAULT_BAUDRATE;
+		file->record = file->buffer;
 	}
 	file->block_length = length;
 	return TRUE;
@@ -408,17 +469,17 @@ int IMG_TAPE_Read(IMG_TAPE_t *file, unsigned int *duration, int *is_gap, UBYTE *
 
 	if (file->block_is_fsk) {
 		/* Compose a 16-bit word with length of a signal in 1/10 of ms. */
-		unsigned int len = file->buffer[file->next_blockbyte++];
-		len |= ((unsigned int)file->buffer[file->next_blockbyte++]) << 8;
+		unsigned int len = file->record[file->next_blockbyte++];
+		len |= ((unsigned int)file->record[file->next_blockbyte++]) << 8;
 
 		/* Convert len from 1/10ms to CPU ticks. */
 		*duration = len * 178 + len * 9790 / 10000; /* (len * 1789790 / 10000), avoiding overflow */
 		*is_gap = TRUE;
 	} else {
-		*byte = file->buffer[file->next_blockbyte++];
+		*byte = file->record[file->next_blockbyte++];
 		*is_gap = FALSE;
 		/* Next event will be after 10 bits of data gets loaded. */
-		*duration = 10 * 1789790 / (file->isCAS ? file->block_baudrates[file->current_block] : 600);
+		*duration = 10 * 1789790 / file->baudrate;
 	}
 	return TRUE;
 }
@@ -510,8 +571,8 @@ int IMG_TAPE_SerinStatus(IMG_TAPE_t *file, int event_time_left)
 
 		/* exam rate; if time_to_irq < duration of one byte */
 		if (event_time_left <
-			10 * 1789790 / (file->isCAS ? file->block_baudrates[file->current_block] : 600) - 1) {
-			bit = event_time_left / (1789790 / (file->isCAS ? file->block_baudrates[file->current_block] : 600));
+			10 * 1789790 / file->baudrate - 1) {
+			bit = event_time_left / (1789790 / file->baudrate);
 		}
 		else {
 			bit = 0;
@@ -526,7 +587,7 @@ int IMG_TAPE_SerinStatus(IMG_TAPE_t *file, int event_time_left)
 			return 0;
 
 		/* eval tone to return */
-		return (file->buffer[file->next_blockbyte - 1] >> (8 - bit)) & 1;
+		return (file->record[file->next_blockbyte - 1] >> (8 - bit)) & 1;
 	}
 }
 
@@ -544,11 +605,11 @@ int IMG_TAPE_SkipToData(IMG_TAPE_t *file, int ms)
 				   and skipped as a whole. */
 				file->next_blockbyte = file->block_length;
 			} else {
-				int bytes = ms * (file->isCAS ? file->block_baudrates[file->current_block] : 600) / 1000 / 10;
+				int bytes = ms * file->baudrate / 1000 / 10;
 				if (bytes > file->block_length - file->next_blockbyte)
 					bytes = file->block_length - file->next_blockbyte;
 				file->next_blockbyte += bytes;
-				ms -= bytes * 10 * 1000 / (file->isCAS ? file->block_baudrates[file->current_block] : 600);
+				ms -= bytes * 10 * 1000 / file->baudrate;
 			}
 			continue;
 		}
@@ -566,14 +627,13 @@ int IMG_TAPE_SkipToData(IMG_TAPE_t *file, int ms)
 int IMG_TAPE_ReadToMemory(IMG_TAPE_t *file, UWORD dest_addr, int length)
 {
 	int read_length;
+	UBYTE const *record;
 	if (file->was_writing) {
 		CassetteFlush(file);
 		file->was_writing = FALSE;
 	}
 
-	read_length = file->block_length - file->next_blockbyte;
-
-	if (read_length == 0) {
+	if (file->next_blockbyte >= file->block_length) {
 		/* No bytes left in current block, need to read next block. */
 		int gap;
 		if (!ReadNextRecord(file, &gap))
@@ -586,11 +646,35 @@ int IMG_TAPE_ReadToMemory(IMG_TAPE_t *file, UWORD dest_addr, int length)
 		   always cause read failure. */
 		return FALSE;
 
+	read_length = file->block_length - file->next_blockbyte;
+	record = file->record + file->next_blockbyte;
+
 	/* Copy record to memory, excluding the checksum byte if it exists. */
-	MEMORY_CopyToMem(file->buffer + file->next_blockbyte, dest_addr, read_length >= length ? length : read_length);
+	MEMORY_CopyToMem(record, dest_addr, read_length >= length ? length : read_length);
 	file->next_blockbyte += (read_length >= length + 1 ? length + 1 : read_length);
 	return read_length >= length + 1 &&
-	       file->buffer[length] == SIO_ChkSum(file->buffer, length);
+	       record[length] == SIO_ChkSum(record, length);
+}
+
+int IMG_TAPE_AtDataRecord(IMG_TAPE_t *file)
+{
+	unsigned int next_block;
+	if (file->was_writing)
+		return FALSE;
+	if (file->block_length != 0) {
+		if (file->next_blockbyte == 0)
+			/* The block is loaded, but its IRG is still being passed. */
+			return !file->block_is_fsk;
+		if (file->next_blockbyte < file->block_length)
+			/* In the middle of a record. */
+			return FALSE;
+		next_block = file->current_block + 1;
+	}
+	else
+		next_block = file->current_block;
+	if (next_block >= (unsigned int)file->num_blocks)
+		return FALSE;
+	return !file->isCAS || !file->blocks[next_block].is_fsk;
 }
 
 int IMG_TAPE_WriteFromMemory(IMG_TAPE_t *file, UWORD src_addr, int length, int gap)
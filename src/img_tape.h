@@ -91,6 +91,9 @@ int IMG_TAPE_SkipToData(IMG_TAPE_t *file, int ms);
    checksum is correct), FALSE on too short record or bad checksum,
    or -1 on read error/EOF (also implicates too short record). */
 int IMG_TAPE_ReadToMemory(IMG_TAPE_t *file, UWORD dest_addr, int length);
+/* Returns TRUE if no part of the next record has been read yet and the
+   record can be passed to IMG_TAPE_ReadToMemory (it is not an FSK block). */
+int IMG_TAPE_AtDataRecord(IMG_TAPE_t *file);
 /* Writes data from system memory starting at SRC_ADDR of specified LENGTH
    to a tape record. GAP is length of the pre-record gap, in ms.
    Returns TRUE on success or FALSE on write error. */
@@ -64,6 +64,10 @@ int INPUT_joy_block_opposite_directions = 1;
 
 int INPUT_joy_multijoy = 0;
 
+int INPUT_scripted = FALSE;
+int INPUT_script_port[2] = {0xff, 0xff};
+int INPUT_script_trig[4] = {1, 1, 1, 1};
+
 int INPUT_joy_5200_min = 6;
 int INPUT_joy_5200_center = 114;
 int INPUT_joy_5200_max = 220;
@@ -540,7 +544,7 @@ void INPUT_Frame(void)
 		sscanf(gzbuf,"%d ",&i);
 	} else {
 #endif
-		i = PLATFORM_PORT(0);
+		i = INPUT_scripted ? INPUT_script_port[0] : PLATFORM_PORT(0);
 #ifdef EVENT_RECORDING
 	}
 	if (recording) {
@@ -556,7 +560,7 @@ void INPUT_Frame(void)
 		sscanf(gzbuf,"%d ",&i);
 	} else {
 #endif
-		i = PLATFORM_PORT(1);
+		i = INPUT_scripted ? INPUT_script_port[1] : PLATFORM_PORT(1);
 #ifdef EVENT_RECORDING
 	}
 	if (recording) {
@@ -601,7 +605,7 @@ void INPUT_Frame(void)
 
 		} else {
 #endif
-			TRIG_input[i] = PLATFORM_TRIG(i);
+			TRIG_input[i] = INPUT_scripted ? INPUT_script_trig[i] : PLATFORM_TRIG(i);
 #ifdef EVENT_RECORDING
 		}
 		if(recording){
@@ -41,6 +41,13 @@ extern int INPUT_joy_block_opposite_directions;	/* can't move joystick left
 
 extern int INPUT_joy_multijoy;	/* emulate MultiJoy4 interface */
 
+/* When INPUT_scripted is TRUE, INPUT_Frame() takes the joystick ports
+   (as returned by PLATFORM_PORT) and triggers from INPUT_script_port
+   and INPUT_script_trig instead of the platform functions. */
+extern int INPUT_scripted;
+extern int INPUT_script_port[2];
+extern int INPUT_script_trig[4];
+
 /* 5200 joysticks values */
 extern int INPUT_joy_5200_min;
 extern int INPUT_joy_5200_center;
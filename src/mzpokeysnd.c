@@ -24,6 +24,7 @@
 
 #include "config.h"
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #ifdef ASAP /* external project, see http://asap.sf.net */
@@ -33,6 +34,11 @@
 #endif
 #include "mzpokeysnd.h"
 #include "pokeysnd.h"
+#ifdef HAVE_INTTYPES_H
+#include <inttypes.h>
+#else
+typedef long long int64_t;
+#endif
 #include "remez.h"
 #include "antic.h"
 #include "gtia.h"
@@ -61,7 +67,10 @@ static const double pokeymix[61+CONSOLE_VOL] = { /* Nonlinear POKEY mixing array
 
 #define SND_FILTER_SIZE  2048
 
-#define NPOKEYS 2
+/* Maximal output level, see "Master gain and DC offset calculation" below */
+#define MAX_SAMPLE 152
+
+#define NPOKEYS POKEY_MAXPOKEYS
 
 
 /* M_PI was not defined in MSVC headers */
@@ -94,6 +103,8 @@ static const int filter_size_8_8 = 1214;
 /* Flags and quality */
 static int snd_quality = 0;
 
+int MZPOKEYSND_fixed_point = FALSE;
+
 /* Poly tables */
 static int poly4tbl[15];
 static int poly5tbl[31];
@@ -118,6 +129,15 @@ static double ticks_per_sample;
 static double samp_pos;
 #endif /* SYNCHRONIZED_SOUND */
 
+/* The fixed-point resampler keeps output levels with Q_LEVEL_BITS
+   fractional bits, and filter coefficients with Q_FILTER_BITS fractional
+   bits. Their products are summed in 64-bit integers. */
+#define Q_LEVEL_BITS 10
+#define Q_FILTER_BITS 20
+#define Q_SUM_BITS (Q_LEVEL_BITS + Q_FILTER_BITS)
+/* Number of filter phases between two ticks, for synchronized sound. */
+#define Q_PHASES 64
+
 /* State variables for single Pokey Chip */
 typedef struct stPokeyState
 {
@@ -134,6 +154,9 @@ typedef struct stPokeyState
     qev_t qev[1322];
     int qebeg;
     int qeend;
+    /* ovola and qev in fixed point, for the fixed-point resampler */
+    int ovolaq;
+    int qevq[1322];
 
     /* Main divider (64khz/15khz) */
     int mdivk;    /* 28 for 64khz, 114 for 15khz */
@@ -290,6 +313,7 @@ static void ResetPokeyState(PokeyState* ps)
 
     /* Change queue */
     ps->ovola = 0;
+    ps->ovolaq = 0;
     ps->qebeg = 0;
     ps->qeend = 0;
 
@@ -513,9 +537,121 @@ static double interp_read_resam_all(PokeyState* ps, double frac)
 }
 #endif  /* SYNCHRONIZED_SOUND */
 
+/* Fixed-point resampler. It sums the same series as read_resam_all and
+   interp_read_resam_all, but in integers: Q_PHASES precomputed copies of
+   the interpolated filter replace interp_filter_data. */
+static int *filter_q = NULL;
+#ifdef SYNCHRONIZED_SOUND
+static int *filter_phases_q = NULL; /* Q_PHASES+1 filters, each filter_size long */
+#endif
+
+/* Computes filter_q and filter_phases_q from filter_data. Returns FALSE
+   if there is not enough memory. */
+static int init_filter_q(void)
+{
+    int i;
+    filter_q = (int *) malloc(filter_size * sizeof(int));
+    if (filter_q == NULL)
+        return FALSE;
+    for (i = 0; i < filter_size; i++)
+        filter_q[i] = (int) floor(filter_data[i] * (1 << Q_FILTER_BITS) + 0.5);
+#ifdef SYNCHRONIZED_SOUND
+    {
+        int phase;
+        filter_phases_q = (int *) malloc((Q_PHASES + 1) * filter_size * sizeof(int));
+        if (filter_phases_q == NULL) {
+            free(filter_q);
+            filter_q = NULL;
+            return FALSE;
+        }
+        for (phase = 0; phase <= Q_PHASES; phase++)
+            for (i = 0; i < filter_size; i++)
+                filter_phases_q[phase * filter_size + i] = (int) floor(
+                    interp_filter_data(i, (double) phase / Q_PHASES) * (1 << Q_FILTER_BITS) + 0.5);
+    }
+#endif
+    return TRUE;
+}
+
+/* Returns the filtered output level with Q_SUM_BITS fractional bits,
+   computed with filter coefficients FILTER. */
+static int64_t read_resam_all_q(PokeyState* ps, int const *filter)
+{
+    int i = ps->qebeg;
+    int curtick = ps->curtick;
+    int avol, bvol;
+    int64_t sum = 0;
+
+    if (ps->qebeg == ps->qeend)
+        return (int64_t) ps->ovolaq * filter[0]; /* if no events in the queue */
+
+    avol = ps->ovolaq;
+
+    /* Separate two loop cases, for wrap-around and without */
+    if (ps->qeend < ps->qebeg) /* With wrap */
+    {
+        for (; i < filter_size; i++)
+        {
+            bvol = ps->qevq[i];
+            sum += (int64_t) (avol - bvol) * filter[curtick - ps->qet[i]];
+            avol = bvol;
+        }
+        i = 0;
+    }
+
+    /* without wrap */
+    for (; i < ps->qeend; i++)
+    {
+        bvol = ps->qevq[i];
+        sum += (int64_t) (avol - bvol) * filter[curtick - ps->qet[i]];
+        avol = bvol;
+    }
+
+    sum += (int64_t) avol * filter[0];
+    return sum;
+}
+
+/* Dither for the fixed-point resampler: uniform noise of 0.5 LSB
+   amplitude from a xorshift generator. Output has 32 fractional bits. */
+#define DITHER_SEED 2463534242U
+static ULONG dither_state = DITHER_SEED;
+
+static int64_t dither_q(void)
+{
+    ULONG x = dither_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    dither_state = x;
+    return (int64_t) (x >> 1) - 0x40000000;
+}
+
+/* Gains of the 8-bit and 16-bit outputs (see below for their derivation)
+   with 16 fractional bits. */
+static int gain8_q;
+static int gain16_q;
+
+/* Converts a resampled level SUM (Q_SUM_BITS fractional bits) plus
+   integer level EXTRA to an output sample, like the floor() expressions
+   in mzpokeysnd_process_8/16 do for the double-precision resampler.
+   DITHER selects whether to add the dither. */
+static int quantize_q(int64_t sum, int extra, int gain_q, int dither)
+{
+    /* Reduce to 16 fractional bits, so that the product fits in 64 bits. */
+    int64_t level = (sum + (int64_t) (extra * 2 - MAX_SAMPLE) * (1 << (Q_SUM_BITS - 1)))
+                    >> (Q_SUM_BITS - 16);
+    /* Add 0.5 for rounding, in 32 fractional bits. */
+    return (int) ((level * gain_q + ((int64_t) 1 << 31) + (dither ? dither_q() : 0)) >> 32);
+}
+
 static void add_change(PokeyState* ps, qev_t a)
 {
     ps->qev[ps->qeend] = a;
+#ifdef NONLINEAR_MIXING
+    ps->qevq[ps->qeend] = (int) (a * (1 << Q_LEVEL_BITS) + 0.5);
+#else
+    ps->qevq[ps->qeend] = a << Q_LEVEL_BITS;
+#endif
     ps->qet[ps->qeend] = ps->curtick; /*0;*/
     ++ps->qeend;
     if(ps->qeend >= filter_size)
@@ -547,6 +683,7 @@ static void bump_qe_subticks(PokeyState* ps, int subticks)
             if(ps->curtick - ps->qet[i] >= filter_size - 1)
             {
                 ps->ovola = ps->qev[i];
+                ps->ovolaq = ps->qevq[i];
                 ++ps->qebeg;
                 if(ps->qebeg >= filter_size)
                     ps->qebeg = 0;
@@ -565,6 +702,7 @@ static void bump_qe_subticks(PokeyState* ps, int subticks)
         if(ps->curtick - ps->qet[i] >= filter_size - 1)
         {
             ps->ovola = ps->qev[i];
+            ps->ovolaq = ps->qevq[i];
             ++ps->qebeg;
             if(ps->qebeg >= filter_size)
                 ps->qebeg = 0;
@@ -1149,6 +1287,12 @@ static double generate_sample(PokeyState* ps)
     return read_resam_all(ps);
 }
 
+static int64_t generate_sample_q(PokeyState* ps)
+{
+    advance_ticks(ps, pokey_frq/POKEYSND_playback_freq);
+    return read_resam_all_q(ps, filter_q);
+}
+
 /******************************************
  filter table generator by Krzysztof Nikiel
  ******************************************/
@@ -1255,6 +1399,8 @@ found:
 
 static void mzpokeysnd_process_8(void* sndbuffer, int sndn);
 static void mzpokeysnd_process_16(void* sndbuffer, int sndn);
+static void mzpokeysnd_process_8_fixed(void* sndbuffer, int sndn);
+static void mzpokeysnd_process_16_fixed(void* sndbuffer, int sndn);
 static void Update_pokey_sound_mz(UWORD addr, UBYTE val, UBYTE chip, UBYTE gain);
 #ifdef SERIO_SOUND
 static void Update_serio_sound_mz(int out, UBYTE data);
@@ -1320,8 +1466,6 @@ int MZPOKEYSND_Init(ULONG freq17, int playback_freq, UBYTE num_pokeys,
 	POKEYSND_samp_freq=playback_freq;
 #endif  /* VOL_ONLY_SOUND */
 
-	POKEYSND_Process_ptr = (flags & POKEYSND_BIT16) ? mzpokeysnd_process_16 : mzpokeysnd_process_8;
-
     switch(playback_freq)
     {
 #if 0
@@ -1404,6 +1548,22 @@ int MZPOKEYSND_Init(ULONG freq17, int playback_freq, UBYTE num_pokeys,
 	audible_frq = (int ) (cutoff * pokey_frq);
     }
 
+	free(filter_q);
+	filter_q = NULL;
+#ifdef SYNCHRONIZED_SOUND
+	free(filter_phases_q);
+	filter_phases_q = NULL;
+#endif
+	/* Restart the dither, so the output after init is reproducible. */
+	dither_state = DITHER_SEED;
+	if (MZPOKEYSND_fixed_point && init_filter_q()) {
+		gain8_q = (int)(255.0 / MAX_SAMPLE / 4 * M_PI * 0.95 * 65536 + 0.5);
+		gain16_q = (int)(65535.0 / MAX_SAMPLE / 4 * M_PI * 0.95 * 65536 + 0.5);
+		POKEYSND_Process_ptr = (flags & POKEYSND_BIT16) ? mzpokeysnd_process_16_fixed : mzpokeysnd_process_8_fixed;
+	}
+	else
+		POKEYSND_Process_ptr = (flags & POKEYSND_BIT16) ? mzpokeysnd_process_16 : mzpokeysnd_process_8;
+
     build_poly4();
     build_poly5();
     build_poly9();
@@ -1413,8 +1573,9 @@ int MZPOKEYSND_Init(ULONG freq17, int playback_freq, UBYTE num_pokeys,
 	if (clear_regs)
 #endif
 	{
-		ResetPokeyState(pokey_states);
-		ResetPokeyState(pokey_states + 1);
+		int i;
+		for (i = 0; i < NPOKEYS; i++)
+			ResetPokeyState(pokey_states + i);
 	}
 	num_cur_pokeys = num_pokeys;
 
@@ -2306,7 +2467,134 @@ void mzpokeysnd_debugreset(UBYTE chip)
 
  ******************************************************************/
 
-#define MAX_SAMPLE 152
+#ifdef VOL_ONLY_SOUND
+/* Advances POKEYSND_sampout by one output sample. */
+static void update_sampout(void)
+{
+    if( POKEYSND_sampbuf_rptr!=POKEYSND_sampbuf_ptr )
+        { int l;
+        if( POKEYSND_sampbuf_cnt[POKEYSND_sampbuf_rptr]>0 )
+            POKEYSND_sampbuf_cnt[POKEYSND_sampbuf_rptr]-=1280;
+        while(  (l=POKEYSND_sampbuf_cnt[POKEYSND_sampbuf_rptr])<=0 )
+            {	POKEYSND_sampout=POKEYSND_sampbuf_val[POKEYSND_sampbuf_rptr];
+                    POKEYSND_sampbuf_rptr++;
+                    if( POKEYSND_sampbuf_rptr>=POKEYSND_SAMPBUF_MAX )
+                            POKEYSND_sampbuf_rptr=0;
+                    if( POKEYSND_sampbuf_rptr!=POKEYSND_sampbuf_ptr )
+                        {
+                        POKEYSND_sampbuf_cnt[POKEYSND_sampbuf_rptr]+=l;
+                        }
+                    else	break;
+            }
+        }
+}
+#endif
+
+/* Returns TRUE if the output of PS can't change until the next register
+   write: the filter has settled after the last output change, and no
+   channel output depends on the channel counters (all channels are silent
+   or volume-only, or stopped). */
+static int steady_state(PokeyState* ps)
+{
+    if(ps->forcero || ps->qebeg != ps->qeend)
+        return FALSE;
+#ifdef NONLINEAR_MIXING
+    return (ps->c0vo || ps->vol0 == 0) && (ps->c1vo || ps->vol1 == 0)
+        && (ps->c2vo || ps->vol2 == 0) && (ps->c3vo || ps->vol3 == 0);
+#else
+    return ps->c0stop && ps->c1stop && ps->c2stop && ps->c3stop;
+#endif
+}
+
+/* If the output of all chips is steady, stores an output frame (a sample
+   for each chip, 16-bit when BIT16) in FRAME and returns TRUE. With
+   INTERPOLATED (synchronized sound) the frame must be the same at all
+   positions between ticks. The frame is not dithered - dither only adds
+   noise to a constant level. */
+static int steady_frame(UBYTE *frame, int bit16, int interpolated)
+{
+    int i;
+
+    for(i=0; i<num_cur_pokeys; i++)
+    {
+        PokeyState* ps = pokey_states + i;
+        int extra = 0;
+        int lo, hi;
+
+        if(!steady_state(ps))
+            return FALSE;
+#ifdef VOL_ONLY_SOUND
+        if(i == 0 && !interpolated)
+        {
+            if(POKEYSND_sampbuf_rptr != POKEYSND_sampbuf_ptr)
+                return FALSE;
+            extra = POKEYSND_sampout;
+        }
+#endif
+        if(filter_q != NULL)
+        {
+            int const *f0 = filter_q;
+            int const *f1 = filter_q;
+            int gain_q = bit16 ? gain16_q : gain8_q;
+#ifdef SYNCHRONIZED_SOUND
+            if(interpolated)
+            {
+                f0 = filter_phases_q;
+                f1 = filter_phases_q + Q_PHASES * filter_size;
+            }
+#endif
+            lo = quantize_q((int64_t) ps->ovolaq * f0[0], extra, gain_q, FALSE);
+            hi = quantize_q((int64_t) ps->ovolaq * f1[0], extra, gain_q, FALSE);
+        }
+        else
+        {
+            double gain = (bit16 ? 65535.0 : 255.0) / MAX_SAMPLE / 4 * M_PI * 0.95;
+            double l0 = ps->ovola * filter_data[0];
+            double l1 = l0;
+#ifdef SYNCHRONIZED_SOUND
+            if(interpolated)
+            {
+                l0 = ps->ovola * interp_filter_data(0, 0.0);
+                l1 = ps->ovola * interp_filter_data(0, 1.0);
+            }
+#endif
+            lo = (int)floor((l0 + extra - MAX_SAMPLE / 2.0) * gain + 0.5);
+            hi = (int)floor((l1 + extra - MAX_SAMPLE / 2.0) * gain + 0.5);
+        }
+        /* The level is linear in the position, so it is enough to
+           compare its ends. */
+        if(lo != hi)
+            return FALSE;
+        if(bit16)
+        {
+            SWORD sample = (SWORD) lo;
+            memcpy(frame + 2 * i, &sample, 2);
+        }
+        else
+            frame[i] = (UBYTE) (lo + 128);
+    }
+    return TRUE;
+}
+
+/* Fast path of mzpokeysnd_process_*: if the output is steady, fills the
+   remaining NSAM samples of BUFFER with it, advances the chips and
+   returns TRUE. */
+static int process_steady(UBYTE *buffer, int nsam, int bit16)
+{
+    UBYTE frame[2 * NPOKEYS];
+    int frame_size = num_cur_pokeys * (bit16 ? 2 : 1);
+    int frames = nsam / num_cur_pokeys;
+    int i;
+
+    if(!steady_frame(frame, bit16, FALSE))
+        return FALSE;
+    for(i=0; i<frames; i++)
+        memcpy(buffer + i * frame_size, frame, frame_size);
+    for(i=0; i<num_cur_pokeys; i++)
+        advance_ticks(pokey_states + i, frames * (pokey_frq/POKEYSND_playback_freq));
+    POKEYSND_stat_fast_samples += frames * num_cur_pokeys;
+    return TRUE;
+}
 
 static void mzpokeysnd_process_8(void* sndbuffer, int sndn)
 {
@@ -2316,28 +2604,16 @@ static void mzpokeysnd_process_8(void* sndbuffer, int sndn)
 
     if(num_cur_pokeys<1)
         return; /* module was not initialized */
+    POKEYSND_stat_samples += sndn;
 
     /* if there are two pokeys, then the signal is stereo
        we assume even sndn */
     while(nsam >= (int) num_cur_pokeys)
     {
+        if(process_steady((UBYTE *) buffer, nsam, FALSE))
+            break;
 #ifdef VOL_ONLY_SOUND
-        if( POKEYSND_sampbuf_rptr!=POKEYSND_sampbuf_ptr )
-            { int l;
-            if( POKEYSND_sampbuf_cnt[POKEYSND_sampbuf_rptr]>0 )
-                POKEYSND_sampbuf_cnt[POKEYSND_sampbuf_rptr]-=1280;
-            while(  (l=POKEYSND_sampbuf_cnt[POKEYSND_sampbuf_rptr])<=0 )
-                {	POKEYSND_sampout=POKEYSND_sampbuf_val[POKEYSND_sampbuf_rptr];
-                        POKEYSND_sampbuf_rptr++;
-                        if( POKEYSND_sampbuf_rptr>=POKEYSND_SAMPBUF_MAX )
-                                POKEYSND_sampbuf_rptr=0;
-                        if( POKEYSND_sampbuf_rptr!=POKEYSND_sampbuf_ptr )
-                            {
-                            POKEYSND_sampbuf_cnt[POKEYSND_sampbuf_rptr]+=l;
-                            }
-                        else	break;
-                }
-            }
+        update_sampout();
 #endif
 
 #ifdef VOL_ONLY_SOUND
@@ -2365,28 +2641,16 @@ static void mzpokeysnd_process_16(void* sndbuffer, int sndn)
 
     if(num_cur_pokeys<1)
         return; /* module was not initialized */
+    POKEYSND_stat_samples += sndn;
 
     /* if there are two pokeys, then the signal is stereo
        we assume even sndn */
     while(nsam >= (int) num_cur_pokeys)
     {
+        if(process_steady((UBYTE *) buffer, nsam, TRUE))
+            break;
 #ifdef VOL_ONLY_SOUND
-        if( POKEYSND_sampbuf_rptr!=POKEYSND_sampbuf_ptr )
-            { int l;
-            if( POKEYSND_sampbuf_cnt[POKEYSND_sampbuf_rptr]>0 )
-                POKEYSND_sampbuf_cnt[POKEYSND_sampbuf_rptr]-=1280;
-            while(  (l=POKEYSND_sampbuf_cnt[POKEYSND_sampbuf_rptr])<=0 )
-                {	POKEYSND_sampout=POKEYSND_sampbuf_val[POKEYSND_sampbuf_rptr];
-                        POKEYSND_sampbuf_rptr++;
-                        if( POKEYSND_sampbuf_rptr>=POKEYSND_SAMPBUF_MAX )
-                                POKEYSND_sampbuf_rptr=0;
-                        if( POKEYSND_sampbuf_rptr!=POKEYSND_sampbuf_ptr )
-                            {
-                            POKEYSND_sampbuf_cnt[POKEYSND_sampbuf_rptr]+=l;
-                            }
-                        else	break;
-                }
-            }
+        update_sampout();
 #endif
 #ifdef VOL_ONLY_SOUND
         buffer[0] = (SWORD)floor((generate_sample(pokey_states) + POKEYSND_sampout - MAX_SAMPLE / 2.0)
@@ -2405,6 +2669,62 @@ static void mzpokeysnd_process_16(void* sndbuffer, int sndn)
     }
 }
 
+/* Versions of the above for the fixed-point resampler. They keep the
+   same gain, DC offset and dither amplitude. */
+static void mzpokeysnd_process_8_fixed(void* sndbuffer, int sndn)
+{
+    int i;
+    int nsam = sndn;
+    UBYTE *buffer = (UBYTE *) sndbuffer;
+
+    if(num_cur_pokeys<1)
+        return; /* module was not initialized */
+    POKEYSND_stat_samples += sndn;
+
+    while(nsam >= (int) num_cur_pokeys)
+    {
+        if(process_steady((UBYTE *) buffer, nsam, FALSE))
+            break;
+#ifdef VOL_ONLY_SOUND
+        update_sampout();
+        buffer[0] = (UBYTE)(quantize_q(generate_sample_q(pokey_states), POKEYSND_sampout, gain8_q, TRUE) + 128);
+#else
+        buffer[0] = (UBYTE)(quantize_q(generate_sample_q(pokey_states), 0, gain8_q, TRUE) + 128);
+#endif
+        for(i=1; i<num_cur_pokeys; i++)
+            buffer[i] = (UBYTE)(quantize_q(generate_sample_q(pokey_states + i), 0, gain8_q, TRUE) + 128);
+        buffer += num_cur_pokeys;
+        nsam -= num_cur_pokeys;
+    }
+}
+
+static void mzpokeysnd_process_16_fixed(void* sndbuffer, int sndn)
+{
+    int i;
+    int nsam = sndn;
+    SWORD *buffer = (SWORD *) sndbuffer;
+
+    if(num_cur_pokeys<1)
+        return; /* module was not initialized */
+    POKEYSND_stat_samples += sndn;
+
+    while(nsam >= (int) num_cur_pokeys)
+    {
+        if(process_steady((UBYTE *) buffer, nsam, TRUE))
+            break;
+#ifdef VOL_ONLY_SOUND
+        update_sampout();
+        buffer[0] = (SWORD)quantize_q(generate_sample_q(pokey_states), POKEYSND_sampout, gain16_q, TRUE);
+#else
+        buffer[0] = (SWORD)quantize_q(generate_sample_q(pokey_states), 0, gain16_q, TRUE);
+#endif
+        for(i=1; i<num_cur_pokeys; i++)
+            buffer[i] = (SWORD)quantize_q(generate_sample_q(pokey_states + i), 0, gain16_q, TRUE);
+        buffer += num_cur_pokeys;
+        nsam -= num_cur_pokeys;
+    }
+}
+
 #ifdef SYNCHRONIZED_SOUND
 static void generate_sync(unsigned int num_ticks)
 {
@@ -2413,6 +2733,12 @@ static void generate_sync(unsigned int num_ticks)
 	UBYTE *buffer = POKEYSND_process_buffer + POKEYSND_process_buffer_fill;
 	UBYTE *buffer_end = POKEYSND_process_buffer + POKEYSND_process_buffer_length;
 	unsigned int i;
+	int bit16 = POKEYSND_snd_flags & POKEYSND_BIT16;
+	/* Fast path for steady output: the frame and its size in bytes, and
+	   the ticks the chips have to be advanced by */
+	UBYTE steady[2 * NPOKEYS];
+	int steady_size = 0;
+	unsigned int steady_ticks = 0;
 
 	for (;;) {
 		double int_part;
@@ -2429,10 +2755,32 @@ static void generate_sync(unsigned int num_ticks)
 		samp_pos = new_samp_pos;
 		num_ticks -= ticks;
 
+		POKEYSND_stat_samples += num_cur_pokeys;
+		if (steady_size == 0 && steady_frame(steady, bit16, TRUE))
+			steady_size = num_cur_pokeys * (bit16 ? 2 : 1);
+		if (steady_size > 0) {
+			memcpy(buffer, steady, steady_size);
+			buffer += steady_size;
+			steady_ticks += ticks;
+			POKEYSND_stat_fast_samples += num_cur_pokeys;
+			continue;
+		}
+
 		for (i = 0; i < num_cur_pokeys; ++i) {
 			/* advance pokey to the new position and produce a sample */
 			advance_ticks(pokey_states + i, ticks);
-			if (POKEYSND_snd_flags & POKEYSND_BIT16) {
+			if (filter_phases_q != NULL) {
+				int const *filter = filter_phases_q
+					+ (int)(samp_pos * Q_PHASES + 0.5) * filter_size;
+				int64_t sum = read_resam_all_q(pokey_states + i, filter);
+				if (POKEYSND_snd_flags & POKEYSND_BIT16) {
+					*((SWORD *)buffer) = (SWORD)quantize_q(sum, 0, gain16_q, TRUE);
+					buffer += 2;
+				}
+				else
+					*buffer++ = (UBYTE)(quantize_q(sum, 0, gain8_q, TRUE) + 128);
+			}
+			else if (POKEYSND_snd_flags & POKEYSND_BIT16) {
 				*((SWORD *)buffer) = (SWORD)floor(
 					(interp_read_resam_all(pokey_states + i, samp_pos) - MAX_SAMPLE / 2.0)
 					* (65535.0 / MAX_SAMPLE / 4 * M_PI * 0.95)
@@ -2450,8 +2798,9 @@ static void generate_sync(unsigned int num_ticks)
 	}
 
 	POKEYSND_process_buffer_fill = buffer - POKEYSND_process_buffer;
+	num_ticks += steady_ticks;
 	if (num_ticks > 0) {
-		/* remaining ticks */
+		/* remaining ticks, including those skipped by the fast path */
 		for (i = 0; i < num_cur_pokeys; ++i)
 			advance_ticks(pokey_states + i, num_ticks);
 	}
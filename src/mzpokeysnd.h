@@ -3,6 +3,10 @@
 
 #include "atari.h"
 
+/* When TRUE, the sound is resampled in fixed-point arithmetic instead of
+   double precision. Takes effect at the next MZPOKEYSND_Init(). */
+extern int MZPOKEYSND_fixed_point;
+
 int MZPOKEYSND_Init(ULONG freq17,
                         int playback_freq,
                         UBYTE num_pokeys,
@@ -35,13 +35,69 @@
 #include "videomode.h"
 #endif /* SUPPORTS_CHANGE_VIDEOMODE */
 
+/* The unscaled blitters compute lookup indices 8 pixels at a time with SSE2
+   or NEON instructions, when available. */
+#if !defined(PAL_BLENDING_NO_SIMD) && defined(__GNUC__) && defined(__SSE2__)
+#define PAL_BLENDING_SSE2
+#include <emmintrin.h>
+#elif !defined(PAL_BLENDING_NO_SIMD) && defined(__GNUC__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define PAL_BLENDING_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(PAL_BLENDING_SSE2) || defined(PAL_BLENDING_NEON)
+int PAL_BLENDING_simd = TRUE;
+#else
+int PAL_BLENDING_simd = FALSE;
+#endif
+
 static union {
 	UWORD bpp16[2][256];	/* 16-bit palette */
 	ULONG bpp32[2][256];	/* 32-bit palette */
 } palette;
 
+/* A blended pixel depends only on its colour and on the hue of the pixel
+   above it, so all blended colours are computed in advance. Indexed by
+   BLENDED_INDEX(). */
+static union {
+	UWORD bpp16[2][16 * 256];
+	ULONG bpp32[2][16 * 256];
+} blended;
+
+#define BLENDED_INDEX(prev, c) (((prev) & 0xf0) << 4 | (c))
+
 static ULONG shift_mask;
 
+static void UpdateBlended(int bpp)
+{
+	ULONG quad, quad_prev;
+	int odd;
+	int prev;
+	int c;
+	for (odd = 0; odd < 2; odd++)
+		for (prev = 0; prev < 256; prev += 0x10)
+			for (c = 0; c < 256; c++) {
+				/* Make QUAD_PREV have the same Y component as the current line's pixel. */
+				if (bpp == 16) {
+					quad_prev = palette.bpp16[odd ^ 1][prev | (c & 0x0f)];
+					quad = palette.bpp16[odd][c];
+				}
+				else {
+					quad_prev = palette.bpp32[odd ^ 1][prev | (c & 0x0f)];
+					quad = palette.bpp32[odd][c];
+				}
+				/* Since QUAD_PREV and QUAD have the same Y component, computing
+				   averages of even U/V and odd U/V is equal to computing averages
+				   of even and odd RGB components. */
+				/* ((quad+quad_prev) & shift_mask)/2; */
+				quad = (quad & quad_prev) + (((quad ^ quad_prev) & shift_mask) >> 1);
+				if (bpp == 16)
+					blended.bpp16[odd][BLENDED_INDEX(prev, c)] = (UWORD) quad;
+				else
+					blended.bpp32[odd][BLENDED_INDEX(prev, c)] = quad;
+			}
+}
+
 void PAL_BLENDING_UpdateLookup(void)
 {
 	if (ARTIFACT_mode == ARTIFACT_PAL_BLEND) {
@@ -95,81 +151,114 @@ void PAL_BLENDING_UpdateLookup(void)
 			PLATFORM_MapRGB(palette.bpp32[1], odd_pal, 256);
 		}
 		shift_mask = ~shift_mask;
+		UpdateBlended(format.bpp);
 	}
 }
 
+#if defined(PAL_BLENDING_SSE2) || defined(PAL_BLENDING_NEON)
+/* Stores BLENDED_INDEX() of 8 pixels in IDX. */
+static void GetIndices8(UWORD idx[8], UBYTE const *src, UBYTE const *src_prev)
+{
+#ifdef PAL_BLENDING_SSE2
+	__m128i c = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i const *)src), _mm_setzero_si128());
+	__m128i prev = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i const *)src_prev), _mm_setzero_si128());
+	_mm_storeu_si128((__m128i *)idx, _mm_or_si128(c, _mm_slli_epi16(_mm_and_si128(prev, _mm_set1_epi16(0xf0)), 4)));
+#else /* PAL_BLENDING_NEON */
+	uint16x8_t c = vmovl_u8(vld1_u8(src));
+	uint16x8_t prev = vmovl_u8(vld1_u8(src_prev));
+	vst1q_u16(idx, vorrq_u16(c, vshlq_n_u16(vandq_u16(prev, vdupq_n_u16(0xf0)), 4)));
+#endif
+}
+#endif
+
 void PAL_BLENDING_Blit16(ULONG *dest, UBYTE *src, int pitch, int width, int height, int start_odd)
 {
-	register ULONG quad, quad_prev;
-	register UBYTE c;
 	register int pos;
 	UBYTE *src_prev = src;
-	int odd_prev = start_odd ^ 1;
 	int width_32;
 	if (width & 0x01)
 		width_32 = width + 1;
 	else
 		width_32 = width;
 	while (height > 0) {
-		pos = width_32;
-		do {
-			pos--;
-			c = src[pos];
-			/* Make QUAD_PREV have the same Y component as the current line's pixel. */
-			quad_prev = palette.bpp16[odd_prev][(src_prev[pos] & 0xf0) | (c & 0x0f)] << 16;
-			quad = palette.bpp16[start_odd][c] << 16;
-			pos--;
-			c = src[pos];
-			quad_prev |= palette.bpp16[odd_prev][(src_prev[pos] & 0xf0) | (c & 0x0f)];
-			quad |= palette.bpp16[start_odd][c];
-			/* Since QUAD_PREV and QUAD have the same Y component, computing
-			   averages of even U/V and odd U/V is equal to computing averages
-			   of even and odd RGB components. */
-			/* dest[pos >> 1] = ((quad+quad_prev) & shift_mask)/2; */
-			dest[pos >> 1] = (quad & quad_prev) + (((quad ^ quad_prev) & shift_mask) >> 1);
-		} while (pos > 0);
+		UWORD const *blend = blended.bpp16[start_odd];
+		pos = 0;
+#if defined(PAL_BLENDING_SSE2) || defined(PAL_BLENDING_NEON)
+		if (PAL_BLENDING_simd) {
+			UWORD idx[8];
+			for (; pos + 8 <= width_32; pos += 8) {
+				ULONG *d = dest + (pos >> 1);
+				GetIndices8(idx, src + pos, src_prev + pos);
+				d[0] = blend[idx[1]] << 16 | blend[idx[0]];
+				d[1] = blend[idx[3]] << 16 | blend[idx[2]];
+				d[2] = blend[idx[5]] << 16 | blend[idx[4]];
+				d[3] = blend[idx[7]] << 16 | blend[idx[6]];
+			}
+		}
+#endif
+		for (; pos < width_32; pos += 2)
+			dest[pos >> 1] = blend[BLENDED_INDEX(src_prev[pos + 1], src[pos + 1])] << 16
+			                 | blend[BLENDED_INDEX(src_prev[pos], src[pos])];
 		src_prev = src;
 		src += Screen_WIDTH;
 		dest += pitch;
 		height--;
 		start_odd ^= 1;
-		odd_prev ^= 1;
 	}
 }
 
 void PAL_BLENDING_Blit32(ULONG *dest, UBYTE *src, int pitch, int width, int height, int start_odd)
 {
-	register ULONG quad, quad_prev;
-	register UBYTE c;
 	register int pos;
 	UBYTE *src_prev = src;
-	int odd_prev = start_odd ^ 1;
 	while (height > 0) {
-		pos = width;
-		do {
-			pos--;
-			c = src[pos];
-			/* Make QUAD_PREV have the same Y component as the current line's pixel. */
-			quad_prev = palette.bpp32[odd_prev][(src_prev[pos] & 0xf0) | (c & 0x0f)];
-			quad = palette.bpp32[start_odd][c];
-			/* Since QUAD_PREV and QUAD have the same Y component, computing
-			   averages of even U/V and odd U/V is equal to computing averages
-			   of even and odd RGB components. */
-			/* dest[pos] = ((quad+quad_prev) & shift_mask)/2; */
-			dest[pos] = (quad & quad_prev) + (((quad ^ quad_prev) & shift_mask) >> 1);
-		} while (pos > 0);
+		ULONG const *blend = blended.bpp32[start_odd];
+		pos = 0;
+#if defined(PAL_BLENDING_SSE2) || defined(PAL_BLENDING_NEON)
+		if (PAL_BLENDING_simd) {
+			UWORD idx[8];
+			for (; pos + 8 <= width; pos += 8) {
+				ULONG *d = dest + pos;
+				GetIndices8(idx, src + pos, src_prev + pos);
+				d[0] = blend[idx[0]];
+				d[1] = blend[idx[1]];
+				d[2] = blend[idx[2]];
+				d[3] = blend[idx[3]];
+				d[4] = blend[idx[4]];
+				d[5] = blend[idx[5]];
+				d[6] = blend[idx[6]];
+				d[7] = blend[idx[7]];
+			}
+		}
+#endif
+		for (; pos < width; pos++)
+			dest[pos] = blend[BLENDED_INDEX(src_prev[pos], src[pos])];
 		src_prev = src;
 		src += Screen_WIDTH;
 		dest += pitch;
 		height--;
 		start_odd ^= 1;
-		odd_prev ^= 1;
 	}
 }
 
-void PAL_BLENDING_BlitScaled16(ULONG *dest, UBYTE *src, int pitch, int width, int height, int dest_width, int dest_height, int start_odd)
+/* Advances the scaled blitters' source position by NUM_ROWS destination
+   lines. */
+static void SkipScaledRows(UBYTE **src, UBYTE **src_prev, int *y, int dy, int *start_odd, int num_rows)
+{
+	for (; num_rows > 0; num_rows--) {
+		*y -= dy;
+		if (*y < 0) {
+			*y += 0x10000;
+			*src_prev = *src;
+			*src += Screen_WIDTH;
+			*start_odd ^= 1;
+		}
+	}
+}
+
+void PAL_BLENDING_BlitScaledRows16(ULONG *dest, UBYTE *src, int pitch, int width, int height, int dest_width, int dest_height, int start_odd, int first_row, int num_rows)
 {
-	register ULONG quad, quad_prev;
+	register ULONG quad;
 	register int x;
 	int y = 0x10000;
 	int w1 = dest_width / 2 - 1;
@@ -180,46 +269,29 @@ void PAL_BLENDING_BlitScaled16(ULONG *dest, UBYTE *src, int pitch, int width, in
 	int dy = h / dest_height;
 	int init_x = (width << 16) - 0x4000;
 	UBYTE *src_prev = src;
-	int odd_prev = start_odd ^ 1;
-
-	UBYTE c;
 
-	while (dest_height > 0) {
+	SkipScaledRows(&src, &src_prev, &y, dy, &start_odd, first_row);
+	dest += pitch * first_row;
+	while (num_rows > 0) {
+		UWORD const *blend = blended.bpp16[start_odd];
 		x = init_x;
 		pos = w1;
 		while (pos >= 0) {
-			c = src[x >> 16];
-			/* Make QUAD_PREV have the same Y component as the current line's pixel. */
-			quad_prev = palette.bpp16[odd_prev][(src_prev[x >> 16] & 0xf0) | (c & 0x0f)] << 16;
-			quad = palette.bpp16[start_odd][c] << 16;
+			quad = blend[BLENDED_INDEX(src_prev[x >> 16], src[x >> 16])] << 16;
 			x -= dx;
-			c = src[x >> 16];
-			quad_prev |= palette.bpp16[odd_prev][(src_prev[x >> 16] & 0xf0) | (c & 0x0f)];
-			quad |= palette.bpp16[start_odd][c];
+			quad |= blend[BLENDED_INDEX(src_prev[x >> 16], src[x >> 16])];
 			x -= dx;
-			/* Since QUAD_PREV and QUAD have the same Y component, computing
-			   averages of even U/V and odd U/V is equal to computing averages
-			   of even and odd RGB components. */
-			/* dest[pos] = ((quad+quad_prev) & shift_mask)/2; */
-			dest[pos] = (quad & quad_prev) + (((quad ^ quad_prev) & shift_mask) >> 1);
+			dest[pos] = quad;
 			pos--;
 		}
 		dest += pitch;
-		y -= dy;
-		--dest_height;
-		if (y < 0) {
-			y += 0x10000;
-			src_prev = src;
-			src += Screen_WIDTH;
-			start_odd ^= 1;
-			odd_prev ^= 1;
-		}
+		--num_rows;
+		SkipScaledRows(&src, &src_prev, &y, dy, &start_odd, 1);
 	}
 }
 
-void PAL_BLENDING_BlitScaled32(ULONG *dest, UBYTE *src, int pitch, int width, int height, int dest_width, int dest_height, int start_odd)
+void PAL_BLENDING_BlitScaledRows32(ULONG *dest, UBYTE *src, int pitch, int width, int height, int dest_width, int dest_height, int start_odd, int first_row, int num_rows)
 {
-	register ULONG quad, quad_prev;
 	register int x;
 	int y = 0x10000;
 	int w1 = dest_width - 1;
@@ -230,35 +302,30 @@ void PAL_BLENDING_BlitScaled32(ULONG *dest, UBYTE *src, int pitch, int width, in
 	int dy = h / dest_height;
 	int init_x = w - 0x4000;
 	UBYTE *src_prev = src;
-	int odd_prev = start_odd ^ 1;
-
-	UBYTE c;
 
-	while (dest_height > 0) {
+	SkipScaledRows(&src, &src_prev, &y, dy, &start_odd, first_row);
+	dest += pitch * first_row;
+	while (num_rows > 0) {
+		ULONG const *blend = blended.bpp32[start_odd];
 		x = init_x;
 		pos = w1;
 		while (pos >= 0) {
-			c = src[x >> 16];
-			/* Make QUAD_PREV have the same Y component as the current line's pixel. */
-			quad_prev = palette.bpp32[odd_prev][(src_prev[x >> 16] & 0xf0) | (c & 0x0f)];
-			quad = palette.bpp32[start_odd][c];
+			dest[pos] = blend[BLENDED_INDEX(src_prev[x >> 16], src[x >> 16])];
 			x -= dx;
-			/* Since QUAD_PREV and QUAD have the same Y component, computing
-			   averages of even U/V and odd U/V is equal to computing averages
-			   of even and odd RGB components. */
-			/* dest[pos] = ((quad+quad_prev) & shift_mask)/2; */
-			dest[pos] = (quad & quad_prev) + (((quad ^ quad_prev) & shift_mask) >> 1);
 			pos--;
 		}
 		dest += pitch;
-		y -= dy;
-		--dest_height;
-		if (y < 0) {
-			y += 0x10000;
-			src_prev = src;
-			src += Screen_WIDTH;
-			start_odd ^= 1;
-			odd_prev ^= 1;
-		}
+		--num_rows;
+		SkipScaledRows(&src, &src_prev, &y, dy, &start_odd, 1);
 	}
 }
+
+void PAL_BLENDING_BlitScaled16(ULONG *dest, UBYTE *src, int pitch, int width, int height, int dest_width, int dest_height, int start_odd)
+{
+	PAL_BLENDING_BlitScaledRows16(dest, src, pitch, width, height, dest_width, dest_height, start_odd, 0, dest_height);
+}
+
+void PAL_BLENDING_BlitScaled32(ULONG *dest, UBYTE *src, int pitch, int width, int height, int dest_width, int dest_height, int start_odd)
+{
+	PAL_BLENDING_BlitScaledRows32(dest, src, pitch, width, height, dest_width, dest_height, start_odd, 0, dest_height);
+}
@@ -17,4 +17,14 @@ void PAL_BLENDING_BlitScaled16(ULONG *dest, UBYTE *src, int pitch, int width, in
 /* Blit with scaling to a 32-BPP screen. */
 void PAL_BLENDING_BlitScaled32(ULONG *dest, UBYTE *src, int pitch, int width, int height, int dest_width, int dest_height, int start_odd);
 
+/* Same as PAL_BLENDING_BlitScaled16/32, but output only NUM_ROWS rows of
+   the destination image starting at row FIRST_ROW. Rows do not depend on
+   each other, so different rows may be blitted in parallel. */
+void PAL_BLENDING_BlitScaledRows16(ULONG *dest, UBYTE *src, int pitch, int width, int height, int dest_width, int dest_height, int start_odd, int first_row, int num_rows);
+void PAL_BLENDING_BlitScaledRows32(ULONG *dest, UBYTE *src, int pitch, int width, int height, int dest_width, int dest_height, int start_odd, int first_row, int num_rows);
+
+/* TRUE if the blitters use SSE2/NEON instructions. It is TRUE by default
+   if they are compiled in; may be set to FALSE to use the plain C code. */
+extern int PAL_BLENDING_simd;
+
 #endif /* PAL_BLENDING_H_ */
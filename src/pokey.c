@@ -93,12 +93,22 @@ void POKEY_SetRandomCounter(ULONG value)
 	random_scanline_counter = value;
 }
 
+#ifdef STEREO_SOUND
+/* Returns the address bits that select one of the extra POKEY chips. */
+static int ChipSelectMask(void)
+{
+	if (POKEYSND_quad_enabled)
+		return 0x30;
+	return POKEYSND_stereo_enabled ? 0x10 : 0;
+}
+#endif /* STEREO_SOUND */
+
 UBYTE POKEY_GetByte(UWORD addr, int no_side_effects)
 {
 	UBYTE byte = 0xff;
 
 #ifdef STEREO_SOUND
-	if (addr & 0x0010 && POKEYSND_stereo_enabled)
+	if (addr & ChipSelectMask())
 		return 0;
 #endif
 	addr &= 0x0f;
@@ -178,10 +188,50 @@ static int POKEY_siocheck(void)
 #define POKEYSND_Update(addr, val, chip, gain)
 #endif
 
+#ifdef STEREO_SOUND
+/* Writes a register of one of the extra POKEY chips (CHIP >= 1). Only the
+   sound registers are emulated in these chips. */
+static void PutByteExtraChip(int chip, UWORD addr, UBYTE byte)
+{
+	switch (addr) {
+	case POKEY_OFFSET_AUDF1:
+	case POKEY_OFFSET_AUDF2:
+	case POKEY_OFFSET_AUDF3:
+	case POKEY_OFFSET_AUDF4:
+		POKEY_AUDF[(addr >> 1) + chip * 4] = byte;
+		break;
+	case POKEY_OFFSET_AUDC1:
+	case POKEY_OFFSET_AUDC2:
+	case POKEY_OFFSET_AUDC3:
+	case POKEY_OFFSET_AUDC4:
+		POKEY_AUDC[(addr >> 1) + chip * 4] = byte;
+		break;
+	case POKEY_OFFSET_AUDCTL:
+		POKEY_AUDCTL[chip] = byte;
+		/* determine the base multiplier for the 'div by n' calculations */
+		if (byte & POKEY_CLOCK_15)
+			POKEY_Base_mult[chip] = POKEY_DIV_15;
+		else
+			POKEY_Base_mult[chip] = POKEY_DIV_64;
+		break;
+	case POKEY_OFFSET_STIMER:
+	case POKEY_OFFSET_SKCTL:
+		break;
+	default:
+		return;
+	}
+	POKEYSND_Update(addr, byte, (UBYTE) chip, SOUND_GAIN);
+}
+#endif /* STEREO_SOUND */
+
 void POKEY_PutByte(UWORD addr, UBYTE byte)
 {
 #ifdef STEREO_SOUND
-	addr &= POKEYSND_stereo_enabled ? 0x1f : 0x0f;
+	addr &= 0x0f | ChipSelectMask();
+	if (addr >= POKEY_OFFSET_POKEY2) {
+		PutByteExtraChip(addr >> 4, (UWORD) (addr & 0x0f), byte);
+		return;
+	}
 #else
 	addr &= 0x0f;
 #endif
@@ -256,8 +306,6 @@ void POKEY_PutByte(UWORD addr, UBYTE byte)
 #ifdef VOICEBOX
 		VOICEBOX_SEROUTPutByte(byte);
 #endif
-		if ((POKEY_SKCTL & 0x70) == 0x20 && POKEY_siocheck())
-			SIO_PutByte(byte);
 		/* check if cassette 2-tone mode has been enabled */
 		if ((POKEY_SKCTL & 0x08) == 0x00) {
 			/* intelligent device */
@@ -280,6 +328,9 @@ void POKEY_PutByte(UWORD addr, UBYTE byte)
 				POKEY_DELAYED_XMTDONE_IRQ = 0;
 			}
 		};
+		/* after setting the delays - turbo SIO shortens them */
+		if ((POKEY_SKCTL & 0x70) == 0x20 && POKEY_siocheck())
+			SIO_PutByte(byte);
 #ifdef SERIO_SOUND
 		POKEYSND_UpdateSerio(1, byte);
 #endif
@@ -311,56 +362,6 @@ void POKEY_PutByte(UWORD addr, UBYTE byte)
 			/* TODO other registers should also be reset. */
 		}
 		break;
-#ifdef STEREO_SOUND
-	case POKEY_OFFSET_AUDC1 + POKEY_OFFSET_POKEY2:
-		POKEY_AUDC[POKEY_CHAN1 + POKEY_CHIP2] = byte;
-		POKEYSND_Update(POKEY_OFFSET_AUDC1, byte, 1, SOUND_GAIN);
-		break;
-	case POKEY_OFFSET_AUDC2 + POKEY_OFFSET_POKEY2:
-		POKEY_AUDC[POKEY_CHAN2 + POKEY_CHIP2] = byte;
-		POKEYSND_Update(POKEY_OFFSET_AUDC2, byte, 1, SOUND_GAIN);
-		break;
-	case POKEY_OFFSET_AUDC3 + POKEY_OFFSET_POKEY2:
-		POKEY_AUDC[POKEY_CHAN3 + POKEY_CHIP2] = byte;
-		POKEYSND_Update(POKEY_OFFSET_AUDC3, byte, 1, SOUND_GAIN);
-		break;
-	case POKEY_OFFSET_AUDC4 + POKEY_OFFSET_POKEY2:
-		POKEY_AUDC[POKEY_CHAN4 + POKEY_CHIP2] = byte;
-		POKEYSND_Update(POKEY_OFFSET_AUDC4, byte, 1, SOUND_GAIN);
-		break;
-	case POKEY_OFFSET_AUDCTL + POKEY_OFFSET_POKEY2:
-		POKEY_AUDCTL[1] = byte;
-		/* determine the base multiplier for the 'div by n' calculations */
-		if (byte & POKEY_CLOCK_15)
-			POKEY_Base_mult[1] = POKEY_DIV_15;
-		else
-			POKEY_Base_mult[1] = POKEY_DIV_64;
-
-		POKEYSND_Update(POKEY_OFFSET_AUDCTL, byte, 1, SOUND_GAIN);
-		break;
-	case POKEY_OFFSET_AUDF1 + POKEY_OFFSET_POKEY2:
-		POKEY_AUDF[POKEY_CHAN1 + POKEY_CHIP2] = byte;
-		POKEYSND_Update(POKEY_OFFSET_AUDF1, byte, 1, SOUND_GAIN);
-		break;
-	case POKEY_OFFSET_AUDF2 + POKEY_OFFSET_POKEY2:
-		POKEY_AUDF[POKEY_CHAN2 + POKEY_CHIP2] = byte;
-		POKEYSND_Update(POKEY_OFFSET_AUDF2, byte, 1, SOUND_GAIN);
-		break;
-	case POKEY_OFFSET_AUDF3 + POKEY_OFFSET_POKEY2:
-		POKEY_AUDF[POKEY_CHAN3 + POKEY_CHIP2] = byte;
-		POKEYSND_Update(POKEY_OFFSET_AUDF3, byte, 1, SOUND_GAIN);
-		break;
-	case POKEY_OFFSET_AUDF4 + POKEY_OFFSET_POKEY2:
-		POKEY_AUDF[POKEY_CHAN4 + POKEY_CHIP2] = byte;
-		POKEYSND_Update(POKEY_OFFSET_AUDF4, byte, 1, SOUND_GAIN);
-		break;
-	case POKEY_OFFSET_STIMER + POKEY_OFFSET_POKEY2:
-		POKEYSND_Update(POKEY_OFFSET_STIMER, byte, 1, SOUND_GAIN);
-		break;
-	case POKEY_OFFSET_SKCTL + POKEY_OFFSET_POKEY2:
-		POKEYSND_Update(POKEY_OFFSET_SKCTL, byte, 1, SOUND_GAIN);
-		break;
-#endif
 	}
 }
 
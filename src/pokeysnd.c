@@ -24,6 +24,7 @@
 
 #include "config.h"
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #ifdef ASAP /* external project, see http://asap.sf.net */
@@ -38,6 +39,9 @@
 #endif
 #include "mzpokeysnd.h"
 #include "pokeysnd.h"
+#if defined(SOUND) && defined(SYNCHRONIZED_SOUND) && !defined(ASAP) && !defined(__PLUS)
+#include "sound.h"
+#endif
 #if defined(PBI_XLD) || defined (VOICEBOX)
 #include "votraxsnd.h"
 #endif
@@ -158,6 +162,9 @@ int mz_clear_regs = 0;
 #endif
 
 int POKEYSND_enable_new_pokey = TRUE;
+
+unsigned int POKEYSND_stat_samples = 0;
+unsigned int POKEYSND_stat_fast_samples = 0;
 int POKEYSND_bienias_fix = TRUE;  /* when TRUE, high frequencies get emulated: better sound but slower */
 #if defined(__PLUS) && !defined(_WX_)
 #define BIENIAS_FIX (g_Sound.nBieniasFix)
@@ -168,6 +175,25 @@ int POKEYSND_bienias_fix = TRUE;  /* when TRUE, high frequencies get emulated: b
 int POKEYSND_stereo_enabled = FALSE;
 #endif
 
+/* Number of chips generated by the sound engine. It is greater than
+   POKEYSND_num_pokeys when the chips are mixed down to the output channels. */
+static int num_chips = 1;
+
+#ifdef STEREO_SOUND
+int POKEYSND_quad_enabled = FALSE;
+char POKEYSND_quad_mix[POKEY_MAXPOKEYS + 1] = "LRLR";
+
+/* Weight of each chip in each output channel, and sum of the weights of
+   each output channel. */
+static int mix_weight[POKEY_MAXPOKEYS][2];
+static int mix_sum[2];
+/* TRUE if the mix is the default "LRLR" into two channels */
+static int mix_lrlr;
+/* Buffer of the engine output when mixing down in POKEYSND_Process */
+static UBYTE *mix_buffer = NULL;
+static unsigned int mix_buffer_size = 0;
+#endif /* STEREO_SOUND */
+
 /* multiple sound engine interface */
 static void pokeysnd_process_8(void *sndbuffer, int sndn);
 static void pokeysnd_process_16(void *sndbuffer, int sndn);
@@ -277,17 +303,140 @@ static void init_vol_only(void)
 }
 #endif /* VOL_ONLY_SOUND */
 
+#ifdef STEREO_SOUND
+int POKEYSND_SetQuadMix(const char *mix)
+{
+	int i;
+	for (i = 0; i < POKEY_MAXPOKEYS; i++) {
+		if (mix[i] != 'L' && mix[i] != 'R' && mix[i] != 'C')
+			return FALSE;
+	}
+	if (mix[POKEY_MAXPOKEYS] != '\0')
+		return FALSE;
+	strcpy(POKEYSND_quad_mix, mix);
+	return TRUE;
+}
+
+/* Computes the weights of the chips in the output channels. */
+static void init_mix(void)
+{
+	int chip;
+	mix_sum[0] = mix_sum[1] = 0;
+	for (chip = 0; chip < num_chips; chip++) {
+		if (POKEYSND_num_pokeys == 1) {
+			mix_weight[chip][0] = 1;
+			mix_weight[chip][1] = 0;
+		}
+		else {
+			/* A centred chip is heard at half level in both channels. */
+			switch (POKEYSND_quad_mix[chip]) {
+			case 'L':
+				mix_weight[chip][0] = 2;
+				mix_weight[chip][1] = 0;
+				break;
+			case 'R':
+				mix_weight[chip][0] = 0;
+				mix_weight[chip][1] = 2;
+				break;
+			default:
+				mix_weight[chip][0] = 1;
+				mix_weight[chip][1] = 1;
+				break;
+			}
+		}
+		mix_sum[0] += mix_weight[chip][0];
+		mix_sum[1] += mix_weight[chip][1];
+	}
+	mix_lrlr = num_chips == 4 && POKEYSND_num_pokeys == 2
+	           && strcmp(POKEYSND_quad_mix, "LRLR") == 0;
+}
+
+/* Mixes FRAMES frames of num_chips samples from IN down to FRAMES frames
+   of POKEYSND_num_pokeys samples in OUT. OUT may be the same buffer as IN. */
+static void mix_down(const void *in, void *out, int frames)
+{
+	int i;
+	int chip;
+	int ch;
+	if (POKEYSND_snd_flags & POKEYSND_BIT16) {
+		const SWORD *src = (const SWORD *) in;
+		SWORD *dst = (SWORD *) out;
+		if (mix_lrlr) {
+			for (i = 0; i < frames; i++) {
+				int l = (src[0] + src[2]) / 2;
+				int r = (src[1] + src[3]) / 2;
+				dst[0] = (SWORD) l;
+				dst[1] = (SWORD) r;
+				src += 4;
+				dst += 2;
+			}
+			return;
+		}
+		for (i = 0; i < frames; i++) {
+			int acc[2] = {0, 0};
+			for (chip = 0; chip < num_chips; chip++) {
+				acc[0] += mix_weight[chip][0] * src[chip];
+				acc[1] += mix_weight[chip][1] * src[chip];
+			}
+			for (ch = 0; ch < POKEYSND_num_pokeys; ch++)
+				dst[ch] = (SWORD) (mix_sum[ch] == 0 ? 0 : acc[ch] / mix_sum[ch]);
+			src += num_chips;
+			dst += POKEYSND_num_pokeys;
+		}
+	}
+	else {
+		const UBYTE *src = (const UBYTE *) in;
+		UBYTE *dst = (UBYTE *) out;
+		if (mix_lrlr) {
+			for (i = 0; i < frames; i++) {
+				int l = (src[0] + src[2] - 2 * 0x80) / 2;
+				int r = (src[1] + src[3] - 2 * 0x80) / 2;
+				dst[0] = (UBYTE) (l + 0x80);
+				dst[1] = (UBYTE) (r + 0x80);
+				src += 4;
+				dst += 2;
+			}
+			return;
+		}
+		for (i = 0; i < frames; i++) {
+			int acc[2] = {0, 0};
+			for (chip = 0; chip < num_chips; chip++) {
+				acc[0] += mix_weight[chip][0] * (src[chip] - 0x80);
+				acc[1] += mix_weight[chip][1] * (src[chip] - 0x80);
+			}
+			for (ch = 0; ch < POKEYSND_num_pokeys; ch++)
+				dst[ch] = (UBYTE) ((mix_sum[ch] == 0 ? 0 : acc[ch] / mix_sum[ch]) + 0x80);
+			src += num_chips;
+			dst += POKEYSND_num_pokeys;
+		}
+	}
+}
+#endif /* STEREO_SOUND */
+
 int POKEYSND_DoInit(void)
 {
-	SndSave_CloseSoundFile();
+#if defined(SOUND) && defined(SYNCHRONIZED_SOUND) && !defined(ASAP) && !defined(__PLUS)
+	/* A headless capture keeps its format when sound is reinitialised (see
+	   Sound_Setup), so it continues in the same file. */
+	if (!Sound_headless)
+#endif
+		SndSave_CloseSoundFile();
 
 #ifdef VOL_ONLY_SOUND
 	init_vol_only();
 #endif /* VOL_ONLY_SOUND */
 
+	num_chips = POKEYSND_num_pokeys;
+#ifdef STEREO_SOUND
+	/* Only the new engine emulates more than two chips. */
+	if (POKEYSND_quad_enabled && POKEYSND_enable_new_pokey)
+		num_chips = POKEY_MAXPOKEYS;
+	init_mix();
+#endif
+
 	if (POKEYSND_enable_new_pokey)
 		return MZPOKEYSND_Init(snd_freq17, POKEYSND_playback_freq,
-				POKEYSND_num_pokeys, POKEYSND_snd_flags, mz_quality
+				(UBYTE) num_chips, POKEYSND_snd_flags, mz_quality
 #ifdef __PLUS
 				, mz_clear_regs
 #endif
@@ -320,7 +469,13 @@ int POKEYSND_Init(ULONG freq17, int playback_freq, UBYTE num_pokeys,
 		unsigned int ticks_per_frame = Atari800_tv_mode*114;
 		unsigned int max_ticks_per_frame = ticks_per_frame + surplus_ticks;
 		double ticks_per_sample = (double)ticks_per_frame / samples_per_frame;
-		POKEYSND_process_buffer_length = POKEYSND_num_pokeys * (unsigned int)ceil((double)max_ticks_per_frame / ticks_per_sample) * ((POKEYSND_snd_flags & POKEYSND_BIT16) ? 2:1);
+		/* Room for all chips, as they are mixed down in the buffer. */
+		unsigned int chips = POKEYSND_num_pokeys;
+#ifdef STEREO_SOUND
+		if (POKEYSND_quad_enabled)
+			chips = POKEY_MAXPOKEYS;
+#endif
+		POKEYSND_process_buffer_length = chips * (unsigned int)ceil((double)max_ticks_per_frame / ticks_per_sample) * ((POKEYSND_snd_flags & POKEYSND_BIT16) ? 2:1);
 		free(POKEYSND_process_buffer);
 		POKEYSND_process_buffer = (UBYTE *)Util_malloc(POKEYSND_process_buffer_length);
 		POKEYSND_process_buffer_fill = 0;
@@ -341,6 +496,19 @@ void POKEYSND_SetMzQuality(int quality)	/* specially for win32, perhaps not need
 
 void POKEYSND_Process(void *sndbuffer, int sndn)
 {
+#ifdef STEREO_SOUND
+	if (num_chips != POKEYSND_num_pokeys) {
+		int frames = sndn / POKEYSND_num_pokeys;
+		unsigned int size = frames * num_chips * ((POKEYSND_snd_flags & POKEYSND_BIT16) ? 2 : 1);
+		if (size > mix_buffer_size) {
+			mix_buffer = (UBYTE *) Util_realloc(mix_buffer, size);
+			mix_buffer_size = size;
+		}
+		POKEYSND_Process_ptr(mix_buffer, frames * num_chips);
+		mix_down(mix_buffer, sndbuffer, frames);
+	}
+	else
+#endif
 	POKEYSND_Process_ptr(sndbuffer, sndn);
 #if defined(PBI_XLD) || defined (VOICEBOX)
 	VOTRAXSND_Process(sndbuffer,sndn);
@@ -363,6 +531,13 @@ int POKEYSND_UpdateProcessBuffer(void)
 	Update_synchronized_sound();
 	sndn = POKEYSND_process_buffer_fill / ((POKEYSND_snd_flags & POKEYSND_BIT16) ? 2 : 1);
 	POKEYSND_process_buffer_fill = 0;
+#ifdef STEREO_SOUND
+	if (num_chips != POKEYSND_num_pokeys) {
+		int frames = sndn / num_chips;
+		mix_down(POKEYSND_process_buffer, POKEYSND_process_buffer, frames);
+		sndn = frames * POKEYSND_num_pokeys;
+	}
+#endif
 
 #if defined(PBI_XLD) || defined (VOICEBOX)
 	VOTRAXSND_Process(POKEYSND_process_buffer, sndn);
@@ -465,7 +640,8 @@ void POKEYSND_Update(UWORD addr, UBYTE val, UBYTE chip, UBYTE gain)
 #ifdef SYNCHRONIZED_SOUND
     Update_synchronized_sound();
 #endif /* SYNCHRONIZED_SOUND */
-	POKEYSND_Update_ptr(addr, val, chip, gain);
+	if (chip < num_chips)
+		POKEYSND_Update_ptr(addr, val, chip, gain);
 }
 
 static void Update_pokey_sound_rf(UWORD addr, UBYTE val, UBYTE chip,
@@ -730,6 +906,40 @@ static void Update_pokey_sound_rf(UWORD addr, UBYTE val, UBYTE chip,
 /*                                                                           */
 /*****************************************************************************/
 
+/* Returns TRUE if the next FRAMES output frames can't contain a channel
+   event or a change of volume-only output, ie. all of them except for
+   the first one (which may be interpolated) are identical. */
+static int steady_rf(int frames)
+{
+	ULONG samp_cnt_w;
+	ULONG last_sample;
+	int chan;
+
+#ifdef VOL_ONLY_SOUND
+	if (POKEYSND_sampbuf_rptr != POKEYSND_sampbuf_ptr)
+		return FALSE;
+#ifdef STEREO_SOUND
+	if (sampbuf_rptr2 != sampbuf_ptr2)
+		return FALSE;
+#endif
+#endif /* VOL_ONLY_SOUND */
+
+#ifdef WORDS_BIGENDIAN
+	samp_cnt_w = READ_U32((UBYTE *) (&Samp_n_cnt[0]) + 3);
+#else
+	samp_cnt_w = READ_U32((UBYTE *) (&Samp_n_cnt[0]) + 1);
+#endif
+	if (samp_cnt_w >= 0x40000000)
+		return FALSE;
+	/* Whole part of the sample counter at the last sample event, rounded up. */
+	last_sample = samp_cnt_w + (ULONG) ((double) (frames - 1) * Samp_n_max / 256) + 1;
+	/* A channel event happens when its counter is not above the sample counter. */
+	for (chan = 0; chan < 4 * Num_pokeys; chan++)
+		if (Div_n_cnt[chan] <= last_sample)
+			return FALSE;
+	return TRUE;
+}
+
 static void pokeysnd_process_8(void *sndbuffer, int sndn)
 {
 	register UBYTE *buffer = (UBYTE *) sndbuffer;
@@ -756,6 +966,35 @@ static void pokeysnd_process_8(void *sndbuffer, int sndn)
 	register UBYTE count;
 	register UBYTE *vol_ptr;
 
+	/* Size of an output frame */
+	int frame = 1;
+#ifdef STEREO_SOUND
+#ifdef __PLUS
+	if (POKEYSND_stereo_enabled)
+#endif
+	if (Num_pokeys > 1)
+		frame = 2;
+#endif
+
+	/* Fast path: when no channel changes its output in the whole buffer
+	   (eg. all are silent or volume-only), generate two frames as usual
+	   and repeat the second one. */
+	if (sndn > 2 * frame && sndn % frame == 0 && steady_rf(sndn / frame)) {
+		int i;
+		pokeysnd_process_8(buffer, 2 * frame);
+		for (i = 2 * frame; i < sndn; i++)
+			buffer[i] = buffer[i - frame];
+#ifdef WORDS_BIGENDIAN
+		*(Samp_n_cnt + 1) += Samp_n_max * (ULONG) (sndn / frame - 2);
+#else
+		*Samp_n_cnt += Samp_n_max * (ULONG) (sndn / frame - 2);
+#endif
+		POKEYSND_stat_samples += sndn - 2 * frame;
+		POKEYSND_stat_fast_samples += sndn - 2 * frame;
+		return;
+	}
+	POKEYSND_stat_samples += sndn;
+
 	/* set a pointer to the whole portion of the samp_n_cnt */
 #ifdef WORDS_BIGENDIAN
 	samp_cnt_w_ptr = ((UBYTE *) (&Samp_n_cnt[0]) + 3);
@@ -1272,7 +1511,10 @@ static void Generate_sync_rf(unsigned int num_ticks)
 	unsigned int ticks;
 	UBYTE *buffer = POKEYSND_process_buffer + POKEYSND_process_buffer_fill;
 	UBYTE *buffer_end = POKEYSND_process_buffer + POKEYSND_process_buffer_length;
+	int samples = 0;
 
+	/* Time in this engine advances only with output samples, so all
+	   samples are generated with one call. */
 	for (;;) {
 		double int_part;
 		new_samp_pos = samp_pos + ticks_per_sample;
@@ -1288,17 +1530,19 @@ static void Generate_sync_rf(unsigned int num_ticks)
 		samp_pos = new_samp_pos;
 		num_ticks -= ticks;
 
-		if (POKEYSND_snd_flags & POKEYSND_BIT16) {
-			pokeysnd_process_16(buffer, POKEYSND_num_pokeys);
+		samples += POKEYSND_num_pokeys;
+		if (POKEYSND_snd_flags & POKEYSND_BIT16)
 			buffer += 2 * POKEYSND_num_pokeys;
-		}
-		else {
-			pokeysnd_process_8(buffer, POKEYSND_num_pokeys);
+		else
 			buffer += POKEYSND_num_pokeys;
-		}
-
 	}
 
+	if (samples > 0) {
+		if (POKEYSND_snd_flags & POKEYSND_BIT16)
+			pokeysnd_process_16(POKEYSND_process_buffer + POKEYSND_process_buffer_fill, samples);
+		else
+			pokeysnd_process_8(POKEYSND_process_buffer + POKEYSND_process_buffer_fill, samples);
+	}
 	POKEYSND_process_buffer_fill = buffer - POKEYSND_process_buffer;
 }
 #endif /* SYNCHRONIZED_SOUND */
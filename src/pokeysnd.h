@@ -91,6 +91,17 @@ extern int POKEYSND_serio_sound_enabled;
 extern int POKEYSND_console_sound_enabled;
 extern int POKEYSND_bienias_fix;
 
+#ifdef STEREO_SOUND
+/* When TRUE, four chips are emulated at $D200, $D210, $D220 and $D230
+   (only with the new POKEY engine) and mixed down to the output channels.
+   POKEYSND_quad_mix places each chip in the stereo image: 'L' left,
+   'R' right or 'C' centre. Both take effect at the next POKEYSND_Init. */
+extern int POKEYSND_quad_enabled;
+extern char POKEYSND_quad_mix[POKEY_MAXPOKEYS + 1];
+/* Sets POKEYSND_quad_mix. Returns FALSE if MIX is not valid. */
+int POKEYSND_SetQuadMix(const char *mix);
+#endif
+
 extern void (*POKEYSND_Process_ptr)(void *sndbuffer, int sndn);
 extern void (*POKEYSND_Update_ptr)(UWORD addr, UBYTE val, UBYTE chip, UBYTE gain);
 extern void (*POKEYSND_UpdateSerio)(int out, UBYTE data);
@@ -113,6 +124,12 @@ void POKEYSND_Process(void *sndbuffer, int sndn);
 int POKEYSND_DoInit(void);
 void POKEYSND_SetMzQuality(int quality);
 
+/* Statistics of the sound engines: number of output samples generated,
+   and how many of them were produced by the fast path for silent or
+   steady output. The caller may reset them, eg. every frame. */
+extern unsigned int POKEYSND_stat_samples;
+extern unsigned int POKEYSND_stat_fast_samples;
+
 /* Volume only emulations declarations */
 #ifdef VOL_ONLY_SOUND
 
@@ -47,6 +47,7 @@
 #include "log.h"
 #include "platform.h"
 #include "pokey.h"
+#include "sdl/ntsc_threads.h"
 #include "sdl/video.h"
 #include "ui.h"
 #include "util.h"
@@ -522,6 +523,8 @@ int PLATFORM_Keyboard(void)
 				return AKEY_NONE;
 			default:
 				if(FILTER_NTSC_emu != NULL){
+					/* The filter may be in use by NTSC worker threads. */
+					SDL_NTSC_THREADS_Wait();
 					switch(lastkey){
 					case SDLK_7:
 						if (kbhits[SDLK_LSHIFT]) {
@@ -0,0 +1,377 @@
+/*
+ * sdl/ntsc_threads.c - SDL library specific port code - multithreaded NTSC filter
+ *
+ * Copyright (C) 2016 Atari800 development team (see DOC/CREDITS)
+ *
+ * This file is part of the Atari800 emulator project which emulates
+ * the Atari 400, 800, 800XL, 130XE, and 5200 8-bit computers.
+ *
+ * Atari800 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Atari800 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atari800; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <SDL.h>
+
+#include "atari.h"
+#include "log.h"
+#include "util.h"
+
+#include "sdl/ntsc_threads.h"
+
+/* atari_ntsc filters each row independently of the others, so the rows
+   of a frame can be split into horizontal bands and filtered in parallel
+   without affecting the output in any way. The same worker threads also
+   run other banded jobs, see SDL_NTSC_THREADS_RunBands(). */
+
+int SDL_NTSC_THREADS_num = 0;
+int SDL_NTSC_THREADS_async = FALSE;
+
+typedef struct band_t {
+	SDL_Thread *thread;
+	/* Posted by the emulation thread when the band's parameters are set. */
+	SDL_sem *start;
+	ATARI_NTSC_IN_T const *in;
+	UBYTE *out;
+	int first_row;
+	int height;
+} band_t;
+
+static band_t bands[SDL_NTSC_THREADS_MAX];
+/* Number of currently running worker threads. */
+static int num_workers = 0;
+/* Posted by a worker thread after it finished its band. */
+static SDL_sem *done_sem = NULL;
+static int quit_workers = FALSE;
+
+/* Parameters of the current job, common for all bands. */
+static SDL_NTSC_THREADS_blit_t job_blit;
+static atari_ntsc_t const *job_ntsc;
+static long job_in_row_width;
+static int job_in_width;
+static long job_out_pitch;
+/* If not NULL, the job is a SDL_NTSC_THREADS_RunBands() call. */
+static SDL_NTSC_THREADS_band_t job_band_func = NULL;
+static void *job_band_arg;
+
+/* Number of bands of an asynchronous job that are still being filtered. */
+static int pending_bands = 0;
+
+/* Copy of the Atari screen being filtered asynchronously, and the filter's
+   output for it. */
+static ATARI_NTSC_IN_T *async_in = NULL;
+static UBYTE *async_out = NULL;
+static size_t async_in_size = 0;
+static size_t async_out_size = 0;
+/* TRUE if async_out contains a frame (or will, after SDL_NTSC_THREADS_Wait). */
+static int async_ready = FALSE;
+/* Parameters with which the frame in async_out was generated. */
+static SDL_NTSC_THREADS_blit_t async_blit;
+static atari_ntsc_t const *async_ntsc;
+static int async_in_width;
+static int async_in_height;
+static int async_bytes_per_pixel;
+
+static int Worker(void *data)
+{
+	band_t *band = (band_t *)data;
+	for (;;) {
+		SDL_SemWait(band->start);
+		if (quit_workers)
+			break;
+		if (job_band_func != NULL)
+			(*job_band_func)(job_band_arg, band->first_row, band->height);
+		else
+			(*job_blit)(job_ntsc, band->in, job_in_row_width, job_in_width,
+			            band->height, band->out, job_out_pitch);
+		SDL_SemPost(done_sem);
+	}
+	return 0;
+}
+
+static void StopWorkers(void)
+{
+	int i;
+	SDL_NTSC_THREADS_Wait();
+	quit_workers = TRUE;
+	for (i = 0; i < num_workers; i++)
+		SDL_SemPost(bands[i].start);
+	for (i = 0; i < num_workers; i++) {
+		SDL_WaitThread(bands[i].thread, NULL);
+		SDL_DestroySemaphore(bands[i].start);
+	}
+	quit_workers = FALSE;
+	num_workers = 0;
+	if (done_sem != NULL) {
+		SDL_DestroySemaphore(done_sem);
+		done_sem = NULL;
+	}
+}
+
+/* Starts NUM worker threads. Returns the number of threads actually
+   started. */
+static int StartWorkers(int num)
+{
+	StopWorkers();
+	if (num <= 0)
+		return 0;
+	if (num > SDL_NTSC_THREADS_MAX)
+		num = SDL_NTSC_THREADS_MAX;
+	done_sem = SDL_CreateSemaphore(0);
+	if (done_sem == NULL) {
+		Log_print("Cannot create NTSC filter semaphore: %s", SDL_GetError());
+		return 0;
+	}
+	for (num_workers = 0; num_workers < num; num_workers++) {
+		band_t *band = &bands[num_workers];
+		band->start = SDL_CreateSemaphore(0);
+		if (band->start == NULL)
+			break;
+		band->thread = SDL_CreateThread(&Worker, band);
+		if (band->thread == NULL) {
+			SDL_DestroySemaphore(band->start);
+			break;
+		}
+	}
+	if (num_workers < num)
+		Log_print("Cannot start NTSC filter threads: %s", SDL_GetError());
+	return num_workers;
+}
+
+/* Splits HEIGHT rows into NUM_BANDS bands and hands the first NUM bands to
+   the worker threads. Job parameters must be set beforehand; IN and OUT
+   are not used by SDL_NTSC_THREADS_RunBands() jobs. */
+static void StartBands(ATARI_NTSC_IN_T const *in, UBYTE *out, int height, int num_bands, int num)
+{
+	int i;
+	for (i = 0; i < num; i++) {
+		int y0 = height * i / num_bands;
+		int y1 = height * (i + 1) / num_bands;
+		if (job_band_func == NULL) {
+			bands[i].in = in + y0 * job_in_row_width;
+			bands[i].out = out + y0 * job_out_pitch;
+		}
+		bands[i].first_row = y0;
+		bands[i].height = y1 - y0;
+		SDL_SemPost(bands[i].start);
+	}
+}
+
+static void WaitBands(int num)
+{
+	for (; num > 0; num--)
+		SDL_SemWait(done_sem);
+}
+
+static void SetJob(SDL_NTSC_THREADS_blit_t blit_func, atari_ntsc_t const *ntsc,
+                   long in_row_width, int in_width, long out_pitch)
+{
+	job_band_func = NULL;
+	job_blit = blit_func;
+	job_ntsc = ntsc;
+	job_in_row_width = in_row_width;
+	job_in_width = in_width;
+	job_out_pitch = out_pitch;
+}
+
+/* Filters the frame with all worker threads and the calling thread, and
+   returns when the whole frame is done. */
+static void BlitParallel(SDL_NTSC_THREADS_blit_t blit_func, atari_ntsc_t const *ntsc,
+                         ATARI_NTSC_IN_T const *atari_in, long in_row_width,
+                         int in_width, int in_height, void *rgb_out, long out_pitch)
+{
+	int y0 = in_height * num_workers / (num_workers + 1);
+	SetJob(blit_func, ntsc, in_row_width, in_width, out_pitch);
+	StartBands(atari_in, (UBYTE *)rgb_out, in_height, num_workers + 1, num_workers);
+	/* The last band is done by the calling thread. */
+	(*blit_func)(ntsc, atari_in + y0 * in_row_width, in_row_width, in_width,
+	             in_height - y0, (UBYTE *)rgb_out + y0 * out_pitch, out_pitch);
+	WaitBands(num_workers);
+}
+
+static void BlitAsync(SDL_NTSC_THREADS_blit_t blit_func, atari_ntsc_t const *ntsc,
+                      ATARI_NTSC_IN_T const *atari_in, long in_row_width,
+                      int in_width, int in_height, void *rgb_out, long out_pitch,
+                      int bytes_per_pixel)
+{
+	long row_bytes = ATARI_NTSC_OUT_WIDTH(in_width) * bytes_per_pixel;
+	int y;
+
+	SDL_NTSC_THREADS_Wait();
+	if (async_ready && async_blit == blit_func && async_ntsc == ntsc
+	    && async_in_width == in_width && async_in_height == in_height
+	    && async_bytes_per_pixel == bytes_per_pixel) {
+		/* Output the previous frame, filtered in the background. */
+		for (y = 0; y < in_height; y++)
+			memcpy((UBYTE *)rgb_out + y * out_pitch, async_out + y * row_bytes, row_bytes);
+	}
+	else
+		/* No previous frame with matching parameters - filter the current
+		   one immediately so the screen is never left blank. */
+		BlitParallel(blit_func, ntsc, atari_in, in_row_width, in_width, in_height, rgb_out, out_pitch);
+
+	/* Snapshot the current frame, as the emulation thread will overwrite
+	   Screen_atari while the workers are filtering it. */
+	if (async_in_size < (size_t)in_width * in_height) {
+		async_in_size = (size_t)in_width * in_height;
+		async_in = (ATARI_NTSC_IN_T *)Util_realloc(async_in, async_in_size * sizeof(ATARI_NTSC_IN_T));
+	}
+	if (async_out_size < (size_t)row_bytes * in_height) {
+		async_out_size = (size_t)row_bytes * in_height;
+		async_out = (UBYTE *)Util_realloc(async_out, async_out_size);
+	}
+	for (y = 0; y < in_height; y++)
+		memcpy(async_in + y * in_width, atari_in + y * in_row_width, in_width * sizeof(ATARI_NTSC_IN_T));
+
+	async_blit = blit_func;
+	async_ntsc = ntsc;
+	async_in_width = in_width;
+	async_in_height = in_height;
+	async_bytes_per_pixel = bytes_per_pixel;
+	async_ready = TRUE;
+
+	SetJob(blit_func, ntsc, in_width, in_width, row_bytes);
+	StartBands(async_in, async_out, in_height, num_workers, num_workers);
+	pending_bands = num_workers;
+}
+
+/* Starts or stops worker threads after SDL_NTSC_THREADS_num changed. */
+static void UpdateWorkers(void)
+{
+	if (SDL_NTSC_THREADS_num != num_workers) {
+		SDL_NTSC_THREADS_num = StartWorkers(SDL_NTSC_THREADS_num);
+		async_ready = FALSE;
+	}
+}
+
+void SDL_NTSC_THREADS_Blit(SDL_NTSC_THREADS_blit_t blit_func, atari_ntsc_t const *ntsc,
+                           ATARI_NTSC_IN_T const *atari_in, long in_row_width,
+                           int in_width, int in_height, void *rgb_out, long out_pitch,
+                           int bytes_per_pixel)
+{
+	UpdateWorkers();
+
+	if (num_workers == 0)
+		(*blit_func)(ntsc, atari_in, in_row_width, in_width, in_height, rgb_out, out_pitch);
+	else if (SDL_NTSC_THREADS_async)
+		BlitAsync(blit_func, ntsc, atari_in, in_row_width, in_width, in_height, rgb_out, out_pitch, bytes_per_pixel);
+	else {
+		/* A job may still be running if async mode was just turned off. */
+		SDL_NTSC_THREADS_Wait();
+		async_ready = FALSE;
+		BlitParallel(blit_func, ntsc, atari_in, in_row_width, in_width, in_height, rgb_out, out_pitch);
+	}
+}
+
+void SDL_NTSC_THREADS_RunBands(SDL_NTSC_THREADS_band_t func, void *arg, int num_rows)
+{
+	int y0;
+	UpdateWorkers();
+	if (num_workers == 0) {
+		(*func)(arg, 0, num_rows);
+		return;
+	}
+	/* An asynchronous NTSC job may still be running after a display mode
+	   change. */
+	SDL_NTSC_THREADS_Wait();
+	async_ready = FALSE;
+	job_band_func = func;
+	job_band_arg = arg;
+	StartBands(NULL, NULL, num_rows, num_workers + 1, num_workers);
+	/* The last band is done by the calling thread. */
+	y0 = num_rows * num_workers / (num_workers + 1);
+	(*func)(arg, y0, num_rows - y0);
+	WaitBands(num_workers);
+}
+
+void SDL_NTSC_THREADS_Wait(void)
+{
+	if (pending_bands > 0) {
+		WaitBands(pending_bands);
+		pending_bands = 0;
+	}
+}
+
+int SDL_NTSC_THREADS_ReadConfig(char *option, char *parameters)
+{
+	if (strcmp(option, "NTSC_FILTER_THREADS") == 0) {
+		int value = Util_sscandec(parameters);
+		if (value < 0 || value > SDL_NTSC_THREADS_MAX)
+			return FALSE;
+		SDL_NTSC_THREADS_num = value;
+	}
+	else if (strcmp(option, "NTSC_FILTER_ASYNC") == 0)
+		return (SDL_NTSC_THREADS_async = Util_sscanbool(parameters)) != -1;
+	else
+		return FALSE;
+	return TRUE;
+}
+
+void SDL_NTSC_THREADS_WriteConfig(FILE *fp)
+{
+	fprintf(fp, "NTSC_FILTER_THREADS=%d\n", SDL_NTSC_THREADS_num);
+	fprintf(fp, "NTSC_FILTER_ASYNC=%d\n", SDL_NTSC_THREADS_async);
+}
+
+int SDL_NTSC_THREADS_Initialise(int *argc, char *argv[])
+{
+	int i, j;
+
+	for (i = j = 1; i < *argc; i++) {
+		int i_a = (i + 1 < *argc);		/* is argument available? */
+		int a_m = FALSE;			/* error, argument missing! */
+		if (strcmp(argv[i], "-ntsc-threads") == 0) {
+			if (i_a) {
+				SDL_NTSC_THREADS_num = Util_sscandec(argv[++i]);
+				if (SDL_NTSC_THREADS_num < 0 || SDL_NTSC_THREADS_num > SDL_NTSC_THREADS_MAX) {
+					Log_print("Invalid number of NTSC filter threads %s", argv[i]);
+					return FALSE;
+				}
+			}
+			else a_m = TRUE;
+		}
+		else if (strcmp(argv[i], "-ntsc-async") == 0)
+			SDL_NTSC_THREADS_async = TRUE;
+		else if (strcmp(argv[i], "-no-ntsc-async") == 0)
+			SDL_NTSC_THREADS_async = FALSE;
+		else {
+			if (strcmp(argv[i], "-help") == 0) {
+				Log_print("\t-ntsc-threads <n> Filter NTSC video with n additional threads (0..%d)", SDL_NTSC_THREADS_MAX);
+				Log_print("\t-ntsc-async       Filter NTSC video while emulating next frame");
+				Log_print("\t-no-ntsc-async    Finish NTSC filtering before continuing emulation");
+			}
+			argv[j++] = argv[i];
+		}
+
+		if (a_m) {
+			Log_print("Missing argument for '%s'", argv[i]);
+			return FALSE;
+		}
+	}
+	*argc = j;
+
+	return TRUE;
+}
+
+void SDL_NTSC_THREADS_Exit(void)
+{
+	StopWorkers();
+	free(async_in);
+	free(async_out);
+	async_in = NULL;
+	async_out = NULL;
+	async_in_size = async_out_size = 0;
+	async_ready = FALSE;
+}
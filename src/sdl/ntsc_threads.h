@@ -0,0 +1,79 @@
+/*
+ * sdl/ntsc_threads.h - SDL library specific port code - multithreaded NTSC filter
+ *
+ * Copyright (C) 2016 Atari800 development team (see DOC/CREDITS)
+ *
+ * This file is part of the Atari800 emulator project which emulates
+ * the Atari 400, 800, 800XL, 130XE, and 5200 8-bit computers.
+ *
+ * Atari800 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Atari800 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atari800; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef SDL_NTSC_THREADS_H_
+#define SDL_NTSC_THREADS_H_
+
+#include <stdio.h>
+
+#include "atari_ntsc/atari_ntsc.h"
+
+/* Signature shared by all atari_ntsc_blit_* functions. */
+typedef void (*SDL_NTSC_THREADS_blit_t)(atari_ntsc_t const *ntsc, ATARI_NTSC_IN_T const *atari_in,
+                                        long in_row_width, int in_width, int in_height,
+                                        void *rgb_out, long out_pitch);
+
+/* Signature of a job for SDL_NTSC_THREADS_RunBands(): processes NUM_ROWS
+   rows starting at FIRST_ROW. */
+typedef void (*SDL_NTSC_THREADS_band_t)(void *arg, int first_row, int num_rows);
+
+/* Number of worker threads that filter horizontal bands of the screen.
+   0 means that the whole frame is filtered by the calling thread. Takes
+   effect at the next call to SDL_NTSC_THREADS_Blit(). */
+extern int SDL_NTSC_THREADS_num;
+#define SDL_NTSC_THREADS_MAX 16
+
+/* When TRUE (and SDL_NTSC_THREADS_num > 0) the worker threads filter a frame
+   while the emulation thread continues with the next one. The displayed
+   image is then delayed by one frame. */
+extern int SDL_NTSC_THREADS_async;
+
+/* Filters IN_HEIGHT rows of the Atari screen with BLIT_FUNC, splitting the
+   work into bands of rows. Parameters are the same as in atari_ntsc_blit_*;
+   BYTES_PER_PIXEL is the size of an output pixel (2 or 4). The output is
+   identical to a single BLIT_FUNC call over the whole area. */
+void SDL_NTSC_THREADS_Blit(SDL_NTSC_THREADS_blit_t blit_func, atari_ntsc_t const *ntsc,
+                           ATARI_NTSC_IN_T const *atari_in, long in_row_width,
+                           int in_width, int in_height, void *rgb_out, long out_pitch,
+                           int bytes_per_pixel);
+
+/* Splits NUM_ROWS rows into bands and calls FUNC for each band, in the
+   worker threads and the calling thread. Returns when all bands are done.
+   FUNC must produce the same result whatever the split. */
+void SDL_NTSC_THREADS_RunBands(SDL_NTSC_THREADS_band_t func, void *arg, int num_rows);
+
+/* Waits until a frame being filtered asynchronously is finished. Must be
+   called before the atari_ntsc_t structure is modified or freed. */
+void SDL_NTSC_THREADS_Wait(void);
+
+/* Read/write to configuration file. */
+int SDL_NTSC_THREADS_ReadConfig(char *option, char *parameters);
+void SDL_NTSC_THREADS_WriteConfig(FILE *fp);
+
+/* Processing of command-line arguments. */
+int SDL_NTSC_THREADS_Initialise(int *argc, char *argv[]);
+
+/* Stops the worker threads and frees their buffers. */
+void SDL_NTSC_THREADS_Exit(void);
+
+#endif /* SDL_NTSC_THREADS_H_ */
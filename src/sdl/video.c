@@ -43,6 +43,7 @@
 #include "xep80.h"
 
 #include "sdl/input.h"
+#include "sdl/ntsc_threads.h"
 #include "sdl/palette.h"
 #include "sdl/video.h"
 #include "sdl/video_sw.h"
@@ -106,8 +107,10 @@ void SDL_VIDEO_UpdatePaletteLookup(VIDEOMODE_MODE_t mode, int bpp_32)
 void PLATFORM_PaletteUpdate(void)
 {
 #ifdef NTSC_FILTER
-	if (SDL_VIDEO_current_display_mode == VIDEOMODE_MODE_NTSC_FILTER)
+	if (SDL_VIDEO_current_display_mode == VIDEOMODE_MODE_NTSC_FILTER) {
+		SDL_NTSC_THREADS_Wait();
 		FILTER_NTSC_Update(FILTER_NTSC_emu);
+	}
 	else
 #endif
 	{
@@ -145,6 +148,7 @@ static void UpdateNtscFilter(VIDEOMODE_MODE_t mode)
 {
 	if (mode != VIDEOMODE_MODE_NTSC_FILTER && FILTER_NTSC_emu != NULL) {
 		/* Turning filter off */
+		SDL_NTSC_THREADS_Exit();
 		FILTER_NTSC_Delete(FILTER_NTSC_emu);
 		FILTER_NTSC_emu = NULL;
 #if HAVE_OPENGL
@@ -322,6 +326,8 @@ int SDL_VIDEO_ReadConfig(char *option, char *parameters)
 #endif /* HAVE_OPENGL */
 	else if (SDL_VIDEO_SW_ReadConfig(option, parameters)) {
 	}
+	else if (SDL_NTSC_THREADS_ReadConfig(option, parameters)) {
+	}
 	else
 		return FALSE;
 	return TRUE;
@@ -337,6 +343,7 @@ void SDL_VIDEO_WriteConfig(FILE *fp)
 	SDL_VIDEO_GL_WriteConfig(fp);
 #endif
 	SDL_VIDEO_SW_WriteConfig(fp);
+	SDL_NTSC_THREADS_WriteConfig(fp);
 }
 
 void SDL_VIDEO_InitSDL(void)
@@ -443,6 +450,7 @@ int SDL_VIDEO_Initialise(int *argc, char *argv[])
 #if HAVE_OPENGL
 	    || !SDL_VIDEO_GL_Initialise(argc, argv)
 #endif
+	    || !SDL_NTSC_THREADS_Initialise(argc, argv)
 	)
 		return FALSE;
 
@@ -466,6 +474,9 @@ int SDL_VIDEO_Initialise(int *argc, char *argv[])
 
 void SDL_VIDEO_Exit(void)
 {
+	/* The worker threads may be running for PAL blending as well. */
+	SDL_NTSC_THREADS_Exit();
+	SDL_VIDEO_SW_Exit();
 	SDL_VIDEO_QuitSDL();
 #ifdef NTSC_FILTER
 	if (FILTER_NTSC_emu)
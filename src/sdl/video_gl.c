@@ -45,6 +45,7 @@
 #include "xep80_fonts.h"
 #include "util.h"
 
+#include "sdl/ntsc_threads.h"
 #include "sdl/palette.h"
 #include "sdl/video.h"
 #include "sdl/video_gl.h"
@@ -682,14 +683,16 @@ static void DisplayPalBlending(GLvoid *dest)
 #if NTSC_FILTER
 static void DisplayNTSCEmu(GLvoid *dest)
 {
-	(*pixel_formats[SDL_VIDEO_GL_pixel_format].ntsc_blit_func)(
+	SDL_NTSC_THREADS_Blit(
+		pixel_formats[SDL_VIDEO_GL_pixel_format].ntsc_blit_func,
 		FILTER_NTSC_emu,
 		(ATARI_NTSC_IN_T *) ((UBYTE *)Screen_atari + Screen_WIDTH * VIDEOMODE_src_offset_top + VIDEOMODE_src_offset_left),
 		Screen_WIDTH,
 		VIDEOMODE_src_width,
 		VIDEOMODE_src_height,
 		dest,
-		VIDEOMODE_actual_width * (bpp_32 ? 4 : 2));
+		VIDEOMODE_actual_width * (bpp_32 ? 4 : 2),
+		bpp_32 ? 4 : 2);
 }
 #endif
 
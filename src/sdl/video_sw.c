@@ -45,10 +45,21 @@
 #include "xep80_fonts.h"
 #include "util.h"
 
+#include "sdl/ntsc_threads.h"
 #include "sdl/palette.h"
 #include "sdl/video.h"
 #include "sdl/video_sw.h"
 
+/* DisplayWithScaling() uses SSE2 or NEON instructions for the integer
+   scaling ratios, when available. */
+#if !defined(SDL_VIDEO_SW_NO_SIMD) && defined(__GNUC__) && defined(__SSE2__)
+#define SCALE_SSE2
+#include <emmintrin.h>
+#elif !defined(SDL_VIDEO_SW_NO_SIMD) && defined(__GNUC__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define SCALE_NEON
+#include <arm_neon.h>
+#endif
+
 static int fullscreen = 1;
 
 int SDL_VIDEO_SW_bpp = 0;
@@ -510,24 +521,28 @@ static void DisplayNTSCEmu(void)
 	case 16:
 		pixels += VIDEOMODE_dest_offset_left * 2;
 		/* blit atari image, doubled vertically */
-		atari_ntsc_blit_rgb16(FILTER_NTSC_emu,
+		SDL_NTSC_THREADS_Blit(&atari_ntsc_blit_rgb16,
+		                      FILTER_NTSC_emu,
 		                      (ATARI_NTSC_IN_T *) ((UBYTE *)Screen_atari + Screen_WIDTH * VIDEOMODE_src_offset_top + VIDEOMODE_src_offset_left),
 		                      Screen_WIDTH,
 		                      VIDEOMODE_src_width,
 		                      VIDEOMODE_src_height,
 		                      pixels,
-		                      SDL_VIDEO_screen->pitch * 2);
+		                      SDL_VIDEO_screen->pitch * 2,
+		                      2);
 		scanLines_16((void *)pixels, VIDEOMODE_dest_width, VIDEOMODE_dest_height, SDL_VIDEO_screen->pitch, SDL_VIDEO_scanlines_percentage);
 		break;
 	case 32:
 		pixels += VIDEOMODE_dest_offset_left * 4;
-		atari_ntsc_blit_argb32(FILTER_NTSC_emu,
+		SDL_NTSC_THREADS_Blit(&atari_ntsc_blit_argb32,
+		                      FILTER_NTSC_emu,
 		                      (ATARI_NTSC_IN_T *) ((UBYTE *)Screen_atari + Screen_WIDTH * VIDEOMODE_src_offset_top + VIDEOMODE_src_offset_left),
-		                       Screen_WIDTH,
-		                       VIDEOMODE_src_width,
-		                       VIDEOMODE_src_height,
-		                       pixels,
-		                       SDL_VIDEO_screen->pitch * 2);
+		                      Screen_WIDTH,
+		                      VIDEOMODE_src_width,
+		                      VIDEOMODE_src_height,
+		                      pixels,
+		                      SDL_VIDEO_screen->pitch * 2,
+		                      4);
 		scanLines_32((void *)pixels, VIDEOMODE_dest_width, VIDEOMODE_dest_height, SDL_VIDEO_screen->pitch, SDL_VIDEO_scanlines_percentage);
 		break;
 	}
@@ -673,98 +688,276 @@ static void DisplayWithoutScaling(void)
 	}
 }
 
-static void DisplayWithScaling(void)
+/* Lookup tables of DisplayWithScaling(), computed by UpdateScaling() for
+   the current source and destination sizes. */
+static struct {
+	int src_width;
+	int dest_width;
+	int bpp;
+	/* Number of pixels written in each row. */
+	int width;
+	/* Source column of each destination pixel. */
+	int *columns;
+	int columns_size;
+	/* 2, 3 or 4 if each source pixel is repeated exactly that many times,
+	   0 otherwise. */
+	int ratio;
+} scaling = { 0, 0, 0, 0, NULL, 0, 0 };
+
+static void UpdateScaling(int bpp)
 {
-	register Uint32 quad;
-	register int x;
-	register Uint8 *screen = (UBYTE *)Screen_atari + Screen_WIDTH * VIDEOMODE_src_offset_top + VIDEOMODE_src_offset_left;
-	register Uint32 *pixels = (Uint32 *) SDL_VIDEO_screen->pixels;
-	int i;
-	int y = 0;
-	int w1;
-	int w = (VIDEOMODE_src_width) << 16;
-	int h = (VIDEOMODE_src_height) << 16;
-	register int dx = w / VIDEOMODE_dest_width;
-	register int yy;
+	int dx = (VIDEOMODE_src_width << 16) / VIDEOMODE_dest_width;
+	int x = (VIDEOMODE_src_width << 16) - 0x4000;
 	int pos;
-	int pitch4 = SDL_VIDEO_screen->pitch / 4;
-	int dy = h / VIDEOMODE_dest_height;
-	int init_x = (VIDEOMODE_src_width << 16) - 0x4000;
+	int ratio;
+
+	scaling.src_width = VIDEOMODE_src_width;
+	scaling.dest_width = VIDEOMODE_dest_width;
+	scaling.bpp = bpp;
+	/* Whole 32-bit words are written, so the 8- and 16-bit rows are rounded
+	   down. */
+	switch (bpp) {
+	case 8:
+		scaling.width = VIDEOMODE_dest_width & ~3;
+		break;
+	case 16:
+		scaling.width = VIDEOMODE_dest_width & ~1;
+		break;
+	default:
+		scaling.width = VIDEOMODE_dest_width;
+	}
+	if (scaling.columns_size < scaling.width) {
+		scaling.columns_size = scaling.width;
+		scaling.columns = (int *)Util_realloc(scaling.columns, scaling.width * sizeof(int));
+	}
+	/* Step from the right edge, as the fixed-point scaler always did. */
+	for (pos = scaling.width - 1; pos >= 0; pos--) {
+		scaling.columns[pos] = x >> 16;
+		x -= dx;
+	}
 
-	Uint8 c;
+	scaling.ratio = 0;
+	for (ratio = 2; ratio <= 4; ratio++) {
+		if (scaling.width == VIDEOMODE_src_width * ratio) {
+			for (pos = 0; pos < scaling.width; pos++)
+				if (scaling.columns[pos] != pos / ratio)
+					break;
+			if (pos == scaling.width)
+				scaling.ratio = ratio;
+		}
+	}
+}
+
+/* Scales one row of the Atari screen, SRC, into DEST. */
+static void ScaleRow8(Uint8 *dest, Uint8 const *src)
+{
+	int const *columns = scaling.columns;
+	int pos;
+	for (pos = 0; pos < scaling.width; pos++)
+		dest[pos] = src[columns[pos]];
+}
 
-	i = VIDEOMODE_dest_height;
+static void ScaleRow16(Uint16 *dest, Uint8 const *src)
+{
+	Uint16 const *palette = SDL_PALETTE_buffer.bpp16;
+	int x = 0;
+	int pos;
+	switch (scaling.ratio) {
+	case 2:
+#if defined(SCALE_SSE2) || defined(SCALE_NEON)
+		for (; x + 8 <= scaling.src_width; x += 8, dest += 16) {
+#ifdef SCALE_SSE2
+			__m128i v = _mm_set_epi16(palette[src[x + 7]], palette[src[x + 6]], palette[src[x + 5]], palette[src[x + 4]],
+			                          palette[src[x + 3]], palette[src[x + 2]], palette[src[x + 1]], palette[src[x]]);
+			_mm_storeu_si128((__m128i *)dest, _mm_unpacklo_epi16(v, v));
+			_mm_storeu_si128((__m128i *)(dest + 8), _mm_unpackhi_epi16(v, v));
+#else
+			uint16x8x2_t v;
+			Uint16 p[8];
+			for (pos = 0; pos < 8; pos++)
+				p[pos] = palette[src[x + pos]];
+			v.val[0] = v.val[1] = vld1q_u16(p);
+			vst2q_u16(dest, v);
+#endif
+		}
+#endif
+		for (; x < scaling.src_width; x++, dest += 2)
+			dest[0] = dest[1] = palette[src[x]];
+		break;
+	case 3:
+#ifdef SCALE_NEON
+		for (; x + 8 <= scaling.src_width; x += 8, dest += 24) {
+			uint16x8x3_t v;
+			Uint16 p[8];
+			for (pos = 0; pos < 8; pos++)
+				p[pos] = palette[src[x + pos]];
+			v.val[0] = v.val[1] = v.val[2] = vld1q_u16(p);
+			vst3q_u16(dest, v);
+		}
+#endif
+		for (; x < scaling.src_width; x++, dest += 3)
+			dest[0] = dest[1] = dest[2] = palette[src[x]];
+		break;
+	case 4:
+#if defined(SCALE_SSE2) || defined(SCALE_NEON)
+		for (; x + 8 <= scaling.src_width; x += 8, dest += 32) {
+#ifdef SCALE_SSE2
+			__m128i v = _mm_set_epi16(palette[src[x + 7]], palette[src[x + 6]], palette[src[x + 5]], palette[src[x + 4]],
+			                          palette[src[x + 3]], palette[src[x + 2]], palette[src[x + 1]], palette[src[x]]);
+			__m128i lo = _mm_unpacklo_epi16(v, v);
+			__m128i hi = _mm_unpackhi_epi16(v, v);
+			_mm_storeu_si128((__m128i *)dest, _mm_unpacklo_epi32(lo, lo));
+			_mm_storeu_si128((__m128i *)(dest + 8), _mm_unpackhi_epi32(lo, lo));
+			_mm_storeu_si128((__m128i *)(dest + 16), _mm_unpacklo_epi32(hi, hi));
+			_mm_storeu_si128((__m128i *)(dest + 24), _mm_unpackhi_epi32(hi, hi));
+#else
+			uint16x8x4_t v;
+			Uint16 p[8];
+			for (pos = 0; pos < 8; pos++)
+				p[pos] = palette[src[x + pos]];
+			v.val[0] = v.val[1] = v.val[2] = v.val[3] = vld1q_u16(p);
+			vst4q_u16(dest, v);
+#endif
+		}
+#endif
+		for (; x < scaling.src_width; x++, dest += 4)
+			dest[0] = dest[1] = dest[2] = dest[3] = palette[src[x]];
+		break;
+	default:
+		for (pos = 0; pos < scaling.width; pos++)
+			dest[pos] = palette[src[scaling.columns[pos]]];
+	}
+}
 
-	switch (SDL_VIDEO_screen->format->BitsPerPixel) {
+static void ScaleRow32(Uint32 *dest, Uint8 const *src)
+{
+	Uint32 const *palette = SDL_PALETTE_buffer.bpp32;
+	int x = 0;
+	int pos;
+#ifdef SCALE_NEON
+	Uint32 p[4];
+#endif
+	switch (scaling.ratio) {
+	case 2:
+#if defined(SCALE_SSE2) || defined(SCALE_NEON)
+		for (; x + 4 <= scaling.src_width; x += 4, dest += 8) {
+#ifdef SCALE_SSE2
+			__m128i v = _mm_set_epi32(palette[src[x + 3]], palette[src[x + 2]], palette[src[x + 1]], palette[src[x]]);
+			_mm_storeu_si128((__m128i *)dest, _mm_unpacklo_epi32(v, v));
+			_mm_storeu_si128((__m128i *)(dest + 4), _mm_unpackhi_epi32(v, v));
+#else
+			uint32x4x2_t v;
+			for (pos = 0; pos < 4; pos++)
+				p[pos] = palette[src[x + pos]];
+			v.val[0] = v.val[1] = vld1q_u32(p);
+			vst2q_u32(dest, v);
+#endif
+		}
+#endif
+		for (; x < scaling.src_width; x++, dest += 2)
+			dest[0] = dest[1] = palette[src[x]];
+		break;
+	case 3:
+#if defined(SCALE_SSE2) || defined(SCALE_NEON)
+		for (; x + 4 <= scaling.src_width; x += 4, dest += 12) {
+#ifdef SCALE_SSE2
+			__m128i v = _mm_set_epi32(palette[src[x + 3]], palette[src[x + 2]], palette[src[x + 1]], palette[src[x]]);
+			_mm_storeu_si128((__m128i *)dest, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 0, 0)));
+			_mm_storeu_si128((__m128i *)(dest + 4), _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 2, 1, 1)));
+			_mm_storeu_si128((__m128i *)(dest + 8), _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 2)));
+#else
+			uint32x4x3_t v;
+			for (pos = 0; pos < 4; pos++)
+				p[pos] = palette[src[x + pos]];
+			v.val[0] = v.val[1] = v.val[2] = vld1q_u32(p);
+			vst3q_u32(dest, v);
+#endif
+		}
+#endif
+		for (; x < scaling.src_width; x++, dest += 3)
+			dest[0] = dest[1] = dest[2] = palette[src[x]];
+		break;
+	case 4:
+#if defined(SCALE_SSE2) || defined(SCALE_NEON)
+		for (; x + 4 <= scaling.src_width; x += 4, dest += 16) {
+#ifdef SCALE_SSE2
+			__m128i v = _mm_set_epi32(palette[src[x + 3]], palette[src[x + 2]], palette[src[x + 1]], palette[src[x]]);
+			_mm_storeu_si128((__m128i *)dest, _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 0, 0, 0)));
+			_mm_storeu_si128((__m128i *)(dest + 4), _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 1, 1, 1)));
+			_mm_storeu_si128((__m128i *)(dest + 8), _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 2, 2, 2)));
+			_mm_storeu_si128((__m128i *)(dest + 12), _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3)));
+#else
+			uint32x4x4_t v;
+			for (pos = 0; pos < 4; pos++)
+				p[pos] = palette[src[x + pos]];
+			v.val[0] = v.val[1] = v.val[2] = v.val[3] = vld1q_u32(p);
+			vst4q_u32(dest, v);
+#endif
+		}
+#endif
+		for (; x < scaling.src_width; x++, dest += 4)
+			dest[0] = dest[1] = dest[2] = dest[3] = palette[src[x]];
+		break;
+	default:
+		for (pos = 0; pos < scaling.width; pos++)
+			dest[pos] = palette[src[scaling.columns[pos]]];
+	}
+}
+
+static void DisplayWithScaling(void)
+{
+	Uint8 *screen = (UBYTE *)Screen_atari + Screen_WIDTH * VIDEOMODE_src_offset_top + VIDEOMODE_src_offset_left;
+	Uint8 *pixels = (Uint8 *) SDL_VIDEO_screen->pixels + SDL_VIDEO_screen->pitch * VIDEOMODE_dest_offset_top;
+	int bpp = SDL_VIDEO_screen->format->BitsPerPixel;
+	int dy = (VIDEOMODE_src_height << 16) / VIDEOMODE_dest_height;
+	int y = 0;
+	int i;
+	/* Previous destination row, and the source row it was scaled from. */
+	Uint8 *prev_pixels = NULL;
+	int prev_row = -1;
+	size_t row_bytes;
+	/* Reading back from video memory may be much slower than scaling a row
+	   again. */
+	int copy_rows = !(SDL_VIDEO_screen->flags & SDL_HWSURFACE);
+
+	if (scaling.src_width != VIDEOMODE_src_width || scaling.dest_width != VIDEOMODE_dest_width || scaling.bpp != bpp)
+		UpdateScaling(bpp);
+	row_bytes = scaling.width * (bpp / 8);
+
+	switch (bpp) {
 	/* Possible values are 8, 16 and 32, as checked earlier in the
 	 * PLATFORM_SetVideoMode() function. */
 	case 8:
-		pixels += pitch4 * VIDEOMODE_dest_offset_top + VIDEOMODE_dest_offset_left / 4;
-		w1 = VIDEOMODE_dest_width / 4 - 1;
-		while (i > 0) {
-			x = init_x;
-			pos = w1;
-			yy = Screen_WIDTH * (y >> 16);
-			while (pos >= 0) {
-				quad = (screen[yy + (x >> 16)] << 24);
-				x -= dx;
-				quad += (screen[yy + (x >> 16)] << 16);
-				x -= dx;
-				quad += (screen[yy + (x >> 16)] << 8);
-				x -= dx;
-				quad += (screen[yy + (x >> 16)] << 0);
-				x -= dx;
-
-				pixels[pos] = quad;
-				pos--;
-
-			}
-			pixels += pitch4;
-			y += dy;
-			i--;
-		}
+		pixels += VIDEOMODE_dest_offset_left & ~3;
 		break;
 	case 16:
-		pixels += pitch4 * VIDEOMODE_dest_offset_top + VIDEOMODE_dest_offset_left / 2;
-		w1 = VIDEOMODE_dest_width / 2 - 1;
-		while (i > 0) {
-			x = init_x;
-			pos = w1;
-			yy = Screen_WIDTH * (y >> 16);
-			while (pos >= 0) {
-				c = screen[yy + (x >> 16)];
-				quad = SDL_PALETTE_buffer.bpp16[c] << 16;
-				x -= dx;
-				c = screen[yy + (x >> 16)];
-				quad += SDL_PALETTE_buffer.bpp16[c];
-				x -= dx;
-				pixels[pos] = quad;
-				pos--;
-			}
-			pixels += pitch4;
-			y += dy;
-			i--;
-		}
+		pixels += (VIDEOMODE_dest_offset_left & ~1) * 2;
 		break;
 	default:
-		pixels += pitch4 * VIDEOMODE_dest_offset_top + VIDEOMODE_dest_offset_left;
-		w1 = VIDEOMODE_dest_width - 1;
-		/* SDL_VIDEO_screen->format->BitsPerPixel = 32 */
-		while (i > 0) {
-			x = init_x;
-			pos = w1;
-			yy = Screen_WIDTH * (y >> 16);
-			while (pos >= 0) {
-				c = screen[yy + (x >> 16)];
-				quad = SDL_PALETTE_buffer.bpp32[c];
-				x -= dx;
-				pixels[pos] = quad;
-				pos--;
+		pixels += VIDEOMODE_dest_offset_left * 4;
+	}
+
+	for (i = 0; i < VIDEOMODE_dest_height; i++) {
+		int row = y >> 16;
+		if (row == prev_row && copy_rows)
+			memcpy(pixels, prev_pixels, row_bytes);
+		else {
+			Uint8 *src = screen + Screen_WIDTH * row;
+			switch (bpp) {
+			case 8:
+				ScaleRow8(pixels, src);
+				break;
+			case 16:
+				ScaleRow16((Uint16 *)pixels, src);
+				break;
+			default:
+				ScaleRow32((Uint32 *)pixels, src);
 			}
-			pixels += pitch4;
-			y += dy;
-			i--;
+			prev_pixels = pixels;
+			prev_row = row;
 		}
+		pixels += SDL_VIDEO_screen->pitch;
+		y += dy;
 	}
 }
 
@@ -787,22 +980,46 @@ static void DisplayPalBlending(void)
 	}
 }
 
+/* Parameters of a scaled PAL blending blit, shared by all bands. */
+typedef struct pal_blending_job_t {
+	ULONG *pixels;
+	UBYTE *screen;
+	int pitch4;
+	int bpp;
+} pal_blending_job_t;
+
+static void PalBlendingScaledBand(void *arg, int first_row, int num_rows)
+{
+	pal_blending_job_t const *job = (pal_blending_job_t const *)arg;
+	if (job->bpp == 16)
+		PAL_BLENDING_BlitScaledRows16(job->pixels, job->screen, job->pitch4, VIDEOMODE_src_width, VIDEOMODE_src_height, VIDEOMODE_dest_width, VIDEOMODE_dest_height, VIDEOMODE_src_offset_top % 2, first_row, num_rows);
+	else
+		PAL_BLENDING_BlitScaledRows32(job->pixels, job->screen, job->pitch4, VIDEOMODE_src_width, VIDEOMODE_src_height, VIDEOMODE_dest_width, VIDEOMODE_dest_height, VIDEOMODE_src_offset_top % 2, first_row, num_rows);
+}
+
 static void DisplayPalBlendingScaled(void)
 {
-	int pitch4 = SDL_VIDEO_screen->pitch / 4;
-	Uint8 *screen = (UBYTE *)Screen_atari + Screen_WIDTH * VIDEOMODE_src_offset_top + VIDEOMODE_src_offset_left;
+	pal_blending_job_t job;
 	Uint32 *pixels = (Uint32 *) SDL_VIDEO_screen->pixels;
-	switch (SDL_VIDEO_screen->format->BitsPerPixel) {
+	job.pitch4 = SDL_VIDEO_screen->pitch / 4;
+	job.screen = (UBYTE *)Screen_atari + Screen_WIDTH * VIDEOMODE_src_offset_top + VIDEOMODE_src_offset_left;
+	job.bpp = SDL_VIDEO_screen->format->BitsPerPixel;
+	switch (job.bpp) {
 	/* Possible values are 8, 16 and 32, as checked earlier in the
 	 * PLATFORM_SetVideoMode() function. */
 	case 16:
-		pixels += pitch4 * VIDEOMODE_dest_offset_top + VIDEOMODE_dest_offset_left / 2;
-		PAL_BLENDING_BlitScaled16((ULONG*)pixels, screen, pitch4, VIDEOMODE_src_width, VIDEOMODE_src_height, VIDEOMODE_dest_width, VIDEOMODE_dest_height, VIDEOMODE_src_offset_top % 2);
+		pixels += job.pitch4 * VIDEOMODE_dest_offset_top + VIDEOMODE_dest_offset_left / 2;
 		break;
 	case 32:
-		pixels += pitch4 * VIDEOMODE_dest_offset_top + VIDEOMODE_dest_offset_left;
-		PAL_BLENDING_BlitScaled32((ULONG*)pixels, screen, pitch4, VIDEOMODE_src_width, VIDEOMODE_src_height, VIDEOMODE_dest_width, VIDEOMODE_dest_height, VIDEOMODE_src_offset_top % 2);
+		pixels += job.pitch4 * VIDEOMODE_dest_offset_top + VIDEOMODE_dest_offset_left;
+		break;
+	default:
+		return;
 	}
+	job.pixels = (ULONG *)pixels;
+	/* Rows of the scaled image are independent, so they are blitted in
+	   parallel by the NTSC filter's threads. */
+	SDL_NTSC_THREADS_RunBands(&PalBlendingScaledBand, &job, VIDEOMODE_dest_height);
 }
 #endif /* PAL_BLENDING */
 
@@ -879,3 +1096,12 @@ int SDL_VIDEO_SW_Initialise(int *argc, char *argv[])
 
 	return TRUE;
 }
+
+void SDL_VIDEO_SW_Exit(void)
+{
+	free(scaling.columns);
+	scaling.columns = NULL;
+	scaling.columns_size = 0;
+	/* Force UpdateScaling() on the next DisplayWithScaling(). */
+	scaling.src_width = 0;
+}
@@ -28,5 +28,7 @@ void SDL_VIDEO_SW_WriteConfig(FILE *fp);
 
 /* Initialisation and processing of command-line arguments. */
 int SDL_VIDEO_SW_Initialise(int *argc, char *argv[]);
+/* Frees the scaling tables. */
+void SDL_VIDEO_SW_Exit(void);
 
 #endif /* SDL_VIDEO_SW_H_ */
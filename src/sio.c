@@ -29,6 +29,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h> /* getpid() */
+#endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #include "afile.h"
 #include "antic.h"  /* ANTIC_ypos */
@@ -37,6 +43,7 @@
 #include "cassette.h"
 #include "compfile.h"
 #include "cpu.h"
+#include "crc32.h"
 #include "esc.h"
 #include "log.h"
 #include "memory.h"
@@ -48,6 +55,10 @@
 #ifndef BASIC
 #include "statesav.h"
 #endif
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#define SIO_MMAP
+#include <sys/mman.h>
+#endif
 
 #undef DEBUG_PRO
 #undef DEBUG_VAPI
@@ -72,6 +83,25 @@ static int image_type[SIO_MAX_DRIVES];
 #define IMAGE_TYPE_PRO  2
 #define IMAGE_TYPE_VAPI 3
 static FILE *disk[SIO_MAX_DRIVES] = { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL };
+/* Contents of the disk image in memory, so that accessing a sector
+   is a memcpy() instead of fseek() and fread()/fwrite(). Either
+   - a mapping of the image file (where mmap() is available) - only the
+     part of the file that existed when it was mounted is mapped;
+     the rest (short images) is accessed through the FILE, or
+   - the whole image decompressed from a DCM or gzip file, with no FILE
+     behind it (disk[] is NULL). */
+static UBYTE *image_data[SIO_MAX_DRIVES];
+static ULONG image_size[SIO_MAX_DRIVES];
+static int image_compression[SIO_MAX_DRIVES];
+#define IMAGE_COMPRESSION_NONE 0
+#define IMAGE_COMPRESSION_GZ   1
+#define IMAGE_COMPRESSION_DCM  2
+/* TRUE if a decompressed image was modified since it was mounted or saved */
+static int image_dirty[SIO_MAX_DRIVES];
+/* TRUE if image_data of a decompressed image is a private mapping of
+   a file in SIO_disk_cache_dir rather than a malloc'd block */
+static int image_cached[SIO_MAX_DRIVES];
+#define IMAGE_MOUNTED(unit) (disk[unit] != NULL || image_data[unit] != NULL)
 static int sectorcount[SIO_MAX_DRIVES];
 static int sectorsize[SIO_MAX_DRIVES];
 /* these two are used by the 1450XLD parallel disk device */
@@ -178,9 +208,489 @@ static int ExpectedBytes = 0;
 
 int ignore_header_writeprotect = FALSE;
 
+int SIO_compressed_writable = FALSE;
+
+char SIO_disk_cache_dir[FILENAME_MAX] = "";
+
+int SIO_flush_policy = SIO_FLUSH_BACKGROUND;
+
+UWORD SIO_os_routine = 0;
+
+int SIO_turbo = FALSE;
+/* Scanlines between the data bytes of accelerated transfers. Starts at
+   SIO_TURBO_INTERVAL and is doubled whenever the Atari retries a command
+   whose bytes it didn't keep up with. When it reaches SIO_SERIN_INTERVAL,
+   transfers are no longer accelerated. After TURBO_RECOVER_TRANSFERS
+   commands without such a retry it is halved again. */
+static int turbo_interval = SIO_TURBO_INTERVAL;
+#define TURBO_RECOVER_TRANSFERS 32
+static int turbo_good_transfers = 0;
+/* TRUE if data bytes of the current command are sent faster. */
+static int turbo_transfer = FALSE;
+/* TRUE if a byte of the current accelerated transfer arrived before the
+   Atari acknowledged the interrupt of the previous one. */
+static int turbo_lost = FALSE;
+/* Command frame of the last command. */
+static UBYTE turbo_command[4];
+/* Set by SIO_ReadSector if the result depends on the drive timing
+   (VAPI images, duplicate and bad sectors of PRO images). */
+static int timing_sensitive;
+
+/* Sectors written to the part of an image that is accessed with stdio
+   (images that couldn't be mapped, and the tail of short images) are
+   kept in a write-back cache, so that a burst of writes on slow storage
+   doesn't stall the emulation. Depending on SIO_flush_policy the dirty
+   sectors are written by a background thread, or when the disk is
+   dismounted, the state is saved or SIO_FlushDisks() is called.
+   Without threads the background policy writes sectors directly. */
+typedef struct {
+	ULONG offset;
+	int size;
+	unsigned int generation; /* incremented when the sector is written again */
+	UBYTE data[256];
+} dirty_sector_t;
+/* Dirty sectors of each drive indexed by sector number (allocated on
+   the first write) and a FIFO of the sector numbers waiting to be
+   written, each at most once. A sector being written by the flusher
+   thread is in dirty_sectors but not in dirty_queue. */
+static dirty_sector_t **dirty_sectors[SIO_MAX_DRIVES];
+static int *dirty_queue[SIO_MAX_DRIVES];
+static int dirty_head[SIO_MAX_DRIVES];
+static int dirty_queued[SIO_MAX_DRIVES];
+static int dirty_total = 0;
+
+#ifdef HAVE_PTHREAD
+static int flusher_running = FALSE;
+static int flusher_failed = FALSE;
+static int stop_flusher;
+static pthread_t flusher_thread;
+/* Protects the dirty sector cache. */
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Serializes stdio access to the image files. Never taken before cache_mutex. */
+static pthread_mutex_t file_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Signalled when a sector is queued or the flusher should stop. */
+static pthread_cond_t dirty_cond = PTHREAD_COND_INITIALIZER;
+/* Signalled when the flusher finishes writing a sector. */
+static pthread_cond_t flushed_cond = PTHREAD_COND_INITIALIZER;
+/* Drive whose sector is being written by the flusher, or -1. */
+static int flushing_unit = -1;
+#define LOCK_CACHE()    pthread_mutex_lock(&cache_mutex)
+#define UNLOCK_CACHE()  pthread_mutex_unlock(&cache_mutex)
+#define LOCK_FILES()    pthread_mutex_lock(&file_mutex)
+#define UNLOCK_FILES()  pthread_mutex_unlock(&file_mutex)
+#else
+#define LOCK_CACHE()
+#define UNLOCK_CACHE()
+#define LOCK_FILES()
+#define UNLOCK_FILES()
+#endif /* HAVE_PTHREAD */
+
+#ifdef SIO_MMAP
+/* Maps the whole image file of UNIT. On failure the image is accessed with stdio. */
+static void MapImage(int unit)
+{
+	int writable = SIO_drive_status[unit] == SIO_READ_WRITE;
+	long size;
+	void *map;
+	if (fflush(disk[unit]) != 0)
+		return;
+	size = Util_flen(disk[unit]);
+	if (size <= 0)
+		return;
+	map = mmap(NULL, (size_t) size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+	           MAP_SHARED, fileno(disk[unit]), 0);
+	if (map == MAP_FAILED)
+		return;
+	image_data[unit] = (UBYTE *) map;
+	image_size[unit] = (ULONG) size;
+}
+#endif /* SIO_MMAP */
+
+/* Frees the decompressed image of UNIT. */
+static void FreeImageData(int unit)
+{
+#ifdef SIO_MMAP
+	if (image_cached[unit])
+		munmap(image_data[unit], image_size[unit]);
+	else
+#endif
+		free(image_data[unit]);
+	image_data[unit] = NULL;
+	image_size[unit] = 0;
+	image_cached[unit] = FALSE;
+}
+
+static void FreeDirtyCache(int unit);
+
+/* Releases the image of UNIT: unmaps and closes its file
+   or frees the decompressed image. */
+static void CloseImage(int unit)
+{
+	FreeDirtyCache(unit);
+	if (image_compression[unit] != IMAGE_COMPRESSION_NONE) {
+		if (image_dirty[unit])
+			Log_print("D%d: changes to %s discarded", unit + 1, SIO_filename[unit]);
+		FreeImageData(unit);
+	}
+#ifdef SIO_MMAP
+	else if (image_data[unit] != NULL) {
+		if (SIO_drive_status[unit] == SIO_READ_WRITE)
+			msync(image_data[unit], image_size[unit], MS_SYNC);
+		munmap(image_data[unit], image_size[unit]);
+	}
+#endif
+	if (disk[unit] != NULL)
+		Util_fclose(disk[unit], sio_tmpbuf[unit]);
+	disk[unit] = NULL;
+	image_data[unit] = NULL;
+	image_size[unit] = 0;
+	image_compression[unit] = IMAGE_COMPRESSION_NONE;
+	image_dirty[unit] = FALSE;
+}
+
+/* Returns length of the image in UNIT. */
+static ULONG ImageLength(int unit)
+{
+	if (disk[unit] == NULL)
+		return image_size[unit];
+	return (ULONG) Util_flen(disk[unit]);
+}
+
+/* Reads SIZE bytes at OFFSET of the image in UNIT to BUFFER.
+   Returns the number of bytes read, which is less than SIZE
+   past the end of the image. */
+static int ReadImage(int unit, ULONG offset, UBYTE *buffer, int size)
+{
+	int done = 0;
+	if (offset < image_size[unit]) {
+		done = image_size[unit] - offset < (ULONG) size ? (int) (image_size[unit] - offset) : size;
+		memcpy(buffer, image_data[unit] + offset, done);
+		if (done == size)
+			return size;
+	}
+	if (disk[unit] == NULL)
+		return done;
+	LOCK_FILES();
+	fseek(disk[unit], offset + done, SEEK_SET);
+	done += (int) fread(buffer + done, 1, size - done, disk[unit]);
+	UNLOCK_FILES();
+	return done;
+}
+
+/* Writes SIZE bytes from BUFFER at OFFSET of the image in UNIT. */
+static void WriteImage(int unit, ULONG offset, const UBYTE *buffer, int size)
+{
+	int done = 0;
+	if (disk[unit] == NULL) {
+		/* decompressed image - extend it if it is short */
+		if (offset + size > image_size[unit]) {
+			UBYTE *data = (UBYTE *) Util_malloc(offset + size);
+			memcpy(data, image_data[unit], image_size[unit]);
+			if (offset > image_size[unit])
+				memset(data + image_size[unit], 0, offset - image_size[unit]);
+			FreeImageData(unit);
+			image_data[unit] = data;
+			image_size[unit] = offset + size;
+		}
+		image_dirty[unit] = TRUE;
+	}
+	if (offset < image_size[unit]) {
+		done = image_size[unit] - offset < (ULONG) size ? (int) (image_size[unit] - offset) : size;
+		memcpy(image_data[unit] + offset, buffer, done);
+		if (done == size)
+			return;
+	}
+	LOCK_FILES();
+	fseek(disk[unit], offset + done, SEEK_SET);
+	fwrite(buffer + done, 1, size - done, disk[unit]);
+	UNLOCK_FILES();
+}
+
+/* Adds SECTOR to the end of the write queue of UNIT. */
+static void QueueDirty(int unit, int sector)
+{
+	dirty_queue[unit][(dirty_head[unit] + dirty_queued[unit]) % sectorcount[unit]] = sector;
+	dirty_queued[unit]++;
+}
+
+/* Removes the first sector from the write queue of UNIT and returns it. */
+static int UnqueueDirty(int unit)
+{
+	int sector = dirty_queue[unit][dirty_head[unit]];
+	dirty_head[unit] = (dirty_head[unit] + 1) % sectorcount[unit];
+	dirty_queued[unit]--;
+	return sector;
+}
+
+/* Removes SECTOR of UNIT from the cache after it was written. */
+static void FreeDirty(int unit, int sector)
+{
+	free(dirty_sectors[unit][sector]);
+	dirty_sectors[unit][sector] = NULL;
+	dirty_total--;
+}
+
+/* Writes the image data that stdio keeps buffered for UNIT to its file. */
+static void FlushFile(int unit)
+{
+	LOCK_FILES();
+	fflush(disk[unit]);
+	UNLOCK_FILES();
+}
+
+#ifdef HAVE_PTHREAD
+static void *FlusherThread(void *arg)
+{
+	LOCK_CACHE();
+	for (;;) {
+		int unit;
+		int sector;
+		dirty_sector_t copy;
+		for (unit = 0; unit < SIO_MAX_DRIVES; unit++)
+			if (dirty_queued[unit] > 0)
+				break;
+		if (unit == SIO_MAX_DRIVES) {
+			if (stop_flusher)
+				break;
+			pthread_cond_wait(&dirty_cond, &cache_mutex);
+			continue;
+		}
+		sector = UnqueueDirty(unit);
+		copy = *dirty_sectors[unit][sector];
+		flushing_unit = unit;
+		UNLOCK_CACHE();
+		WriteImage(unit, copy.offset, copy.data, copy.size);
+		FlushFile(unit);
+		LOCK_CACHE();
+		flushing_unit = -1;
+		/* Keep the sector if it was written again meanwhile. */
+		if (dirty_sectors[unit][sector]->generation == copy.generation)
+			FreeDirty(unit, sector);
+		else
+			QueueDirty(unit, sector);
+		pthread_cond_broadcast(&flushed_cond);
+	}
+	UNLOCK_CACHE();
+	return NULL;
+}
+#endif /* HAVE_PTHREAD */
+
+/* Starts the flusher thread if it is not running.
+   Returns FALSE if dirty sectors can't be written in the background. */
+static int StartFlusher(void)
+{
+#ifdef HAVE_PTHREAD
+	if (!flusher_running && !flusher_failed) {
+		stop_flusher = FALSE;
+		flusher_running = pthread_create(&flusher_thread, NULL, FlusherThread, NULL) == 0;
+		flusher_failed = !flusher_running;
+	}
+	return flusher_running;
+#else
+	return FALSE;
+#endif /* HAVE_PTHREAD */
+}
+
+/* Writes all dirty sectors to the image file of UNIT. */
+static void FlushDirty(int unit)
+{
+	if (dirty_sectors[unit] == NULL)
+		return;
+	LOCK_CACHE();
+#ifdef HAVE_PTHREAD
+	while (flushing_unit == unit)
+		pthread_cond_wait(&flushed_cond, &cache_mutex);
+#endif
+	while (dirty_queued[unit] > 0) {
+		int sector = UnqueueDirty(unit);
+		dirty_sector_t *entry = dirty_sectors[unit][sector];
+		WriteImage(unit, entry->offset, entry->data, entry->size);
+		FreeDirty(unit, sector);
+	}
+	UNLOCK_CACHE();
+	FlushFile(unit);
+}
+
+/* Flushes and frees the write-back cache of UNIT. */
+static void FreeDirtyCache(int unit)
+{
+	FlushDirty(unit);
+	free(dirty_sectors[unit]);
+	free(dirty_queue[unit]);
+	dirty_sectors[unit] = NULL;
+	dirty_queue[unit] = NULL;
+}
+
+/* Writes SIZE bytes from BUFFER to SECTOR at OFFSET of the image in UNIT,
+   through the write-back cache if SIO_flush_policy allows. */
+static void WriteSectorData(int unit, int sector, ULONG offset, const UBYTE *buffer, int size)
+{
+	dirty_sector_t *entry;
+	if (disk[unit] == NULL) {
+		/* decompressed image - kept in memory anyway */
+		WriteImage(unit, offset, buffer, size);
+		return;
+	}
+	if (SIO_flush_policy == SIO_FLUSH_SYNC
+	 || offset + size <= image_size[unit] /* mapped - the OS writes it back */
+	 || (SIO_flush_policy == SIO_FLUSH_BACKGROUND && !StartFlusher())) {
+		WriteImage(unit, offset, buffer, size);
+		if (SIO_flush_policy == SIO_FLUSH_SYNC && offset + size > image_size[unit])
+			FlushFile(unit);
+		return;
+	}
+	LOCK_CACHE();
+	if (dirty_sectors[unit] == NULL) {
+		int i;
+		dirty_sectors[unit] = (dirty_sector_t **) Util_malloc((sectorcount[unit] + 1) * sizeof(dirty_sector_t *));
+		for (i = 0; i <= sectorcount[unit]; i++)
+			dirty_sectors[unit][i] = NULL;
+		dirty_queue[unit] = (int *) Util_malloc(sectorcount[unit] * sizeof(int));
+		dirty_head[unit] = 0;
+		dirty_queued[unit] = 0;
+	}
+	entry = dirty_sectors[unit][sector];
+	if (entry == NULL) {
+		entry = dirty_sectors[unit][sector] = (dirty_sector_t *) Util_malloc(sizeof(dirty_sector_t));
+		entry->generation = 0;
+		dirty_total++;
+		QueueDirty(unit, sector);
+#ifdef HAVE_PTHREAD
+		pthread_cond_signal(&dirty_cond);
+#endif
+	}
+	else
+		entry->generation++;
+	entry->offset = offset;
+	entry->size = size;
+	memcpy(entry->data, buffer, size);
+	UNLOCK_CACHE();
+}
+
+/* Reads SIZE bytes of SECTOR at OFFSET of the image in UNIT to BUFFER,
+   from the write-back cache if the sector is dirty. */
+static int ReadSectorData(int unit, int sector, ULONG offset, UBYTE *buffer, int size)
+{
+	if (dirty_sectors[unit] != NULL) {
+		dirty_sector_t *entry;
+		LOCK_CACHE();
+		entry = dirty_sectors[unit][sector];
+		if (entry != NULL)
+			memcpy(buffer, entry->data, size);
+		UNLOCK_CACHE();
+		if (entry != NULL)
+			return size;
+	}
+	return ReadImage(unit, offset, buffer, size);
+}
+
+void SIO_FlushDisks(void)
+{
+	int unit;
+	for (unit = 0; unit < SIO_MAX_DRIVES; unit++)
+		FlushDirty(unit);
+}
+
+void SIO_StopFlusher(void)
+{
+	SIO_FlushDisks();
+#ifdef HAVE_PTHREAD
+	if (flusher_running) {
+		LOCK_CACHE();
+		stop_flusher = TRUE;
+		pthread_cond_signal(&dirty_cond);
+		UNLOCK_CACHE();
+		pthread_join(flusher_thread, NULL);
+		flusher_running = FALSE;
+	}
+#endif /* HAVE_PTHREAD */
+}
+
+int SIO_SetFlushPolicy(const char *policy)
+{
+	if (Util_stricmp(policy, "sync") == 0)
+		SIO_flush_policy = SIO_FLUSH_SYNC;
+	else if (Util_stricmp(policy, "background") == 0)
+		SIO_flush_policy = SIO_FLUSH_BACKGROUND;
+	else if (Util_stricmp(policy, "dismount") == 0)
+		SIO_flush_policy = SIO_FLUSH_DISMOUNT;
+	else
+		return FALSE;
+	return TRUE;
+}
+
+const char *SIO_GetFlushPolicy(void)
+{
+	switch (SIO_flush_policy) {
+	case SIO_FLUSH_SYNC:
+		return "sync";
+	case SIO_FLUSH_DISMOUNT:
+		return "dismount";
+	default:
+		return "background";
+	}
+}
+
+int SIO_DirtySectors(void)
+{
+	int count;
+	LOCK_CACHE();
+	count = dirty_total;
+	UNLOCK_CACHE();
+	return count;
+}
+
 int SIO_Initialise(int *argc, char *argv[])
 {
 	int i;
+	int j;
+	for (i = j = 1; i < *argc; i++) {
+		int i_a = (i + 1 < *argc);		/* is argument available? */
+		int a_m = FALSE;			/* error, argument missing! */
+
+		if (strcmp(argv[i], "-compressed-rw") == 0)
+			SIO_compressed_writable = TRUE;
+		else if (strcmp(argv[i], "-compressed-ro") == 0)
+			SIO_compressed_writable = FALSE;
+		else if (strcmp(argv[i], "-disk-cache") == 0) {
+			if (i_a)
+				Util_strlcpy(SIO_disk_cache_dir, argv[++i], sizeof(SIO_disk_cache_dir));
+			else a_m = TRUE;
+		}
+		else if (strcmp(argv[i], "-turbo-sio") == 0)
+			SIO_turbo = TRUE;
+		else if (strcmp(argv[i], "-no-turbo-sio") == 0)
+			SIO_turbo = FALSE;
+		else if (strcmp(argv[i], "-disk-flush") == 0) {
+			if (i_a) {
+				if (!SIO_SetFlushPolicy(argv[++i])) {
+					Log_print("Invalid disk flush policy '%s'", argv[i]);
+					return FALSE;
+				}
+			}
+			else a_m = TRUE;
+		}
+		else {
+			if (strcmp(argv[i], "-help") == 0) {
+				Log_print("\t-compressed-rw    Allow writing to DCM and gzip disk images in memory");
+				Log_print("\t-compressed-ro    Mount DCM and gzip disk images read-only");
+				Log_print("\t-disk-cache <dir> Share decompressed disk images through directory <dir>");
+				Log_print("\t-turbo-sio        Accelerate serial disk transfers when SIO patch is off");
+				Log_print("\t-no-turbo-sio     Transfer data at the real disk drive speed");
+				Log_print("\t-disk-flush sync|background|dismount");
+				Log_print("\t                  Write changed disk sectors immediately, in the background,");
+				Log_print("\t                  or only when the disk is removed or the state saved");
+			}
+			argv[j++] = argv[i];
+		}
+
+		if (a_m) {
+			Log_print("Missing argument for '%s'", argv[i]);
+			return FALSE;
+		}
+	}
+	*argc = j;
+
 	for (i = 0; i < SIO_MAX_DRIVES; i++) {
 		strcpy(SIO_filename[i], "Off");
 		SIO_drive_status[i] = SIO_OFF;
@@ -198,139 +708,66 @@ void SIO_Exit(void)
 	int i;
 	for (i = 1; i <= SIO_MAX_DRIVES; i++)
 		SIO_Dismount(i);
+	SIO_StopFlusher();
 }
 
-int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
+/* Recognizes the format of the image in UNIT and sets up its parameters.
+   If the format can't be written, reopens the file read-only.
+   Returns FALSE if the image is invalid. */
+static int ParseImage(int unit, const char *filename, int b_open_readonly, SIO_UnitStatus *status)
 {
-	FILE *f = NULL;
-	SIO_UnitStatus status = SIO_READ_WRITE;
 	struct AFILE_ATR_Header header;
 
-	/* avoid overruns in SIO_filename[] */
-	if (strlen(filename) >= FILENAME_MAX)
+	if (ReadImage(unit, 0, (UBYTE *) &header, sizeof(struct AFILE_ATR_Header)) != sizeof(struct AFILE_ATR_Header))
 		return FALSE;
 
-	/* release previous disk */
-	SIO_Dismount(diskno);
-
-	/* open file */
-	if (!b_open_readonly)
-		f = Util_fopen(filename, "rb+", sio_tmpbuf[diskno - 1]);
-	if (f == NULL) {
-		f = Util_fopen(filename, "rb", sio_tmpbuf[diskno - 1]);
-		if (f == NULL)
-			return FALSE;
-		status = SIO_READ_ONLY;
-	}
-
-	/* read header */
-	if (fread(&header, 1, sizeof(struct AFILE_ATR_Header), f) != sizeof(struct AFILE_ATR_Header)) {
-		fclose(f);
-		return FALSE;
-	}
-
-	/* detect compressed image and uncompress */
-	switch (header.magic1) {
-	case 0xf9:
-	case 0xfa:
-		/* DCM */
-		{
-			FILE *f2 = Util_tmpopen(sio_tmpbuf[diskno - 1]);
-			if (f2 == NULL)
-				return FALSE;
-			Util_rewind(f);
-			if (!CompFile_DCMtoATR(f, f2)) {
-				Util_fclose(f2, sio_tmpbuf[diskno - 1]);
-				fclose(f);
-				return FALSE;
-			}
-			fclose(f);
-			f = f2;
-		}
-		Util_rewind(f);
-		if (fread(&header, 1, sizeof(struct AFILE_ATR_Header), f) != sizeof(struct AFILE_ATR_Header)) {
-			Util_fclose(f, sio_tmpbuf[diskno - 1]);
-			return FALSE;
-		}
-		status = SIO_READ_ONLY;
-		/* XXX: status = b_open_readonly ? SIO_READ_ONLY : SIO_READ_WRITE; */
-		break;
-	case 0x1f:
-		if (header.magic2 == 0x8b) {
-			/* ATZ/ATR.GZ, XFZ/XFD.GZ */
-			fclose(f);
-			f = Util_tmpopen(sio_tmpbuf[diskno - 1]);
-			if (f == NULL)
-				return FALSE;
-			if (!CompFile_ExtractGZ(filename, f)) {
-				Util_fclose(f, sio_tmpbuf[diskno - 1]);
-				return FALSE;
-			}
-			Util_rewind(f);
-			if (fread(&header, 1, sizeof(struct AFILE_ATR_Header), f) != sizeof(struct AFILE_ATR_Header)) {
-				Util_fclose(f, sio_tmpbuf[diskno - 1]);
-				return FALSE;
-			}
-			status = SIO_READ_ONLY;
-			/* XXX: status = b_open_readonly ? SIO_READ_ONLY : SIO_READ_WRITE; */
-		}
-		break;
-	default:
-		break;
-	}
-
-	boot_sectors_type[diskno - 1] = BOOT_SECTORS_LOGICAL;
+	boot_sectors_type[unit] = BOOT_SECTORS_LOGICAL;
 
 	if (header.magic1 == AFILE_ATR_MAGIC1 && header.magic2 == AFILE_ATR_MAGIC2) {
-		/* ATR (may be temporary from DCM or ATR/ATR.GZ) */
-		image_type[diskno - 1] = IMAGE_TYPE_ATR;
+		/* ATR (may be decompressed from DCM or ATR/ATR.GZ) */
+		image_type[unit] = IMAGE_TYPE_ATR;
 
-		sectorsize[diskno - 1] = (header.secsizehi << 8) + header.secsizelo;
-		if (sectorsize[diskno - 1] != 128 && sectorsize[diskno - 1] != 256) {
-			Util_fclose(f, sio_tmpbuf[diskno - 1]);
+		sectorsize[unit] = (header.secsizehi << 8) + header.secsizelo;
+		if (sectorsize[unit] != 128 && sectorsize[unit] != 256)
 			return FALSE;
-		}
 
 		if (header.writeprotect != 0 && !ignore_header_writeprotect)
-			status = SIO_READ_ONLY;
+			*status = SIO_READ_ONLY;
 
 		/* ATR header contains length in 16-byte chunks. */
 		/* First compute number of 128-byte chunks
 		   - it's number of sectors on single density disk */
-		sectorcount[diskno - 1] = ((header.hiseccounthi << 24)
+		sectorcount[unit] = ((header.hiseccounthi << 24)
 			+ (header.hiseccountlo << 16)
 			+ (header.seccounthi << 8)
 			+ header.seccountlo) >> 3;
 
 		/* Fix number of sectors if double density */
-		if (sectorsize[diskno - 1] == 256) {
-			if ((sectorcount[diskno - 1] & 1) != 0)
+		if (sectorsize[unit] == 256) {
+			if ((sectorcount[unit] & 1) != 0)
 				/* logical (128-byte) boot sectors */
-				sectorcount[diskno - 1] += 3;
+				sectorcount[unit] += 3;
 			else {
 				/* 256-byte boot sectors */
 				/* check if physical or SIO2PC: physical if there's
 				   a non-zero byte in bytes 0x190-0x30f of the ATR file */
 				UBYTE buffer[0x180];
 				int i;
-				fseek(f, 0x190, SEEK_SET);
-				if (fread(buffer, 1, 0x180, f) != 0x180) {
-					Util_fclose(f, sio_tmpbuf[diskno - 1]);
+				if (ReadImage(unit, 0x190, buffer, 0x180) != 0x180)
 					return FALSE;
-				}
-				boot_sectors_type[diskno - 1] = BOOT_SECTORS_SIO2PC;
+				boot_sectors_type[unit] = BOOT_SECTORS_SIO2PC;
 				for (i = 0; i < 0x180; i++)
 					if (buffer[i] != 0) {
-						boot_sectors_type[diskno - 1] = BOOT_SECTORS_PHYSICAL;
+						boot_sectors_type[unit] = BOOT_SECTORS_PHYSICAL;
 						break;
 					}
 			}
-			sectorcount[diskno - 1] >>= 1;
+			sectorcount[unit] >>= 1;
 		}
 	}
 	else if (header.magic1 == 'A' && header.magic2 == 'T' && header.seccountlo == '8' &&
 		 header.seccounthi == 'X') {
-		int file_length = Util_flen(f);
+		int file_length = (int) ImageLength(unit);
 		vapi_additional_info_t *info;
 		vapi_file_header_t fileheader;
 		vapi_track_header_t trackheader;
@@ -339,26 +776,25 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 		/* .atx is read only for now */
 #ifndef VAPI_WRITE_ENABLE
 		if (!b_open_readonly) {
-			fclose(f);
-			f = Util_fopen(filename, "rb", sio_tmpbuf[diskno - 1]);
-			if (f == NULL)
-				return FALSE;
-			status = SIO_READ_ONLY;
+			if (disk[unit] != NULL) {
+				fclose(disk[unit]);
+				disk[unit] = Util_fopen(filename, "rb", sio_tmpbuf[unit]);
+				if (disk[unit] == NULL)
+					return FALSE;
+			}
+			*status = SIO_READ_ONLY;
 		}
 #endif
 		
-		image_type[diskno - 1] = IMAGE_TYPE_VAPI;
-		sectorsize[diskno - 1] = 128;
-		sectorcount[diskno - 1] = 720;
-		fseek(f,0,SEEK_SET);
-		if (fread(&fileheader,1,sizeof(fileheader),f) != sizeof(fileheader)) {
-			Util_fclose(f, sio_tmpbuf[diskno - 1]);
+		image_type[unit] = IMAGE_TYPE_VAPI;
+		sectorsize[unit] = 128;
+		sectorcount[unit] = 720;
+		if (ReadImage(unit, 0, (UBYTE *) &fileheader, sizeof(fileheader)) != sizeof(fileheader)) {
 			Log_print("VAPI: Bad File Header");
 			return(FALSE);
 			}
 		trackoffset = VAPI_32(fileheader.startdata);	
 		if (trackoffset > file_length) {
-			Util_fclose(f, sio_tmpbuf[diskno - 1]);
 			Log_print("VAPI: Bad Track Offset");
 			return(FALSE);
 			}
@@ -371,9 +807,7 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 			ULONG next;
 			UWORD tracktype;
 
-			fseek(f,trackoffset,SEEK_SET);
-			if (fread(&trackheader,1,sizeof(trackheader),f) != sizeof(trackheader)) {
-				Util_fclose(f, sio_tmpbuf[diskno - 1]);
+			if (ReadImage(unit, trackoffset, (UBYTE *) &trackheader, sizeof(trackheader)) != sizeof(trackheader)) {
 				Log_print("VAPI: Bad Track Header");
 				return(FALSE);
 				}
@@ -386,10 +820,10 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 		}
 
 		info = (vapi_additional_info_t *)Util_malloc(sizeof(vapi_additional_info_t));
-		additional_info[diskno-1] = info;
-		info->sectors = (vapi_sec_info_t *)Util_malloc(sectorcount[diskno - 1] * 
+		additional_info[unit] = info;
+		info->sectors = (vapi_sec_info_t *)Util_malloc(sectorcount[unit] * 
  					    sizeof(vapi_sec_info_t));
-		memset(info->sectors, 0, sectorcount[diskno - 1] * 
+		memset(info->sectors, 0, sectorcount[unit] * 
  					 sizeof(vapi_sec_info_t));
 
 		/* Now read all the sector data */
@@ -402,11 +836,7 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 			UWORD tracktype;
 			int j;
 
-			fseek(f,trackoffset,SEEK_SET);
-			if (fread(&trackheader,1,sizeof(trackheader),f) != sizeof(trackheader)) {
-				free(info->sectors);
-				free(info);
-				Util_fclose(f, sio_tmpbuf[diskno - 1]);
+			if (ReadImage(unit, trackoffset, (UBYTE *) &trackheader, sizeof(trackheader)) != sizeof(trackheader)) {
 				Log_print("VAPI: Bad Track Header while reading sectors");
 				return(FALSE);
 				}
@@ -420,35 +850,26 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 #endif
 			if (tracktype == 0) {
 				if (seclistdata > file_length) {
-					free(info->sectors);
-					free(info);
-					Util_fclose(f, sio_tmpbuf[diskno - 1]);
 					Log_print("VAPI: Bad Sector List Offset");
 					return(FALSE);
 					}
-				fseek(f,seclistdata,SEEK_SET);
-				if (fread(&sectorlist,1,sizeof(sectorlist),f) != sizeof(sectorlist)) {
-					free(info->sectors);
-					free(info);
-					Util_fclose(f, sio_tmpbuf[diskno - 1]);
+				if (ReadImage(unit, seclistdata, (UBYTE *) &sectorlist, sizeof(sectorlist)) != sizeof(sectorlist)) {
 					Log_print("VAPI: Bad Sector List");
 					return(FALSE);
 					}
+				seclistdata += sizeof(sectorlist);
 #ifdef DEBUG_VAPI
 				Log_print("Size sec list %x type %d",VAPI_32(sectorlist.sizelist),sectorlist.type);
 #endif
 				for (j=0;j<sectorcnt;j++) {
 					double percent_rot;
 
-					if (fread(&sectorheader,1,sizeof(sectorheader),f) != sizeof(sectorheader)) {
-						free(info->sectors);
-						free(info);
-						Util_fclose(f, sio_tmpbuf[diskno - 1]);
+					if (ReadImage(unit, seclistdata, (UBYTE *) &sectorheader, sizeof(sectorheader)) != sizeof(sectorheader)) {
 						Log_print("VAPI: Bad Sector Header");
 						return(FALSE);
 						}
+					seclistdata += sizeof(sectorheader);
 					if (sectorheader.sectornum > 18)  {
-						Util_fclose(f, sio_tmpbuf[diskno - 1]);
 						Log_print("VAPI: Bad Sector Index: Track %d Sec Num %d Index %d",
 								trackheader.tracknum,j,sectorheader.sectornum);
 						return(FALSE);
@@ -461,9 +882,6 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 					sector->sec_status[sector->sec_count] = ~sectorheader.sectorstatus;
 					sector->sec_count++;
 					if (sector->sec_count > MAX_VAPI_PHANTOM_SEC) {
-						free(info->sectors);
-						free(info);
-						Util_fclose(f, sio_tmpbuf[diskno - 1]);
 						Log_print("VAPI: Too many Phantom Sectors");
 						return(FALSE);
 						}
@@ -485,7 +903,7 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 		}			
 	}
 	else {
-		int file_length = Util_flen(f);
+		int file_length = (int) ImageLength(unit);
 		/* check for PRO */
 		if ((file_length-16)%(128+12) == 0 &&
 				(header.magic1*256 + header.magic2 == (file_length-16)/(128+12)) &&
@@ -493,80 +911,306 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 			pro_additional_info_t *info;
 			/* .pro is read only for now */
 			if (!b_open_readonly) {
-				fclose(f);
-				f = Util_fopen(filename, "rb", sio_tmpbuf[diskno - 1]);
-				if (f == NULL)
-					return FALSE;
-				status = SIO_READ_ONLY;
+				if (disk[unit] != NULL) {
+					fclose(disk[unit]);
+					disk[unit] = Util_fopen(filename, "rb", sio_tmpbuf[unit]);
+					if (disk[unit] == NULL)
+						return FALSE;
+				}
+				*status = SIO_READ_ONLY;
 			}
-			image_type[diskno - 1] = IMAGE_TYPE_PRO;
-			sectorsize[diskno - 1] = 128;
+			image_type[unit] = IMAGE_TYPE_PRO;
+			sectorsize[unit] = 128;
 			if (file_length >= 1040*(128+12)+16) {
 				/* assume enhanced density */
-				sectorcount[diskno - 1] = 1040;
+				sectorcount[unit] = 1040;
 			}
 			else {
 				/* assume single density */
-				sectorcount[diskno - 1] = 720;
+				sectorcount[unit] = 720;
 			}
 
 			info = (pro_additional_info_t *)Util_malloc(sizeof(pro_additional_info_t));
-			additional_info[diskno-1] = info;
-			info->count = (unsigned char *)Util_malloc(sectorcount[diskno - 1]);
-			memset(info->count, 0, sectorcount[diskno -1]);
+			additional_info[unit] = info;
+			info->count = (unsigned char *)Util_malloc(sectorcount[unit]);
+			memset(info->count, 0, sectorcount[unit]);
 			info->max_sector = (file_length-16)/(128+12);
 		}
 		else {
-			/* XFD (may be temporary from XFZ/XFD.GZ) */
+			/* XFD (may be decompressed from XFZ/XFD.GZ) */
 
-			image_type[diskno - 1] = IMAGE_TYPE_XFD;
+			image_type[unit] = IMAGE_TYPE_XFD;
 
 			if (file_length <= (1040 * 128)) {
 				/* single density */
-				sectorsize[diskno - 1] = 128;
-				sectorcount[diskno - 1] = file_length >> 7;
+				sectorsize[unit] = 128;
+				sectorcount[unit] = file_length >> 7;
 			}
 			else {
 				/* double density */
-				sectorsize[diskno - 1] = 256;
+				sectorsize[unit] = 256;
 				if ((file_length & 0xff) == 0) {
-					boot_sectors_type[diskno - 1] = BOOT_SECTORS_PHYSICAL;
-					sectorcount[diskno - 1] = file_length >> 8;
+					boot_sectors_type[unit] = BOOT_SECTORS_PHYSICAL;
+					sectorcount[unit] = file_length >> 8;
 				}
 				else
-					sectorcount[diskno - 1] = (file_length + 0x180) >> 8;
+					sectorcount[unit] = (file_length + 0x180) >> 8;
 			}
 		}
 	}
 
 #ifdef DEBUG
 	Log_print("sectorcount = %d, sectorsize = %d",
-		   sectorcount[diskno - 1], sectorsize[diskno - 1]);
+		   sectorcount[unit], sectorsize[unit]);
+#endif
+	SIO_format_sectorsize[unit] = sectorsize[unit];
+	SIO_format_sectorcount[unit] = sectorcount[unit];
+	return TRUE;
+}
+
+/* Frees the information about copy-protected sectors of UNIT. */
+static void FreeAdditionalInfo(int unit)
+{
+	if (additional_info[unit] == NULL)
+		return;
+	if (image_type[unit] == IMAGE_TYPE_PRO) {
+		free(((pro_additional_info_t *)additional_info[unit])->count);
+	}
+	else if (image_type[unit] == IMAGE_TYPE_VAPI) {
+		free(((vapi_additional_info_t *)additional_info[unit])->sectors);
+	}
+	free(additional_info[unit]);
+	additional_info[unit] = NULL;
+}
+
+/* Decompressed images can be stored in SIO_disk_cache_dir, so that
+   several emulator instances mounting the same compressed image decompress
+   it only once and share its memory. Cache files are named after CRC32 and
+   length of the compressed file and are never modified once written. */
+
+/* Stores name of the cache file for compressed image F in PATH. */
+static int CachePath(FILE *f, char *path)
+{
+	ULONG crc;
+	char name[32];
+	Util_rewind(f);
+	if (!CRC32_FromFile(f, &crc))
+		return FALSE;
+	snprintf(name, sizeof(name), "%08lx-%d.img", (unsigned long) crc, Util_flen(f));
+	Util_catpath(path, SIO_disk_cache_dir, name);
+	return TRUE;
+}
+
+/* Loads the cache file PATH as the decompressed image of UNIT.
+   Where possible it is mapped privately: pages are shared with other
+   instances until written to, and writes are copy-on-write. */
+static int LoadCachedImage(int unit, const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	long size;
+	if (f == NULL)
+		return FALSE;
+	size = Util_flen(f);
+	if (size <= 0) {
+		fclose(f);
+		return FALSE;
+	}
+#ifdef SIO_MMAP
+	{
+		void *map = mmap(NULL, (size_t) size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(f), 0);
+		if (map != MAP_FAILED) {
+			fclose(f);
+			image_data[unit] = (UBYTE *) map;
+			image_size[unit] = (ULONG) size;
+			image_cached[unit] = TRUE;
+			return TRUE;
+		}
+	}
 #endif
-	SIO_format_sectorsize[diskno - 1] = sectorsize[diskno - 1];
-	SIO_format_sectorcount[diskno - 1] = sectorcount[diskno - 1];
+	image_data[unit] = (UBYTE *) Util_malloc(size);
+	if (fread(image_data[unit], 1, size, f) != (size_t) size) {
+		fclose(f);
+		FreeImageData(unit);
+		return FALSE;
+	}
+	fclose(f);
+	image_size[unit] = (ULONG) size;
+	return TRUE;
+}
+
+/* Writes the decompressed image of UNIT to the cache file PATH. The file
+   is written under a temporary name and renamed, so other instances never
+   see an incomplete image. */
+static void StoreCachedImage(int unit, const char *path)
+{
+	char tmp_path[FILENAME_MAX];
+	FILE *f;
+	int ok;
+#ifdef HAVE_UNISTD_H
+	snprintf(tmp_path, sizeof(tmp_path), "%s.%ld", path, (long) getpid());
+#else
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+#endif
+	f = fopen(tmp_path, "wb");
+	if (f == NULL) {
+		Log_print("Cannot write disk cache file %s", tmp_path);
+		return;
+	}
+	ok = fwrite(image_data[unit], 1, image_size[unit], f) == image_size[unit];
+	ok = fclose(f) == 0 && ok;
+	if (!ok || rename(tmp_path, path) != 0) {
+		/* on some systems rename() fails if another instance was first */
+		Util_unlink(tmp_path);
+		return;
+	}
+#ifdef SIO_MMAP
+	/* Share the pages with other instances from now on. */
+	{
+		UBYTE *data = image_data[unit];
+		ULONG size = image_size[unit];
+		image_data[unit] = NULL;
+		image_size[unit] = 0;
+		if (LoadCachedImage(unit, path) && image_size[unit] == size)
+			free(data);
+		else {
+			if (image_data[unit] != NULL)
+				FreeImageData(unit);
+			image_data[unit] = data;
+			image_size[unit] = size;
+		}
+	}
+#endif
+}
+
+int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
+{
+	FILE *f = NULL;
+	SIO_UnitStatus status = SIO_READ_WRITE;
+	UBYTE magic[2];
+	char cache_path[FILENAME_MAX];
+
+	/* avoid overruns in SIO_filename[] */
+	if (strlen(filename) >= FILENAME_MAX)
+		return FALSE;
+
+	/* release previous disk */
+	SIO_Dismount(diskno);
+	/* a new disk may come with a loader that copes with full turbo speed */
+	turbo_interval = SIO_TURBO_INTERVAL;
+	turbo_good_transfers = 0;
+
+	/* open file */
+	if (!b_open_readonly)
+		f = Util_fopen(filename, "rb+", sio_tmpbuf[diskno - 1]);
+	if (f == NULL) {
+		f = Util_fopen(filename, "rb", sio_tmpbuf[diskno - 1]);
+		if (f == NULL)
+			return FALSE;
+		status = SIO_READ_ONLY;
+	}
+
+	/* read header */
+	if (fread(magic, 1, 2, f) != 2) {
+		fclose(f);
+		return FALSE;
+	}
+
+	/* detect compressed image and uncompress it to memory */
+	cache_path[0] = '\0';
+	if (magic[0] == 0xf9 || magic[0] == 0xfa || (magic[0] == 0x1f && magic[1] == 0x8b)) {
+		int success;
+		if (SIO_disk_cache_dir[0] != '\0' && !CachePath(f, cache_path))
+			cache_path[0] = '\0';
+		if (magic[0] == 0x1f) {
+			/* ATZ/ATR.GZ, XFZ/XFD.GZ */
+			image_compression[diskno - 1] = IMAGE_COMPRESSION_GZ;
+			success = (cache_path[0] != '\0' && LoadCachedImage(diskno - 1, cache_path))
+				|| CompFile_ExtractGZToMemory(filename, &image_data[diskno - 1], &image_size[diskno - 1]);
+		}
+		else {
+			/* DCM */
+			image_compression[diskno - 1] = IMAGE_COMPRESSION_DCM;
+			Util_rewind(f);
+			success = (cache_path[0] != '\0' && LoadCachedImage(diskno - 1, cache_path))
+				|| CompFile_DCMtoATRMemory(f, &image_data[diskno - 1], &image_size[diskno - 1]);
+		}
+		fclose(f);
+		f = NULL;
+		if (!success) {
+			image_compression[diskno - 1] = IMAGE_COMPRESSION_NONE;
+			return FALSE;
+		}
+		/* Changes stay in memory until SIO_SaveImage() is called. */
+		if (!SIO_compressed_writable)
+			status = SIO_READ_ONLY;
+	}
+	disk[diskno - 1] = f;
+
+	if (!ParseImage(diskno - 1, filename, b_open_readonly, &status)) {
+		FreeAdditionalInfo(diskno - 1);
+		CloseImage(diskno - 1);
+		return FALSE;
+	}
+
+	/* The image is valid - keep it in the cache for other instances. */
+	if (cache_path[0] != '\0' && !image_cached[diskno - 1] && !Util_fileexists(cache_path))
+		StoreCachedImage(diskno - 1, cache_path);
+
 	strcpy(SIO_filename[diskno - 1], filename);
 	SIO_drive_status[diskno - 1] = status;
-	disk[diskno - 1] = f;
+#ifdef SIO_MMAP
+	if (disk[diskno - 1] != NULL)
+		MapImage(diskno - 1);
+#endif
 	return TRUE;
 }
 
 void SIO_Dismount(int diskno)
 {
-	if (disk[diskno - 1] != NULL) {
-		Util_fclose(disk[diskno - 1], sio_tmpbuf[diskno - 1]);
-		disk[diskno - 1] = NULL;
+	if (IMAGE_MOUNTED(diskno - 1)) {
+		CloseImage(diskno - 1);
 		SIO_drive_status[diskno - 1] = SIO_NO_DISK;
 		strcpy(SIO_filename[diskno - 1], "Empty");
-		if (image_type[diskno - 1] == IMAGE_TYPE_PRO) {
-			free(((pro_additional_info_t *)additional_info[diskno-1])->count);
-		}
-		else if (image_type[diskno - 1] == IMAGE_TYPE_VAPI) {
-			free(((vapi_additional_info_t *)additional_info[diskno-1])->sectors);
+		FreeAdditionalInfo(diskno - 1);
+	}
+}
+
+int SIO_SaveImage(int diskno, const char *filename)
+{
+	int unit = diskno - 1;
+	FILE *fp;
+	if (image_compression[unit] == IMAGE_COMPRESSION_NONE)
+		return FALSE;
+	if (filename == NULL) {
+		if (image_compression[unit] == IMAGE_COMPRESSION_DCM) {
+			Log_print("D%d: cannot compress to DCM, save the disk to another file", diskno);
+			return FALSE;
 		}
-		free(additional_info[diskno - 1]);
-		additional_info[diskno - 1] = 0;
+#ifdef HAVE_LIBZ
+		if (!CompFile_CompressGZ(SIO_filename[unit], image_data[unit], image_size[unit]))
+			return FALSE;
+		image_dirty[unit] = FALSE;
+		return TRUE;
+#else
+		return FALSE;
+#endif
 	}
+	fp = fopen(filename, "wb");
+	if (fp == NULL)
+		return FALSE;
+	if (fwrite(image_data[unit], 1, image_size[unit], fp) != image_size[unit]) {
+		fclose(fp);
+		return FALSE;
+	}
+	if (fclose(fp) != 0)
+		return FALSE;
+	image_dirty[unit] = FALSE;
+	return TRUE;
+}
+
+int SIO_ImageModified(int diskno)
+{
+	return image_dirty[diskno - 1];
 }
 
 void SIO_DisableDrive(int diskno)
@@ -629,15 +1273,13 @@ void SIO_SizeOfSector(UBYTE unit, int sector, int *sz, ULONG *ofs)
 		*ofs = offset;
 }
 
-static int SeekSector(int unit, int sector)
+static int SeekSector(int unit, int sector, ULONG *offset)
 {
-	ULONG offset;
 	int size;
 
 	SIO_last_sector = sector;
 	snprintf(SIO_status, sizeof(SIO_status), "%d: %d", unit + 1, sector);
-	SIO_SizeOfSector((UBYTE) unit, sector, &size, &offset);
-	fseek(disk[unit], offset, SEEK_SET);
+	SIO_SizeOfSector((UBYTE) unit, sector, &size, offset);
 
 	return size;
 }
@@ -646,33 +1288,36 @@ static int SeekSector(int unit, int sector)
 int SIO_ReadSector(int unit, int sector, UBYTE *buffer)
 {
 	int size;
+	ULONG offset;
 	if (BINLOAD_start_binloading)
 		return BINLOAD_LoaderStart(buffer);
 
 	io_success[unit] = -1;
 	if (SIO_drive_status[unit] == SIO_OFF)
 		return 0;
-	if (disk[unit] == NULL)
+	if (!IMAGE_MOUNTED(unit))
 		return 'N';
 	if (sector <= 0 || sector > sectorcount[unit])
 		return 'E';
 	SIO_last_op = SIO_LAST_READ;
 	SIO_last_op_time = 1;
 	SIO_last_drive = unit + 1;
+	timing_sensitive = image_type[unit] == IMAGE_TYPE_VAPI;
 	/* FIXME: what sector size did the user expect? */
-	size = SeekSector(unit, sector);
+	size = SeekSector(unit, sector, &offset);
 	if (image_type[unit] == IMAGE_TYPE_PRO) {
 		pro_additional_info_t *info;
 		unsigned char *count;
 		info = (pro_additional_info_t *)additional_info[unit];
 		count = info->count;
-		if (fread(buffer, 1, 12, disk[unit]) < 12) {
+		if (ReadImage(unit, offset, buffer, 12) < 12) {
 			Log_print("Error in header of .pro image: sector:%d", sector);
 			return 'E';
 		}
 		/* handle duplicate sectors */
 		if (buffer[5] != 0) {
 			int dupnum = count[sector];
+			timing_sensitive = TRUE;
 #ifdef DEBUG_PRO
 			Log_print("duplicate sector:%d dupnum:%d",sector, dupnum);
 #endif
@@ -684,17 +1329,20 @@ int SIO_ReadSector(int unit, int sector, UBYTE *buffer)
 					Log_print("Error in .pro image: sector:%d dupnum:%d", sector, dupnum);
 					return 'E';
 				}
-				size = SeekSector(unit, sector);
+				size = SeekSector(unit, sector, &offset);
 				/* read sector header */
-				if (fread(buffer, 1, 12, disk[unit]) < 12) {
+				if (ReadImage(unit, offset, buffer, 12) < 12) {
 					Log_print("Error in header2 of .pro image: sector:%d dupnum:%d", sector, dupnum);
 					return 'E';
 				}
 			}
 		}
+		/* sector data follows the header */
+		offset += 12;
 		/* bad sector */
 		if (buffer[1] != 0xff) {
-			if (fread(buffer, 1, size, disk[unit]) < size) {
+			timing_sensitive = TRUE;
+			if (ReadImage(unit, offset, buffer, size) < size) {
 				Log_print("Error in bad sector of .pro image: sector:%d", sector);
 			}
 			io_success[unit] = sector;
@@ -786,13 +1434,13 @@ int SIO_ReadSector(int unit, int sector, UBYTE *buffer)
 		if (secinfo->sec_count > 1)
 			Log_print("duplicate sector:%d dupnum:%d delay:%d",sector, secindex,info->vapi_delay_time);
 #endif
-		fseek(disk[unit],secinfo->sec_offset[secindex],SEEK_SET);
+		offset = secinfo->sec_offset[secindex];
 		info->sec_stat_buff[0] = 0x8 | ((secinfo->sec_status[secindex] == 0xFF) ? 0 : 0x04);
 		info->sec_stat_buff[1] = secinfo->sec_status[secindex];
 		info->sec_stat_buff[2] = 0xe0;
 		info->sec_stat_buff[3] = 0;
 		if (secinfo->sec_status[secindex] != 0xFF) {
-			if (fread(buffer, 1, size, disk[unit]) < size) {
+			if (ReadImage(unit, offset, buffer, size) < size) {
 				Log_print("error reading sector:%d", sector);
 			}
 			io_success[unit] = sector;
@@ -816,7 +1464,7 @@ int SIO_ReadSector(int unit, int sector, UBYTE *buffer)
 		Log_flushlog();
 #endif		
 	}
-	if (fread(buffer, 1, size, disk[unit]) < size) {
+	if (ReadSectorData(unit, sector, offset, buffer, size) < size) {
 		Log_print("incomplete sector num:%d", sector);
 	}
 	io_success[unit] = 0;
@@ -826,10 +1474,11 @@ int SIO_ReadSector(int unit, int sector, UBYTE *buffer)
 int SIO_WriteSector(int unit, int sector, const UBYTE *buffer)
 {
 	int size;
+	ULONG offset;
 	io_success[unit] = -1;
 	if (SIO_drive_status[unit] == SIO_OFF)
 		return 0;
-	if (disk[unit] == NULL)
+	if (!IMAGE_MOUNTED(unit))
 		return 'N';
 	if (SIO_drive_status[unit] != SIO_READ_WRITE || sector <= 0 || sector > sectorcount[unit])
 		return 'E';
@@ -854,9 +1503,8 @@ int SIO_WriteSector(int unit, int sector, const UBYTE *buffer)
 			return 'E';
 		}
 		
-		size = SeekSector(unit, sector);
-		fseek(disk[unit],secinfo->sec_offset[0],SEEK_SET);
-		fwrite(buffer, 1, size, disk[unit]);
+		size = SeekSector(unit, sector, &offset);
+		WriteImage(unit, secinfo->sec_offset[0], buffer, size);
 		io_success[unit] = 0;
 		return 'C';
 #if 0		
@@ -872,13 +1520,13 @@ int SIO_WriteSector(int unit, int sector, const UBYTE *buffer)
 			return 'E';
 		}
 		
-		size = SeekSector(unit, sector);
+		size = SeekSector(unit, sector, &offset);
 		if (buffer[1] != 0xff) {
 #endif			
 	} 
 #endif
-	size = SeekSector(unit, sector);
-	fwrite(buffer, 1, size, disk[unit]);
+	size = SeekSector(unit, sector, &offset);
+	WriteSectorData(unit, sector, offset, buffer, size);
 	io_success[unit] = 0;
 	return 'C';
 }
@@ -890,12 +1538,13 @@ int SIO_FormatDisk(int unit, UBYTE *buffer, int sectsize, int sectcount)
 	int save_boot_sectors_type;
 	int bootsectsize;
 	int bootsectcount;
+	struct AFILE_ATR_Header header;
 	FILE *f;
 	int i;
 	io_success[unit] = -1;
 	if (SIO_drive_status[unit] == SIO_OFF)
 		return 0;
-	if (disk[unit] == NULL)
+	if (!IMAGE_MOUNTED(unit))
 		return 'N';
 	if (SIO_drive_status[unit] != SIO_READ_WRITE)
 		return 'E';
@@ -911,16 +1560,7 @@ int SIO_FormatDisk(int unit, UBYTE *buffer, int sectsize, int sectcount)
 	if (sectsize == 256 && save_boot_sectors_type != BOOT_SECTORS_LOGICAL)
 		bootsectsize = 256;
 	bootsectcount = sectcount < 3 ? sectcount : 3;
-	/* Umount the file and open it in "wb" mode (it will truncate the file) */
-	SIO_Dismount(unit + 1);
-	f = fopen(fname, "wb");
-	if (f == NULL) {
-		Log_print("SIO_FormatDisk: failed to open %s for writing", fname);
-		return 'E';
-	}
-	/* Write ATR header if necessary */
 	if (is_atr) {
-		struct AFILE_ATR_Header header;
 		ULONG disksize = (bootsectsize * bootsectcount + sectsize * (sectcount - bootsectcount)) >> 4;
 		memset(&header, 0, sizeof(header));
 		header.magic1 = AFILE_ATR_MAGIC1;
@@ -931,18 +1571,43 @@ int SIO_FormatDisk(int unit, UBYTE *buffer, int sectsize, int sectcount)
 		header.seccounthi = (UBYTE) (disksize >> 8);
 		header.hiseccountlo = (UBYTE) (disksize >> 16);
 		header.hiseccounthi = (UBYTE) (disksize >> 24);
-		fwrite(&header, 1, sizeof(header), f);
-	}
-	/* Write boot sectors */
-	memset(buffer, 0, sectsize);
-	for (i = 1; i <= bootsectcount; i++)
-		fwrite(buffer, 1, bootsectsize, f);
-	/* Write regular sectors */
-	for ( ; i <= sectcount; i++)
-		fwrite(buffer, 1, sectsize, f);
-	/* Close file and mount the disk back */
-	fclose(f);
-	SIO_Mount(unit + 1, fname, FALSE);
+	}
+	if (image_compression[unit] != IMAGE_COMPRESSION_NONE) {
+		/* Decompressed image - format it in memory */
+		SIO_UnitStatus status = SIO_READ_WRITE;
+		ULONG size = (is_atr ? sizeof(header) : 0) + bootsectsize * bootsectcount + sectsize * (sectcount - bootsectcount);
+		FreeAdditionalInfo(unit);
+		FreeImageData(unit);
+		image_data[unit] = (UBYTE *) Util_malloc(size);
+		memset(image_data[unit], 0, size);
+		if (is_atr)
+			memcpy(image_data[unit], &header, sizeof(header));
+		image_size[unit] = size;
+		image_dirty[unit] = TRUE;
+		ParseImage(unit, fname, FALSE, &status);
+	}
+	else {
+		/* Umount the file and open it in "wb" mode (it will truncate the file) */
+		SIO_Dismount(unit + 1);
+		f = fopen(fname, "wb");
+		if (f == NULL) {
+			Log_print("SIO_FormatDisk: failed to open %s for writing", fname);
+			return 'E';
+		}
+		/* Write ATR header if necessary */
+		if (is_atr)
+			fwrite(&header, 1, sizeof(header), f);
+		/* Write boot sectors */
+		memset(buffer, 0, sectsize);
+		for (i = 1; i <= bootsectcount; i++)
+			fwrite(buffer, 1, bootsectsize, f);
+		/* Write regular sectors */
+		for ( ; i <= sectcount; i++)
+			fwrite(buffer, 1, sectsize, f);
+		/* Close file and mount the disk back */
+		fclose(f);
+		SIO_Mount(unit + 1, fname, FALSE);
+	}
 	/* We want to keep the current PHYSICAL/SIO2PC boot sectors type
 	   (since the image is blank it can't be figured out by SIO_Mount) */
 	if (bootsectsize == 256)
@@ -1066,8 +1731,9 @@ int SIO_DriveStatus(int unit, UBYTE *buffer)
 	/* .PRO contains status information in the sector header */
 	if (io_success[unit] != 0  && image_type[unit] == IMAGE_TYPE_PRO) {
 		int sector = io_success[unit];
-		SeekSector(unit, sector);
-		if (fread(buffer, 1, 4, disk[unit]) < 4) {
+		ULONG offset;
+		SeekSector(unit, sector, &offset);
+		if (ReadImage(unit, offset, buffer, 4) < 4) {
 			Log_print("SIO_DriveStatus: failed to read sector header");
 		}
 		return 'C';
@@ -1084,7 +1750,7 @@ int SIO_DriveStatus(int unit, UBYTE *buffer)
 		return 'C';
 	}	
 	buffer[0] = 16;         /* drive active */
-	buffer[1] = disk[unit] != NULL ? 255 /* WD 177x OK */ : 127 /* no disk */;
+	buffer[1] = IMAGE_MOUNTED(unit) ? 255 /* WD 177x OK */ : 127 /* no disk */;
 	if (io_success[unit] != 0)
 		buffer[0] |= 4;     /* failed RW-operation */
 	if (SIO_drive_status[unit] == SIO_READ_ONLY)
@@ -1118,6 +1784,21 @@ void SIO_Handler(void)
 	int realsize = 0;
 	int cmd = MEMORY_dGetByte(0x302);
 
+	if (Atari800_boot_capture && MEMORY_dGetByte(0x300) == 0x31 && MEMORY_dGetByte(0x301) == 1
+	    && cmd == 0x52 && sector == 1)
+		/* The OS is initialised and reads the boot sector. */
+		Atari800_SaveBootSnapshot();
+
+	if (!ESC_enable_sio_patch
+	    && !(BINLOAD_start_binloading && BINLOAD_xex_inject && !BINLOAD_slow_xex_loading)
+	    && (MEMORY_dGetByte(0x300) != 0x60 || cmd != 0x52 || !CASSETTE_CanReadInstantly())) {
+		/* Only instant tape loading or XEX injection is patched in.
+		   Continue in the OS SIO routine, which also reads the records
+		   that can't be loaded instantly. */
+		CPU_regPC = SIO_os_routine;
+		return;
+	}
+
 	if ((unsigned int)MEMORY_dGetByte(0x300) + (unsigned int)MEMORY_dGetByte(0x301) > 0xff) {
 		/* carry */
 		unit++;
@@ -1251,6 +1932,14 @@ void SIO_Handler(void)
 		UBYTE gaps = MEMORY_dGetByte(0x30b);
 		switch (cmd){
 		case 0x52:	/* read */
+			if (!ESC_enable_sio_patch) {
+				/* instant tape loading - the gap is not waited for */
+				if (CASSETTE_ReadInstantly(data, length))
+					result = 'C';
+				else
+					result = 'E';
+				break;
+			}
 			/* set expected Gap */
 			CASSETTE_AddGap(gaps == 0 ? 2000 : 160);
 			/* get record from storage medium */
@@ -1337,6 +2026,34 @@ UBYTE SIO_ChkSum(const UBYTE *buffer, int length)
 	return checksum;
 }
 
+/* Decides whether the data of the command in CommandFrame is sent
+   at turbo speed. */
+static void TurboCommand(void)
+{
+	if (!SIO_turbo) {
+		turbo_transfer = FALSE;
+		return;
+	}
+	if (turbo_lost && memcmp(CommandFrame, turbo_command, 4) == 0) {
+		/* The Atari missed bytes of the last transfer and repeats the
+		   command. Repeating a command that it received completely (e.g.
+		   polling the drive status) doesn't reduce the speed. */
+		turbo_good_transfers = 0;
+		if (turbo_interval < SIO_SERIN_INTERVAL) {
+			turbo_interval <<= 1;
+			Log_print("Turbo SIO: slowed down to %d scanlines per byte", turbo_interval);
+		}
+	}
+	else if (++turbo_good_transfers >= TURBO_RECOVER_TRANSFERS && turbo_interval > SIO_TURBO_INTERVAL) {
+		turbo_good_transfers = 0;
+		turbo_interval >>= 1;
+		Log_print("Turbo SIO: sped up to %d scanlines per byte", turbo_interval);
+	}
+	memcpy(turbo_command, CommandFrame, 4);
+	turbo_transfer = turbo_interval < SIO_SERIN_INTERVAL;
+	turbo_lost = FALSE;
+}
+
 static UBYTE Command_Frame(void)
 {
 	int unit;
@@ -1354,6 +2071,7 @@ static UBYTE Command_Frame(void)
 		TransferStatus = SIO_NoFrame;
 		return 0;
 	}
+	TurboCommand();
 	switch (CommandFrame[1]) {
 	case 0x4e:				/* Read Status */
 #ifdef DEBUG
@@ -1403,11 +2121,16 @@ static UBYTE Command_Frame(void)
 			CommandFrame[3], CommandFrame[4]);
 #endif
 		SIO_SizeOfSector((UBYTE) unit, sector, &realsize, NULL);
+		timing_sensitive = FALSE;
 		DataBuffer[0] = SIO_ReadSector(unit, sector, DataBuffer + 1);
 		DataBuffer[1 + realsize] = SIO_ChkSum(DataBuffer + 1, realsize);
 		DataIndex = 0;
 		ExpectedBytes = 2 + realsize;
 		TransferStatus = SIO_ReadFrame;
+		/* Protected sectors are checked by timing the drive - and a failed
+		   read is retried anyway, which is not a sign of lost bytes. */
+		if (timing_sensitive || DataBuffer[0] != 'C')
+			turbo_transfer = FALSE;
 		/* wait longer before confirmation because bytes could be lost */
 		/* before the buffer was set (see $E9FB & $EA37 in XL-OS) */
 		POKEY_DELAYED_SERIN_IRQ = SIO_SERIN_INTERVAL << 2; 
@@ -1534,6 +2257,15 @@ static UBYTE WriteSectorBack(void)
 /* Put a byte that comes out of POKEY. So get it here... */
 void SIO_PutByte(int byte)
 {
+	int device = (TransferStatus == SIO_CommandFrame && CommandIndex == 0) ? byte : CommandFrame[0];
+
+	/* Bytes sent to a disk drive can't get lost, so with turbo SIO they
+	   go out faster than the Atari would send them. */
+	if (SIO_turbo && (POKEY_SKCTL & 0x08) == 0 && device >= 0x31 && device <= 0x38
+	 && (TransferStatus == SIO_CommandFrame || TransferStatus == SIO_WriteFrame)) {
+		POKEY_DELAYED_SEROUT_IRQ = SIO_TURBO_INTERVAL;
+		POKEY_DELAYED_XMTDONE_IRQ = 2 * SIO_TURBO_INTERVAL - 1;
+	}
 	switch (TransferStatus) {
 	case SIO_CommandFrame:
 		if (CommandIndex < ExpectedBytes) {
@@ -1585,7 +2317,8 @@ void SIO_PutByte(int byte)
 		break;
 	}
 	CASSETTE_PutByte(byte);
-	/* POKEY_DELAYED_SEROUT_IRQ = SIO_SEROUT_INTERVAL; */ /* already set in pokey.c */
+	/* POKEY_DELAYED_SEROUT_IRQ = SIO_SEROUT_INTERVAL; */ /* already set in pokey.c,
+	   before calling us */
 }
 
 /* Get a byte from the floppy to the pokey. */
@@ -1603,6 +2336,12 @@ int SIO_GetByte(void)
 		/* FALL THROUGH */
 	case SIO_ReadFrame:
 		if (DataIndex < ExpectedBytes) {
+			/* Bytes after the first two follow at turbo speed. The byte is
+			   lost if the serial input interrupt is disabled or the last
+			   one is still pending. */
+			if (turbo_transfer && DataIndex > 1
+			 && ((POKEY_IRQEN & 0x20) == 0 || (POKEY_IRQST & 0x20) == 0))
+				turbo_lost = TRUE;
 			byte = DataBuffer[DataIndex++];
 			if (DataIndex >= ExpectedBytes) {
 				TransferStatus = SIO_NoFrame;
@@ -1611,6 +2350,8 @@ int SIO_GetByte(void)
 				/* set delay using the expected transfer speed */
 				POKEY_DELAYED_SERIN_IRQ = (DataIndex == 1) ? SIO_SERIN_INTERVAL
 					: ((SIO_SERIN_INTERVAL * POKEY_AUDF[POKEY_CHAN3] - 1) / 0x28 + 1);
+				if (turbo_transfer && DataIndex > 1 && POKEY_DELAYED_SERIN_IRQ > turbo_interval)
+					POKEY_DELAYED_SERIN_IRQ = turbo_interval;
 			}
 		}
 		else {
@@ -1682,6 +2423,9 @@ void SIO_StateSave(void)
 {
 	int i;
 
+	/* the saved state refers to the image files - bring them up to date */
+	SIO_FlushDisks();
+
 	for (i = 0; i < 8; i++) {
 		StateSav_SaveINT((int *) &SIO_drive_status[i], 1);
 		StateSav_SaveFNAME(SIO_filename[i]);
@@ -27,11 +27,54 @@ extern int SIO_last_op_time;
 extern int SIO_last_drive; /* 1 .. 8 */
 extern int SIO_last_sector;
 
+/* If TRUE, DCM and gzip compressed images are writable. They are
+   decompressed to memory and changes are kept there until SIO_SaveImage(). */
+extern int SIO_compressed_writable;
+
+/* Directory where decompressed DCM and gzip images are kept and shared
+   between emulator instances. Empty string if not used. */
+extern char SIO_disk_cache_dir[FILENAME_MAX];
+
+/* When sectors written by the Atari reach the image files:
+   SIO_FLUSH_SYNC - immediately (each write is passed to the OS, so it
+     survives a crash of the emulator),
+   SIO_FLUSH_BACKGROUND - soon, written by a background thread (or directly
+     without threads),
+   SIO_FLUSH_DISMOUNT - when the disk is dismounted, the state is saved
+     or SIO_FlushDisks() is called.
+   Sectors in mapped images are always passed to the OS immediately. */
+#define SIO_FLUSH_SYNC       0
+#define SIO_FLUSH_BACKGROUND 1
+#define SIO_FLUSH_DISMOUNT   2
+extern int SIO_flush_policy;
+/* Sets SIO_flush_policy from "sync", "background" or "dismount".
+   Returns FALSE for other strings. */
+int SIO_SetFlushPolicy(const char *policy);
+const char *SIO_GetFlushPolicy(void);
+/* Writes all changed sectors waiting in the write-back cache. */
+void SIO_FlushDisks(void);
+/* Like SIO_FlushDisks(), and also stops the background thread (it is
+   started again by the next write), so the emulator can be forked. */
+void SIO_StopFlusher(void);
+/* Returns the number of changed sectors not yet written to the image files. */
+int SIO_DirtySectors(void);
+
 int SIO_Mount(int diskno, const char *filename, int b_open_readonly);
 void SIO_Dismount(int diskno);
+/* Writes the decompressed image in DISKNO to FILENAME (uncompressed),
+   or when FILENAME is NULL recompresses it back to the mounted gzip file.
+   Returns FALSE on error and for uncompressed images. */
+int SIO_SaveImage(int diskno, const char *filename);
+/* Returns TRUE if the decompressed image in DISKNO has unsaved changes. */
+int SIO_ImageModified(int diskno);
 void SIO_DisableDrive(int diskno);
 int SIO_RotateDisks(void);
 void SIO_Handler(void);
+/* Address of the OS SIO routine. When the SIO patch is off, but
+   CASSETTE_instant_load, BINLOAD_xex_inject or Atari800_boot_capture is on,
+   SIO_Handler handles only the cassette reads and the boot of an injected
+   XEX file, and passes other requests to this routine. Set by ESC_PatchOS. */
+extern UWORD SIO_os_routine;
 
 UBYTE SIO_ChkSum(const UBYTE *buffer, int length);
 void SIO_SwitchCommandFrame(int onoff);
@@ -46,6 +89,16 @@ void SIO_Exit(void);
 #define SIO_SEROUT_INTERVAL    8
 #define SIO_ACK_INTERVAL      36
 
+/* Turbo SIO: when TRUE, data bytes of serial disk transfers (used when the
+   SIO patch is off, or by custom loaders) follow each other after
+   SIO_TURBO_INTERVAL scanlines. The speed is reduced when the Atari
+   misses bytes and retries the command, and raised again after a run of
+   successful transfers. Sectors whose reading depends on the drive timing
+   (VAPI images, duplicate and bad sectors of PRO images) are always sent
+   at the normal speed. */
+#define SIO_TURBO_INTERVAL     2
+extern int SIO_turbo;
+
 /* These functions are also used by the 1450XLD Parallel disk device */
 extern int SIO_format_sectorcount[SIO_MAX_DRIVES];
 extern int SIO_format_sectorsize[SIO_MAX_DRIVES];
@@ -22,7 +22,14 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
+#include "config.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include "log.h"
 #include "pokeysnd.h"
 #include "sndsave.h"
 
@@ -31,6 +38,128 @@ static FILE *sndoutput = NULL;
 
 static ULONG byteswritten;
 
+/* Sound data is collected in preallocated blocks. Full blocks are queued
+   and written to the file by a writer thread, so that slow storage doesn't
+   stall the sound output. Without threads, full blocks are written
+   directly - still in large chunks. */
+#define BLOCK_SIZE 65536
+#define NUM_BLOCKS 16
+
+static UBYTE *block_memory = NULL;
+static unsigned int block_fill[NUM_BLOCKS];
+/* The queue holds blocks queue_head .. queue_head+queued-1 (mod NUM_BLOCKS),
+   followed by the block being filled by SndSave_WriteToSoundFile. */
+static unsigned int queue_head;
+static unsigned int queued;
+/* Block being filled, and number of bytes in it. */
+static unsigned int cur_block;
+static unsigned int cur_fill;
+/* Set when writing a block fails. */
+static int write_error;
+/* Number of blocks dropped because the writer thread fell behind. */
+static unsigned int overruns;
+
+#ifdef HAVE_PTHREAD
+static int threaded = FALSE;
+static int stop_writer;
+static pthread_t writer_thread;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Signalled when a block is queued or the writer should stop. */
+static pthread_cond_t queued_cond = PTHREAD_COND_INITIALIZER;
+/* Signalled when the writer frees a block. */
+static pthread_cond_t free_cond = PTHREAD_COND_INITIALIZER;
+
+static void *WriterThread(void *arg)
+{
+	pthread_mutex_lock(&queue_mutex);
+	for (;;) {
+		unsigned int block;
+		int ok;
+		while (queued == 0 && !stop_writer)
+			pthread_cond_wait(&queued_cond, &queue_mutex);
+		if (queued == 0)
+			break;
+		block = queue_head;
+		pthread_mutex_unlock(&queue_mutex);
+		ok = fwrite(block_memory + block * BLOCK_SIZE, 1, block_fill[block], sndoutput) == block_fill[block];
+		pthread_mutex_lock(&queue_mutex);
+		if (ok)
+			byteswritten += block_fill[block];
+		else
+			write_error = TRUE;
+		queue_head = (queue_head + 1) % NUM_BLOCKS;
+		queued--;
+		pthread_cond_signal(&free_cond);
+	}
+	pthread_mutex_unlock(&queue_mutex);
+	return NULL;
+}
+#endif /* HAVE_PTHREAD */
+
+/* Queues the block being filled and starts filling the next one. */
+static void SubmitBlock(void)
+{
+	unsigned int block = cur_block;
+#ifdef HAVE_PTHREAD
+	if (threaded) {
+		pthread_mutex_lock(&queue_mutex);
+		if (queued == NUM_BLOCKS - 1) {
+			/* The disk is falling behind and all other blocks wait to be
+			   written. Drop this block rather than stall the sound
+			   output, and fill it again. */
+			overruns++;
+			pthread_mutex_unlock(&queue_mutex);
+			cur_fill = 0;
+			return;
+		}
+		block_fill[block] = cur_fill;
+		queued++;
+		pthread_cond_signal(&queued_cond);
+		pthread_mutex_unlock(&queue_mutex);
+		cur_block = (cur_block + 1) % NUM_BLOCKS;
+		cur_fill = 0;
+		return;
+	}
+#endif /* HAVE_PTHREAD */
+	block_fill[block] = cur_fill;
+	cur_block = (cur_block + 1) % NUM_BLOCKS;
+	cur_fill = 0;
+	if (fwrite(block_memory + block * BLOCK_SIZE, 1, block_fill[block], sndoutput) == block_fill[block])
+		byteswritten += block_fill[block];
+	else
+		write_error = TRUE;
+	queue_head = (queue_head + 1) % NUM_BLOCKS;
+}
+
+/* Writes all pending sound data and stops the writer thread. */
+static void FlushBlocks(void)
+{
+#ifdef HAVE_PTHREAD
+	if (threaded && cur_fill > 0) {
+		/* The recording ends, so wait for a free block rather than drop
+		   the last one. */
+		pthread_mutex_lock(&queue_mutex);
+		while (queued == NUM_BLOCKS - 1)
+			pthread_cond_wait(&free_cond, &queue_mutex);
+		pthread_mutex_unlock(&queue_mutex);
+	}
+#endif /* HAVE_PTHREAD */
+	if (cur_fill > 0)
+		SubmitBlock();
+#ifdef HAVE_PTHREAD
+	if (threaded) {
+		pthread_mutex_lock(&queue_mutex);
+		stop_writer = TRUE;
+		pthread_cond_signal(&queued_cond);
+		pthread_mutex_unlock(&queue_mutex);
+		pthread_join(writer_thread, NULL);
+		threaded = FALSE;
+	}
+#endif /* HAVE_PTHREAD */
+	free(block_memory);
+	block_memory = NULL;
+}
+
 /* write 32-bit word as little endian */
 static void write32(long x)
 {
@@ -61,6 +190,12 @@ int SndSave_CloseSoundFile(void)
 	char aligned = 0;
 
 	if (sndoutput != NULL) {
+		FlushBlocks();
+		if (write_error)
+			bSuccess = FALSE;
+		if (overruns > 0)
+			Log_print("Sound recording dropped %u blocks because the disk was too slow", overruns);
+
 		/* A RIFF file's chunks must be word-aligned. So let's align. */
 		if (byteswritten & 1) {
 			if (putc(0, sndoutput) == EOF)
@@ -163,25 +298,55 @@ int SndSave_OpenSoundFile(const char *szFileName)
 	}
 
 	byteswritten = 0;
+	block_memory = (UBYTE *) malloc(NUM_BLOCKS * BLOCK_SIZE);
+	if (block_memory == NULL) {
+		fclose(sndoutput);
+		sndoutput = NULL;
+		return FALSE;
+	}
+	queue_head = 0;
+	queued = 0;
+	cur_block = 0;
+	cur_fill = 0;
+	write_error = FALSE;
+	overruns = 0;
+#ifdef HAVE_PTHREAD
+	stop_writer = FALSE;
+	/* If the thread can't be started, blocks are written directly. */
+	threaded = pthread_create(&writer_thread, NULL, WriterThread, NULL) == 0;
+#endif /* HAVE_PTHREAD */
 	return TRUE;
 }
 
 /* SndSave_WriteToSoundFile will dump PCM data to the WAV file. The best way to do this for Atari800 is
-   probably to call it directly after POKEYSND_Process(buffer, size) with the same values (buffer, size)
+   probably to call it directly after POKEYSND_Process(buffer, size) with the same values (buffer, size).
+   The data is buffered and written to the file in the background.
 
-   RETURNS: the number of bytes written to the file (should be equivalent to the input uiSize parm) */
+   RETURNS: the number of bytes accepted for writing (should be equivalent to the input uiSize parm) */
 
 int SndSave_WriteToSoundFile(const unsigned char *ucBuffer, unsigned int uiSize)
 {
 	/* XXX FIXME: doesn't work with big-endian architectures */
 	if (sndoutput && ucBuffer && uiSize) {
-		int result;
+		unsigned int result;
+		if (write_error) {
+			/* An earlier block couldn't be written. */
+			SndSave_CloseSoundFile();
+			return 0;
+		}
 		if (POKEYSND_snd_flags & POKEYSND_BIT16)
 			uiSize <<= 1;
-		result = fwrite(ucBuffer, 1, uiSize, sndoutput);
-		byteswritten += result;
-		if (result != uiSize) {
-			SndSave_CloseSoundFile();
+		result = uiSize;
+		while (uiSize > 0) {
+			unsigned int len = BLOCK_SIZE - cur_fill;
+			if (len > uiSize)
+				len = uiSize;
+			memcpy(block_memory + cur_block * BLOCK_SIZE + cur_fill, ucBuffer, len);
+			cur_fill += len;
+			ucBuffer += len;
+			uiSize -= len;
+			if (cur_fill == BLOCK_SIZE)
+				SubmitBlock();
 		}
 
 		return result;
@@ -189,3 +354,10 @@ int SndSave_WriteToSoundFile(const unsigned char *ucBuffer, unsigned int uiSize)
 
 	return 0;
 }
+
+/* RETURNS: the number of times sound recording had to wait for the disk since the file was opened */
+
+unsigned int SndSave_GetOverruns(void)
+{
+	return overruns;
+}
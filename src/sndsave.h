@@ -7,6 +7,7 @@ int SndSave_IsSoundFileOpen(void);
 int SndSave_CloseSoundFile(void);
 int SndSave_OpenSoundFile(const char *szFileName);
 int SndSave_WriteToSoundFile(const UBYTE *ucBuffer, unsigned int uiSize);
+unsigned int SndSave_GetOverruns(void);
 
 #endif /* SNDSAVE_H_ */
 
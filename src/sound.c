@@ -24,6 +24,8 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
+#include <math.h>
 
 #include "sound.h"
 
@@ -31,6 +33,8 @@
 #include "log.h"
 #include "platform.h"
 #include "pokeysnd.h"
+#include "mzpokeysnd.h"
+#include "sndsave.h"
 #include "util.h"
 
 #define DEBUG 0
@@ -48,19 +52,29 @@ Sound_setup_t Sound_out;
 
 static int paused = TRUE;
 
+#ifdef SYNCHRONIZED_SOUND
+int Sound_headless = FALSE;
+/* File the sound is written to when Sound_headless is TRUE. */
+static char headless_filename[FILENAME_MAX];
+/* TRUE after the file has been opened, and the output format it was
+   opened with. The file stays open until the emulator exits. */
+static int headless_started = FALSE;
+static Sound_setup_t headless_setup;
+#endif /* SYNCHRONIZED_SOUND */
+
 #ifndef SOUND_CALLBACK
 static UBYTE *process_buffer = NULL;
 static unsigned int process_buffer_size;
 #endif /* !SOUND_CALLBACK */
 
 #ifdef SYNCHRONIZED_SOUND
+/* sync_buffer is a single-producer/single-consumer ring: UpdateSyncBuffer
+   (the emulation thread) only advances sync_write_pos and FillBuffer (the
+   audio callback) only advances sync_read_pos. Both positions run from 0 to
+   2*sync_buffer_size-1, so that a full buffer can be told apart from an
+   empty one. The actual position in the buffer is pos % sync_buffer_size. */
 static UBYTE *sync_buffer = NULL;
 static unsigned int sync_buffer_size;
-/* Two invariants are held:
-   a) 0 <= sync_read_pos < sync_buffer_size
-   b) sync_read_pos <= sync_write_pos <= sync_buffer_size + sync_read_pos
-   sync_write_pos may be >= sync_buffer_size. In such case the actual write
-   position is sync_write_pos % sync_buffer_size. */
 static unsigned int sync_write_pos;
 static unsigned int sync_read_pos;
 
@@ -72,11 +86,50 @@ static unsigned int sync_est_fill;
 /* If sync_est_fill goes outside this bounds, emulation speed is adjusted. */
 static unsigned int sync_min_fill;
 static unsigned int sync_max_fill;
-#ifdef SOUND_CALLBACK
-#endif /* SOUND_CALLBACK */
-/* Time of last write of sudio to output device (either by Sound_Callback or
-   WriteOut). */
-double last_audio_write_time;
+/* Time of last write of audio to output device (either by Sound_Callback or
+   WriteOut), in microseconds modulo 2^32. */
+static unsigned int last_audio_write_us;
+
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+/* Variables shared with the audio callback are accessed with atomic
+   operations, so the emulation thread never takes the sound lock. */
+#define SYNC_LOAD(var) __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+#define SYNC_STORE(var, value) __atomic_store_n(&(var), (value), __ATOMIC_RELEASE)
+#define SYNC_LOCK()
+#define SYNC_UNLOCK()
+#else
+/* No atomic operations - the emulation thread takes the sound lock around
+   accesses to shared variables. Sound_Callback is always called with the
+   lock held, so it needs no locking. */
+#define SYNC_LOAD(var) (var)
+#define SYNC_STORE(var, value) ((var) = (value))
+#define SYNC_LOCK() PLATFORM_SoundLock()
+#define SYNC_UNLOCK() PLATFORM_SoundUnlock()
+#endif
+
+/* Returns current time in microseconds, modulo 2^32. Differences of two such
+   times are correct for periods shorter than 71 minutes. */
+static unsigned int TimeUs(void)
+{
+	return (unsigned int) fmod(Util_time() * 1e6, 4294967296.0);
+}
+
+/* Returns number of bytes between READ_POS and WRITE_POS in sync_buffer. */
+static unsigned int SyncFill(unsigned int write_pos, unsigned int read_pos)
+{
+	if (write_pos >= read_pos)
+		return write_pos - read_pos;
+	return write_pos + 2 * sync_buffer_size - read_pos;
+}
+
+/* Returns position POS in sync_buffer advanced by SIZE bytes. */
+static unsigned int SyncAdvance(unsigned int pos, unsigned int size)
+{
+	pos += size;
+	if (pos >= 2 * sync_buffer_size)
+		pos -= 2 * sync_buffer_size;
+	return pos;
+}
 #endif /* SYNCHRONIZED_SOUND */
 
 enum { MAX_SAMPLE_SIZE = 2, /* for 16-bit */
@@ -88,6 +141,28 @@ enum { MAX_SAMPLE_SIZE = 2, /* for 16-bit */
        MAX_FRAME_SIZE = MAX_SAMPLE_SIZE * MAX_CHANNELS
 };
 
+#ifdef SYNCHRONIZED_SOUND
+int Sound_adaptive_rate = FALSE;
+/* Resampling ratio (output rate / emulated rate) used when
+   Sound_adaptive_rate is TRUE, and the integral term of its PI controller. */
+static double resample_ratio = 1.0;
+static double ratio_integral;
+/* Position of the next output frame, in 1/65536 of an input frame. 0 is the
+   last frame of the previous block, stored in resample_last. */
+static unsigned int resample_pos;
+static int resample_last[MAX_CHANNELS];
+static UBYTE *resample_buffer = NULL;
+static unsigned int resample_buffer_size = 0;
+
+/* Statistics for Sound_GetStats. sync_underflows is written only by
+   FillBuffer, the others only by the emulation thread. */
+static unsigned int sync_underflows;
+static unsigned int sync_overflows;
+static unsigned int sync_dropped_frames;
+static unsigned int stat_min_fill;
+static unsigned int stat_max_fill;
+#endif /* SYNCHRONIZED_SOUND */
+
 int Sound_ReadConfig(char *option, char *ptr)
 {
 	if (strcmp(option, "SOUND_ENABLED") == 0)
@@ -109,6 +184,8 @@ int Sound_ReadConfig(char *option, char *ptr)
 #ifdef SYNCHRONIZED_SOUND
 	else if (strcmp(option, "SOUND_LATENCY") == 0)
 		return (Sound_latency = Util_sscandec(ptr)) != -1;
+	else if (strcmp(option, "SOUND_ADAPTIVE_RATE") == 0)
+		return (Sound_adaptive_rate = Util_sscanbool(ptr)) != -1;
 #endif /* SYNCHRONIZED_SOUND */
 	else
 		return FALSE;
@@ -123,6 +200,7 @@ void Sound_WriteConfig(FILE *fp)
 	fprintf(fp, "SOUND_BUFFER_MS=%u\n", Sound_desired.buffer_ms);
 #ifdef SYNCHRONIZED_SOUND
 	fprintf(fp, "SOUND_LATENCY=%u\n", Sound_latency);
+	fprintf(fp, "SOUND_ADAPTIVE_RATE=%d\n", Sound_adaptive_rate);
 #endif /* SYNCHRONIZED_SOUND */
 }
 
@@ -149,6 +227,10 @@ int Sound_Initialise(int *argc, char *argv[])
 			Sound_desired.sample_size = 2;
 		else if (strcmp(argv[i], "-audio8") == 0)
 			Sound_desired.sample_size = 1;
+		else if (strcmp(argv[i], "-pokey-fixed-point") == 0)
+			MZPOKEYSND_fixed_point = TRUE;
+		else if (strcmp(argv[i], "-pokey-double") == 0)
+			MZPOKEYSND_fixed_point = FALSE;
 		else if (strcmp(argv[i], "snd-buflen") == 0) {
 			if (i_a) {
 				int val = Util_sscandec(argv[++i]);
@@ -164,6 +246,17 @@ int Sound_Initialise(int *argc, char *argv[])
 			if (i_a)
 				Sound_latency = Util_sscandec(argv[++i]);
 			else a_m = TRUE;
+		else if (strcmp(argv[i], "-snd-capture") == 0) {
+			if (i_a) {
+				Util_strlcpy(headless_filename, argv[++i], sizeof(headless_filename));
+				Sound_headless = TRUE;
+			}
+			else a_m = TRUE;
+		}
+		else if (strcmp(argv[i], "-snd-adaptive-rate") == 0)
+			Sound_adaptive_rate = TRUE;
+		else if (strcmp(argv[i], "-snd-adjust-speed") == 0)
+			Sound_adaptive_rate = FALSE;
 #endif /* SYNCHRONIZED_SOUND */
 		else {
 			if (strcmp(argv[i], "-help") == 0) {
@@ -173,9 +266,14 @@ int Sound_Initialise(int *argc, char *argv[])
 				Log_print("\t-dsprate <rate>      Set sound output frequency in Hz");
 				Log_print("\t-audio16             Set sound output format to 16-bit");
 				Log_print("\t-audio8              Set sound output format to 8-bit");
+				Log_print("\t-pokey-fixed-point   Resample POKEY sound in fixed-point arithmetic");
+				Log_print("\t-pokey-double        Resample POKEY sound in double precision");
 				Log_print("\t-snd-buflen <ms>     Set length of the hardware sound buffer in milliseconds");
 #ifdef SYNCHRONIZED_SOUND
 				Log_print("\t-snddelay <ms>       Set sound latency in milliseconds");
+				Log_print("\t-snd-capture <file>  Write sound to WAV file instead of playing it, at max speed");
+				Log_print("\t-snd-adaptive-rate   Keep sound latency by resampling sound output");
+				Log_print("\t-snd-adjust-speed    Keep sound latency by adjusting emulation speed");
 #endif /* SYNCHRONIZED_SOUND */
 			}
 			argv[j++] = argv[i];
@@ -213,6 +311,21 @@ int Sound_Setup(void)
 	Sound_desired.buffer_frames = Sound_desired.freq * Sound_desired.buffer_ms / 1000;
 
 	Sound_out = Sound_desired;
+#ifdef SYNCHRONIZED_SOUND
+	if (Sound_headless) {
+		/* No audio device - the output has exactly the desired parameters.
+		   The emulation runs at max speed, and Sound_Update writes every
+		   frame's samples to the file. */
+		if (headless_started)
+			/* Reinitialised from the UI - keep the format of the file. */
+			Sound_out = headless_setup;
+		else if (Sound_out.buffer_frames == 0)
+			Sound_out.buffer_frames = Sound_out.freq / 50;
+		Sound_enabled = TRUE;
+		Atari800_turbo = TRUE;
+	}
+	else
+#endif /* SYNCHRONIZED_SOUND */
 	if (!(Sound_enabled = PLATFORM_SoundSetup(&Sound_out)))
 		return FALSE;
 
@@ -243,6 +356,17 @@ int Sound_Setup(void)
 #ifdef SYNCHRONIZED_SOUND
 	Sound_SetLatency(Sound_latency);
 #endif /* SYNCHRONIZED_SOUND */
+#ifdef SYNCHRONIZED_SOUND
+	if (Sound_headless && !headless_started) {
+		if (!SndSave_OpenSoundFile(headless_filename)) {
+			Log_print("Cannot create sound file %s", headless_filename);
+			Sound_Exit();
+			return FALSE;
+		}
+		headless_started = TRUE;
+		headless_setup = Sound_out;
+	}
+#endif /* SYNCHRONIZED_SOUND */
 
 	Sound_desired.freq = Sound_out.freq;
 	Sound_desired.sample_size = Sound_out.sample_size;
@@ -260,7 +384,12 @@ int Sound_Setup(void)
 void Sound_Exit(void)
 {
 	if (Sound_enabled) {
-		PLATFORM_SoundExit();
+#ifdef SYNCHRONIZED_SOUND
+		/* The sound file is closed by Atari800_Exit, so disabling and
+		   enabling sound doesn't truncate it. */
+		if (!Sound_headless)
+#endif /* SYNCHRONIZED_SOUND */
+			PLATFORM_SoundExit();
 		Sound_enabled = FALSE;
 #ifndef SOUND_CALLBACK
 		free(process_buffer);
@@ -269,6 +398,9 @@ void Sound_Exit(void)
 #ifdef SYNCHRONIZED_SOUND
 		free(sync_buffer);
 		sync_buffer = NULL;
+		free(resample_buffer);
+		resample_buffer = NULL;
+		resample_buffer_size = 0;
 #endif /* SYNCHRONIZED_SOUND */
 	}
 }
@@ -277,7 +409,10 @@ void Sound_Pause(void)
 {
 	if (Sound_enabled && !paused) {
 		/* stop audio output */
-		PLATFORM_SoundPause();
+#ifdef SYNCHRONIZED_SOUND
+		if (!Sound_headless)
+#endif /* SYNCHRONIZED_SOUND */
+			PLATFORM_SoundPause();
 		paused = TRUE;
 	}
 }
@@ -289,9 +424,12 @@ void Sound_Continue(void)
 #ifdef SYNCHRONIZED_SOUND
 /*		sync_write_pos = sync_read_pos + sync_min_fill;
 		avg_fill = sync_min_fill;*/
-		last_audio_write_time = Util_time();
+		SYNC_LOCK();
+		SYNC_STORE(last_audio_write_us, TimeUs());
+		SYNC_UNLOCK();
+		if (!Sound_headless)
 #endif /* SYNCHRONIZED_SOUND */
-		PLATFORM_SoundContinue();
+			PLATFORM_SoundContinue();
 		paused = FALSE;
 	}
 }
@@ -300,39 +438,35 @@ void Sound_Continue(void)
 static void FillBuffer(UBYTE *buffer, unsigned int size)
 {
 #ifdef SYNCHRONIZED_SOUND
-	unsigned int new_read_pos;
 	static UBYTE last_frame[MAX_FRAME_SIZE];
 	unsigned int bytes_per_frame = Sound_out.channels * Sound_out.sample_size;
-	unsigned int to_write = sync_write_pos - sync_read_pos;
+	unsigned int read_pos = sync_read_pos;
+	unsigned int to_write = SyncFill(SYNC_LOAD(sync_write_pos), read_pos);
 
 	if (to_write > 0) {
+		unsigned int offset = read_pos >= sync_buffer_size ? read_pos - sync_buffer_size : read_pos;
 		if (to_write > size)
 			to_write = size;
 
-		new_read_pos = sync_read_pos + to_write;
-
-		if (new_read_pos <= sync_buffer_size)
+		if (offset + to_write <= sync_buffer_size)
 			/* no wrap */
-			memcpy(buffer, sync_buffer + sync_read_pos, to_write);
+			memcpy(buffer, sync_buffer + offset, to_write);
 		else {
 			/* wraps */
-			unsigned int first_part_size = sync_buffer_size - sync_read_pos;
-			memcpy(buffer, sync_buffer + sync_read_pos, first_part_size);
+			unsigned int first_part_size = sync_buffer_size - offset;
+			memcpy(buffer, sync_buffer + offset, first_part_size);
 			memcpy(buffer + first_part_size, sync_buffer, to_write - first_part_size);
 		}
 
-		sync_read_pos = new_read_pos;
-		if (sync_read_pos > sync_buffer_size) {
-			sync_read_pos -= sync_buffer_size;
-			sync_write_pos -= sync_buffer_size;
-		}
+		/* Give the space back to UpdateSyncBuffer only after copying. */
+		SYNC_STORE(sync_read_pos, SyncAdvance(read_pos, to_write));
 		/* Save the last frame as we may need it to fill underflow. */
 		memcpy(last_frame, buffer + to_write - bytes_per_frame, bytes_per_frame);
 	}
 
-
 	/* Just repeat the last good frame if underflow. */
 	if (to_write < size) {
+		SYNC_STORE(sync_underflows, sync_underflows + 1);
 #if DEBUG
 		Log_print("Sound buffer underflow: fill %d, needed %d",
 		          to_write/Sound_out.channels/Sound_out.sample_size,
@@ -353,12 +487,12 @@ void Sound_Callback(UBYTE *buffer, unsigned int size)
 {
 #if DEBUG >= 2
 		Log_print("Callback: fill %u, needed %u",
-		          (sync_write_pos - sync_read_pos) / Sound_out.channels / Sound_out.sample_size,
+		          SyncFill(sync_write_pos, sync_read_pos) / Sound_out.channels / Sound_out.sample_size,
 		          size / Sound_out.channels / Sound_out.sample_size);
 #endif
 	FillBuffer(buffer, size);
 #ifdef SYNCHRONIZED_SOUND
-	last_audio_write_time = Util_time();
+	SYNC_STORE(last_audio_write_us, TimeUs());
 #endif /* SYNCHRONIZED_SOUND */
 }
 #else /* !SOUND_CALLBACK */
@@ -370,7 +504,7 @@ static void WriteOut(void)
 	if (avail > 0) {
 #if DEBUG >= 2
 		Log_print("WriteOut: fill %u, needed %u",
-		          (sync_write_pos - sync_read_pos) / Sound_out.channels / Sound_out.sample_size,
+		          SyncFill(sync_write_pos, sync_read_pos) / Sound_out.channels / Sound_out.sample_size,
 		          avail / Sound_out.channels / Sound_out.sample_size);
 #endif
 		/* On some platforms (eg. NestedVM) avail may be larger than process_buffer_size. */
@@ -381,42 +515,170 @@ static void WriteOut(void)
 			avail -= len;
 		} while (avail > 0);
 #ifdef SYNCHRONIZED_SOUND
-		last_audio_write_time = Util_time();
+		last_audio_write_us = TimeUs();
 #endif /* SYNCHRONIZED_SOUND */
 	}
 }
 #endif /* !SOUND_CALLBACK */
 
 #ifdef SYNCHRONIZED_SOUND
+/* Resamples IN_FRAMES audio frames from IN by resample_ratio, with linear
+   interpolation, into resample_buffer. Returns number of output bytes. */
+static unsigned int Resample(UBYTE const *in, unsigned int in_frames)
+{
+	unsigned int channels = Sound_out.channels;
+	unsigned int step = (unsigned int) (65536.0 / resample_ratio + 0.5);
+	unsigned int end = in_frames << 16;
+	unsigned int pos = resample_pos;
+	unsigned int out_bytes = 0;
+	unsigned int c;
+
+	if (in_frames == 0)
+		return 0;
+	if (pos < end)
+		out_bytes = (end - pos + step - 1) / step * channels * Sound_out.sample_size;
+	if (out_bytes > resample_buffer_size) {
+		resample_buffer = (UBYTE *) Util_realloc(resample_buffer, out_bytes);
+		resample_buffer_size = out_bytes;
+	}
+
+	if (Sound_out.sample_size == 2) {
+		SWORD const *src = (SWORD const *) in;
+		SWORD *dst = (SWORD *) resample_buffer;
+		for (; pos < end; pos += step) {
+			unsigned int i = pos >> 16;
+			int frac = (pos & 0xffff) >> 1;
+			for (c = 0; c < channels; c++) {
+				int a = i == 0 ? resample_last[c] : src[(i - 1) * channels + c];
+				int b = src[i * channels + c];
+				*dst++ = (SWORD) (a + (((b - a) * frac) >> 15));
+			}
+		}
+		for (c = 0; c < channels; c++)
+			resample_last[c] = src[(in_frames - 1) * channels + c];
+	}
+	else {
+		UBYTE *dst = resample_buffer;
+		for (; pos < end; pos += step) {
+			unsigned int i = pos >> 16;
+			int frac = (pos & 0xffff) >> 1;
+			for (c = 0; c < channels; c++) {
+				int a = i == 0 ? resample_last[c] : in[(i - 1) * channels + c];
+				int b = in[i * channels + c];
+				*dst++ = (UBYTE) (a + (((b - a) * frac) >> 15));
+			}
+		}
+		for (c = 0; c < channels; c++)
+			resample_last[c] = in[(in_frames - 1) * channels + c];
+	}
+	resample_pos = pos - end;
+	return out_bytes;
+}
+
+/* Updates resample_ratio after FRAMES audio frames were produced. A PI
+   controller keeps the averaged buffer fill in the middle between
+   sync_min_fill and sync_max_fill. */
+static void UpdateResampleRatio(unsigned int frames)
+{
+	/* Gains are per second of fill error; the ratio changes by at most
+	   0.5%, which is inaudible. */
+	static double const kp = 1.0;
+	static double const ki = 0.25;
+	static double const max_correction = 0.005;
+	double bytes_per_sec = (double)Sound_out.freq * Sound_out.channels * Sound_out.sample_size;
+	double error = (avg_fill - (sync_min_fill + sync_max_fill) / 2.0) / bytes_per_sec;
+	double correction;
+
+	ratio_integral += error * frames / Sound_out.freq;
+	/* Prevent windup of the integral term. */
+	if (ki * ratio_integral > max_correction)
+		ratio_integral = max_correction / ki;
+	else if (ki * ratio_integral < -max_correction)
+		ratio_integral = -max_correction / ki;
+	correction = kp * error + ki * ratio_integral;
+	if (correction > max_correction)
+		correction = max_correction;
+	else if (correction < -max_correction)
+		correction = -max_correction;
+	/* Too full buffer - produce fewer samples. */
+	resample_ratio = 1.0 - correction;
+}
+
+/* Waits until the audio output frees at least NEEDED bytes in sync_buffer.
+   Returns current fill of sync_buffer, which may still be too large if the
+   output stalled for longer than a few HW buffers. */
+static unsigned int WaitForSyncSpace(unsigned int needed)
+{
+	unsigned int bytes_per_frame = Sound_out.channels * Sound_out.sample_size;
+	/* Poll a few times per HW buffer, and give up after the time needed to
+	   play the whole sync_buffer plus a few HW buffers. */
+	double slice = (double)Sound_out.buffer_frames / Sound_out.freq / 4;
+	double timeout = ((double)sync_buffer_size / bytes_per_frame + 4 * Sound_out.buffer_frames) / Sound_out.freq;
+	double start = Util_time();
+	unsigned int read_pos;
+	unsigned int fill;
+
+	for (;;) {
+#ifndef SOUND_CALLBACK
+		WriteOut(); /* Write to audio buffer as much as possible. */
+#endif /* SOUND_CALLBACK */
+		SYNC_LOCK();
+		read_pos = SYNC_LOAD(sync_read_pos);
+		SYNC_UNLOCK();
+		fill = SyncFill(sync_write_pos, read_pos);
+		if (needed <= sync_buffer_size - fill || Util_time() - start >= timeout)
+			return fill;
+		Util_sleep(slice);
+	}
+}
+
 static void UpdateSyncBuffer(void)
 {
 	unsigned int bytes_written;
 	unsigned int samples_written;
 	unsigned int fill;
-	unsigned int new_write_pos;
-
-	PLATFORM_SoundLock();
+	unsigned int offset;
+	unsigned int write_pos = sync_write_pos;
+	unsigned int read_pos;
+	unsigned int last_write_us;
+	UBYTE const *samples;
+
+	SYNC_LOCK();
+	read_pos = SYNC_LOAD(sync_read_pos);
+	last_write_us = SYNC_LOAD(last_audio_write_us);
+	SYNC_UNLOCK();
 	/* Current fill of the audio buffer. */
-	fill = sync_write_pos - sync_read_pos;
+	fill = SyncFill(write_pos, read_pos);
 
 	/* Update sync_est_fill. */
 	{
-		unsigned int est_gap;
-		est_gap = (Util_time() - last_audio_write_time)*Sound_out.freq*Sound_out.channels*Sound_out.sample_size;
+		double est_gap;
+		est_gap = (unsigned int) (TimeUs() - last_write_us) / 1e6 * Sound_out.freq*Sound_out.channels*Sound_out.sample_size;
 		if (fill < est_gap)
 			sync_est_fill = 0;
 		else
-			sync_est_fill = fill - est_gap;
+			sync_est_fill = fill - (unsigned int) est_gap;
 	}
 
-	if (Atari800_turbo && sync_est_fill > sync_max_fill) {
-		PLATFORM_SoundUnlock();
+	if (sync_est_fill < stat_min_fill)
+		stat_min_fill = sync_est_fill;
+	if (sync_est_fill > stat_max_fill)
+		stat_max_fill = sync_est_fill;
+
+	if (Atari800_turbo && sync_est_fill > sync_max_fill)
 		return;
-	}
 
 	/* produce samples from the sound emulation */
 	samples_written = POKEYSND_UpdateProcessBuffer();
 	bytes_written = Sound_out.sample_size * samples_written;
+	samples = POKEYSND_process_buffer;
+	if (Sound_adaptive_rate) {
+		unsigned int frames = samples_written / Sound_out.channels;
+		if (!Atari800_turbo)
+			UpdateResampleRatio(frames);
+		bytes_written = Resample(samples, frames);
+		samples = resample_buffer;
+	}
 
 	/* if there isn't enough room... */
 	if (bytes_written > sync_buffer_size - fill) {
@@ -428,41 +690,42 @@ static void UpdateSyncBuffer(void)
 #endif
 		/* Wait until hardware buffer can be filled, or wait until callback
 		   makes place in the buffer. */
-		do {
-			PLATFORM_SoundUnlock();
-			/* Sleep for the duration of one full HW buffer. */
-			Util_sleep((double)Sound_out.buffer_frames / Sound_out.freq);
-			PLATFORM_SoundLock();
-#ifndef SOUND_CALLBACK
-			WriteOut(); /* Write to audio buffer as much as possible. */
-#endif /* SOUND_CALLBACK */
-			fill = sync_write_pos - sync_read_pos;
-		} while (bytes_written > sync_buffer_size - fill);
+		sync_overflows++;
+		fill = WaitForSyncSpace(bytes_written);
+		if (bytes_written > sync_buffer_size - fill) {
+			/* Output is stalled - drop samples that don't fit. */
+			unsigned int bytes_per_frame = Sound_out.channels * Sound_out.sample_size;
+			unsigned int fitting = (sync_buffer_size - fill) / bytes_per_frame * bytes_per_frame;
+			sync_dropped_frames += (bytes_written - fitting) / bytes_per_frame;
+			bytes_written = fitting;
+#if DEBUG
+			Log_print("Sound output stalled, dropped samples");
+#endif
+		}
 	}
-	/* Now bytes_written <= audio_buffer_size + dsp_read_pos - dsp_write_pos) */
+	/* Now bytes_written <= sync_buffer_size - fill */
 
 #if DEBUG >= 2
 	Log_print("UpdateSyncBuffer: est_gap: %f, fill %u, write %u",
-			(Util_time() - last_audio_write_time)*Sound_out.freq,
+			(unsigned int) (TimeUs() - last_write_us) / 1e6 * Sound_out.freq,
 	          fill / Sound_out.channels/Sound_out.sample_size,
 	          bytes_written / Sound_out.channels/Sound_out.sample_size);
 #endif
-	/* now we copy the data into the buffer and adjust the positions */
-	new_write_pos = sync_write_pos + bytes_written;
-	if (new_write_pos/sync_buffer_size == sync_write_pos/sync_buffer_size)
+	/* now we copy the data into the buffer and publish the new position */
+	offset = write_pos >= sync_buffer_size ? write_pos - sync_buffer_size : write_pos;
+	if (offset + bytes_written <= sync_buffer_size)
 		/* no wrap */
-		memcpy(sync_buffer + sync_write_pos%sync_buffer_size, POKEYSND_process_buffer, bytes_written);
+		memcpy(sync_buffer + offset, samples, bytes_written);
 	else {
 		/* wraps */
-		int first_part_size = sync_buffer_size - sync_write_pos%sync_buffer_size;
-		memcpy(sync_buffer + sync_write_pos%sync_buffer_size, POKEYSND_process_buffer, first_part_size);
-		memcpy(sync_buffer, POKEYSND_process_buffer + first_part_size, bytes_written - first_part_size);
+		unsigned int first_part_size = sync_buffer_size - offset;
+		memcpy(sync_buffer + offset, samples, first_part_size);
+		memcpy(sync_buffer, samples + first_part_size, bytes_written - first_part_size);
 	}
 
-	sync_write_pos = new_write_pos;
-	if (sync_write_pos > sync_read_pos + sync_buffer_size)
-		sync_write_pos -= sync_buffer_size;
-	PLATFORM_SoundUnlock();
+	SYNC_LOCK();
+	SYNC_STORE(sync_write_pos, SyncAdvance(write_pos, bytes_written));
+	SYNC_UNLOCK();
 }
 #endif /* SYNCHRONIZED_SOUND */
 
@@ -471,6 +734,11 @@ void Sound_Update(void)
 	if (!Sound_enabled || paused)
 		return;
 #ifdef SYNCHRONIZED_SOUND
+	if (Sound_headless) {
+		/* Samples are written to the sound file by POKEYSND. */
+		POKEYSND_UpdateProcessBuffer();
+		return;
+	}
 	UpdateSyncBuffer();
 #endif /* SYNCHRONIZED_SOUND */
 #ifndef SOUND_CALLBACK
@@ -487,6 +755,8 @@ void Sound_SetLatency(unsigned int latency)
 		enum { SYNC_BUFFER_FRAGS = 5 };
 		unsigned int bytes_per_frame = Sound_out.channels * Sound_out.sample_size;
 		unsigned int latency_frames = Sound_out.freq*Sound_latency/1000;
+		/* The buffer is reallocated, so the callback must be blocked even if
+		   the positions are updated without locking. */
 		PLATFORM_SoundLock();
 		sync_buffer_size = (latency_frames + SYNC_BUFFER_FRAGS*Sound_out.buffer_frames) * bytes_per_frame;
 		sync_min_fill = latency_frames * bytes_per_frame;
@@ -494,6 +764,14 @@ void Sound_SetLatency(unsigned int latency)
 		avg_fill = sync_min_fill;
 		sync_read_pos = 0;
 		sync_write_pos = sync_min_fill;
+		resample_ratio = 1.0;
+		ratio_integral = 0.0;
+		resample_pos = 1 << 16;
+		sync_underflows = 0;
+		sync_overflows = 0;
+		sync_dropped_frames = 0;
+		stat_min_fill = UINT_MAX;
+		stat_max_fill = 0;
 		free(sync_buffer);
 		sync_buffer = Util_malloc(sync_buffer_size);
 		memset(sync_buffer, 0, sync_buffer_size);
@@ -509,10 +787,13 @@ double Sound_AdjustSpeed(void)
 	if (Sound_enabled && !paused) {
 #if 1
 		avg_fill = avg_fill + alpha * (sync_est_fill - avg_fill);
-		if (avg_fill < sync_min_fill)
-			delay_mult = 0.95;
-		else if (avg_fill > sync_max_fill)
-			delay_mult = 1.05;
+		/* With adaptive rate the output is resampled instead. */
+		if (!Sound_adaptive_rate) {
+			if (avg_fill < sync_min_fill)
+				delay_mult = 0.95;
+			else if (avg_fill > sync_max_fill)
+				delay_mult = 1.05;
+		}
 #endif
 #if 0
 		if (sync_est_fill < sync_min_fill)
@@ -532,6 +813,34 @@ double Sound_AdjustSpeed(void)
 	}
 	return delay_mult;
 }
+
+void Sound_GetStats(Sound_stats_t *stats)
+{
+	double bytes_per_ms = Sound_out.freq * Sound_out.channels * Sound_out.sample_size / 1000.0;
+	if (!Sound_enabled || bytes_per_ms == 0) {
+		memset(stats, 0, sizeof(*stats));
+		stats->ratio = 1.0;
+		return;
+	}
+	stats->latency_ms = sync_est_fill / bytes_per_ms;
+	stats->avg_latency_ms = avg_fill / bytes_per_ms;
+	if (stat_min_fill > stat_max_fill)
+		/* No update since the previous call. */
+		stats->min_latency_ms = stats->max_latency_ms = stats->latency_ms;
+	else {
+		stats->min_latency_ms = stat_min_fill / bytes_per_ms;
+		stats->max_latency_ms = stat_max_fill / bytes_per_ms;
+	}
+	stats->target_latency_ms = (Sound_adaptive_rate ? (sync_min_fill + sync_max_fill) / 2.0 : sync_min_fill) / bytes_per_ms;
+	stats->ratio = Sound_adaptive_rate ? resample_ratio : 1.0;
+	SYNC_LOCK();
+	stats->underflows = SYNC_LOAD(sync_underflows);
+	SYNC_UNLOCK();
+	stats->overflows = sync_overflows;
+	stats->dropped_frames = sync_dropped_frames;
+	stat_min_fill = UINT_MAX;
+	stat_max_fill = 0;
+}
 #endif /* SYNCHRONIZED_SOUND */
 
 unsigned int Sound_NextPow2(unsigned int num)
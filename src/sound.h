@@ -85,10 +85,49 @@ extern unsigned int Sound_latency;
 
 void Sound_SetLatency(unsigned int latency);
 
+/* TRUE when sound is not played but written to a WAV file (-snd-capture).
+   No audio device is opened, and the emulation runs in turbo mode, as fast
+   as the CPU allows. The file gets the same samples as a recording made
+   during a real-time run. */
+extern int Sound_headless;
+
+/* When TRUE, emulation runs at exact speed and the sound output is instead
+   resampled with a ratio that keeps the sound buffer at the desired latency.
+   This allows smaller latency and hardware buffers than adjusting the
+   emulation speed. FALSE by default. */
+extern int Sound_adaptive_rate;
+
 /* Returns a factor (1.0 by default) to adjust the speed of the emulation
  * so that if the sound buffer is too full or too empty. The emulation
- * slows down or speeds up to match the actual speed of sound output. */
+ * slows down or speeds up to match the actual speed of sound output.
+ * Always returns 1.0 if Sound_adaptive_rate is TRUE. */
 double Sound_AdjustSpeed(void);
+
+/* Statistics of the sound buffer, see Sound_GetStats. */
+typedef struct Sound_stats_t {
+	/* Estimated time of sound waiting to be played, in milliseconds. */
+	double latency_ms;
+	/* latency_ms averaged over a few frames. */
+	double avg_latency_ms;
+	/* Lowest and highest latency_ms since the previous Sound_GetStats call. */
+	double min_latency_ms;
+	double max_latency_ms;
+	/* The latency the emulator aims at. */
+	double target_latency_ms;
+	/* Current resampling ratio (output rate / emulated rate); 1.0 if
+	   Sound_adaptive_rate is FALSE. */
+	double ratio;
+	/* Number of times the audio output ran out of samples. */
+	unsigned int underflows;
+	/* Number of times the emulator had to wait for space in the buffer. */
+	unsigned int overflows;
+	/* Number of audio frames dropped because the output stalled. */
+	unsigned int dropped_frames;
+} Sound_stats_t;
+
+/* Fills STATS with current statistics. Counters are cumulative since the
+   last Sound_SetLatency call (ie. since sound was set up). */
+void Sound_GetStats(Sound_stats_t *stats);
 #endif /* SYNCHRONIZED_SOUND */
 
 /* Helper function for use when hardware audio buffer size is required to
@@ -328,9 +328,12 @@ void StateSav_ReadFNAME(char *filename)
 	filename[namelen] = 0;
 }
 
-int StateSav_SaveAtariState(const char *filename, const char *mode, UBYTE SaveVerbose)
+/* Saves the whole state, or with BOOT set, a boot snapshot - the state of
+   the emulated computer without the machine type, cartridge and drives. */
+static int SaveState(const char *filename, const char *mode, UBYTE SaveVerbose, int boot)
 {
 	UBYTE StateVersion = SAVE_VERSION_NUMBER;
+	const char *header = boot ? "A800BOOT" : "ATARI800";
 
 	if (StateFile != NULL) {
 		GZCLOSE(StateFile);
@@ -344,7 +347,7 @@ int StateSav_SaveAtariState(const char *filename, const char *mode, UBYTE SaveVe
 		GetGZErrorText();
 		return FALSE;
 	}
-	if (GZWRITE(StateFile, "ATARI800", 8) == 0) {
+	if (GZWRITE(StateFile, header, 8) == 0) {
 		GetGZErrorText();
 		GZCLOSE(StateFile);
 		StateFile = NULL;
@@ -355,9 +358,11 @@ int StateSav_SaveAtariState(const char *filename, const char *mode, UBYTE SaveVe
 	StateSav_SaveUBYTE(&SaveVerbose, 1);
 	/* The order here is important. Atari800_StateSave must be first because it saves the machine type, and
 	   decisions on what to save/not save are made based off that later in the process */
-	Atari800_StateSave();
-	CARTRIDGE_StateSave();
-	SIO_StateSave();
+	if (!boot) {
+		Atari800_StateSave();
+		CARTRIDGE_StateSave();
+		SIO_StateSave();
+	}
 	ANTIC_StateSave();
 	CPU_StateSave(SaveVerbose);
 	GTIA_StateSave();
@@ -412,7 +417,17 @@ int StateSav_SaveAtariState(const char *filename, const char *mode, UBYTE SaveVe
 	return TRUE;
 }
 
-int StateSav_ReadAtariState(const char *filename, const char *mode)
+int StateSav_SaveAtariState(const char *filename, const char *mode, UBYTE SaveVerbose)
+{
+	return SaveState(filename, mode, SaveVerbose, FALSE);
+}
+
+int StateSav_SaveBootState(const char *filename)
+{
+	return SaveState(filename, "wb", FALSE, TRUE);
+}
+
+static int ReadState(const char *filename, const char *mode, int boot)
 {
 	char header_string[8];
 	UBYTE StateVersion = 0;  /* The version of the save file */
@@ -437,7 +452,7 @@ int StateSav_ReadAtariState(const char *filename, const char *mode)
 		StateFile = NULL;
 		return FALSE;
 	}
-	if (memcmp(header_string, "ATARI800", 8) != 0) {
+	if (memcmp(header_string, boot ? "A800BOOT" : "ATARI800", 8) != 0) {
 		Log_print("This is not an Atari800 state save file.");
 		GZCLOSE(StateFile);
 		StateFile = NULL;
@@ -453,17 +468,20 @@ int StateSav_ReadAtariState(const char *filename, const char *mode)
 		return FALSE;
 	}
 
-	if (StateVersion > SAVE_VERSION_NUMBER || StateVersion < 3) {
+	if (StateVersion > SAVE_VERSION_NUMBER || StateVersion < 3
+	    || (boot && StateVersion != SAVE_VERSION_NUMBER)) {
 		Log_print("Cannot read this state file because it is an incompatible version.");
 		GZCLOSE(StateFile);
 		StateFile = NULL;
 		return FALSE;
 	}
 
-	Atari800_StateRead(StateVersion);
-	if (StateVersion >= 4) {
-		CARTRIDGE_StateRead(StateVersion);
-		SIO_StateRead();
+	if (!boot) {
+		Atari800_StateRead(StateVersion);
+		if (StateVersion >= 4) {
+			CARTRIDGE_StateRead(StateVersion);
+			SIO_StateRead();
+		}
 	}
 	ANTIC_StateRead();
 	CPU_StateRead(SaveVerbose, StateVersion);
@@ -540,6 +558,16 @@ int StateSav_ReadAtariState(const char *filename, const char *mode)
 	return TRUE;
 }
 
+int StateSav_ReadAtariState(const char *filename, const char *mode)
+{
+	return ReadState(filename, mode, FALSE);
+}
+
+int StateSav_ReadBootState(const char *filename)
+{
+	return ReadState(filename, "rb", TRUE);
+}
+
 
 /* hack to compress in memory before writing
  * - for DREAMCAST only
@@ -5,6 +5,10 @@
 
 int StateSav_SaveAtariState(const char *filename, const char *mode, UBYTE SaveVerbose);
 int StateSav_ReadAtariState(const char *filename, const char *mode);
+/* Save/read a boot snapshot: the state of the emulated computer without
+   the machine type, cartridges and disk drives, which must match. */
+int StateSav_SaveBootState(const char *filename);
+int StateSav_ReadBootState(const char *filename);
 
 void StateSav_SaveUBYTE(const UBYTE *data, int num);
 void StateSav_SaveUWORD(const UWORD *data, int num);
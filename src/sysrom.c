@@ -30,7 +30,18 @@
 #endif
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#if defined(HAVE_STAT) && defined(HAVE_SYS_STAT_H)
+#include <sys/stat.h>
+#define ROM_INDEX
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h> /* getcwd(), getpid() */
+#endif
+#ifdef HAVE_DIRECT_H
+#include <direct.h> /* getcwd on MSVC*/
+#endif
 
 #include "sysrom.h"
 
@@ -262,10 +273,239 @@ static int MatchByName(char const *filename, int len, int only_if_not_set)
 	return -1;
 }
 
+/* Computes CRC of FILENAME and stores its length at *LEN. Returns FALSE
+   if the file can't be read (e.g. it's a directory) or has a length
+   that no ROM has. */
+static int FileCRC(char const *filename, int *len, ULONG *crc)
+{
+	FILE *file;
+	if ((file = fopen(filename, "rb")) == NULL)
+		return FALSE;
+
+	*len = Util_flen(file);
+	/* Don't proceed to CRC computation if the file has invalid size. */
+	if (!IsLengthAllowed(*len)) {
+		fclose(file);
+		return FALSE;
+	}
+	Util_rewind(file);
+
+	if (!CRC32_FromFile(file, crc)) {
+		fclose(file);
+		return FALSE;
+	}
+	fclose(file);
+	return TRUE;
+}
+
+#ifdef ROM_INDEX
+#ifndef DEFAULT_ROM_INDEX_NAME
+#define DEFAULT_ROM_INDEX_NAME ".atari800-roms"
+#endif
+#define INDEX_HEADER "Atari800 ROM index 1\n"
+#define INDEX_BUCKETS 1024
+
+/* Index of the files with ROM sizes found by SYSROM_FindInDir, so that
+   the CRC of a file is computed again only if its size or modification
+   time changed. Entries are chained in hash buckets by path. */
+typedef struct {
+	char *path;
+	long size; /* -1 if the file is gone */
+	long mtime;
+	ULONG crc;
+	int next;
+} index_entry_t;
+/* ~/.atari800-roms; empty if HOME is not set, which disables saving. */
+static char index_filename[FILENAME_MAX];
+static index_entry_t *index_entries = NULL;
+static int index_num = 0;
+static int index_capacity = 0;
+static int index_buckets[INDEX_BUCKETS];
+static int index_loaded = FALSE;
+static int index_changed = FALSE;
+
+static unsigned int HashPath(char const *path)
+{
+	return ~CRC32_Update(0xffffffff, (UBYTE const *) path, strlen(path)) % INDEX_BUCKETS;
+}
+
+static index_entry_t *FindIndexEntry(char const *path)
+{
+	int i;
+	for (i = index_buckets[HashPath(path)]; i >= 0; i = index_entries[i].next) {
+		if (strcmp(index_entries[i].path, path) == 0)
+			return &index_entries[i];
+	}
+	return NULL;
+}
+
+static index_entry_t *AddIndexEntry(char const *path)
+{
+	index_entry_t *entry;
+	unsigned int bucket = HashPath(path);
+	if (index_num == index_capacity) {
+		index_capacity = index_capacity == 0 ? 256 : index_capacity * 2;
+		index_entries = (index_entry_t *) Util_realloc(index_entries, index_capacity * sizeof(index_entry_t));
+	}
+	entry = &index_entries[index_num];
+	entry->path = Util_strdup(path);
+	entry->next = index_buckets[bucket];
+	index_buckets[bucket] = index_num++;
+	return entry;
+}
+
+/* Reads the index file once. A missing or invalid file gives an empty index. */
+static void LoadIndex(void)
+{
+	FILE *fp;
+	char line[FILENAME_MAX + 64];
+	int i;
+	if (index_loaded)
+		return;
+	index_loaded = TRUE;
+	for (i = 0; i < INDEX_BUCKETS; i++)
+		index_buckets[i] = -1;
+	if (getenv("HOME") == NULL)
+		return;
+	Util_catpath(index_filename, getenv("HOME"), DEFAULT_ROM_INDEX_NAME);
+	if ((fp = fopen(index_filename, "r")) == NULL)
+		return;
+	if (fgets(line, sizeof(line), fp) != NULL && strcmp(line, INDEX_HEADER) == 0) {
+		while (fgets(line, sizeof(line), fp) != NULL) {
+			unsigned long crc;
+			long size;
+			long mtime;
+			int pos;
+			index_entry_t *entry;
+			Util_chomp(line);
+			if (sscanf(line, "%lx %ld %ld %n", &crc, &size, &mtime, &pos) < 3
+			    || line[pos] == '\0' || FindIndexEntry(line + pos) != NULL)
+				continue;
+			entry = AddIndexEntry(line + pos);
+			entry->size = size;
+			entry->mtime = mtime;
+			entry->crc = (ULONG) crc;
+		}
+	}
+	fclose(fp);
+}
+
+/* Writes the index file if it changed. */
+static void SaveIndex(void)
+{
+	char tmp_filename[FILENAME_MAX];
+	FILE *fp;
+	int i;
+	if (!index_changed || index_filename[0] == '\0'
+	    || strlen(index_filename) + 24 >= FILENAME_MAX)
+		return;
+	index_changed = FALSE;
+	/* Write a new file and rename it, so a concurrently started emulator
+	   never reads a partial index. The temporary name is unique to this
+	   process, so two emulators saving at once don't mix their writes. */
+#ifdef HAVE_UNISTD_H
+	sprintf(tmp_filename, "%s.%ld", index_filename, (long) getpid());
+#else
+	sprintf(tmp_filename, "%s.tmp", index_filename);
+#endif
+	if ((fp = fopen(tmp_filename, "w")) == NULL)
+		return;
+	fputs(INDEX_HEADER, fp);
+	for (i = 0; i < index_num; i++) {
+		if (index_entries[i].size >= 0)
+			fprintf(fp, "%08lx %ld %ld %s\n", (unsigned long) index_entries[i].crc,
+			        index_entries[i].size, index_entries[i].mtime, index_entries[i].path);
+	}
+	if (fclose(fp) != 0 || rename(tmp_filename, index_filename) != 0)
+		Util_unlink(tmp_filename);
+}
+
+/* Like FileCRC, but takes the CRC from the index if the size and
+   modification time of FILENAME haven't changed. */
+static int IndexedFileCRC(char const *filename, int *len, ULONG *crc)
+{
+	struct stat st;
+	index_entry_t *entry;
+	if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode))
+		return FALSE;
+	/* Files of other sizes are not indexed - they're rejected without opening. */
+	if (st.st_size > 0x4000 || !IsLengthAllowed((int) st.st_size))
+		return FALSE;
+	entry = FindIndexEntry(filename);
+	if (entry != NULL && entry->size == (long) st.st_size && entry->mtime == (long) st.st_mtime) {
+		*len = (int) st.st_size;
+		*crc = entry->crc;
+		return TRUE;
+	}
+	if (!FileCRC(filename, len, crc))
+		return FALSE;
+	if (entry == NULL)
+		entry = AddIndexEntry(filename);
+	entry->size = *len;
+	entry->mtime = (long) st.st_mtime;
+	entry->crc = *crc;
+	index_changed = TRUE;
+	return TRUE;
+}
+
+/* Writes to RESULT the absolute path of DIRECTORY, which the index uses
+   for its files: relative paths would mix up files of the same name found
+   from different working directories. Returns FALSE if the path can't be
+   determined - then the files aren't indexed. */
+static int IndexDirectory(char const *directory, char *result)
+{
+	if (directory[0] == Util_DIR_SEP_CHAR
+#ifdef DIR_SEP_BACKSLASH
+	    || directory[0] == '/' || (directory[0] != '\0' && directory[1] == ':')
+#endif
+	   ) {
+		Util_strlcpy(result, directory, FILENAME_MAX);
+		return TRUE;
+	}
+#ifdef HAVE_GETCWD
+	{
+		char cwd[FILENAME_MAX];
+		if (getcwd(cwd, FILENAME_MAX) != NULL) {
+			Util_catpath(result, cwd, directory);
+			return TRUE;
+		}
+	}
+#endif
+	return FALSE;
+}
+
+/* Marks index entries of files in DIRECTORY that no longer exist. */
+static void PruneIndex(char const *directory)
+{
+	char dir_prefix[FILENAME_MAX];
+	int i;
+	/* Compare both directories with a trailing separator, so "roms" and
+	   "roms/" match. */
+	Util_catpath(dir_prefix, directory, "");
+	for (i = 0; i < index_num; i++) {
+		char dir_part[FILENAME_MAX];
+		char entry_prefix[FILENAME_MAX];
+		struct stat st;
+		if (index_entries[i].size < 0)
+			continue;
+		Util_splitpath(index_entries[i].path, dir_part, NULL);
+		Util_catpath(entry_prefix, dir_part, "");
+		if (strcmp(entry_prefix, dir_prefix) == 0 && stat(index_entries[i].path, &st) != 0) {
+			index_entries[i].size = -1;
+			index_changed = TRUE;
+		}
+	}
+}
+#endif /* ROM_INDEX */
+
 int SYSROM_FindInDir(char const *directory, int only_if_not_set)
 {
 	DIR *dir;
 	struct dirent *entry;
+#ifdef ROM_INDEX
+	char index_dir[FILENAME_MAX];
+	int indexed;
+#endif
 
 	if (only_if_not_set && num_unset_roms == 0)
 		/* No unset ROM paths left. */
@@ -274,31 +514,28 @@ int SYSROM_FindInDir(char const *directory, int only_if_not_set)
 	if ((dir = opendir(directory)) == NULL)
 		return FALSE;
 
+#ifdef ROM_INDEX
+	LoadIndex();
+	indexed = IndexDirectory(directory, index_dir);
+#endif
 	while ((entry = readdir(dir)) != NULL) {
 		char full_filename[FILENAME_MAX];
-		FILE *file;
 		int len;
 		int id;
 		ULONG crc;
 		int matched_crc = FALSE;
 		Util_catpath(full_filename, directory, entry->d_name);
-		if ((file = fopen(full_filename, "rb")) == NULL)
-			/* Ignore non-readable files (e.g. directories). */
-			continue;
-
-		len = Util_flen(file);
-		/* Don't proceed to CRC computation if the file has invalid size. */
-		if (!IsLengthAllowed(len)){
-			fclose(file);
-			continue;
+#ifdef ROM_INDEX
+		if (indexed) {
+			char index_path[FILENAME_MAX];
+			Util_catpath(index_path, index_dir, entry->d_name);
+			if (!IndexedFileCRC(index_path, &len, &crc))
+				continue;
 		}
-		Util_rewind(file);
-
-		if (!CRC32_FromFile(file, &crc)) {
-			fclose(file);
+		else
+#endif
+		if (!FileCRC(full_filename, &len, &crc))
 			continue;
-		}
-		fclose(file);
 
 		/* Match ROM image by CRC. */
 		for (id = 0; id < SYSROM_SIZE; ++id) {
@@ -329,6 +566,11 @@ int SYSROM_FindInDir(char const *directory, int only_if_not_set)
 	}
 
 	closedir(dir);
+#ifdef ROM_INDEX
+	if (indexed)
+		PruneIndex(index_dir);
+	SaveIndex();
+#endif
 	return TRUE;
 }
 
@@ -776,6 +776,7 @@ static void DiskManagement(void)
 		UI_MENU_ACTION(10, "Rotate Disks"),
 		UI_MENU_FILESEL(11, "Make Blank ATR Disk"),
 		UI_MENU_FILESEL_TIP(12, "Uncompress Disk Image", "Convert GZ or DCM to ATR"),
+		UI_MENU_ACTION_TIP(13, "Save Changed Compressed Disks", "Write back GZ and DCM images changed in memory"),
 		UI_MENU_END
 	};
 
@@ -939,6 +940,31 @@ static void DiskManagement(void)
 				}
 			}
 			break;
+		case 13:
+			{
+				int saved = 0;
+				for (i = 0; i < 8; i++) {
+					if (!SIO_ImageModified(i + 1))
+						continue;
+					/* DCM images cannot be compressed back - ask where to save them */
+					if (SIO_SaveImage(i + 1, NULL))
+						saved++;
+					else {
+						strcpy(disk_filename, SIO_filename[i]);
+						if (UI_driver->fGetSaveFilename(disk_filename, UI_atari_files_dir, UI_n_atari_files_dir)) {
+							if (SIO_SaveImage(i + 1, disk_filename))
+								saved++;
+							else
+								CantSave(disk_filename);
+						}
+					}
+				}
+				if (saved == 0)
+					UI_driver->fMessage("No changed disks saved", 1);
+				else
+					UI_driver->fMessage("Changed disks saved", 1);
+			}
+			break;
 		default:
 			if (dsknum < 0)
 				return;
@@ -1381,6 +1407,7 @@ static void TapeManagement(void)
 		UI_MENU_ACTION_PREFIX_TIP(1, "Position: ", position_string, NULL),
 		UI_MENU_CHECK(2, "Record:"),
 		UI_MENU_SUBMENU(3, "Make blank tape"),
+		UI_MENU_CHECK(4, "Instant loading:"),
 		UI_MENU_END
 	};
 
@@ -1415,6 +1442,7 @@ static void TapeManagement(void)
 		}
 
 		SetItemChecked(menu_array, 2, CASSETTE_record);
+		SetItemChecked(menu_array, 4, CASSETTE_instant_load);
 
 		if (CASSETTE_status == CASSETTE_STATUS_NONE)
 			memcpy(position_string, "N/A", 4);
@@ -1478,6 +1506,10 @@ static void TapeManagement(void)
 		case 3:
 			MakeBlankTapeMenu();
 			break;
+		case 4:
+			CASSETTE_instant_load = !CASSETTE_instant_load;
+			ESC_UpdatePatches();
+			break;
 		default:
 			return;
 		}
@@ -1893,8 +1925,10 @@ static void AtariSettings(void)
 		UI_MENU_SUBMENU_SUFFIX(18, "Enable XEP80:", NULL),
 #endif /* XEP80_EMULATION */
 		UI_MENU_CHECK(3, "SIO patch (fast disk access):"),
+		UI_MENU_CHECK(20, "Turbo SIO (fast serial disk I/O):"),
 		UI_MENU_CHECK(17, "Turbo (F12):"),
 		UI_MENU_CHECK(19, "Slow booting of DOS binary files:"),
+		UI_MENU_CHECK(21, "Direct loading of DOS binary files:"),
 		UI_MENU_ACTION(4, "H: device (hard disk):"),
 		UI_MENU_CHECK(5, "P: device (printer):"),
 #ifdef R_IO_DEVICE
@@ -1928,11 +1962,13 @@ static void AtariSettings(void)
 		SetItemChecked(menu_array, 1, CASSETTE_hold_start_on_reboot);
 		SetItemChecked(menu_array, 2, RTIME_enabled);
 		SetItemChecked(menu_array, 3, ESC_enable_sio_patch);
+		SetItemChecked(menu_array, 20, SIO_turbo);
 #ifdef XEP80_EMULATION
 		FindMenuItem(menu_array, 18)->suffix = xep80_menu_array[XEP80_enabled ? XEP80_port + 1 : 0].item;
 #endif /* XEP80_EMULATION */
 		SetItemChecked(menu_array, 17, Atari800_turbo);
 		SetItemChecked(menu_array, 19, BINLOAD_slow_xex_loading);
+		SetItemChecked(menu_array, 21, BINLOAD_xex_inject);
 		FindMenuItem(menu_array, 4)->suffix = Devices_enable_h_patch ? (Devices_h_read_only ? "Read-only" : "Read/write") : "No ";
 		SetItemChecked(menu_array, 5, Devices_enable_p_patch);
 #ifdef R_IO_DEVICE
@@ -2029,6 +2065,12 @@ static void AtariSettings(void)
 		case 19:
 			BINLOAD_slow_xex_loading = !BINLOAD_slow_xex_loading;
 			break;
+		case 20:
+			SIO_turbo = !SIO_turbo;
+			break;
+		case 21:
+			BINLOAD_xex_inject = !BINLOAD_xex_inject;
+			break;
 		default:
 			ESC_UpdatePatches();
 			return;
@@ -3719,6 +3761,27 @@ static void ControllerConfiguration(void)
 
 #ifdef SOUND
 
+#if defined(SOUND_THIN_API) && defined(SYNCHRONIZED_SOUND)
+static void SoundStatistics(void)
+{
+	Sound_stats_t stats;
+	char text[512];
+	char *p = text;
+	Sound_GetStats(&stats);
+	/* Lines are separated by the '\0' written by sprintf. */
+	p += sprintf(p, "Latency:         %.1f ms", stats.latency_ms) + 1;
+	p += sprintf(p, "Average latency: %.1f ms", stats.avg_latency_ms) + 1;
+	p += sprintf(p, "Latency range:   %.1f - %.1f ms", stats.min_latency_ms, stats.max_latency_ms) + 1;
+	p += sprintf(p, "Target latency:  %.1f ms", stats.target_latency_ms) + 1;
+	p += sprintf(p, "Resampling:      %.5f", stats.ratio) + 1;
+	p += sprintf(p, "Underflows:      %u", stats.underflows) + 1;
+	p += sprintf(p, "Overflows:       %u", stats.overflows) + 1;
+	p += sprintf(p, "Dropped frames:  %u", stats.dropped_frames) + 1;
+	strcpy(p, "\n");
+	UI_driver->fInfoScreen("Sound Buffer Statistics", text);
+}
+#endif /* defined(SOUND_THIN_API) && defined(SYNCHRONIZED_SOUND) */
+
 static int SoundSettings(void)
 {
 #ifdef SOUND_THIN_API
@@ -3782,6 +3845,9 @@ static int SoundSettings(void)
 		UI_MENU_CHECK(8, "Serial IO Sound:"),
 #endif
 		UI_MENU_ACTION(9, "Enable higher frequencies:"),
+#if defined(SOUND_THIN_API) && defined(SYNCHRONIZED_SOUND)
+		UI_MENU_ACTION(10, "Buffer statistics"),
+#endif
 		UI_MENU_END
 	};
 
@@ -3926,6 +3992,11 @@ static int SoundSettings(void)
 			if (!POKEYSND_enable_new_pokey)
 				POKEYSND_bienias_fix = !POKEYSND_bienias_fix;
 			break;
+#if defined(SOUND_THIN_API) && defined(SYNCHRONIZED_SOUND)
+		case 10:
+			SoundStatistics();
+			break;
+#endif
 		default:
 #ifdef SOUND_THIN_API
 			if (!Sound_enabled)
@@ -0,0 +1,307 @@
+/*
+ * ntscbench.c - benchmark of the NTSC filter blitters
+ *
+ * Copyright (C) 2016 Atari800 development team (see DOC/CREDITS)
+ *
+ * This file is part of the Atari800 emulator project which emulates
+ * the Atari 400, 800, 800XL, 130XE, and 5200 8-bit computers.
+ *
+ * Atari800 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Atari800 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atari800; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+/* Measures the speed of atari_ntsc_blit_* with each instruction set
+   available on the host CPU, and checks that all of them produce the same
+   image as the portable code.
+
+   Input frames are Screen_atari contents, either as 8-bit PCX screenshots
+   saved by the emulator (non-interlaced), or as raw dumps of 384x240 bytes.
+   Without input files a few synthetic frames are used.
+
+   Build from the src directory:
+   cc -O2 -I. -o ntscbench util/ntscbench.c atari_ntsc/atari_ntsc.c
+      atari_ntsc/atari_ntsc_simd.c -lm
+   (config.h must exist, ie. run configure first.) */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "colours.h"
+#include "atari_ntsc/atari_ntsc.h"
+
+#define SCREEN_WIDTH 384
+#define SCREEN_HEIGHT 240
+#define VISIBLE_WIDTH 336
+#define IN_WIDTH atari_ntsc_full_in_width
+#define OUT_WIDTH atari_ntsc_full_out_width
+
+#define MAX_FRAMES 64
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* How many seconds to run each test */
+#define TRIAL_TIME 2.0
+
+static unsigned char *frames[MAX_FRAMES];
+static int num_frames = 0;
+
+/* atari_ntsc.c needs these from colours.c. */
+double Colours_Gamma2Linear(double c, double gamma_adj)
+{
+	if (c >= 0.0)
+		return pow(c, gamma_adj);
+	else
+		return c / 12.92;
+}
+
+double Colours_Linear2sRGB(double c)
+{
+	if (c <= 0.0031308)
+		return c * 12.92;
+	else
+		return 1.055 * pow(c, 1.0/2.4) - 0.055;
+}
+
+/* Fills YIQ_TABLE with a default-looking NTSC palette. */
+static void MakeYIQ(double yiq_table[768])
+{
+	int cr, lm;
+	for (cr = 0; cr < 16; cr++) {
+		double angle = (cr - 1) * 2.0 * M_PI / 15.0 + 303.0 * M_PI / 180.0;
+		double sat = cr == 0 ? 0.0 : 0.15;
+		for (lm = 0; lm < 16; lm++) {
+			*yiq_table++ = lm / 15.0;
+			*yiq_table++ = sat * sin(angle);
+			*yiq_table++ = sat * cos(angle);
+		}
+	}
+}
+
+static unsigned char *NewFrame(void)
+{
+	unsigned char *frame;
+	if (num_frames >= MAX_FRAMES)
+		return NULL;
+	frame = (unsigned char *) calloc(SCREEN_WIDTH, SCREEN_HEIGHT);
+	if (frame != NULL)
+		frames[num_frames++] = frame;
+	return frame;
+}
+
+/* Loads a non-interlaced PCX screenshot or a raw Screen_atari dump. */
+static int LoadFrame(const char *filename)
+{
+	FILE *fp = fopen(filename, "rb");
+	unsigned char header[128];
+	unsigned char *frame;
+	long size;
+	if (fp == NULL) {
+		perror(filename);
+		return 0;
+	}
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	frame = NewFrame();
+	if (frame == NULL) {
+		fclose(fp);
+		fprintf(stderr, "%s: too many frames\n", filename);
+		return 0;
+	}
+	if (size == SCREEN_WIDTH * SCREEN_HEIGHT) {
+		if (fread(frame, 1, SCREEN_WIDTH * SCREEN_HEIGHT, fp) != SCREEN_WIDTH * SCREEN_HEIGHT)
+			goto error;
+	}
+	else {
+		int width, height;
+		int x = 0, y = 0;
+		if (fread(header, 1, sizeof(header), fp) != sizeof(header)
+		    || header[0] != 0x0a || header[2] != 1 || header[3] != 8 || header[65] != 1)
+			goto error;
+		width = (header[8] | header[9] << 8) + 1;
+		height = (header[10] | header[11] << 8) + 1;
+		if (width != VISIBLE_WIDTH || height != SCREEN_HEIGHT)
+			goto error;
+		/* The visible area is centred in Screen_atari. */
+		while (y < height) {
+			int c = getc(fp);
+			int count = 1;
+			if (c == EOF)
+				goto error;
+			if ((c & 0xc0) == 0xc0) {
+				count = c & 0x3f;
+				c = getc(fp);
+				if (c == EOF)
+					goto error;
+			}
+			while (count-- > 0 && y < height) {
+				frame[y * SCREEN_WIDTH + (SCREEN_WIDTH - VISIBLE_WIDTH) / 2 + x] = (unsigned char) c;
+				if (++x == width) {
+					x = 0;
+					y++;
+				}
+			}
+		}
+	}
+	fclose(fp);
+	return 1;
+error:
+	fclose(fp);
+	fprintf(stderr, "%s: not a 384x240 Screen_atari dump or an 8-bit %dx%d PCX screenshot\n",
+	        filename, VISIBLE_WIDTH, SCREEN_HEIGHT);
+	return 0;
+}
+
+/* Creates frames with smooth gradients, vertical stripes and noise -
+   the last one is the worst case for the filter's memory access. */
+static void MakeFrames(void)
+{
+	unsigned char *frame;
+	int x, y;
+	unsigned int seed = 1;
+	if ((frame = NewFrame()) != NULL)
+		for (y = 0; y < SCREEN_HEIGHT; y++)
+			for (x = 0; x < SCREEN_WIDTH; x++)
+				frame[y * SCREEN_WIDTH + x] = (unsigned char) ((y / 15) << 4 | (x / 24));
+	if ((frame = NewFrame()) != NULL)
+		for (y = 0; y < SCREEN_HEIGHT; y++)
+			for (x = 0; x < SCREEN_WIDTH; x++)
+				frame[y * SCREEN_WIDTH + x] = (x & 1) ? 0x0f : 0x94;
+	if ((frame = NewFrame()) != NULL)
+		for (y = 0; y < SCREEN_HEIGHT; y++)
+			for (x = 0; x < SCREEN_WIDTH; x++) {
+				seed = seed * 1103515245 + 12345;
+				frame[y * SCREEN_WIDTH + x] = (unsigned char) (seed >> 16);
+			}
+}
+
+typedef void (*blit_t)(atari_ntsc_t const *, ATARI_NTSC_IN_T const *, long, int, int, void *, long);
+
+static const struct {
+	const char *name;
+	blit_t func;
+	int bytes_per_pixel;
+} formats[] = {
+	{ "RGB16", &atari_ntsc_blit_rgb16, 2 },
+	{ "BGR16", &atari_ntsc_blit_bgr16, 2 },
+	{ "ARGB32", &atari_ntsc_blit_argb32, 4 },
+	{ "BGRA32", &atari_ntsc_blit_bgra32, 4 }
+};
+
+#define NUM_FORMATS ((int) (sizeof(formats) / sizeof(formats[0])))
+
+static void Blit(atari_ntsc_t const *ntsc, int format, int frame, void *out)
+{
+	formats[format].func(ntsc, frames[frame] + (SCREEN_WIDTH - IN_WIDTH) / 2, SCREEN_WIDTH,
+	                     IN_WIDTH, SCREEN_HEIGHT, out, OUT_WIDTH * formats[format].bytes_per_pixel);
+}
+
+static double Time(void)
+{
+	return (double) clock() / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char *argv[])
+{
+	static const int simds[] = {
+		ATARI_NTSC_SIMD_NONE, ATARI_NTSC_SIMD_SSE2, ATARI_NTSC_SIMD_AVX2, ATARI_NTSC_SIMD_NEON
+	};
+	double yiq_table[768];
+	atari_ntsc_setup_t setup;
+	atari_ntsc_t *ntsc;
+	unsigned char *ref;
+	unsigned char *out;
+	size_t out_size = (size_t) OUT_WIDTH * SCREEN_HEIGHT * 4;
+	double base_fps[NUM_FORMATS];
+	int mismatches = 0;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-help") == 0) {
+			printf("Usage: %s [screenshot.pcx|screen.raw ...]\n", argv[0]);
+			return 0;
+		}
+		if (!LoadFrame(argv[i]))
+			return 1;
+	}
+	if (num_frames == 0)
+		MakeFrames();
+
+	ntsc = (atari_ntsc_t *) malloc(sizeof(atari_ntsc_t));
+	ref = (unsigned char *) malloc(out_size * NUM_FORMATS * num_frames);
+	out = (unsigned char *) malloc(out_size);
+	if (ntsc == NULL || ref == NULL || out == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	MakeYIQ(yiq_table);
+	setup = atari_ntsc_composite;
+	setup.yiq_palette = yiq_table;
+	atari_ntsc_init(ntsc, &setup);
+
+	printf("%d frame(s), %dx%d -> %dx%d, host CPU supports %s\n", num_frames,
+	       IN_WIDTH, SCREEN_HEIGHT, OUT_WIDTH, SCREEN_HEIGHT,
+	       atari_ntsc_simd_name(atari_ntsc_simd_detect()));
+
+	for (i = 0; i < (int) (sizeof(simds) / sizeof(simds[0])); i++) {
+		int format;
+		if (atari_ntsc_simd_select(simds[i]) != simds[i])
+			continue;
+		printf("%-6s", atari_ntsc_simd_name(simds[i]));
+		for (format = 0; format < NUM_FORMATS; format++) {
+			double start = Time();
+			double elapsed;
+			long count = 0;
+			int frame;
+			/* Compare with output of the portable code. */
+			for (frame = 0; frame < num_frames; frame++) {
+				unsigned char *r = ref + out_size * (format * num_frames + frame);
+				memset(out, 0x55, out_size);
+				Blit(ntsc, format, frame, out);
+				if (simds[i] == ATARI_NTSC_SIMD_NONE)
+					memcpy(r, out, out_size);
+				else if (memcmp(r, out, out_size) != 0)
+					mismatches++;
+			}
+			do {
+				Blit(ntsc, format, count % num_frames, out);
+				count++;
+			} while ((elapsed = Time() - start) < TRIAL_TIME);
+			if (simds[i] == ATARI_NTSC_SIMD_NONE) {
+				base_fps[format] = count / elapsed;
+				printf("  %s %7.1f fps       ", formats[format].name, count / elapsed);
+			}
+			else
+				printf("  %s %7.1f fps (x%.2f)", formats[format].name, count / elapsed,
+				       count / elapsed / base_fps[format]);
+			fflush(stdout);
+		}
+		printf("\n");
+	}
+
+	free(out);
+	free(ref);
+	free(ntsc);
+	if (mismatches != 0) {
+		printf("ERROR: %d frame(s) differ from the portable code\n", mismatches);
+		return 1;
+	}
+	printf("Output of all instruction sets is identical\n");
+	return 0;
+}
@@ -0,0 +1,456 @@
+/*
+ * palbench.c - test and benchmark of the PAL blending blitters
+ *
+ * Copyright (C) 2016 Atari800 development team (see DOC/CREDITS)
+ *
+ * This file is part of the Atari800 emulator project which emulates
+ * the Atari 400, 800, 800XL, 130XE, and 5200 8-bit computers.
+ *
+ * Atari800 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Atari800 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atari800; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+/* Checks that the PAL_BLENDING_* blitters - plain C, SIMD, and the scaled
+   blitters run in horizontal bands - produce exactly the same images as
+   the reference blitters below (which are the original per-pixel
+   blending code), for several frames, pixel formats and screen sizes.
+   Then measures the speed of each blitter.
+
+   Input frames are raw dumps of Screen_atari (384x240 bytes); without
+   input files a few synthetic frames are used.
+
+   Build from the src directory (config.h must exist, ie. run configure
+   with PAL blending enabled first):
+   cc -O2 -I. -o palbench util/palbench.c pal_blending.c -lm */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "atari.h"
+#include "artifact.h"
+#include "colours.h"
+#include "colours_pal.h"
+#include "pal_blending.h"
+#include "platform.h"
+#include "screen.h"
+
+#define MAX_FRAMES 64
+#define MAX_DEST_WIDTH 1536
+#define MAX_DEST_HEIGHT 1200
+
+/* How many seconds to run each benchmark */
+#define TRIAL_TIME 1.0
+
+/* Number of bands the scaled blits are split into in the band test. */
+#define NUM_BANDS 5
+
+/* Stubs for the functions and variables used by pal_blending.c. */
+ARTIFACT_t ARTIFACT_mode = ARTIFACT_PAL_BLEND;
+Colours_setup_t COLOURS_PAL_setup;
+COLOURS_EXTERNAL_t COLOURS_PAL_external;
+static int bpp = 32;
+
+/* Palettes passed to PLATFORM_MapRGB, in the reference blitters' format. */
+static union {
+	UWORD bpp16[2][256];
+	ULONG bpp32[2][256];
+} ref_palette;
+static int num_mapped = 0;
+
+void COLOURS_PAL_GetYUV(double yuv_table[256*5])
+{
+	int i;
+	for (i = 0; i < 256; i++) {
+		int cr = i >> 4;
+		double sat = cr == 0 ? 0.0 : 0.2;
+		*yuv_table++ = (i & 0x0f) / 15.0;
+		*yuv_table++ = sat * ((cr * 7) % 16 - 8) / 8.0;
+		*yuv_table++ = sat * ((cr * 5) % 16 - 8) / 8.0;
+		*yuv_table++ = sat * ((cr * 3) % 16 - 8) / 8.0;
+		*yuv_table++ = sat * ((cr * 11) % 16 - 8) / 8.0;
+	}
+}
+
+void Colours_YUV2RGB(double y, double u, double v, double *r, double *g, double *b)
+{
+	*r = y + 1.14 * v;
+	*g = y - 0.395 * u - 0.581 * v;
+	*b = y + 2.032 * u;
+}
+
+double Colours_Gamma2Linear(double c, double gamma_adj)
+{
+	return c;
+}
+
+double Colours_Linear2sRGB(double c)
+{
+	return c;
+}
+
+void Colours_SetRGB(int i, int r, int g, int b, int *colortable_ptr)
+{
+	r = r < 0 ? 0 : r > 255 ? 255 : r;
+	g = g < 0 ? 0 : g > 255 ? 255 : g;
+	b = b < 0 ? 0 : b > 255 ? 255 : b;
+	colortable_ptr[i] = (r << 16) + (g << 8) + b;
+}
+
+void PLATFORM_GetPixelFormat(PLATFORM_pixel_format_t *format)
+{
+	format->bpp = bpp;
+	if (bpp == 16) {
+		format->rmask = 0xf800;
+		format->gmask = 0x07e0;
+		format->bmask = 0x001f;
+	}
+	else {
+		format->rmask = 0xff0000;
+		format->gmask = 0x00ff00;
+		format->bmask = 0x0000ff;
+	}
+}
+
+/* pal_blending.c maps the even lines' palette first, then the odd lines'. */
+void PLATFORM_MapRGB(void *dest, int const *palette, int size)
+{
+	int i;
+	for (i = 0; i < size; i++) {
+		int c = palette[i];
+		if (bpp == 16)
+			((UWORD *)dest)[i] = (UWORD)((c >> 8 & 0xf800) | (c >> 5 & 0x07e0) | (c >> 3 & 0x001f));
+		else
+			((ULONG *)dest)[i] = 0xff000000 | c;
+	}
+	if (bpp == 16)
+		memcpy(ref_palette.bpp16[num_mapped & 1], dest, size * sizeof(UWORD));
+	else
+		memcpy(ref_palette.bpp32[num_mapped & 1], dest, size * sizeof(ULONG));
+	num_mapped++;
+}
+
+/* Reference blitters: blend each pixel with the pixel above it, as
+   pal_blending.c did before using a table of blended colours. */
+static ULONG RefShiftMask(void)
+{
+	/* Mask of everything except the lowest bit of each RGB component. */
+	if (bpp == 16)
+		return ~((ULONG) 0x08210821);
+	return ~((ULONG) 0x010101);
+}
+
+#define REF_BLEND(quad, quad_prev, shift_mask) \
+	(((quad) & (quad_prev)) + ((((quad) ^ (quad_prev)) & (shift_mask)) >> 1))
+
+static void RefBlit16(ULONG *dest, UBYTE *src, int pitch, int width, int height, int start_odd)
+{
+	ULONG shift_mask = RefShiftMask();
+	UBYTE *src_prev = src;
+	int pos;
+	width = (width + 1) & ~1;
+	while (height-- > 0) {
+		for (pos = 0; pos < width; pos += 2) {
+			ULONG quad_prev = ref_palette.bpp16[start_odd ^ 1][(src_prev[pos] & 0xf0) | (src[pos] & 0x0f)]
+			                  | ref_palette.bpp16[start_odd ^ 1][(src_prev[pos + 1] & 0xf0) | (src[pos + 1] & 0x0f)] << 16;
+			ULONG quad = ref_palette.bpp16[start_odd][src[pos]]
+			             | ref_palette.bpp16[start_odd][src[pos + 1]] << 16;
+			dest[pos >> 1] = REF_BLEND(quad, quad_prev, shift_mask);
+		}
+		src_prev = src;
+		src += Screen_WIDTH;
+		dest += pitch;
+		start_odd ^= 1;
+	}
+}
+
+static void RefBlit32(ULONG *dest, UBYTE *src, int pitch, int width, int height, int start_odd)
+{
+	ULONG shift_mask = RefShiftMask();
+	UBYTE *src_prev = src;
+	int pos;
+	while (height-- > 0) {
+		for (pos = 0; pos < width; pos++) {
+			ULONG quad_prev = ref_palette.bpp32[start_odd ^ 1][(src_prev[pos] & 0xf0) | (src[pos] & 0x0f)];
+			ULONG quad = ref_palette.bpp32[start_odd][src[pos]];
+			dest[pos] = REF_BLEND(quad, quad_prev, shift_mask);
+		}
+		src_prev = src;
+		src += Screen_WIDTH;
+		dest += pitch;
+		start_odd ^= 1;
+	}
+}
+
+/* Returns the reference colour of source pixel POS. */
+static ULONG RefPixel(UBYTE *src, UBYTE *src_prev, int pos, int start_odd, ULONG shift_mask)
+{
+	ULONG quad_prev, quad;
+	if (bpp == 16) {
+		quad_prev = ref_palette.bpp16[start_odd ^ 1][(src_prev[pos] & 0xf0) | (src[pos] & 0x0f)];
+		quad = ref_palette.bpp16[start_odd][src[pos]];
+	}
+	else {
+		quad_prev = ref_palette.bpp32[start_odd ^ 1][(src_prev[pos] & 0xf0) | (src[pos] & 0x0f)];
+		quad = ref_palette.bpp32[start_odd][src[pos]];
+	}
+	return REF_BLEND(quad, quad_prev, shift_mask);
+}
+
+static void RefBlitScaled(ULONG *dest, UBYTE *src, int pitch, int width, int height, int dest_width, int dest_height, int start_odd)
+{
+	ULONG shift_mask = RefShiftMask();
+	UBYTE *src_prev = src;
+	int dx = (width << 16) / dest_width;
+	int dy = (height << 16) / dest_height;
+	int y = 0x10000;
+	while (dest_height-- > 0) {
+		int x = (width << 16) - 0x4000;
+		int pos;
+		if (bpp == 16)
+			for (pos = dest_width / 2 - 1; pos >= 0; pos--) {
+				ULONG quad = RefPixel(src, src_prev, x >> 16, start_odd, shift_mask) << 16;
+				x -= dx;
+				dest[pos] = quad | RefPixel(src, src_prev, x >> 16, start_odd, shift_mask);
+				x -= dx;
+			}
+		else
+			for (pos = dest_width - 1; pos >= 0; pos--) {
+				dest[pos] = RefPixel(src, src_prev, x >> 16, start_odd, shift_mask);
+				x -= dx;
+			}
+		dest += pitch;
+		y -= dy;
+		if (y < 0) {
+			y += 0x10000;
+			src_prev = src;
+			src += Screen_WIDTH;
+			start_odd ^= 1;
+		}
+	}
+}
+
+static UBYTE *frames[MAX_FRAMES];
+static int num_frames = 0;
+
+static UBYTE *NewFrame(void)
+{
+	UBYTE *frame;
+	if (num_frames >= MAX_FRAMES)
+		return NULL;
+	frame = (UBYTE *) calloc(Screen_WIDTH, Screen_HEIGHT);
+	if (frame != NULL)
+		frames[num_frames++] = frame;
+	return frame;
+}
+
+static int LoadFrame(const char *filename)
+{
+	FILE *fp = fopen(filename, "rb");
+	UBYTE *frame = NewFrame();
+	int ok;
+	if (fp == NULL || frame == NULL) {
+		perror(filename);
+		return FALSE;
+	}
+	ok = fread(frame, 1, Screen_WIDTH * Screen_HEIGHT, fp) == Screen_WIDTH * Screen_HEIGHT;
+	fclose(fp);
+	if (!ok)
+		fprintf(stderr, "%s: not a %dx%d Screen_atari dump\n", filename, Screen_WIDTH, Screen_HEIGHT);
+	return ok;
+}
+
+static void MakeFrames(void)
+{
+	UBYTE *frame;
+	int x, y;
+	unsigned int seed = 1;
+	if ((frame = NewFrame()) != NULL)
+		for (y = 0; y < Screen_HEIGHT; y++)
+			for (x = 0; x < Screen_WIDTH; x++)
+				frame[y * Screen_WIDTH + x] = (UBYTE) ((y / 15) << 4 | (x / 24));
+	if ((frame = NewFrame()) != NULL)
+		for (y = 0; y < Screen_HEIGHT; y++)
+			for (x = 0; x < Screen_WIDTH; x++)
+				frame[y * Screen_WIDTH + x] = (UBYTE) (((x >> 3) ^ (y >> 3)) & 1 ? 0x36 : 0x94 + (y & 7));
+	if ((frame = NewFrame()) != NULL)
+		for (y = 0; y < Screen_HEIGHT; y++)
+			for (x = 0; x < Screen_WIDTH; x++) {
+				seed = seed * 1103515245 + 12345;
+				frame[y * Screen_WIDTH + x] = (UBYTE) (seed >> 16);
+			}
+}
+
+/* Source area and destination size of a test. DEST_WIDTH == 0 means an
+   unscaled blit. */
+typedef struct {
+	int width;
+	int height;
+	int dest_width;
+	int dest_height;
+} test_size_t;
+
+static const test_size_t sizes[] = {
+	{ 336, 240, 0, 0 },
+	{ 320, 200, 0, 0 },
+	{ 335, 239, 0, 0 },
+	{ 336, 240, 672, 480 },
+	{ 336, 240, 1008, 720 },
+	{ 320, 200, 800, 600 },
+	{ 336, 240, 1366, 768 },
+	{ 336, 240, 250, 180 }
+};
+
+#define NUM_SIZES ((int) (sizeof(sizes) / sizeof(sizes[0])))
+
+static ULONG *ref;
+static ULONG *out;
+
+/* Ways to blit a frame. */
+enum {
+	BLIT_REFERENCE,
+	BLIT_WHOLE,
+	BLIT_BANDS
+};
+
+/* Blits FRAME. The scaled blit is split into NUM_BANDS bands with
+   BLIT_BANDS. */
+static void Blit(ULONG *dest, test_size_t const *size, int frame, int start_odd, int mode)
+{
+	UBYTE *src = frames[frame] + (Screen_WIDTH - size->width) / 2;
+	int pitch = MAX_DEST_WIDTH;
+	if (mode == BLIT_REFERENCE) {
+		if (size->dest_width != 0)
+			RefBlitScaled(dest, src, pitch, size->width, size->height, size->dest_width, size->dest_height, start_odd);
+		else if (bpp == 16)
+			RefBlit16(dest, src, pitch, size->width, size->height, start_odd);
+		else
+			RefBlit32(dest, src, pitch, size->width, size->height, start_odd);
+	}
+	else if (size->dest_width == 0) {
+		if (bpp == 16)
+			PAL_BLENDING_Blit16(dest, src, pitch, size->width, size->height, start_odd);
+		else
+			PAL_BLENDING_Blit32(dest, src, pitch, size->width, size->height, start_odd);
+	}
+	else if (mode == BLIT_BANDS) {
+		int i;
+		for (i = 0; i < NUM_BANDS; i++) {
+			int y0 = size->dest_height * i / NUM_BANDS;
+			int y1 = size->dest_height * (i + 1) / NUM_BANDS;
+			if (bpp == 16)
+				PAL_BLENDING_BlitScaledRows16(dest, src, pitch, size->width, size->height, size->dest_width, size->dest_height, start_odd, y0, y1 - y0);
+			else
+				PAL_BLENDING_BlitScaledRows32(dest, src, pitch, size->width, size->height, size->dest_width, size->dest_height, start_odd, y0, y1 - y0);
+		}
+	}
+	else if (bpp == 16)
+		PAL_BLENDING_BlitScaled16(dest, src, pitch, size->width, size->height, size->dest_width, size->dest_height, start_odd);
+	else
+		PAL_BLENDING_BlitScaled32(dest, src, pitch, size->width, size->height, size->dest_width, size->dest_height, start_odd);
+}
+
+static double Time(void)
+{
+	return (double) clock() / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t buf_size = (size_t) MAX_DEST_WIDTH * MAX_DEST_HEIGHT * sizeof(ULONG);
+	int mismatches = 0;
+	int simd_available = PAL_BLENDING_simd;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-help") == 0) {
+			printf("Usage: %s [screen.raw ...]\n", argv[0]);
+			return 0;
+		}
+		if (!LoadFrame(argv[i]))
+			return 1;
+	}
+	if (num_frames == 0)
+		MakeFrames();
+	ref = (ULONG *) malloc(buf_size);
+	out = (ULONG *) malloc(buf_size);
+	if (ref == NULL || out == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	if (!simd_available)
+		printf("SIMD blitters not compiled in\n");
+
+	for (bpp = 16; bpp <= 32; bpp += 16) {
+		PAL_BLENDING_UpdateLookup();
+		for (i = 0; i < NUM_SIZES; i++) {
+			test_size_t const *size = &sizes[i];
+			int frame;
+			int start_odd;
+			double fps[3];
+			int simd;
+			/* Compare with output of the reference blitter. */
+			for (frame = 0; frame < num_frames; frame++)
+				for (start_odd = 0; start_odd < 2; start_odd++) {
+					memset(ref, 0x55, buf_size);
+					Blit(ref, size, frame, start_odd, BLIT_REFERENCE);
+					for (simd = 0; simd <= simd_available; simd++) {
+						int mode;
+						PAL_BLENDING_simd = simd;
+						for (mode = BLIT_WHOLE; mode <= (size->dest_width == 0 ? BLIT_WHOLE : BLIT_BANDS); mode++) {
+							memset(out, 0x55, buf_size);
+							Blit(out, size, frame, start_odd, mode);
+							if (memcmp(ref, out, buf_size) != 0) {
+								printf("ERROR: %d bpp %dx%d->%dx%d frame %d%s%s: output differs\n", bpp,
+								       size->width, size->height, size->dest_width, size->dest_height, frame,
+								       simd ? " SIMD" : "", mode == BLIT_BANDS ? " bands" : "");
+								mismatches++;
+							}
+						}
+					}
+				}
+			fps[2] = 0.0;
+			for (simd = -1; simd <= simd_available; simd++) {
+				double start = Time();
+				double elapsed;
+				long count = 0;
+				PAL_BLENDING_simd = simd > 0;
+				do {
+					Blit(out, size, count % num_frames, count & 1, simd < 0 ? BLIT_REFERENCE : BLIT_WHOLE);
+					count++;
+				} while ((elapsed = Time() - start) < TRIAL_TIME);
+				fps[simd + 1] = count / elapsed;
+			}
+			printf("%d bpp %dx%d -> %dx%d: reference %7.1f fps, C %7.1f fps (x%.2f)", bpp,
+			       size->width, size->height,
+			       size->dest_width == 0 ? size->width : size->dest_width,
+			       size->dest_width == 0 ? size->height : size->dest_height,
+			       fps[0], fps[1], fps[1] / fps[0]);
+			if (simd_available)
+				printf(", SIMD %7.1f fps (x%.2f)", fps[2], fps[2] / fps[0]);
+			printf("\n");
+		}
+	}
+	PAL_BLENDING_simd = simd_available;
+
+	free(out);
+	free(ref);
+	if (mismatches != 0) {
+		printf("ERROR: %d image(s) differ from the reference blitters\n", mismatches);
+		return 1;
+	}
+	printf("All images are identical\n");
+	return 0;
+}
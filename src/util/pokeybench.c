@@ -32,17 +32,64 @@
  *                                                                           *
  *****************************************************************************/
 
+/* Benchmark and regression suite of the POKEY sound engines.
+
+   Without -params, plays scripted register sequences (pure tones, all
+   distortions, every AUDCTL mode, joined 1.79 MHz channels, volume-only
+   samples, silence) through pokeysnd.c and mzpokeysnd.c at each quality
+   and with both resamplers, and reports samples/sec of each engine.
+   -save writes CRC32 hashes of the 16-bit output of each run to a file,
+   and -check compares them with such a file, so that an optimization can
+   be checked to keep the output bit-exact:
+     pokeybench -save ref.txt     (before the change)
+     pokeybench -check ref.txt    (after the change)
+   Without a file name, -check uses util/pokeybench.ref, the references
+   of the default configuration (run from the src directory). Only the
+   old engine and the fixed-point MZ engines are hashed: the output of
+   the double-precision engines depends on the host's floating point and
+   rand(), so they are only timed. -time sets the CPU time of each timed
+   run, 0 only hashes.
+
+   With -params, measures the speed of the MZ POKEY engine with its
+   double-precision and fixed-point resamplers (MZPOKEYSND_fixed_point),
+   the signal-to-noise ratio of the fixed-point output relative to the
+   double-precision one, and the cost of each chip with one, two and four
+   chips. The parameter file holds 10 numbers: AUDF1 AUDC1 AUDF2 AUDC2
+   AUDF3 AUDC3 AUDF4 AUDC4 AUDCTL samplerate. Output files are raw mono
+   samples of the double-precision resampler: unsigned 8-bit and signed
+   16-bit native-endian.
+
+   Build with "make pokeybench" in the src directory, or by hand:
+   cc -O2 -I. -o pokeybench util/pokeybench.c pokeysnd.c mzpokeysnd.c remez.c crc32.c -lm
+   (config.h must exist, ie. run configure first.) */
+
+#include "config.h"
+#include "atari.h"
+#include "antic.h"
+#include "gtia.h"
+#include "log.h"
+#include "pokey.h"
 #include "pokeysnd.h"
 #include "mzpokeysnd.h"
+#include "sndsave.h"
+#include "crc32.h"
+#include "util.h"
+#if defined(PBI_XLD) || defined (VOICEBOX)
+#include "votraxsnd.h"
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
-#include <ctype.h>
 #include <time.h>
 #include <math.h>
 
-/* How many seconds of sound to generate per each test trial */
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* How many seconds to run each test trial */
 #define MZM_TRIAL_TIME 2
 
 /* How many samples per each buffer run */
@@ -54,62 +101,122 @@
 /* How many seconds of sound to save in the outfile */
 #define MZM_SAVE_TIME 10
 
+/* pokeysnd.c and mzpokeysnd.c need these from the rest of the emulator. */
+UBYTE POKEY_AUDF[4 * POKEY_MAXPOKEYS];
+UBYTE POKEY_AUDC[4 * POKEY_MAXPOKEYS];
+UBYTE POKEY_AUDCTL[POKEY_MAXPOKEYS];
+int POKEY_Base_mult[POKEY_MAXPOKEYS];
+UBYTE POKEY_poly9_lookup[POKEY_POLY9_SIZE];
+UBYTE POKEY_poly17_lookup[16385];
+int ANTIC_xpos = 0;
+unsigned int ANTIC_screenline_cpu_clock = 0;
+#ifdef NEW_CYCLE_EXACT
+int ANTIC_cur_screen_pos = ANTIC_NOT_DRAWING;
+const int *ANTIC_cpu2antic_ptr = NULL;
+#endif
+int Atari800_tv_mode = Atari800_TV_PAL;
+int GTIA_speaker = 0;
+
+void Log_print(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf("\n");
+}
+
+void *Util_malloc(size_t size)
+{
+    void *ptr = malloc(size);
+    if (ptr == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    return ptr;
+}
 
-/* Wrapper for fgets, removes trailing whitespace */
-char* fgetl(char* s, int len, FILE* fs)
+void *Util_realloc(void *ptr, size_t size)
+{
+    ptr = realloc(ptr, size);
+    if (ptr == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    return ptr;
+}
+
+#if defined(SOUND) && defined(SYNCHRONIZED_SOUND)
+int Sound_headless = FALSE;
+#endif
+
+int SndSave_CloseSoundFile(void)
+{
+    return TRUE;
+}
+
+int SndSave_WriteToSoundFile(const UBYTE *ucBuffer, unsigned int uiSize)
+{
+    return 0;
+}
+
+#if defined(PBI_XLD) || defined (VOICEBOX)
+void VOTRAXSND_Init(int playback_freq, int n_pokeys, int b16)
+{
+}
+
+void VOTRAXSND_Process(void *sndbuffer, int sndn)
+{
+}
+#endif
+
+/* Initializes the engine for CHIPS chips (1, 2 or 4; more than one gives
+   stereo output) and writes the registers of every chip like pokey.c does */
+static void pkinit(unsigned char *audf, unsigned char *audc, unsigned char audctl,
+                   unsigned short samplerate, int flags, int fixed_point, int chips)
 {
-    char* s2;
     int i;
+    int chip;
+
+    POKEYSND_enable_new_pokey = TRUE;
+    MZPOKEYSND_fixed_point = fixed_point;
+#ifdef STEREO_SOUND
+    POKEYSND_stereo_enabled = chips > 1;
+    POKEYSND_quad_enabled = chips > 2;
+#endif
+    POKEYSND_Init(POKEYSND_FREQ_17_EXACT, samplerate, (UBYTE) (chips > 1 ? 2 : 1), flags);
 
-    s2 = fgets(s,len,fs);
-    if(s2 == NULL)
-        return s2;
-    for(i=strlen(s)-1; i>=0; i--)
-        if(isspace(s[i]))
-            s[i] = '\0';
-    return s2;
+    for(chip=0; chip<chips; chip++)
+    {
+        for(i=0; i<4; i++)
+        {
+            POKEY_AUDF[i + chip*4] = audf[i];
+            POKEYSND_Update(POKEY_OFFSET_AUDF1 + i*2, audf[i], (UBYTE) chip, 1);
+            POKEY_AUDC[i + chip*4] = audc[i];
+            POKEYSND_Update(POKEY_OFFSET_AUDC1 + i*2, audc[i], (UBYTE) chip, 1);
+        }
+        POKEY_AUDCTL[chip] = audctl;
+        POKEY_Base_mult[chip] = (audctl & POKEY_CLOCK_15) ? POKEY_DIV_15 : POKEY_DIV_64;
+        POKEYSND_Update(POKEY_OFFSET_AUDCTL, audctl, (UBYTE) chip, 1);
+    }
 }
 
-int pktest(unsigned char *audf, unsigned char *audc, unsigned char audctl,
-           const char* ofn8, const char* ofn16,
-           unsigned short samplerate)
+/* Returns the average generation rate in samples/sec */
+static double pkspeed(unsigned char *audf, unsigned char *audc, unsigned char audctl,
+                      unsigned short samplerate, int fixed_point)
 {
-    unsigned char* buf;
-    short* buf16;
+    unsigned char buf[MZM_BUF_SAMPLES];
     double rate;
     double rasum;
     double rasum2;
     double varian;
     double stddev;
-    unsigned long samremain, samproc;
+    clock_t start;
     int i;
-    time_t start,finish;
-    FILE* ft;
-
-    buf = malloc(MZM_BUF_SAMPLES);
-    if(buf == NULL)
-    {
-        printf("Out of memory\n");
-        return 1;
-    }
-
-    if(i=Pokey_sound_init(1790000,samplerate,1,0,1))
-    {
-        printf("Error initializing Pokey sound: %d\n",i);
-        return 1;
-    }
 
-    Update_pokey_sound(_AUDF1,audf[0],0,1);
-    Update_pokey_sound(_AUDC1,audc[0],0,1);
-    Update_pokey_sound(_AUDF2,audf[1],0,1);
-    Update_pokey_sound(_AUDC2,audc[1],0,1);
-    Update_pokey_sound(_AUDF3,audf[2],0,1);
-    Update_pokey_sound(_AUDC3,audc[2],0,1);
-    Update_pokey_sound(_AUDF4,audf[3],0,1);
-    Update_pokey_sound(_AUDC4,audc[3],0,1);
-    Update_pokey_sound(_AUDCTL,audctl,0,1);
-    Pokey_debugreset(0);
-    
+    pkinit(audf, audc, audctl, samplerate, 0, fixed_point, 1);
+    POKEYSND_stat_samples = 0;
+    POKEYSND_stat_fast_samples = 0;
 
     rasum = 0.0;
     rasum2 = 0.0;
@@ -117,24 +224,15 @@ int pktest(unsigned char *audf, unsigned char *audc, unsigned char audctl,
     for(i=0; i<TEST_TRIALS; i++)
     {
         rate = 0.0;
-        /* Wait for a change in system time (seconds)
-            to ensure start when a full second begins */
-        time(&start);
-        do
-        {
-            time(&finish);
-        } while(difftime(finish,start) == 0.0);
-
-        start = finish; /* Test start time */
+        start = clock();
         /* Generate until test time elapses */
         do
         {
-            Pokey_process(buf,MZM_BUF_SAMPLES);
+            POKEYSND_Process(buf,MZM_BUF_SAMPLES);
             rate += MZM_BUF_SAMPLES;
-            time(&finish);
-        } while(difftime(finish,start) < MZM_TRIAL_TIME);
+        } while(clock() - start < MZM_TRIAL_TIME * CLOCKS_PER_SEC);
 
-        rate /= MZM_TRIAL_TIME;
+        rate = rate * CLOCKS_PER_SEC / (clock() - start);
 
         printf("Trial %2d:  %10.0f samples/sec\n",
             i+1, rate);
@@ -146,131 +244,158 @@ int pktest(unsigned char *audf, unsigned char *audc, unsigned char audctl,
     printf("\nAverage %10.0f samples/sec\n",rasum/TEST_TRIALS);
 
     varian = (rasum2 - rasum*rasum/TEST_TRIALS)/(TEST_TRIALS-1);
-    stddev = sqrt(varian);
+    stddev = sqrt(varian > 0.0 ? varian : 0.0);
 
     printf("Standard deviation: %10.0f samples/sec\n",stddev);
 
     printf("Gen/play ratio = %3.1f\n",rasum/TEST_TRIALS/samplerate);
 
-    /* And now, write 8-bit output file */
+    printf("Fast path (steady output): %.1f%% of samples\n\n",
+        100.0*POKEYSND_stat_fast_samples/POKEYSND_stat_samples);
 
-    if(i=Pokey_sound_init(1790000,samplerate,1,0,1))
-    {
-        printf("Error initializing Pokey sound: %d\n",i);
-        free(buf);
-        return 1;
-    }
-    Update_pokey_sound(_AUDF1,audf[0],0,1);
-    Update_pokey_sound(_AUDC1,audc[0],0,1);
-    Update_pokey_sound(_AUDF2,audf[1],0,1);
-    Update_pokey_sound(_AUDC2,audc[1],0,1);
-    Update_pokey_sound(_AUDF3,audf[2],0,1);
-    Update_pokey_sound(_AUDC3,audc[2],0,1);
-    Update_pokey_sound(_AUDF4,audf[3],0,1);
-    Update_pokey_sound(_AUDC4,audc[3],0,1);
-    Update_pokey_sound(_AUDCTL,audctl,0,1);
-    Pokey_debugreset(0);
-
-    if(!(ft=fopen(ofn8,"wb")))
+    return rasum/TEST_TRIALS;
+}
+
+#ifdef STEREO_SOUND
+/* Measures the cost of each emulated chip with 1, 2 and 4 chips, including
+   the mixing of four chips down to stereo */
+static void pkchips(unsigned char *audf, unsigned char *audc, unsigned char audctl,
+                    unsigned short samplerate)
+{
+    static const int chip_counts[] = { 1, 2, 4 };
+    short buf[2 * MZM_BUF_SAMPLES];
+    int i;
+
+    for(i=0; i<3; i++)
     {
-        perror(ofn8);
-        free(buf);
-        return 2;
+        int chips = chip_counts[i];
+        int channels = chips > 1 ? 2 : 1;
+        double frames = 0.0;
+        double elapsed;
+        double cpu;
+        clock_t start;
+
+        pkinit(audf, audc, audctl, samplerate, POKEYSND_BIT16, TRUE, chips);
+        start = clock();
+        do
+        {
+            POKEYSND_Process(buf, MZM_BUF_SAMPLES * channels);
+            frames += MZM_BUF_SAMPLES;
+        } while(clock() - start < MZM_TRIAL_TIME * CLOCKS_PER_SEC);
+        elapsed = (double) (clock() - start) / CLOCKS_PER_SEC;
+        /* CPU time as a percentage of the real time of the sound */
+        cpu = 100.0 * samplerate * elapsed / frames;
+        printf("%d chip(s): %10.0f frames/sec, %5.2f%% CPU, %5.2f%% per chip\n",
+               chips, frames / elapsed, cpu, cpu / chips);
+        fflush(stdout);
     }
+    POKEYSND_stereo_enabled = FALSE;
+    POKEYSND_quad_enabled = FALSE;
+    printf("\n");
+}
+#endif /* STEREO_SOUND */
+
+/* Generates MZM_SAVE_TIME seconds of sound into a new buffer */
+static void *pkgenerate(unsigned char *audf, unsigned char *audc, unsigned char audctl,
+                        unsigned short samplerate, int flags, int fixed_point)
+{
+    int sample_size = (flags & POKEYSND_BIT16) ? 2 : 1;
+    unsigned long samremain = (unsigned long) samplerate*MZM_SAVE_TIME;
+    unsigned char *buf = (unsigned char *) Util_malloc(samremain*sample_size);
+    unsigned char *ptr = buf;
 
-    samremain = samplerate*MZM_SAVE_TIME;
+    pkinit(audf, audc, audctl, samplerate, flags, fixed_point, 1);
     while(samremain>0)
     {
-        if(samremain>=MZM_BUF_SAMPLES)
-        {
-            samproc = MZM_BUF_SAMPLES;
-        }
-        else
-        {
-            samproc = samremain;
-        }
-        Pokey_process(buf,(unsigned short)samproc);
-        i = fwrite(buf,1,samproc,ft);
-        if(i<samproc)
-        {
-            perror(ofn8);
-            free(buf);
-            fclose(ft);
-            return 2;
-        }
+        unsigned long samproc = samremain>=MZM_BUF_SAMPLES ? MZM_BUF_SAMPLES : samremain;
+        POKEYSND_Process(ptr,(int)samproc);
+        ptr += samproc*sample_size;
         samremain -= samproc;
     }
+    return buf;
+}
 
-    free(buf);
-    fclose(ft);
-
-    /* Write 16-bit output file */
+static int pkwrite(const char *fn, const void *buf, size_t size)
+{
+    FILE* ft;
 
-    if(i=Pokey_sound_init(1790000,samplerate,1,SND_BIT16,1))
-    {
-        printf("Error initializing Pokey sound: %d\n",i);
-        return 1;
-    }
-    Update_pokey_sound(_AUDF1,audf[0],0,1);
-    Update_pokey_sound(_AUDC1,audc[0],0,1);
-    Update_pokey_sound(_AUDF2,audf[1],0,1);
-    Update_pokey_sound(_AUDC2,audc[1],0,1);
-    Update_pokey_sound(_AUDF3,audf[2],0,1);
-    Update_pokey_sound(_AUDC3,audc[2],0,1);
-    Update_pokey_sound(_AUDF4,audf[3],0,1);
-    Update_pokey_sound(_AUDC4,audc[3],0,1);
-    Update_pokey_sound(_AUDCTL,audctl,0,1);
-    Pokey_debugreset(0);
-
-
-    buf16 = malloc(2*MZM_BUF_SAMPLES);
-    if(buf16 == NULL)
+    if(!(ft=fopen(fn,"wb")))
     {
-        printf("Out of memory\n");
-        return 1;
+        perror(fn);
+        return 2;
     }
-
-    if(!(ft=fopen(ofn16,"wb")))
+    if(fwrite(buf,1,size,ft) < size)
     {
-        perror(ofn16);
-        free(buf16);
+        perror(fn);
+        fclose(ft);
         return 2;
     }
+    fclose(ft);
+    return 0;
+}
 
-    samremain = samplerate*MZM_SAVE_TIME;
-    while(samremain>0)
+static int pktest(unsigned char *audf, unsigned char *audc, unsigned char audctl,
+                  const char* ofn8, const char* ofn16,
+                  unsigned short samplerate)
+{
+    unsigned long samples = (unsigned long) samplerate*MZM_SAVE_TIME;
+    unsigned char *buf8;
+    short *buf16;
+    short *buf16_fixed;
+    double rate_double, rate_fixed;
+    double mean, signal, noise;
+    unsigned long i;
+    int ecode;
+
+    printf("Double-precision resampler:\n");
+    rate_double = pkspeed(audf, audc, audctl, samplerate, FALSE);
+    printf("Fixed-point resampler:\n");
+    rate_fixed = pkspeed(audf, audc, audctl, samplerate, TRUE);
+    printf("Fixed-point speedup: x%.2f\n\n", rate_fixed/rate_double);
+#ifdef STEREO_SOUND
+    printf("Cost per chip (fixed-point, 16-bit):\n");
+    pkchips(audf, audc, audctl, samplerate);
+#endif
+
+    /* Compare 16-bit outputs. Both are dithered with independent noise,
+       so the SNR can't exceed that of the dither. */
+    buf16 = (short *) pkgenerate(audf, audc, audctl, samplerate, POKEYSND_BIT16, FALSE);
+    buf16_fixed = (short *) pkgenerate(audf, audc, audctl, samplerate, POKEYSND_BIT16, TRUE);
+    mean = 0.0;
+    for(i=0; i<samples; i++)
+        mean += buf16[i];
+    mean /= samples;
+    signal = 0.0;
+    noise = 0.0;
+    for(i=0; i<samples; i++)
     {
-        if(samremain>=MZM_BUF_SAMPLES)
-        {
-            samproc = MZM_BUF_SAMPLES;
-        }
-        else
-        {
-            samproc = samremain;
-        }
-        Pokey_process(buf16,(unsigned short)samproc);
-        i = fwrite(buf16,2,samproc,ft);
-        if(i<samproc)
-        {
-            perror(ofn16);
-            free(buf16);
-            fclose(ft);
-            return 2;
-        }
-        samremain -= samproc;
+        double d = buf16_fixed[i] - buf16[i];
+        signal += (buf16[i]-mean)*(buf16[i]-mean);
+        noise += d*d;
     }
-
+    if(noise == 0.0)
+        printf("Fixed-point 16-bit output is identical\n");
+    else if(signal == 0.0)
+        printf("Silence; RMS difference of fixed-point 16-bit output: %.3f LSB\n",
+               sqrt(noise/samples));
+    else
+        printf("SNR of fixed-point 16-bit output: %.1f dB (RMS difference %.3f LSB)\n",
+               10.0*log10(signal/noise), sqrt(noise/samples));
+    free(buf16_fixed);
+
+    /* And now, write output files */
+    buf8 = (unsigned char *) pkgenerate(audf, audc, audctl, samplerate, 0, FALSE);
+    ecode = pkwrite(ofn8, buf8, samples);
+    if(ecode == 0)
+        ecode = pkwrite(ofn16, buf16, samples*2);
+    free(buf8);
     free(buf16);
-    fclose(ft);
-
-    return 0;
+    return ecode;
 }
 
-int main(int argc, char* argv[])
+/* Runs the tests with the registers and sample rate read from PARAMFN */
+static int pkparams(const char *paramfn, const char *ofn8, const char *ofn16)
 {
-    char paramfn[256];
-    char ofn8[256];
-    char ofn16[256];
     FILE* fs;
     unsigned int params[10];
     unsigned char audf[4];
@@ -279,65 +404,12 @@ int main(int argc, char* argv[])
     int i;
     int ecode;
 
-    printf("PokeyBench (c) 2002 by Michael Borisov\n\n");
-
-    /* Get command-line parameters */
-    if(argc<2)
-    {
-        printf("Enter parameter file name: ");
-        fflush(stdout);
-        if(fgetl(paramfn,256,stdin) == NULL)
-        {
-            printf("Bad input\n");
-            return 1;
-        }
-    }
-    else
-    {
-        strncpy(paramfn,argv[1],255);
-        paramfn[255] = '\0';
-    }
-
-    if(argc<3)
-    {
-        printf("Enter output file name (8-bit): ");
-        fflush(stdout);
-        if(fgetl(ofn8,256,stdin) == NULL)
-        {
-            printf("Bad input\n");
-            return 1;
-        }
-    }
-    else
-    {
-        strncpy(ofn8,argv[2],255);
-        ofn8[255] = '\0';
-    }
-
-    if(argc<4)
-    {
-        printf("Enter output file name (16-bit): ");
-        fflush(stdout);
-        if(fgetl(ofn16,256,stdin) == NULL)
-        {
-            printf("Bad input\n");
-            return 1;
-        }
-    }
-    else
-    {
-        strncpy(ofn16,argv[3],255);
-        ofn16[255] = '\0';
-    }
-
-
-    /* Read parameter file */
     if(!(fs = fopen(paramfn,"r")))
     {
         perror(paramfn);
         return 2;
     }
-    
+
     for(i=0; i<10; i++)
     {
         ecode = fscanf(fs,"%u",&tmp);
@@ -371,6 +443,430 @@ int main(int argc, char* argv[])
         audf[i] = params[i*2];
         audc[i] = params[i*2+1];
     }
-    
+
     return pktest(audf,audc,(unsigned char)params[8],ofn8, ofn16, (unsigned short)params[9]);
 }
+
+/* Scripted regression suite
+   -------------------------
+
+   Each script writes POKEY registers at given CPU ticks. It is played
+   through each engine configuration, either with POKEYSND_Process (as
+   the sound callback of the emulator does) or with the synchronized sound
+   of POKEYSND_UpdateProcessBuffer called every frame. The first pass of
+   each run is hashed with CRC32, the next ones are timed. */
+
+/* Output format of the suite */
+#define PK_SAMPLERATE 44100
+#define PK_BUF_FRAMES 256
+
+/* pokey.c passes this gain to POKEYSND_Update */
+#define PK_GAIN 4
+
+#define PK_TICKS_PER_SEC POKEYSND_FREQ_17_EXACT
+#define PK_MS(ms) ((ULONG) ((double) PK_TICKS_PER_SEC * (ms) / 1000))
+
+static const struct {
+    const char *name;
+    int new_pokey;
+    int quality;
+    int fixed_point;
+    int deterministic;      /* same output on every host */
+} pkengines[] = {
+    { "rf", FALSE, 0, FALSE, TRUE },
+    { "mz-q0", TRUE, 0, FALSE, FALSE },
+    { "mz-q1", TRUE, 1, FALSE, FALSE },
+    { "mz-q2", TRUE, 2, FALSE, FALSE },
+    { "mz-q0-fixed", TRUE, 0, TRUE, TRUE },
+    { "mz-q2-fixed", TRUE, 2, TRUE, TRUE }
+};
+
+/* Default reference file of -check */
+#define PK_DEFAULT_REFS "util/pokeybench.ref"
+
+#define PK_NUM_ENGINES ((int) (sizeof(pkengines) / sizeof(pkengines[0])))
+
+/* State of the current run */
+static struct {
+    int sync;               /* TRUE for synchronized sound */
+    int hash;               /* TRUE to hash the output */
+    ULONG crc;
+    unsigned long frames;   /* output frames generated */
+    ULONG frame_tick;       /* tick of the last POKEYSND_UpdateProcessBuffer */
+} pkrun;
+
+static unsigned int pkseed;
+
+/* Deterministic pseudo-random numbers for the scripts */
+static unsigned int pkrand(void)
+{
+    pkseed = pkseed * 1103515245 + 12345;
+    return (pkseed >> 16) & 0x7fff;
+}
+
+static void pkclock(ULONG tick)
+{
+    ANTIC_screenline_cpu_clock = tick;
+    ANTIC_xpos = 0;
+}
+
+/* Adds FRAMES frames of 16-bit output to the hash */
+static void pkhash(const SWORD *buf, int frames)
+{
+    UBYTE bytes[2 * PK_BUF_FRAMES];
+    int i;
+    pkrun.frames += frames;
+    if (!pkrun.hash)
+        return;
+    while (frames > 0) {
+        int n = frames > PK_BUF_FRAMES ? PK_BUF_FRAMES : frames;
+        /* hash little-endian samples, so references don't depend on the host */
+        for (i = 0; i < n; i++) {
+            bytes[2 * i] = (UBYTE) buf[i];
+            bytes[2 * i + 1] = (UBYTE) ((UWORD) buf[i] >> 8);
+        }
+        pkrun.crc = CRC32_Update(pkrun.crc, bytes, 2 * n);
+        buf += n;
+        frames -= n;
+    }
+}
+
+/* Generates the sound up to TICK */
+static void pkadvance(ULONG tick)
+{
+#ifdef SYNCHRONIZED_SOUND
+    if (pkrun.sync) {
+        ULONG ticks_per_frame = Atari800_tv_mode * 114;
+        while (tick - pkrun.frame_tick >= ticks_per_frame) {
+            pkrun.frame_tick += ticks_per_frame;
+            pkclock(pkrun.frame_tick);
+            pkhash((const SWORD *) POKEYSND_process_buffer, POKEYSND_UpdateProcessBuffer());
+        }
+    }
+    else
+#endif
+    {
+        SWORD buf[PK_BUF_FRAMES];
+        unsigned long due = (unsigned long) ((double) tick * PK_SAMPLERATE / PK_TICKS_PER_SEC);
+        while (pkrun.frames < due) {
+            int n = due - pkrun.frames > PK_BUF_FRAMES ? PK_BUF_FRAMES : (int) (due - pkrun.frames);
+            POKEYSND_Process(buf, n);
+            pkhash(buf, n);
+        }
+    }
+    pkclock(tick);
+}
+
+/* Writes a register of the first chip at TICK, like pokey.c does */
+static void pkreg(ULONG tick, UWORD addr, UBYTE val)
+{
+    pkadvance(tick);
+    switch (addr) {
+    case POKEY_OFFSET_AUDF1:
+    case POKEY_OFFSET_AUDF2:
+    case POKEY_OFFSET_AUDF3:
+    case POKEY_OFFSET_AUDF4:
+        POKEY_AUDF[addr >> 1] = val;
+        break;
+    case POKEY_OFFSET_AUDC1:
+    case POKEY_OFFSET_AUDC2:
+    case POKEY_OFFSET_AUDC3:
+    case POKEY_OFFSET_AUDC4:
+        POKEY_AUDC[addr >> 1] = val;
+        break;
+    case POKEY_OFFSET_AUDCTL:
+        POKEY_AUDCTL[0] = val;
+        POKEY_Base_mult[0] = (val & POKEY_CLOCK_15) ? POKEY_DIV_15 : POKEY_DIV_64;
+        break;
+    default:
+        break;
+    }
+    POKEYSND_Update(addr, val, 0, PK_GAIN);
+}
+
+/* Four pure tones playing a random melody, with STIMER writes */
+static ULONG pkscript_tones(void)
+{
+    ULONG t;
+    int i;
+    for (i = 0; i < 4; i++)
+        pkreg(0, (UWORD) (POKEY_OFFSET_AUDC1 + 2 * i), (UBYTE) (0xa4 + i));
+    for (t = 0; t < PK_MS(2000); t += PK_MS(50)) {
+        for (i = 0; i < 4; i++)
+            pkreg(t + i, (UWORD) (POKEY_OFFSET_AUDF1 + 2 * i), (UBYTE) (20 + pkrand() % 200));
+        if (t % PK_MS(500) == 0)
+            pkreg(t + 4, POKEY_OFFSET_STIMER, 0);
+    }
+    return t;
+}
+
+/* All distortions of the polynomial counters */
+static ULONG pkscript_noise(void)
+{
+    static const UBYTE distortions[] = { 0x00, 0x20, 0x40, 0x60, 0x80, 0xc0 };
+    ULONG t = 0;
+    int d;
+    int i;
+    for (d = 0; d < (int) sizeof(distortions); d++) {
+        for (i = 0; i < 4; i++) {
+            pkreg(t, (UWORD) (POKEY_OFFSET_AUDF1 + 2 * i), (UBYTE) (i * 50 + d));
+            pkreg(t, (UWORD) (POKEY_OFFSET_AUDC1 + 2 * i), (UBYTE) (distortions[d] | (6 + i)));
+        }
+        t += PK_MS(300);
+    }
+    return t;
+}
+
+/* Every AUDCTL value: 15 kHz clock, 9-bit poly, 1.79 MHz channels, joined
+   channels and high-pass filters */
+static ULONG pkscript_audctl(void)
+{
+    ULONG t = 0;
+    int audctl;
+    int i;
+    for (i = 0; i < 4; i++) {
+        pkreg(0, (UWORD) (POKEY_OFFSET_AUDF1 + 2 * i), (UBYTE) (0x11 + i * 0x35));
+        pkreg(0, (UWORD) (POKEY_OFFSET_AUDC1 + 2 * i), (UBYTE) ((i & 1 ? 0x05 : 0xa5) + 0x20 * (i >> 1)));
+    }
+    for (audctl = 0; audctl < 256; audctl++) {
+        pkreg(t, POKEY_OFFSET_AUDCTL, (UBYTE) audctl);
+        t += PK_MS(10);
+    }
+    return t;
+}
+
+/* 16-bit periods of joined channels clocked at 1.79 MHz */
+static ULONG pkscript_joined(void)
+{
+    ULONG t = 0;
+    unsigned int period = 0x0100;
+    pkreg(0, POKEY_OFFSET_AUDC1, 0);
+    pkreg(0, POKEY_OFFSET_AUDC2, 0xa8);
+    pkreg(0, POKEY_OFFSET_AUDC3, 0);
+    pkreg(0, POKEY_OFFSET_AUDC4, 0xa6);
+    for (; t < PK_MS(2000); t += PK_MS(20)) {
+        pkreg(t, POKEY_OFFSET_AUDCTL, (UBYTE) (t < PK_MS(1000) ? 0x50 : 0x78));
+        pkreg(t, POKEY_OFFSET_AUDF1, (UBYTE) period);
+        pkreg(t, POKEY_OFFSET_AUDF2, (UBYTE) (period >> 8));
+        pkreg(t, POKEY_OFFSET_AUDF3, (UBYTE) (period >> 1));
+        pkreg(t, POKEY_OFFSET_AUDF4, (UBYTE) (period >> 9));
+        period = (period * 17 / 16) & 0xffff;
+    }
+    return t;
+}
+
+/* Digitized sound in volume-only mode at about 8 kHz */
+static ULONG pkscript_volonly(void)
+{
+    ULONG t;
+    int n = 0;
+    for (t = 0; t < PK_MS(1500); t += PK_TICKS_PER_SEC / 8000, n++) {
+        int v = (int) (7.5 + 7.5 * sin(n * 2 * M_PI * 440 / 8000));
+        pkreg(t, POKEY_OFFSET_AUDC1, (UBYTE) (0x10 | v));
+        if (t >= PK_MS(500))
+            pkreg(t, POKEY_OFFSET_AUDC2, (UBYTE) (0x10 | (pkrand() & 0x0f)));
+    }
+    return t;
+}
+
+/* Silence: fast path of the engines */
+static ULONG pkscript_silence(void)
+{
+    pkreg(0, POKEY_OFFSET_AUDCTL, 0);
+    return PK_MS(2000);
+}
+
+static const struct {
+    const char *name;
+    ULONG (*func)(void);
+} pkscripts[] = {
+    { "tones", pkscript_tones },
+    { "noise", pkscript_noise },
+    { "audctl", pkscript_audctl },
+    { "joined", pkscript_joined },
+    { "volonly", pkscript_volonly },
+    { "silence", pkscript_silence }
+};
+
+#define PK_NUM_SCRIPTS ((int) (sizeof(pkscripts) / sizeof(pkscripts[0])))
+
+/* Plays script SCRIPT through engine ENGINE once, hashing the output if
+   HASH, and returns the CPU time spent generating the sound */
+static double pkplay(int engine, int script, int sync, int hash)
+{
+    clock_t start;
+    ULONG end;
+    int i;
+
+    POKEYSND_enable_new_pokey = pkengines[engine].new_pokey;
+    POKEYSND_SetMzQuality(pkengines[engine].quality);
+    MZPOKEYSND_fixed_point = pkengines[engine].fixed_point;
+    pkclock(0);
+    srand(1);
+    POKEYSND_Init(POKEYSND_FREQ_17_EXACT, PK_SAMPLERATE, 1, POKEYSND_BIT16);
+    pkrun.sync = sync;
+    pkrun.hash = hash;
+    pkrun.crc = 0xffffffff;
+    pkrun.frames = 0;
+    pkrun.frame_tick = 0;
+    pkseed = 1;
+
+    start = clock();
+    for (i = 0; i < 4; i++) {
+        pkreg(0, (UWORD) (POKEY_OFFSET_AUDF1 + 2 * i), 0);
+        pkreg(0, (UWORD) (POKEY_OFFSET_AUDC1 + 2 * i), 0);
+    }
+    pkreg(0, POKEY_OFFSET_AUDCTL, 0);
+    end = pkscripts[script].func();
+    pkadvance(end);
+#ifdef SYNCHRONIZED_SOUND
+    if (sync)
+        pkhash((const SWORD *) POKEYSND_process_buffer, POKEYSND_UpdateProcessBuffer());
+#endif
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Reference hashes read by -check */
+#define PK_MAX_REFS 256
+static struct {
+    char key[64];
+    ULONG crc;
+} pkrefs[PK_MAX_REFS];
+static int pknum_refs = 0;
+
+static int pkreadrefs(const char *fn)
+{
+    FILE *fp = fopen(fn, "r");
+    char key[64];
+    unsigned long crc;
+    if (fp == NULL) {
+        perror(fn);
+        return FALSE;
+    }
+    while (pknum_refs < PK_MAX_REFS && fscanf(fp, "%63s %lx", key, &crc) == 2) {
+        strcpy(pkrefs[pknum_refs].key, key);
+        pkrefs[pknum_refs].crc = (ULONG) crc;
+        pknum_refs++;
+    }
+    fclose(fp);
+    return TRUE;
+}
+
+/* Returns the reference entry of KEY or NULL */
+static ULONG *pkfindref(const char *key)
+{
+    int i;
+    for (i = 0; i < pknum_refs; i++)
+        if (strcmp(pkrefs[i].key, key) == 0)
+            return &pkrefs[i].crc;
+    return NULL;
+}
+
+/* Runs all scripts through all engines. Each run is repeated for at least
+   MIN_TIME seconds of CPU time to measure its speed. Returns the number
+   of hashes that differ from the references. */
+static int pksuite(double min_time, const char *save_fn, int check)
+{
+    FILE *save_fp = NULL;
+    int mismatches = 0;
+    int missing = 0;
+    int sync;
+    int e;
+    int s;
+
+    if (save_fn != NULL && (save_fp = fopen(save_fn, "w")) == NULL) {
+        perror(save_fn);
+        return -1;
+    }
+    printf("%-12s %-6s %14s %10s\n", "engine", "mode", "samples/sec", "realtime");
+#ifdef SYNCHRONIZED_SOUND
+    for (sync = 0; sync <= 1; sync++)
+#else
+    sync = 0;
+#endif
+    {
+        for (e = 0; e < PK_NUM_ENGINES; e++) {
+            double elapsed = 0.0;
+            double frames = 0.0;
+            for (s = 0; s < PK_NUM_SCRIPTS; s++) {
+                char key[64];
+                double script_time = 0.0;
+                if (pkengines[e].deterministic) {
+                    pkplay(e, s, sync, TRUE);
+                    sprintf(key, "%s/%s/%s", sync ? "sync" : "process", pkengines[e].name, pkscripts[s].name);
+                    pkrun.crc ^= 0xffffffff;
+                    if (save_fp != NULL)
+                        fprintf(save_fp, "%s %08lx\n", key, (unsigned long) pkrun.crc);
+                    if (check) {
+                        ULONG *ref = pkfindref(key);
+                        if (ref == NULL) {
+                            printf("%s: no reference\n", key);
+                            missing++;
+                        }
+                        else if (*ref != pkrun.crc) {
+                            printf("%s: output differs (%08lx, reference %08lx)\n",
+                                   key, (unsigned long) pkrun.crc, (unsigned long) *ref);
+                            mismatches++;
+                        }
+                    }
+                }
+                while (script_time < min_time) {
+                    script_time += pkplay(e, s, sync, FALSE);
+                    frames += pkrun.frames;
+                }
+                elapsed += script_time;
+            }
+            if (elapsed > 0.0)
+                printf("%-12s %-6s %14.0f %9.1fx\n", pkengines[e].name, sync ? "sync" : "proc",
+                       frames / elapsed, frames / elapsed / PK_SAMPLERATE);
+            else
+                printf("%-12s %-6s %14s %10s\n", pkengines[e].name, sync ? "sync" : "proc", "-", "-");
+            fflush(stdout);
+        }
+    }
+    if (save_fp != NULL)
+        fclose(save_fp);
+    if (check) {
+        if (mismatches == 0 && missing == 0)
+            printf("Output of all runs matches the references\n");
+        else
+            printf("ERROR: %d run(s) differ from the references, %d without reference\n",
+                   mismatches, missing);
+    }
+    return mismatches + missing;
+}
+
+int main(int argc, char* argv[])
+{
+    const char *save_fn = NULL;
+    const char *check_fn = NULL;
+    double min_time = 0.2;
+    int i;
+
+    printf("PokeyBench (c) 2002 by Michael Borisov\n\n");
+
+    for(i=1; i<argc; i++)
+    {
+        int i_a = (i + 1 < argc);
+        if(strcmp(argv[i], "-params") == 0 && i + 3 < argc)
+        {
+            return pkparams(argv[i+1], argv[i+2], argv[i+3]);
+        }
+        else if(strcmp(argv[i], "-time") == 0 && i_a)
+            min_time = atof(argv[++i]);
+        else if(strcmp(argv[i], "-save") == 0 && i_a)
+            save_fn = argv[++i];
+        else if(strcmp(argv[i], "-check") == 0)
+            check_fn = i_a && argv[i + 1][0] != '-' ? argv[++i] : PK_DEFAULT_REFS;
+        else
+        {
+            printf("Usage: %s [-time <seconds>] [-save <reffile>] [-check [<reffile>]]\n"
+                   "       %s -params <paramfile> <out8> <out16>\n", argv[0], argv[0]);
+            return strcmp(argv[i], "-help") == 0 ? 0 : 1;
+        }
+    }
+
+    if(check_fn != NULL && !pkreadrefs(check_fn))
+        return 2;
+    return pksuite(min_time, save_fn, check_fn != NULL) == 0 ? 0 : 1;
+}
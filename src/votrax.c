@@ -92,6 +92,38 @@ static const char *PhonemeNames[65] =
 
 static int sample_rate[4] = {22050, 22050, 22050, 22050};
 
+/* Fade curves - quarter sine waves - of the lengths used in
+   PrepareVoiceData, computed once instead of for every sample. */
+#define MAX_FADE_CURVES 8
+static struct {
+	int samples;
+	double *curve;
+} fade_curves[MAX_FADE_CURVES];
+static int num_fade_curves = 0;
+
+/* Returns sin((i/SAMPLES)*pi/2) for i = 0..SAMPLES-1. */
+static const double *FadeCurve(int samples)
+{
+	int i;
+	double *curve;
+
+	if (samples <= 0)
+		return NULL;
+	for (i = 0; i < num_fade_curves; i++) {
+		if (fade_curves[i].samples == samples)
+			return fade_curves[i].curve;
+	}
+	if (num_fade_curves == MAX_FADE_CURVES)
+		free(fade_curves[--num_fade_curves].curve);
+	curve = (double *) Util_malloc(samples * sizeof(double));
+	for (i = 0; i < samples; i++)
+		curve[i] = sin((1.0*i/samples)*3.1415/2);
+	fade_curves[num_fade_curves].samples = samples;
+	fade_curves[num_fade_curves].curve = curve;
+	num_fade_curves++;
+	return curve;
+}
+
 /* converts milliseconds to a count of samples */
 static int time_to_samples(int ms)
 {
@@ -108,6 +140,8 @@ static void PrepareVoiceData(int nextPhoneme, int nextIntonation)
 	
 	int iFadeInSamples;
 	int iFadeInPos;
+	const double *pFadeOut;
+	const double *pFadeIn;
 
 	int doMix;
 	/* used only for SecondStart phonemes */
@@ -251,6 +285,9 @@ static void PrepareVoiceData(int nextPhoneme, int nextIntonation)
 		pNextPos = votraxsc01_locals.pActPos;
 	}
 
+	pFadeOut = doMix ? NULL : FadeCurve(iFadeOutSamples);
+	pFadeIn = FadeCurve(iFadeInSamples);
+
 	for (i=0; i<dwCount; i++)
 	{
 		data = 0x00;
@@ -261,7 +298,7 @@ static void PrepareVoiceData(int nextPhoneme, int nextIntonation)
 			double dFadeOut = 1.0;
 
 			if ( !doMix )
-				dFadeOut = 1.0-sin((1.0*iFadeOutPos/iFadeOutSamples)*3.1415/2);
+				dFadeOut = 1.0-pFadeOut[iFadeOutPos];
 
 			if ( !votraxsc01_locals.iRemainingSamples ) {
 				votraxsc01_locals.iRemainingSamples = PhonemeData[votraxsc01_locals.actPhoneme].iLength[votraxsc01_locals.actIntonation];
@@ -280,7 +317,7 @@ static void PrepareVoiceData(int nextPhoneme, int nextIntonation)
 			double dFadeIn = 1.0;
 			
 			if ( iFadeInPos<iFadeInSamples ) {
-				dFadeIn = sin((1.0*iFadeInPos/iFadeInSamples)*3.1415/2);
+				dFadeIn = pFadeIn[iFadeInPos];
 				iFadeInPos++;
 			}
 
@@ -342,6 +379,8 @@ UBYTE Votrax_GetStatus(void)
 void Votrax_Update(int num, SWORD *buffer, int length)
 {
 	int samplesToCopy;
+	SWORD *pLoopStart;
+	int iLoopLength;
 
 #if 0
 	/* if it is a different intonation */
@@ -372,16 +411,29 @@ void Votrax_Update(int num, SWORD *buffer, int length)
 					(*votraxsc01_locals.intf->BusyCallback)(votraxsc01_locals.busy);
 			}
 
+			if ( PhonemeData[votraxsc01_locals.actPhoneme].iType>=PT_VS ) {
+				pLoopStart = PhonemeData[0x3f].lpStart[0];
+				iLoopLength = PhonemeData[0x3f].iLength[0];
+			}
+			else {
+				pLoopStart = PhonemeData[votraxsc01_locals.actPhoneme].lpStart[votraxsc01_locals.actIntonation];
+				iLoopLength = PhonemeData[votraxsc01_locals.actPhoneme].iLength[votraxsc01_locals.actIntonation];
+			}
+
 			if ( votraxsc01_locals.iRemainingSamples==0 ) {
-				if ( PhonemeData[votraxsc01_locals.actPhoneme].iType>=PT_VS ) {
-					votraxsc01_locals.pActPos = PhonemeData[0x3f].lpStart[0];
-					votraxsc01_locals.iRemainingSamples = PhonemeData[0x3f].iLength[0];
-				}
-				else {
-					votraxsc01_locals.pActPos = PhonemeData[votraxsc01_locals.actPhoneme].lpStart[votraxsc01_locals.actIntonation];
-					votraxsc01_locals.iRemainingSamples = PhonemeData[votraxsc01_locals.actPhoneme].iLength[votraxsc01_locals.actIntonation];
-				}
+				votraxsc01_locals.pActPos = pLoopStart;
+				votraxsc01_locals.iRemainingSamples = iLoopLength;
+			}
 
+			/* a one-sample waveform (silence of STOP) fills the rest at once */
+			if ( iLoopLength==1 && votraxsc01_locals.pActPos==pLoopStart ) {
+				while ( length ) {
+					*buffer++ = *pLoopStart;
+					length--;
+				}
+				votraxsc01_locals.pActPos = pLoopStart + 1;
+				votraxsc01_locals.iRemainingSamples = 0;
+				break;
 			}
 
 			/* if there aren't enough remaining, reduce the amount */
@@ -443,6 +495,35 @@ void Votrax_Stop(void)
 		free(votraxsc01_locals.lpBuffer);
 		votraxsc01_locals.lpBuffer = NULL;
 	}
+	while ( num_fade_curves>0 )
+		free(fade_curves[--num_fade_curves].curve);
+}
+
+int Votrax_IsSilent(void)
+{
+	SWORD *pLoopStart;
+	int iLoopLength;
+	int i;
+
+	if ( votraxsc01_locals.busy || votraxsc01_locals.iDelay || votraxsc01_locals.iSamplesInBuffer )
+		return 0;
+	if ( PhonemeData[votraxsc01_locals.actPhoneme].iType>=PT_VS ) {
+		pLoopStart = PhonemeData[0x3f].lpStart[0];
+		iLoopLength = PhonemeData[0x3f].iLength[0];
+	}
+	else {
+		pLoopStart = PhonemeData[votraxsc01_locals.actPhoneme].lpStart[votraxsc01_locals.actIntonation];
+		iLoopLength = PhonemeData[votraxsc01_locals.actPhoneme].iLength[votraxsc01_locals.actIntonation];
+	}
+	/* only the one-sample silence of STOP is checked, other waveforms are
+	   too long to be silent */
+	if ( iLoopLength!=1 || *pLoopStart!=0 )
+		return 0;
+	for ( i=0; i<votraxsc01_locals.iRemainingSamples; i++ ) {
+		if ( votraxsc01_locals.pActPos[i]!=0 )
+			return 0;
+	}
+	return 1;
 }
 
 int Votrax_Samples(int currentP, int nextP, int cursamples)
@@ -18,6 +18,9 @@ void Votrax_PutByte(UBYTE data);
 UBYTE Votrax_GetStatus(void);
 
 void Votrax_Update(int num, SWORD *buffer, int length);
+/* Returns 1 if Votrax_Update would output only zeros until the next
+   Votrax_PutByte, ie. the chip is idle after a STOP or pause. */
+int Votrax_IsSilent(void);
 int Votrax_Samples(int currentP, int nextP, int cursamples);
 
 #endif /* VOTRAX_H_ */
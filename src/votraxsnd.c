@@ -55,6 +55,22 @@ static int samples_per_frame;
 static int votrax_written = FALSE;
 static int votrax_written_byte = 0x3f;
 
+/* Resampler state: the two Votrax samples around the current position,
+   and the position between them and its increment per output sample,
+   with 16 fractional bits */
+static SWORD prev_sample;
+static SWORD next_sample;
+static ULONG position;
+static ULONG step;
+/* FALSE until the first two Votrax samples are read */
+static int primed;
+
+static void set_ratio(double new_ratio)
+{
+	ratio = new_ratio;
+	step = (ULONG) (ratio * 0x10000 + 0.5);
+}
+
 void VOTRAXSND_PutByte(UBYTE byte)
 {
 	/* put byte to voice box */
@@ -115,7 +131,10 @@ void VOTRAXSND_Init(int playback_freq, int n_pokeys, int b16)
 	Votrax_Stop();
 	Votrax_Start((void *)&vi);
 	samples_per_frame = dsprate/(Atari800_tv_mode == Atari800_TV_PAL ? 50 : 60);
-	ratio = (double)VTRX_RATE/(double)dsprate;
+	set_ratio((double)VTRX_RATE/(double)dsprate);
+	prev_sample = next_sample = 0;
+	position = 0;
+	primed = FALSE;
 #ifdef VOICEBOX
 	temp_votrax_buffer_size = (int)(VTRX_BLOCK_SIZE*ratio*(VOICEBOX_BASEAUDF+1) + 10); /* +10 .. little extra? */
 #else
@@ -138,100 +157,53 @@ void VOTRAXSND_Reinit(void)
 /* process votrax and interpolate samples */
 static void votrax_process(SWORD *v_buffer, int len, SWORD *temp_v_buffer)
 {
-	static SWORD last_sample;
-	static SWORD last_sample2;
-	static double startpos;
-	static int have;
-	int max_left_sample_index = (int)(startpos + (double)(len - 1)*ratio);
-	int pos = 0;
-	double fraction = 0;
+	/* number of Votrax samples the position passes before the last output
+	   sample; the next one is read in the next call, after a possible
+	   Votrax_PutByte */
+	int needed = (int) ((position + (ULONG) (len - 1) * step) >> 16);
+	SWORD *src = temp_v_buffer;
 	int i;
-	int floor_next_pos;
 
-	if (have == 2) {
-	    temp_v_buffer[0] = last_sample;
-		temp_v_buffer[1] = last_sample2;
-		Votrax_Update(0, temp_v_buffer + 2, (max_left_sample_index + 1 + 1) - 2);
-	}
-	else if (have == 1) {
-	    temp_v_buffer[0] = last_sample;
-		Votrax_Update(0, temp_v_buffer + 1, (max_left_sample_index + 1 + 1) - 1);
+	if (!primed) {
+		Votrax_Update(0, temp_v_buffer, 2);
+		prev_sample = temp_v_buffer[0];
+		next_sample = temp_v_buffer[1];
+		primed = TRUE;
 	}
-	else if (have == 0) {
-		Votrax_Update(0, temp_v_buffer, max_left_sample_index + 1 + 1);
-	}
-	else if (have < 0) {
-		Votrax_Update(0, temp_v_buffer, -have);
-		Votrax_Update(0, temp_v_buffer, max_left_sample_index + 1 + 1);
-	}
-
+	Votrax_Update(0, temp_v_buffer, needed);
 	for (i = 0; i < len; i++) {
-		SWORD left_sample;
-		SWORD right_sample;
-		SWORD interp_sample;
-		pos = (int)(startpos + (double)i*ratio);
-		fraction = startpos + (double)i*ratio - (double)pos;
-		left_sample = temp_v_buffer[pos];
-		right_sample = temp_v_buffer[pos+1];
-		interp_sample = (int)(left_sample + fraction*(double)(right_sample-left_sample));
-		v_buffer[i] = interp_sample;
-	}
-	floor_next_pos = (int)(startpos + (double)len*ratio);
-	startpos = (startpos + (double)len*ratio) - (double)floor_next_pos;
-	if (floor_next_pos == max_left_sample_index)
-	{
-		have = 2;
-		last_sample = temp_v_buffer[floor_next_pos];
-		last_sample2 = temp_v_buffer[floor_next_pos+1];
-	}
-	else if (floor_next_pos == max_left_sample_index + 1) {
-		have = 1;
-		last_sample = temp_v_buffer[floor_next_pos];
-	}
-	else {
-		have = (floor_next_pos - (max_left_sample_index + 2));
+		while (position >= 0x10000) {
+			position -= 0x10000;
+			prev_sample = next_sample;
+			next_sample = *src++;
+		}
+		/* fraction with 15 bits, so the product fits in an int */
+		v_buffer[i] = (SWORD) (prev_sample + ((int) next_sample - prev_sample) * (int) (position >> 1) / 0x8000);
+		position += step;
 	}
 }
 
-/* 16 bit mixing */
-static void mix(SWORD *dst, SWORD *src, int sndn, int volume)
+/* 16 bit mixing, STRIDE is the number of channels in DST */
+static void mix(SWORD *dst, SWORD *src, int sndn, int volume, int stride)
 {
-	SWORD s1, s2;
-	int val;
-
 	while (sndn--) {
-		s1 = *src;
-		s1 = s1*volume/128;
-		s2 = *dst;
-		src++;
-		val = s1 + s2;
+		int val = *src++ * volume / 128 + *dst;
 		if (val > 32767) val = 32767;
 		if (val < -32768) val = -32768;
-		*dst++ = val;
-		if (num_pokeys == 2) {
-			dst++;
-		}
+		*dst = val;
+		dst += stride;
 	}
 }
 
-/* 8 bit mixing */
-static void mix8(UBYTE *dst, SWORD *src, int sndn, int volume)
+/* 8 bit mixing, STRIDE is the number of channels in DST */
+static void mix8(UBYTE *dst, SWORD *src, int sndn, int volume, int stride)
 {
-	SWORD s1, s2;
-	int val;
-
 	while (sndn--) {
-		s1 = *src;
-		s1 = s1*volume/128;
-		s2 = ((int)(*dst) - 0x80)*256;
-		src++;
-		val = s1 + s2;
+		int val = *src++ * volume / 128 + ((int)(*dst) - 0x80)*256;
 		if (val > 32767) val = 32767;
 		if (val < -32768) val = -32768;
-		*dst++ = (UBYTE)((val/256) + 0x80);
-		if (num_pokeys == 2) {
-			dst++;
-		}
+		*dst = (UBYTE)((val/256) + 0x80);
+		dst += stride;
 	}
 }
 
@@ -241,7 +213,7 @@ void VOTRAXSND_Frame(void)
 #ifdef VOICEBOX
 	if (VOICEBOX_enabled && VOICEBOX_ii) {
 		double factor = (VOICEBOX_BASEAUDF+1.0)/(POKEY_AUDF[3]+1.0);
-		ratio = (double)VTRX_RATE/(double)dsprate * factor;
+		set_ratio((double)VTRX_RATE/(double)dsprate * factor);
 		samples_per_frame = ((double)dsprate/(double)(Atari800_tv_mode == Atari800_TV_PAL ? 50 : 60)) / factor;
 	}
 #endif
@@ -264,12 +236,20 @@ void VOTRAXSND_Process(void *sndbuffer, int sndn)
 		Votrax_PutByte(votrax_written_byte);
 	}
 	sndn /= num_pokeys;
+	/* An idle chip adds nothing to the sound; only keep the position,
+	   with at most one Votrax sample left to read. */
+	if (prev_sample == 0 && next_sample == 0 && Votrax_IsSilent()) {
+		position += (ULONG) sndn * step;
+		if (position >= 0x10000)
+			position = 0x10000 | (position & 0xffff);
+		return;
+	}
 	while (sndn > 0) {
 		int amount = ((sndn > VTRX_BLOCK_SIZE) ? VTRX_BLOCK_SIZE : sndn);
 		votrax_process(votrax_buffer, amount, temp_votrax_buffer);
-		if (bit16) mix((SWORD *)sndbuffer, votrax_buffer, amount, 128/4);
-		else mix8((UBYTE *)sndbuffer, votrax_buffer, amount, 128/4);
-		sndbuffer = (char *) sndbuffer + VTRX_BLOCK_SIZE*(bit16 ? 2 : 1)*((num_pokeys == 2) ? 2: 1);
+		if (bit16) mix((SWORD *)sndbuffer, votrax_buffer, amount, 128/4, num_pokeys);
+		else mix8((UBYTE *)sndbuffer, votrax_buffer, amount, 128/4, num_pokeys);
+		sndbuffer = (char *) sndbuffer + VTRX_BLOCK_SIZE*(bit16 ? 2 : 1)*num_pokeys;
 		sndn -= VTRX_BLOCK_SIZE;
 	}
 }